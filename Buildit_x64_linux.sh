@@ -9,11 +9,15 @@ mkdir builds/inc_x64_linux
 
 cp includes_com/*.h builds/inc_x64_linux/
 cp includes_prosynar/*.h builds/inc_x64_linux/
-for v in source_com/*.cpp; do g++ -pthread $v -g -O0 -Wall -Ibuilds/inc_x64_linux -c -o builds/obj_x64_linux/$(basename $v .cpp).o; done;
-for v in source_com_any_linux/*.cpp; do g++ -pthread $v -g -O0 -Wall -Ibuilds/inc_x64_linux -c -o builds/obj_x64_linux/$(basename $v .cpp).o; done;
-for v in source_com_x64_any/*.cpp; do g++ -pthread $v -g -O0 -Wall -Ibuilds/inc_x64_linux -c -o builds/obj_x64_linux/$(basename $v .cpp).o; done;
-for v in source_prosynar/*.cpp; do g++ -pthread $v -g -O0 -Wall -Ibuilds/inc_x64_linux -c -o builds/obj_x64_linux/$(basename $v .cpp).o; done;
-g++ -pthread -o builds/bin_x64_linux/prosynar builds/obj_x64_linux/*.o -lz -ldl
+for v in source_com/*.cpp; do g++ -pthread $v -g -O0 -Wall -fPIC -Ibuilds/inc_x64_linux -c -o builds/obj_x64_linux/$(basename $v .cpp).o; done;
+for v in source_com_any_linux/*.cpp; do g++ -pthread $v -g -O0 -Wall -fPIC -Ibuilds/inc_x64_linux -c -o builds/obj_x64_linux/$(basename $v .cpp).o; done;
+for v in source_com_x64_any/*.cpp; do g++ -pthread $v -g -O0 -Wall -fPIC -Ibuilds/inc_x64_linux -c -o builds/obj_x64_linux/$(basename $v .cpp).o; done;
+for v in source_prosynar/*.cpp; do g++ -pthread $v -g -O0 -Wall -fPIC -Ibuilds/inc_x64_linux -c -o builds/obj_x64_linux/$(basename $v .cpp).o; done;
+mkdir builds/obj_x64_linux/main
+mv builds/obj_x64_linux/prosynar.o builds/obj_x64_linux/main/
+g++ -pthread -o builds/bin_x64_linux/prosynar builds/obj_x64_linux/main/*.o builds/obj_x64_linux/*.o -lz -ldl
+ar rcs builds/bin_x64_linux/libprosynar.a builds/obj_x64_linux/*.o
+g++ -pthread -shared -o builds/bin_x64_linux/libprosynar.so builds/obj_x64_linux/*.o -lz -ldl
 
 ./builds/bin_x64_linux/prosynar --helpdumpgui | python3 utilities/ArgGuiBuilder.py > builds/bin_x64_linux/prosynargui.py
 ./builds/bin_x64_linux/prosynar -- Fpprobreg --helpdumpgui | python3 utilities/ArgGuiBuilder.py > builds/bin_x64_linux/prosynarFpprobreggui.py
@@ -21,6 +25,7 @@ g++ -pthread -o builds/bin_x64_linux/prosynar builds/obj_x64_linux/*.o -lz -ldl
 ./builds/bin_x64_linux/prosynar -- Frover --helpdumpgui | python3 utilities/ArgGuiBuilder.py > builds/bin_x64_linux/prosynarFrovergui.py
 ./builds/bin_x64_linux/prosynar -- Malign --helpdumpgui | python3 utilities/ArgGuiBuilder.py > builds/bin_x64_linux/prosynarMaligngui.py
 ./builds/bin_x64_linux/prosynar -- Mflash --helpdumpgui | python3 utilities/ArgGuiBuilder.py > builds/bin_x64_linux/prosynarMflashgui.py
+./builds/bin_x64_linux/prosynar -- Mkmer --helpdumpgui | python3 utilities/ArgGuiBuilder.py > builds/bin_x64_linux/prosynarMkmergui.py
 ./builds/bin_x64_linux/prosynar -- Mpear --helpdumpgui | python3 utilities/ArgGuiBuilder.py > builds/bin_x64_linux/prosynarMpeargui.py
 cp GUI.py builds/bin_x64_linux/
 
@@ -30,6 +35,7 @@ cp GUI.py builds/bin_x64_linux/
 ./builds/bin_x64_linux/prosynar -- Frover --helpdumpgui | python3 utilities/ManPageBuilder.py prosynar_Frover "filter pairs with insufficient naive reference overlap" prosynarFrovermandesc.txt > builds/bin_x64_linux/prosynar_Frover.1
 ./builds/bin_x64_linux/prosynar -- Malign --helpdumpgui | python3 utilities/ManPageBuilder.py prosynar_Malign "merge pairs by alignment" prosynarMalignmandesc.txt > builds/bin_x64_linux/prosynar_Malign.1
 ./builds/bin_x64_linux/prosynar -- Mflash --helpdumpgui | python3 utilities/ManPageBuilder.py prosynar_Mflash "merge pairs the way FLASH does it" prosynarMflashmandesc.txt > builds/bin_x64_linux/prosynar_Mflash.1
+./builds/bin_x64_linux/prosynar -- Mkmer --helpdumpgui | python3 utilities/ManPageBuilder.py prosynar_Mkmer "merge pairs the way FLASH does it, seeded by kmers" prosynarMkmermandesc.txt > builds/bin_x64_linux/prosynar_Mkmer.1
 ./builds/bin_x64_linux/prosynar -- Mpear --helpdumpgui | python3 utilities/ManPageBuilder.py prosynar_Mpear "merge pairs the way PEAR does it" prosynarMpearmandesc.txt > builds/bin_x64_linux/prosynar_Mpear.1
 
 
@@ -13,7 +13,11 @@ FOR %%v in (source_com\*.cpp) DO g++ -mthreads %%v -g -O0 -Wall -Ibuilds\inc_x64
 FOR %%v in (source_com_any_win32\*.cpp) DO g++ -mthreads %%v -g -O0 -Wall -Ibuilds\inc_x64_win32 -c -o builds\obj_x64_win32\%%~nv.o
 FOR %%v in (source_com_x64_any\*.cpp) DO g++ -mthreads %%v -g -O0 -Wall -Ibuilds\inc_x64_win32 -c -o builds\obj_x64_win32\%%~nv.o
 FOR %%v in (source_prosynar\*.cpp) DO g++ -mthreads %%v -g -O0 -Wall -Ibuilds\inc_x64_win32 -c -o builds\obj_x64_win32\%%~nv.o
-g++ -mthreads -o builds\bin_x64_win32\prosynar.exe builds\obj_x64_win32\*.o -lz -static-libgcc -static-libstdc++ -static -lpthread
+MKDIR builds\obj_x64_win32\main
+MOVE builds\obj_x64_win32\prosynar.o builds\obj_x64_win32\main\
+g++ -mthreads -o builds\bin_x64_win32\prosynar.exe builds\obj_x64_win32\main\*.o builds\obj_x64_win32\*.o -lz -static-libgcc -static-libstdc++ -static -lpthread
+ar rcs builds\bin_x64_win32\libprosynar.a builds\obj_x64_win32\*.o
+g++ -mthreads -shared -o builds\bin_x64_win32\prosynar.dll builds\obj_x64_win32\*.o -Wl,--out-implib,builds\bin_x64_win32\libprosynar.dll.a -lz -static-libgcc -static-libstdc++ -static -lpthread
 
 builds\bin_x64_win32\prosynar --helpdumpgui | python utilities\ArgGuiBuilder.py > builds\bin_x64_win32\prosynargui.py
 builds\bin_x64_win32\prosynar -- Fpprobreg --helpdumpgui | python utilities\ArgGuiBuilder.py > builds\bin_x64_win32\prosynarFpprobreggui.py
@@ -21,6 +25,7 @@ builds\bin_x64_win32\prosynar -- Fprover --helpdumpgui | python utilities\ArgGui
 builds\bin_x64_win32\prosynar -- Frover --helpdumpgui | python utilities\ArgGuiBuilder.py > builds\bin_x64_win32\prosynarFrovergui.py
 builds\bin_x64_win32\prosynar -- Malign --helpdumpgui | python utilities\ArgGuiBuilder.py > builds\bin_x64_win32\prosynarMaligngui.py
 builds\bin_x64_win32\prosynar -- Mflash --helpdumpgui | python utilities\ArgGuiBuilder.py > builds\bin_x64_win32\prosynarMflashgui.py
+builds\bin_x64_win32\prosynar -- Mkmer --helpdumpgui | python utilities\ArgGuiBuilder.py > builds\bin_x64_win32\prosynarMkmergui.py
 builds\bin_x64_win32\prosynar -- Mpear --helpdumpgui | python utilities\ArgGuiBuilder.py > builds\bin_x64_win32\prosynarMpeargui.py
 COPY GUI.py builds\bin_x64_win32\
 
@@ -30,5 +35,6 @@ builds\bin_x64_win32\prosynar -- Fprover --helpdumpgui | python utilities\ManPag
 builds\bin_x64_win32\prosynar -- Frover --helpdumpgui | python utilities\ManPageBuilder.py prosynar_Frover "filter pairs with insufficient naive reference overlap" prosynarFrovermandesc.txt > builds\bin_x64_win32\prosynar_Frover.1
 builds\bin_x64_win32\prosynar -- Malign --helpdumpgui | python utilities\ManPageBuilder.py prosynar_Malign "merge pairs by alignment" prosynarMalignmandesc.txt > builds\bin_x64_win32\prosynar_Malign.1
 builds\bin_x64_win32\prosynar -- Mflash --helpdumpgui | python utilities\ManPageBuilder.py prosynar_Mflash "merge pairs the way FLASH does it" prosynarMflashmandesc.txt > builds\bin_x64_win32\prosynar_Mflash.1
+builds\bin_x64_win32\prosynar -- Mkmer --helpdumpgui | python utilities\ManPageBuilder.py prosynar_Mkmer "merge pairs the way FLASH does it, seeded by kmers" prosynarMkmermandesc.txt > builds\bin_x64_win32\prosynar_Mkmer.1
 builds\bin_x64_win32\prosynar -- Mpear --helpdumpgui | python utilities\ManPageBuilder.py prosynar_Mpear "merge pairs the way PEAR does it" prosynarMpearmandesc.txt > builds\bin_x64_win32\prosynar_Mpear.1
 
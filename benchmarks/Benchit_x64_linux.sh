@@ -0,0 +1,5 @@
+mkdir -p builds/bench_x64_linux
+
+python3 benchmarks/prosynar_bench.py run --prosynar builds/bin_x64_linux/prosynar --repeat 2000 --threads 1,2,4 --out builds/bench_x64_linux/bench.json example
+if [ -f builds/bench_x64_linux/last.json ]; then python3 benchmarks/prosynar_bench.py compare builds/bench_x64_linux/last.json builds/bench_x64_linux/bench.json > builds/bench_x64_linux/compare.tsv; fi
+cp builds/bench_x64_linux/bench.json builds/bench_x64_linux/last.json
@@ -0,0 +1,340 @@
+
+import os
+import sys
+import json
+import gzip
+import time
+import shutil
+import struct
+import platform
+import tempfile
+import itertools
+import subprocess
+
+toolFileArgs = {"Malign" : [("--cost", "agc")]}
+"""Arguments that point a filter or merger at a dataset file, by name: (flag, kind of file)."""
+
+usageText = """Usage:
+    prosynar_bench.py run [OPTION]* DATASET*
+    prosynar_bench.py compare OLD.json NEW.json [--tolerance 0.1]
+run: time prosynar over every filter/merger combination for each dataset folder.
+    A dataset folder holds a reference (.fa), problem regions (.bed), position dependent costs (.pdc),
+    optionally merge costs (.agc), and the reads (.sam or .bam).
+    --prosynar PATH     The program to run (builds/bin_x64_linux/prosynar).
+    --out FILE.json     Where to write the results (stdout).
+    --threads 1,2,4     The thread counts to try.
+    --filters A,B       The filters to use (all). All subsets are tried, in the order given.
+    --mergers A,B       The mergers to use (all).
+    --repeat 1          Copy the reads this many times (with new names), to make small datasets take long enough to time.
+    --reps 3            Run each combination this many times, keeping the fastest.
+compare: compare two run results, complaining about anything that got slower by more than the tolerance."""
+
+class BenchDataset:
+    """A folder of stuff to run prosynar over."""
+    name = None
+    """The name of the dataset."""
+    refFile = None
+    """The reference."""
+    probFile = None
+    """The problem regions."""
+    costFile = None
+    """The position dependent costs."""
+    agcFile = None
+    """The merge costs, if any."""
+    readFiles = None
+    """The reads."""
+    numPair = 0
+    """The number of pairs in the reads."""
+    def __init__(self, folderName):
+        self.name = os.path.basename(os.path.normpath(folderName))
+        self.readFiles = []
+        for fileName in sorted(os.listdir(folderName)):
+            fullName = os.path.join(folderName, fileName)
+            if fileName.endswith(".fa"):
+                self.refFile = fullName
+            elif fileName.endswith(".bed"):
+                self.probFile = fullName
+            elif fileName.endswith(".pdc"):
+                self.costFile = fullName
+            elif fileName.endswith(".agc"):
+                self.agcFile = fullName
+            elif fileName.endswith(".sam") or fileName.endswith(".bam"):
+                self.readFiles.append(fullName)
+        if (self.refFile is None) or (len(self.readFiles) == 0):
+            raise ValueError(folderName + " needs a reference (.fa) and reads (.sam or .bam).")
+    def fileForKind(self, fileKind):
+        """Get the dataset file of a kind (by extension, no dot)."""
+        return {"fa" : self.refFile, "bed" : self.probFile, "pdc" : self.costFile, "agc" : self.agcFile}[fileKind]
+    def makeCopies(self, numCopy, workFolder):
+        """Copy the reads a number of times, renaming each copy, and count the pairs."""
+        if numCopy > 1:
+            newFiles = []
+            for readFile in self.readFiles:
+                if readFile.endswith(".bam"):
+                    raise ValueError("Only sam files can be repeated: " + readFile)
+                newFile = os.path.join(workFolder, self.name + "_" + os.path.basename(readFile))
+                copySamFile(readFile, newFile, numCopy)
+                newFiles.append(newFile)
+            self.readFiles = newFiles
+        self.numPair = 0
+        for readFile in self.readFiles:
+            if readFile.endswith(".bam"):
+                self.numPair = self.numPair + countBamPairs(readFile)
+            else:
+                self.numPair = self.numPair + countSamPairs(readFile)
+
+def copySamFile(fromName, toName, numCopy):
+    """Write a sam file with the alignments repeated, with a different name for each copy."""
+    with open(fromName, "r") as inF:
+        allLines = [line for line in inF]
+    headLines = [line for line in allLines if line.startswith("@")]
+    entLines = [line.split("\t") for line in allLines if not line.startswith("@")]
+    with open(toName, "w") as outF:
+        for line in headLines:
+            outF.write(line)
+        for i in range(numCopy):
+            for lineS in entLines:
+                outF.write("\t".join([lineS[0] + "_c" + str(i)] + lineS[1:]))
+
+def countSamPairs(fileName):
+    """Count the pairs in a sam file."""
+    numPaired = 0
+    with open(fileName, "r") as inF:
+        for line in inF:
+            if line.startswith("@") or (line.strip() == ""):
+                continue
+            entFlag = int(line.split("\t")[1])
+            if (entFlag & 0x0001) and not (entFlag & 0x0900):
+                numPaired = numPaired + 1
+    return numPaired // 2
+
+def countBamPairs(fileName):
+    """Count the pairs in a bam file."""
+    numPaired = 0
+    with gzip.open(fileName, "rb") as inF:
+        if inF.read(4) != b"BAM\x01":
+            raise ValueError(fileName + " is not a bam file.")
+        headLen = struct.unpack("<i", inF.read(4))[0]
+        inF.read(headLen)
+        numRef = struct.unpack("<i", inF.read(4))[0]
+        for i in range(numRef):
+            nameLen = struct.unpack("<i", inF.read(4))[0]
+            inF.read(nameLen + 4)
+        while True:
+            sizeBuff = inF.read(4)
+            if len(sizeBuff) < 4:
+                break
+            entBuff = inF.read(struct.unpack("<i", sizeBuff)[0])
+            entFlag = struct.unpack("<H", entBuff[14:16])[0]
+            if (entFlag & 0x0001) and not (entFlag & 0x0900):
+                numPaired = numPaired + 1
+    return numPaired // 2
+
+def listTools(progName, listFlag):
+    """Ask prosynar for the names of its filters or mergers."""
+    progOut = subprocess.run([progName, listFlag], stdout=subprocess.PIPE, check=True).stdout.decode()
+    return [line.strip() for line in progOut.split("\n") if line.strip() != ""]
+
+def toolArguments(toolName, forData):
+    """Get the arguments a filter or merger needs to run on a dataset."""
+    toRet = [toolName]
+    for flagName, fileKind in toolFileArgs.get(toolName, []):
+        fileName = forData.fileForKind(fileKind)
+        if fileName is not None:
+            toRet.extend([flagName, fileName])
+    return toRet
+
+def runOnce(progName, forData, useFilters, useMerger, numThread, workFolder):
+    """Run prosynar once, returning the time taken, the peak memory use, the exit code and the stats report."""
+    statsName = os.path.join(workFolder, "stats.json")
+    if os.path.exists(statsName):
+        os.remove(statsName)
+    runArgs = [progName, "--thread", str(numThread), "--ref", forData.refFile, "--stats", statsName, "--out", os.devnull]
+    if forData.probFile is not None:
+        runArgs.extend(["--prob", forData.probFile])
+    if forData.costFile is not None:
+        runArgs.extend(["--cost", forData.costFile])
+    runArgs.extend(forData.readFiles)
+    for filtName in useFilters:
+        runArgs.append("--")
+        runArgs.extend(toolArguments(filtName, forData))
+    runArgs.append("--")
+    runArgs.extend(toolArguments(useMerger, forData))
+    # wait4 gives the memory use of just this run
+    startTime = time.monotonic()
+    runProc = subprocess.Popen(runArgs, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    waitPid, waitStat, waitUse = os.wait4(runProc.pid, 0)
+    runTime = time.monotonic() - startTime
+    runProc.returncode = os.waitstatus_to_exitcode(waitStat) if hasattr(os, "waitstatus_to_exitcode") else (waitStat >> 8)
+    runStats = None
+    if os.path.exists(statsName):
+        with open(statsName, "r") as statF:
+            runStats = json.load(statF)
+    # linux reports ru_maxrss in kilobytes, mac in bytes
+    peakRSS = waitUse.ru_maxrss if platform.system() != "Darwin" else (waitUse.ru_maxrss // 1024)
+    return (runTime, peakRSS, runProc.returncode, runStats)
+
+def stageTimes(runStats):
+    """Pull the per stage timings out of a stats report."""
+    if runStats is None:
+        return None
+    toRet = {}
+    toRet["queues"] = runStats["queues"]
+    toRet["filters"] = {curFilt["name"] : curFilt for curFilt in runStats["filters"]}
+    toRet["merger"] = runStats["merger"]
+    toRet["busySeconds"] = sum([curWork["busySeconds"] for curWork in runStats["workers"]])
+    toRet["helpSeconds"] = sum([curWork["helpSeconds"] for curWork in runStats["workers"]])
+    return toRet
+
+def runKey(curRun):
+    """Get a name for a combination, to match up runs between results."""
+    return curRun["dataset"] + " " + " ".join(curRun["filters"] + [curRun["merger"]]) + " x" + str(curRun["threads"])
+
+def gitCommit():
+    """Get the commit the source folder is on, if it can be found."""
+    try:
+        gitOut = subprocess.run(["git", "rev-parse", "HEAD"], cwd=os.path.dirname(os.path.abspath(__file__)), stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+        return gitOut.stdout.decode().strip() if gitOut.returncode == 0 else None
+    except OSError:
+        return None
+
+def mainRun(argv):
+    # parse the arguments
+    progName = os.path.join("builds", "bin_x64_linux", "prosynar")
+    outName = None
+    threadCounts = [1, 2, 4]
+    filterNames = None
+    mergerNames = None
+    numCopy = 1
+    numRep = 3
+    dataNames = []
+    i = 0
+    while i < len(argv):
+        if argv[i] in ["--prosynar", "--out", "--threads", "--filters", "--mergers", "--repeat", "--reps"]:
+            if i + 1 >= len(argv):
+                raise ValueError(argv[i] + " needs a value.")
+            optVal = argv[i+1]
+            if argv[i] == "--prosynar":
+                progName = optVal
+            elif argv[i] == "--out":
+                outName = optVal
+            elif argv[i] == "--threads":
+                threadCounts = [int(cv) for cv in optVal.split(",")]
+            elif argv[i] == "--filters":
+                filterNames = [cv for cv in optVal.split(",") if cv != ""]
+            elif argv[i] == "--mergers":
+                mergerNames = [cv for cv in optVal.split(",") if cv != ""]
+            elif argv[i] == "--repeat":
+                numCopy = int(optVal)
+            else:
+                numRep = int(optVal)
+            i = i + 2
+        else:
+            dataNames.append(argv[i])
+            i = i + 1
+    if len(dataNames) == 0:
+        raise ValueError("No datasets given.")
+    progName = os.path.abspath(progName)
+    if filterNames is None:
+        filterNames = listTools(progName, "--helplistf")
+    if mergerNames is None:
+        mergerNames = listTools(progName, "--helplistm")
+    # every subset of the filters
+    filterSets = []
+    for setSize in range(len(filterNames) + 1):
+        filterSets.extend([list(cv) for cv in itertools.combinations(filterNames, setSize)])
+    # run the things
+    workFolder = tempfile.mkdtemp(prefix="prosynar_bench_")
+    allRuns = []
+    try:
+        for dataName in dataNames:
+            curData = BenchDataset(dataName)
+            curData.makeCopies(numCopy, workFolder)
+            for useFilters, useMerger, numThread in itertools.product(filterSets, mergerNames, threadCounts):
+                bestRun = None
+                for r in range(numRep):
+                    curRes = runOnce(progName, curData, useFilters, useMerger, numThread, workFolder)
+                    if (bestRun is None) or (curRes[2] != 0) or ((bestRun[2] == 0) and (curRes[0] < bestRun[0])):
+                        bestRun = curRes
+                    if curRes[2] != 0:
+                        break
+                runTime, peakRSS, exitCode, runStats = bestRun
+                curRun = {"dataset" : curData.name, "filters" : useFilters, "merger" : useMerger, "threads" : numThread}
+                curRun["exitCode"] = exitCode
+                curRun["pairs"] = curData.numPair
+                curRun["seconds"] = runTime
+                curRun["pairsPerSecond"] = (curData.numPair / runTime) if runTime > 0 else 0.0
+                curRun["peakRSSKiB"] = peakRSS
+                curRun["stages"] = stageTimes(runStats)
+                allRuns.append(curRun)
+                sys.stderr.write("{0}: {1:.1f} pairs/s, {2} KiB{3}\n".format(runKey(curRun), curRun["pairsPerSecond"], peakRSS, "" if exitCode == 0 else (" FAILED " + str(exitCode))))
+    finally:
+        shutil.rmtree(workFolder)
+    # and write it out
+    allRes = {"prosynar" : progName, "commit" : gitCommit(), "host" : platform.node(), "cpus" : os.cpu_count(), "time" : time.strftime("%Y-%m-%dT%H:%M:%S"), "repeat" : numCopy, "runs" : allRuns}
+    if outName is None:
+        json.dump(allRes, sys.stdout, indent=1, sort_keys=True)
+        sys.stdout.write("\n")
+    else:
+        with open(outName, "w") as outF:
+            json.dump(allRes, outF, indent=1, sort_keys=True)
+            outF.write("\n")
+    return 0 if all([curRun["exitCode"] == 0 for curRun in allRuns]) else 1
+
+def mainCompare(argv):
+    # parse the arguments
+    tolerance = 0.1
+    fileNames = []
+    i = 0
+    while i < len(argv):
+        if argv[i] == "--tolerance":
+            if i + 1 >= len(argv):
+                raise ValueError("--tolerance needs a value.")
+            tolerance = float(argv[i+1])
+            i = i + 2
+        else:
+            fileNames.append(argv[i])
+            i = i + 1
+    if len(fileNames) != 2:
+        raise ValueError("compare needs an old and a new result file.")
+    allRes = []
+    for fileName in fileNames:
+        with open(fileName, "r") as inF:
+            allRes.append({runKey(curRun) : curRun for curRun in json.load(inF)["runs"]})
+    oldRuns, newRuns = allRes
+    # look for anything slower, or broken
+    numBad = 0
+    print("Combination\tOld pairs/s\tNew pairs/s\tChange\tOld KiB\tNew KiB")
+    for curKey in sorted(newRuns.keys()):
+        if curKey not in oldRuns:
+            continue
+        oldRun = oldRuns[curKey]
+        newRun = newRuns[curKey]
+        oldRate = oldRun["pairsPerSecond"]
+        newRate = newRun["pairsPerSecond"]
+        rateChange = ((newRate - oldRate) / oldRate) if oldRate > 0 else 0.0
+        curNote = ""
+        if (newRun["exitCode"] != 0) and (oldRun["exitCode"] == 0):
+            curNote = "\tBROKE"
+            numBad = numBad + 1
+        elif rateChange < -tolerance:
+            curNote = "\tSLOWER"
+            numBad = numBad + 1
+        print("{0}\t{1:.1f}\t{2:.1f}\t{3:+.1%}\t{4}\t{5}{6}".format(curKey, oldRate, newRate, rateChange, oldRun["peakRSSKiB"], newRun["peakRSSKiB"], curNote))
+    for curKey in sorted(set(oldRuns.keys()) - set(newRuns.keys())):
+        print(curKey + "\tmissing from new results")
+    sys.stderr.write(str(numBad) + " regressions\n")
+    return 1 if numBad else 0
+
+if __name__ == "__main__":
+    if (len(sys.argv) < 2) or (sys.argv[1] not in ["run", "compare"]):
+        print(usageText)
+        sys.exit(1)
+    try:
+        if sys.argv[1] == "run":
+            sys.exit(mainRun(sys.argv[2:]))
+        else:
+            sys.exit(mainCompare(sys.argv[2:]))
+    except ValueError as errV:
+        sys.stderr.write(str(errV) + "\n")
+        sys.exit(1)
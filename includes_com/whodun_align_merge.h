@@ -3,33 +3,68 @@
 
 #include "whodun_align.h"
 
-/**Merge a pair of sequences from an alignment.*/
+/**The largest phred score the merger will track (ascii 126).*/
+#define ALIGNMERGE_PHRED_MAX 93
+/**The number of distinct phred scores.*/
+#define ALIGNMERGE_PHRED_COUNT (ALIGNMERGE_PHRED_MAX+1)
+
+/**Merge overlapping bases using the posterior probability (Edgar and Flyvbjerg, 2015).*/
+#define ALIGNMERGE_METHOD_POSTERIOR 0
+/**Merge overlapping bases the way the original FLASH paper does.*/
+#define ALIGNMERGE_METHOD_FLASH 1
+/**Merge overlapping bases the way the original PEAR paper does.*/
+#define ALIGNMERGE_METHOD_PEAR 2
+
+/**Merge a pair of sequences from an alignment. All work is done on phred scores, through tables.*/
 class AlignedSequenceMerger{
 public:
-	/**Set up a blank.*/
+	/**Set up a blank, merging with the posterior method.*/
 	AlignedSequenceMerger();
+	/**
+	 * Set up a blank.
+	 * @param mergeMeth The method to use for merging overlapping bases.
+	 */
+	AlignedSequenceMerger(int mergeMeth);
 	/**Tear down.*/
 	~AlignedSequenceMerger();
+	/**
+	 * Change the way overlapping bases are merged.
+	 * @param mergeMeth The method to use for merging overlapping bases.
+	 */
+	void changeMethod(int mergeMeth);
 	/**
 	 * Change the problem being worked on.
 	 * @param seq1Len The length of the first sequence.
 	 * @param seq1 The first sequence.
-	 * @param qual1 The first quality.
+	 * @param qual1 The first quality (log10 probabilities).
 	 * @param seq2Len The length of the second sequence.
 	 * @param seq2 The second sequence.
-	 * @param qual2 The second quality.
+	 * @param qual2 The second quality (log10 probabilities).
+	 * @param alnUse The alignment between the two.
 	 */
 	void changeFocus(uintptr_t seq1Len, const char* seq1, const double* qual1, uintptr_t seq2Len, const char* seq2, const double* qual2, LinearPairwiseAlignmentIteration* alnUse);
 	/**
 	 * Change the problem being worked on.
 	 * @param seq1Len The length of the first sequence.
 	 * @param seq1 The first sequence.
-	 * @param qual1 The first quality.
+	 * @param qual1 The first quality (ascii phred).
 	 * @param seq2Len The length of the second sequence.
 	 * @param seq2 The second sequence.
-	 * @param qual2 The second quality.
+	 * @param qual2 The second quality (ascii phred).
+	 * @param alnUse The alignment between the two.
 	 */
 	void changeFocus(uintptr_t seq1Len, const char* seq1, const char* qual1, uintptr_t seq2Len, const char* seq2, const char* qual2, LinearPairwiseAlignmentIteration* alnUse);
+	/**
+	 * Change the problem being worked on: the end of the first sequence lies directly on the start of the second.
+	 * @param seq1Len The length of the first sequence.
+	 * @param seq1 The first sequence.
+	 * @param qual1 The first quality (ascii phred).
+	 * @param seq2Len The length of the second sequence.
+	 * @param seq2 The second sequence.
+	 * @param qual2 The second quality (ascii phred).
+	 * @param overLen The number of bases of overlap.
+	 */
+	void changeFocus(uintptr_t seq1Len, const char* seq1, const char* qual1, uintptr_t seq2Len, const char* seq2, const char* qual2, uintptr_t overLen);
 	/**Expand indels from the alignment.*/
 	void expandIndels();
 	/**Add any prefix: complain if there is no obvious prefix.*/
@@ -38,32 +73,78 @@ public:
 	void mergeOverlap();
 	/**Add any suffix: complain if there is no obvious suffix.*/
 	void addInSuffix();
-	
+	/**
+	 * Copy out the merged sequence.
+	 * @param toSeq The place to put the sequence.
+	 * @param toQual The place to put the qualities, as log10 probabilities.
+	 */
+	void getMerged(std::string* toSeq, std::vector<double>* toQual);
+	/**
+	 * Copy out the merged sequence.
+	 * @param toSeq The place to put the sequence.
+	 * @param toQual The place to put the qualities, as ascii phred scores.
+	 */
+	void getMergedPhred(std::string* toSeq, std::string* toQual);
+
 	/**Save a sequence.*/
 	std::string saveSeqA;
 	/**Save a sequence.*/
 	std::string saveSeqB;
-	/**Temporary quality storage*/
-	std::vector<double> saveQualA;
-	/**Temporary quality storage*/
-	std::vector<double> saveQualB;
-	/**The relevant alignment.*/
+	/**Temporary quality storage (phred)*/
+	std::vector<unsigned char> saveQualA;
+	/**Temporary quality storage (phred)*/
+	std::vector<unsigned char> saveQualB;
+	/**The relevant alignment, if any.*/
 	LinearPairwiseAlignmentIteration* curIter;
-	
-	/**Temporary sequence storage*/
+	/**The first index in A that is in the overlap.*/
+	uintptr_t alnStartA;
+	/**The first index in B that is in the overlap.*/
+	uintptr_t alnStartB;
+	/**The index in A after the overlap.*/
+	uintptr_t alnEndA;
+	/**The index in B after the overlap.*/
+	uintptr_t alnEndB;
+
+	/**The number of expanded overlap entries.*/
+	uintptr_t numInfix;
+	/**Temporary sequence storage: -1 for a gap*/
 	std::vector<int> seqIL;
-	/**Temporary quality storage*/
-	std::vector<double> seqdIL;
-	/**Temporary sequence storage*/
+	/**Temporary quality storage (phred)*/
+	std::vector<unsigned char> seqpIL;
+	/**Temporary sequence storage: -1 for a gap*/
 	std::vector<int> seqIR;
-	/**Temporary quality storage*/
-	std::vector<double> seqdIR;
-	
+	/**Temporary quality storage (phred)*/
+	std::vector<unsigned char> seqpIR;
+
+	/**The length of the merged sequence.*/
+	uintptr_t mergeLen;
 	/**The final storage for the merged sequence.*/
 	std::vector<char> mergeSeq;
-	/**The final storage for the merged quality.*/
-	std::vector<double> mergeQual;
+	/**The final storage for the merged quality (phred).*/
+	std::vector<unsigned char> mergeQual;
+
+	/**The merge method in use.*/
+	int mergeMethod;
+	/**The quality of agreeing bases, by winning and losing quality.*/
+	unsigned char matchQual[ALIGNMERGE_PHRED_COUNT*ALIGNMERGE_PHRED_COUNT];
+	/**The quality of disagreeing bases, by winning and losing quality.*/
+	unsigned char mismatchQual[ALIGNMERGE_PHRED_COUNT*ALIGNMERGE_PHRED_COUNT];
+	/**The quality to give a gap between two bases.*/
+	unsigned char gapQual[ALIGNMERGE_PHRED_COUNT*ALIGNMERGE_PHRED_COUNT];
+	/**The log10 probability of each phred.*/
+	double phredLog10[ALIGNMERGE_PHRED_COUNT];
+private:
+	/**
+	 * Make sure there is enough space for the current problem.
+	 */
+	void prepareStorage();
 };
-//TODO
+
+/**
+ * Clamp an ascii phred score to something the merger can track.
+ * @param toConv The ascii phred score.
+ * @return The phred score.
+ */
+unsigned char alignMergeAsciiToPhred(unsigned char toConv);
 
 #endif
\ No newline at end of file
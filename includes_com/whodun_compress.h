@@ -246,6 +246,81 @@ public:
 	std::string myName;
 };
 
+/**In from a block gzip (bgzf) file, as used by bam: can seek to virtual offsets.*/
+class BGZipInStream : public InStream{
+public:
+	/**
+	 * Open the file.
+	 * @param fileName The name of the file.
+	 */
+	BGZipInStream(const char* fileName);
+	/**Clean up and close.*/
+	~BGZipInStream();
+	int readByte();
+	uintptr_t readBytes(char* toR, uintptr_t numR);
+	/**
+	 * Change which byte will be returned next.
+	 * @param toAddr The virtual offset: the address of the block in the high 48 bits, and the offset into the decompressed block in the low 16.
+	 */
+	void seek(uint64_t toAddr);
+	/**
+	 * Get the virtual offset of the next byte to be returned.
+	 * @return The virtual offset.
+	 */
+	uint64_t tell();
+	/**
+	 * Load the next block.
+	 * @return Whether there was a block.
+	 */
+	bool loadBlock();
+	/**The base file.*/
+	FILE* baseFile;
+	/**The name of the file.*/
+	std::string myName;
+	/**The address of the current block in the file.*/
+	uintptr_t blockAddr;
+	/**The address of the next block in the file.*/
+	uintptr_t nextBlockAddr;
+	/**The compressed block.*/
+	std::vector<char> compData;
+	/**The decompressed block.*/
+	std::vector<char> theData;
+	/**The index in the decompressed data the next read should return.*/
+	uintptr_t nextReadI;
+};
+
+/**The most bytes a block gzip output block will hold, before compression.*/
+#define BGZF_BLOCK_DATA 0x00FF00
+
+/**Out to a block gzip (bgzf) file, as used by bam.*/
+class BGZipOutStream : public OutStream{
+public:
+	/**
+	 * Open the file.
+	 * @param append Whether to append to a file if it is already there.
+	 * @param fileName The name of the file.
+	 */
+	BGZipOutStream(int append, const char* fileName);
+	/**Close: finish should have been called, if not this tries to, but cannot complain.*/
+	~BGZipOutStream();
+	void writeByte(int toW);
+	void writeBytes(const char* toW, uintptr_t numW);
+	/**Write anything left, mark the end, and close.*/
+	void finish();
+	/**
+	 * Compress the waiting bytes and write them as a block.
+	 */
+	void dumpBlock();
+	/**The base file.*/
+	FILE* baseFile;
+	/**The name of the file.*/
+	std::string myName;
+	/**The bytes waiting to be compressed.*/
+	std::vector<char> theData;
+	/**The compressed block.*/
+	std::vector<char> compData;
+};
+
 class MultithreadGZipOutStreamUniform;
 
 /**GZip output, but with multiple threads.*/
@@ -24,6 +24,8 @@ public:
 	virtual void writeBytes(const char* toW, uintptr_t numW);
 	/**Flush waiting bytes.*/
 	virtual void flush();
+	/**Write anything waiting, and anything that marks the end: problems show up here, rather than getting lost in the destructor. Nothing can be written after.*/
+	virtual void finish();
 };
 
 /**IOStream is a mess.*/
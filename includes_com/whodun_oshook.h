@@ -43,6 +43,21 @@ int fseekPointer(FILE* stream, intptr_t offset, int whence);
  */
 intptr_t ftellPointer(FILE* stream);
 
+/**
+ * Map the contents of a file into memory, read only.
+ * @param fileName The name of the file.
+ * @param mapSize The place to put the size of the mapping.
+ * @return The start of the mapped contents. Null if there was a problem.
+ */
+void* mapFileRead(const char* fileName, uintptr_t* mapSize);
+
+/**
+ * Unmap a file mapped by mapFileRead.
+ * @param mapAddr The start of the mapped contents.
+ * @param mapSize The size of the mapping.
+ */
+void unmapFile(void* mapAddr, uintptr_t mapSize);
+
 /**
  * Get whether a directory exists.
  * @param dirName The name of the directory.
@@ -128,6 +143,14 @@ void* makeCondition(void* forMutex);
  */
 void waitCondition(void* forMutex, void* forCondition);
 
+/**
+ * Wait on a condition, but not forever.
+ * @param forMutex The relevant lock.
+ * @param forCondition The condition in question.
+ * @param maxWait The longest to wait, in nanoseconds.
+ */
+void waitConditionTimed(void* forMutex, void* forCondition, uintmax_t maxWait);
+
 /**
  * Start one waiting on condition.
  * @param forMutex The relevant lock.
@@ -148,6 +171,78 @@ void broadcastCondition(void* forMutex, void* forCondition);
  */
 void killCondition(void* forCondition);
 
+/**
+ * Get the time since some arbitrary (but fixed) point.
+ * @return The time, in nanoseconds.
+ */
+uintmax_t getMonotonicTime();
+
+/**
+ * Keep the calling thread on one processor.
+ * @param cpuI The index of the processor.
+ * @return Whether that worked.
+ */
+bool pinThisThread(uintptr_t cpuI);
+
+/**
+ * Start listening on a local socket, replacing anything already there.
+ * @param sockName The name of the socket file.
+ * @return A handle to the socket, or null if it could not be opened.
+ */
+void* openLocalServer(const char* sockName);
+
+/**
+ * Wait for something to connect to a local socket.
+ * @param theServer The socket to wait on.
+ * @return A handle to the connection, or null if there was a problem.
+ */
+void* acceptLocalConnection(void* theServer);
+
+/**
+ * Stop listening on a local socket, and remove the socket file.
+ * @param theServer The socket to close.
+ */
+void closeLocalServer(void* theServer);
+
+/**
+ * Connect to a local socket.
+ * @param sockName The name of the socket file.
+ * @return A handle to the connection, or null if it could not connect.
+ */
+void* connectLocalServer(const char* sockName);
+
+/**
+ * Read from a local connection.
+ * @param theConn The connection.
+ * @param toFill The place to put the bytes.
+ * @param numRead The most bytes to read.
+ * @return The number of bytes read: zero if the other end is done, negative on a problem.
+ */
+intptr_t readLocalConnection(void* theConn, char* toFill, uintptr_t numRead);
+
+/**
+ * Write to a local connection.
+ * @param theConn The connection.
+ * @param toWrite The bytes to write.
+ * @param numWrite The number of bytes to write.
+ * @return Whether they were all written.
+ */
+bool writeLocalConnection(void* theConn, const char* toWrite, uintptr_t numWrite);
+
+/**
+ * Limit how long a read or write on a local connection can wait.
+ * @param theConn The connection.
+ * @param maxWait The longest to wait, in nanoseconds: zero to wait forever.
+ * @return Whether the limit could be set.
+ */
+bool setLocalConnectionTimeout(void* theConn, uintmax_t maxWait);
+
+/**
+ * Close a local connection.
+ * @param theConn The connection.
+ */
+void closeLocalConnection(void* theConn);
+
 /**
  * Load a dll.
  * @param loadFrom The name of the dll.
@@ -216,6 +216,8 @@ public:
 	uintptr_t nextHaveQual;
 	/**The last read qualities.*/
 	const double* nextQual;
+	/**The last read qualities, as ascii phred scores: if not null, used instead of nextQual.*/
+	const char* nextQualPhred;
 	/**Clear the above.*/
 	SequenceWriter();
 	/**Allow subclassing.*/
@@ -254,8 +256,7 @@ public:
 	 */
 	GailAQSequenceWriter(int append, BlockCompOutStream* toFlit, const char* indFName);
 	/**
-	 * Make a sequence writer.
-	 * @param append Whether stuff is being appended.
+	 * Make a sequence writer (never appends).
 	 * @param toFlit The thing to write to.
 	 * @param indFName The name of the index file.
 	 */
@@ -289,4 +290,14 @@ void openSequenceFileRead(const char* fileName, InStream** saveIS, SequenceReade
  */
 void openSequenceFileWrite(const char* fileName, OutStream** saveIS, SequenceWriter** saveSS);
 
+/**
+ * Open a named sequence file for writing, compressing gzip output with multiple threads.
+ * @param fileName The name of the file to open: "-" for stdout.
+ * @param saveIS The base output stream, if any.
+ * @param saveSS The sequence stream.
+ * @param numThread The number of blocks to compress at once: one to just use the calling thread.
+ * @param useThreads The threads to use: null to make some.
+ */
+void openSequenceFileWrite(const char* fileName, OutStream** saveIS, SequenceWriter** saveSS, int numThread, ThreadPool* useThreads);
+
 #endif
\ No newline at end of file
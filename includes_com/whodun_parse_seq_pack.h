@@ -0,0 +1,93 @@
+#ifndef WHODUN_PARSE_SEQ_PACK_H
+#define WHODUN_PARSE_SEQ_PACK_H 1
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "whodun_datread.h"
+#include "whodun_parse_seq.h"
+
+/**
+ * Write a packed image of a set of sequences: two bits a base, with runs of anything else and lowercase noted separately.
+ * Only one sequence is held in memory at a time.
+ * @param fromRead The sequences to pack.
+ * @param toWrite The place to write the image.
+ */
+void packSequenceFile(SequenceReader* fromRead, OutStream* toWrite);
+
+/**
+ * Pack a named sequence file.
+ * @param fromFile The name of the sequence file.
+ * @param toFile The name of the image to write.
+ */
+void packSequenceFile(const char* fromFile, const char* toFile);
+
+/**One of the sequences in a packed image.*/
+class PackedSequenceEntry{
+public:
+	/**The name of the sequence.*/
+	std::string seqName;
+	/**The number of bases in the sequence.*/
+	uintptr_t seqLen;
+	/**The packed bases (four to a byte, first base in the low bits).*/
+	const unsigned char* seqData;
+	/**The start of each run of bases that are not ACGT.*/
+	std::vector<uintptr_t> oddStart;
+	/**The length of each run of bases that are not ACGT.*/
+	std::vector<uintptr_t> oddLen;
+	/**The (upper case) character in each run of bases that are not ACGT.*/
+	std::vector<char> oddChar;
+	/**The start of each run of lower case bases.*/
+	std::vector<uintptr_t> lowStart;
+	/**The length of each run of lower case bases.*/
+	std::vector<uintptr_t> lowLen;
+};
+
+/**A packed image of a set of sequences, mapped into memory. Read only after construction, so it can be shared between threads.*/
+class PackedSequenceStore{
+public:
+	/**
+	 * Map in an image.
+	 * @param fileName The name of the image.
+	 */
+	PackedSequenceStore(const char* fileName);
+	/**Unmap.*/
+	~PackedSequenceStore();
+	/**
+	 * Find a sequence by name.
+	 * @param seqName The name of the sequence.
+	 * @return The index of the sequence, or -1 if not present.
+	 */
+	intptr_t findSequence(const std::string& seqName);
+	/**
+	 * Get the length of a sequence.
+	 * @param seqI The index of the sequence.
+	 * @return The number of bases.
+	 */
+	uintptr_t getLength(uintptr_t seqI);
+	/**
+	 * Unpack part of a sequence.
+	 * @param seqI The index of the sequence.
+	 * @param fromI The first base to get.
+	 * @param toI The base after the last to get.
+	 * @param toFill The place to put the bases (replaces any contents).
+	 */
+	void getWindow(uintptr_t seqI, uintptr_t fromI, uintptr_t toI, std::string* toFill);
+
+	/**The sequences.*/
+	std::vector<PackedSequenceEntry> allSeqs;
+	/**The index of each sequence, by name.*/
+	std::map<std::string,uintptr_t> seqInds;
+	/**The name of the image.*/
+	std::string myName;
+	/**The mapped image.*/
+	void* mapAddr;
+	/**The size of the mapped image.*/
+	uintptr_t mapSize;
+	/**The bases for each packed byte.*/
+	char unpackTable[1024];
+};
+
+#endif
\ No newline at end of file
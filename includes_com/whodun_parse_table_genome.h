@@ -1,6 +1,9 @@
 #ifndef WHODUN_PARSE_TABLE_GENOME_H
 #define WHODUN_PARSE_TABLE_GENOME_H 1
 
+#include <map>
+#include <deque>
+
 #include "whodun_parse_table.h"
 
 /**Interpret a tsv as a bed file.*/
@@ -139,6 +142,10 @@ public:
 	 * @param toFill The entry to write.
 	 */
 	virtual void writeNextEntry(CRBSAMFileContents* toFill) = 0;
+	/**
+	 * Write anything that marks the end of the file, so problems show up here rather than in the destructor.
+	 */
+	virtual void finish();
 };
 
 /**Read a sam file.*/
@@ -158,6 +165,83 @@ public:
 	std::string tempStore;
 };
 
+/**
+ * Fill in an entry from the fields of a line of a sam file.
+ * @param numFields The number of fields.
+ * @param fieldSizes The length of each field.
+ * @param fieldTexts The text of each field.
+ * @param toFill The entry to fill in (cleared first).
+ * @param tempStore Temporary storage.
+ */
+void parseSAMEntry(uintptr_t numFields, uintptr_t* fieldSizes, char** fieldTexts, CRBSAMFileContents* toFill, std::string* tempStore);
+
+/**The number of bytes of sam text to read at a time, when parsing with multiple threads.*/
+#define MTSAMREAD_CHUNK_SIZE 0x100000
+
+/**A chunk of sam text, parsed by one thread.*/
+class MultithreadSAMFileReaderChunk{
+public:
+	/**Set up an empty chunk.*/
+	MultithreadSAMFileReaderChunk();
+	/**Tear down.*/
+	~MultithreadSAMFileReaderChunk();
+	/**The text: whole lines.*/
+	std::vector<char> chunkText;
+	/**Storage for the parsed entries.*/
+	std::deque<CRBSAMFileContents> ents;
+	/**The number of entries parsed.*/
+	uintptr_t numEnts;
+	/**The next entry to report.*/
+	uintptr_t nextEnt;
+	/**The problem stopping the parse, if any (after the parsed entries).*/
+	std::string errMess;
+	/**Whether the parse task needs to be waited on.*/
+	bool needJoin;
+	/**The id of the parse task.*/
+	uintptr_t taskID;
+	/**The start of each field in the current line.*/
+	std::vector<char*> fieldTexts;
+	/**The length of each field in the current line.*/
+	std::vector<uintptr_t> fieldSizes;
+	/**Temporary storage for the parse.*/
+	std::string tempStore;
+};
+
+/**Read a sam file, parsing chunks of lines with multiple threads: entries come out in file order.*/
+class MultithreadSAMFileReader : public CRBSAMFileReader{
+public:
+	/**
+	 * Start reading.
+	 * @param toParse The text to parse.
+	 * @param numThread The number of threads to use.
+	 * @param useThreads The threads to use: null to make some.
+	 */
+	MultithreadSAMFileReader(InStream* toParse, int numThread, ThreadPool* useThreads);
+	/**Tear down.*/
+	~MultithreadSAMFileReader();
+	int readNextEntry(CRBSAMFileContents* toFill);
+	/**
+	 * Read the next chunk of text and start parsing it.
+	 * @param toFill The chunk to fill.
+	 * @return Whether there was any text.
+	 */
+	bool startChunk(MultithreadSAMFileReaderChunk* toFill);
+	/**The text to parse.*/
+	InStream* fromSrc;
+	/**The threads to parse with.*/
+	ThreadPool* parseThreads;
+	/**Whether this made the threads.*/
+	bool killPool;
+	/**Whether the text has run out.*/
+	bool hitEnd;
+	/**Storage for the chunks.*/
+	std::vector<MultithreadSAMFileReaderChunk> allChunks;
+	/**The chunks being parsed, in file order.*/
+	std::deque<MultithreadSAMFileReaderChunk*> liveChunks;
+	/**The partial line at the end of the last chunk.*/
+	std::vector<char> carryText;
+};
+
 /**Write a sam file.*/
 class SAMFileWriter : public CRBSAMFileWriter{
 public:
@@ -208,6 +292,101 @@ public:
 	std::vector<std::string> refNames;
 };
 
+/**Write a bam file.*/
+class BAMFileWriter : public CRBSAMFileWriter{
+public:
+	/**
+	 * Set up a writer.
+	 * @param toDump The (block compressed) place to write to.
+	 */
+	BAMFileWriter(OutStream* toDump);
+	/**Tear down: tries to write the header if nothing else was written, but cannot complain.*/
+	~BAMFileWriter();
+	/**
+	 * Write the header if nothing else was written, and finish the (block compressed) output.
+	 */
+	void finish();
+	/**
+	 * Write an entry. Header entries must all come first: the references are taken from the @SQ lines.
+	 * @param toFill The entry to write.
+	 */
+	void writeNextEntry(CRBSAMFileContents* toFill);
+	/**
+	 * Write out the header and reference list gathered so far.
+	 */
+	void writeHeader();
+	/**
+	 * Get the index of a reference.
+	 * @param refName The name of the reference.
+	 * @return The index of the reference: -1 if empty.
+	 */
+	int32_t getReferenceIndex(std::vector<char>* refName);
+	/**The place to write to.*/
+	OutStream* toDump;
+	/**Whether the header has been written.*/
+	int doneHead;
+	/**The text of the header.*/
+	std::vector<char> headerTxt;
+	/**The names of the references.*/
+	std::vector<std::string> refNames;
+	/**The lengths of the references.*/
+	std::vector<uintptr_t> refLens;
+	/**The index of each reference.*/
+	std::map<std::string,int32_t> refInds;
+	/**Temporary storage for reference names.*/
+	std::string tempName;
+	/**Temporary storage for the packed entry.*/
+	std::vector<char> tempStore;
+	/**Temporary storage for split up tags.*/
+	std::vector<char*> tmpS;
+	/**Temporary storage for split up tags.*/
+	std::vector<char*> tmpE;
+};
+
+/**
+ * Get the bin a stretch of reference falls into in a bam index.
+ * @param fromI The first base.
+ * @param toI The base after the last.
+ * @return The bin.
+ */
+uint32_t bamRegionToBin(intptr_t fromI, intptr_t toI);
+
+/**The number of bases covered by each entry in the linear part of a bam index.*/
+#define BAM_INDEX_WINDOW 16384
+/**The bin in a bam index that holds metadata instead of chunks.*/
+#define BAM_INDEX_METABIN 37450
+
+/**The index for one reference in a bam index.*/
+class BAMIndexReference{
+public:
+	/**Set up an empty index.*/
+	BAMIndexReference();
+	/**Tear down.*/
+	~BAMIndexReference();
+	/**The chunks (start and end virtual offset) in each bin.*/
+	std::map< uint32_t, std::vector< std::pair<uint64_t,uint64_t> > > binChunks;
+	/**The smallest virtual offset of any alignment overlapping each window: zero if nothing does.*/
+	std::vector<uint64_t> linearIndex;
+	/**The largest virtual offset at the end of a chunk: zero if no chunks.*/
+	uint64_t maxChunkEnd;
+};
+
+/**The contents of a bam index (bai) file.*/
+class BAMFileIndex{
+public:
+	/**
+	 * Parse an index.
+	 * @param toParse The (uncompressed) index data.
+	 */
+	BAMFileIndex(InStream* toParse);
+	/**Tear down.*/
+	~BAMFileIndex();
+	/**The index for each reference, in the order of the bam header.*/
+	std::vector<BAMIndexReference> refIndex;
+	/**The number of alignments without a position: -1 if the index does not say.*/
+	intptr_t numNoCoord;
+};
+
 /**
  * Turn a cigar string to reference positions.
  * @param refPos0 The 0 position.
@@ -224,6 +403,13 @@ std::pair<uintptr_t,uintptr_t> cigarStringToReferencePositions(uintptr_t refPos0
  */
 std::pair<intptr_t,intptr_t> getCigarReferenceBounds(std::vector<intptr_t>* lookPos);
 
+/**
+ * Get the number of reference bases a cigar string covers, without expanding it.
+ * @param cigStr The cigar string.
+ * @return The number of bases matched or skipped over, or -1 if the string is odd.
+ */
+intptr_t cigarStringReferenceSpan(std::vector<char>* cigStr);
+
 /**
  * Open a named sam/bam/cram file for reading.
  * @param fileName The name of the file to open: "-" for stdin.
@@ -233,6 +419,17 @@ std::pair<intptr_t,intptr_t> getCigarReferenceBounds(std::vector<intptr_t>* look
  */
 void openCRBSamFileRead(const char* fileName, InStream** saveIS, TabularReader** saveTS, CRBSAMFileReader** saveSS);
 
+/**
+ * Open a named sam/bam/cram file for reading, parsing sam text with multiple threads.
+ * @param fileName The name of the file to open: "-" for stdin.
+ * @param saveIS The base input stream, if any.
+ * @param saveTS The base table stream, if any.
+ * @param saveSS The cbsam stream.
+ * @param numThread The number of threads to parse with: one to just use the calling thread.
+ * @param useThreads The threads to use: null to make some.
+ */
+void openCRBSamFileRead(const char* fileName, InStream** saveIS, TabularReader** saveTS, CRBSAMFileReader** saveSS, int numThread, ThreadPool* useThreads);
+
 /**
  * Open a named sam/bam/cram file for writing.
  * @param fileName The name of the file to open: "-" for stdout.
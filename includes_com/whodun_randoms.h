@@ -80,4 +80,46 @@ public:
 	uint32_t prevGen;
 };
 
+/**
+ * Seed a generator from a single number, spreading it out over the whole seed (splitmix64).
+ * @param toSeed The generator to seed.
+ * @param seedVal The number to seed with.
+ */
+void seedRandomGenerator(RandomGenerator* toSeed, uint64_t seedVal);
+
+#define RANDOM_BUFFER_SIZE 1024
+
+/**Hands out random numbers one at a time, pulling them from a mersenne twister in blocks.*/
+class BufferedRandomSource{
+public:
+	/**
+	 * Set up.
+	 * @param seedVal The number to seed with.
+	 */
+	BufferedRandomSource(uint64_t seedVal);
+	/**Clean up.*/
+	~BufferedRandomSource();
+	/**
+	 * Get a uniform random number.
+	 * @return A number in (0,1].
+	 */
+	double nextUniform();
+	/**
+	 * Get a standard normal random number.
+	 * @return The number.
+	 */
+	double nextNormal();
+	
+	/**The generator.*/
+	MersenneTwisterGenerator randGen;
+	/**Uniform random numbers, ready to use.*/
+	double uniBuff[RANDOM_BUFFER_SIZE];
+	/**The next uniform to use.*/
+	uintptr_t uniNext;
+	/**Normal random numbers, ready to use.*/
+	double normBuff[RANDOM_BUFFER_SIZE];
+	/**The next normal to use.*/
+	uintptr_t normNext;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef WHODUN_STRINGEXT_SEQ_H
+#define WHODUN_STRINGEXT_SEQ_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+//kernels for working with sequence data: architecture specific versions may use vector instructions
+
+/**
+ * Reverse the bytes in an array, in place.
+ * @param toRev The array to reverse.
+ * @param numBts The number of bytes.
+ */
+void memreverse(char* toRev, size_t numBts);
+
+/**
+ * Reverse complement a sequence in place: A,C,G and T (upper case) are complemented, anything else is left alone.
+ * @param toRev The sequence to reverse complement.
+ * @param numBts The length of the sequence.
+ */
+void memrevcomp(char* toRev, size_t numBts);
+
+/**
+ * Convert ascii phred scores to log10 probabilities.
+ * @param toConv The phred scores.
+ * @param numConv The number to convert.
+ * @param toStore The place to put the log10 probabilities.
+ */
+void memphredtolog10(const unsigned char* toConv, size_t numConv, double* toStore);
+
+/**
+ * Convert log10 probabilities to ascii phred scores (clamped to 33 through 126).
+ * @param toConv The log10 probabilities.
+ * @param numConv The number to convert.
+ * @param toStore The place to put the phred scores.
+ */
+void memlog10tophred(const double* toConv, size_t numConv, unsigned char* toStore);
+
+/**
+ * Count the number of times each byte shows up.
+ * @param toCount The bytes to count.
+ * @param numBts The number of bytes.
+ * @param toFill The counts to add to (256 entries).
+ */
+void membytecount(const char* toCount, size_t numBts, uintptr_t* toFill);
+
+#endif
\ No newline at end of file
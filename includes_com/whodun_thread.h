@@ -10,17 +10,65 @@
 #include "whodun_cache.h"
 #include "whodun_oshook.h"
 
+/**The number of low bits of a task handle that give the slot: the rest are the generation of the slot.*/
+#define THREADPOOL_SLOT_BITS (4*sizeof(uintptr_t))
+/**The number of task slots to allocate at a time.*/
+#define THREADPOOL_SLOT_CHUNK 256
+
+/**Long running tasks (stages of a pipeline): only idle threads start these, so each needs a thread of its own.*/
+#define THREADPOOL_PRIORITY_STAGE 0
+/**Short tasks feeding or draining a pipeline (parsing, compression).*/
+#define THREADPOOL_PRIORITY_IO 1
+/**Short tasks doing the actual work.*/
+#define THREADPOOL_PRIORITY_COMPUTE 2
+/**The number of priorities.*/
+#define THREADPOOL_NUM_PRIORITY 3
+
+/**A task slot is not in use.*/
+#define THREADPOOL_TASK_FREE 0
+/**A task is sitting in a queue.*/
+#define THREADPOOL_TASK_QUEUED 1
+/**A task is running.*/
+#define THREADPOOL_TASK_RUNNING 2
+/**A task has finished, and is waiting for a join.*/
+#define THREADPOOL_TASK_DONE 3
+
 /**Internal storage for a task.*/
 typedef struct{
-	/**The ID of the task.*/
+	/**The index of the slot.*/
 	uintptr_t taskID;
+	/**The number of times the slot has been reused.*/
+	uintptr_t taskGen;
 	/**The function for the task.*/
 	void(*taskFun)(void*);
 	/**The uniform for the task.*/
 	void* taskUni;
+	/**The state of the task.*/
+	int taskState;
+	/**The queue the task was put in.*/
+	uintptr_t taskQueue;
+	/**The priority of the task.*/
+	int taskPriority;
 } ThreadPoolTaskInfo;
 
-/**A pool of reusable threads.*/
+class ThreadPool;
+
+/**One of the threads in a pool, and its queue.*/
+typedef struct{
+	/**The pool this is in.*/
+	ThreadPool* myPool;
+	/**The index of this thread.*/
+	uintptr_t myIndex;
+	/**Protect the queue.*/
+	void* queueMut;
+	/**The tasks waiting to be run, by priority: the thread takes from the back, others steal from the front.*/
+	std::deque<ThreadPoolTaskInfo*> waitTask[THREADPOOL_NUM_PRIORITY];
+} ThreadPoolWorker;
+
+/**
+ * A pool of reusable threads: each thread has its own queue, and steals from the others when it runs dry.
+ * Higher priority tasks are started first. Every task is joined, and a join runs a task that has not started, so nothing waits forever on a busy pool.
+ */
 class ThreadPool{
 public:
 	/**
@@ -38,28 +86,65 @@ public:
 	 */
 	uintptr_t addTask(void (*toDo)(void*), void* toPass);
 	/**
-	 * Wait for a task to finish.
+	 * Add a task to run.
+	 * @param toDo The function to run.
+	 * @param toPass The thing to add.
+	 * @param priority The priority of the task (THREADPOOL_PRIORITY_*).
+	 * @return The ID of the task. Will need to join at some point.
+	 */
+	uintptr_t addTask(void (*toDo)(void*), void* toPass, int priority);
+	/**
+	 * Wait for a task to finish. If it has not started, it will be run on the calling thread.
 	 * @param taskID The ID of the task.
 	 */
 	void joinTask(uintptr_t taskID);
+	/**
+	 * Run several tasks and wait for all of them: the first runs on the calling thread.
+	 * @param toDo The function to run.
+	 * @param numTask The number of tasks.
+	 * @param toPass The first thing to pass.
+	 * @param passSize The distance (in bytes) between the things to pass.
+	 */
+	void forkJoin(void (*toDo)(void*), uintptr_t numTask, void* toPass, uintptr_t passSize);
+	/**
+	 * Run one waiting task (other than a stage) on the calling thread, if there is one.
+	 * @return Whether a task was run.
+	 */
+	bool helpTask();
+	/**
+	 * Get a task to run.
+	 * @param forWork The thread looking: null if not a thread of this pool.
+	 * @param firstPriority The highest priority to take.
+	 * @return The task, or null if none.
+	 */
+	ThreadPoolTaskInfo* takeTask(ThreadPoolWorker* forWork, int firstPriority);
+	/**
+	 * Run a task and note it done.
+	 * @param toRun The task to run.
+	 */
+	void runTask(ThreadPoolTaskInfo* toRun);
 	/**The number of threads in this pool.*/
 	int numThr;
-	/**The task mutex.*/
+	/**Protects the task slots and sleeping.*/
 	void* taskMut;
-	/**The task conditions.*/
+	/**Idle threads wait on this.*/
 	void* taskCond;
-	/**The ID to use for the next job.*/
-	uintptr_t nextID;
-	/**The tasks waiting to be run.*/
-	std::deque<ThreadPoolTaskInfo> waitTask;
-	/**The IDs of the running/waiting tasks.*/
-	std::set<uintptr_t> hotTasks;
-	/**The IDs of the finished tasks.*/
-	std::set<uintptr_t> doneTasks;
-	/**Condition variables for things actively waiting on jobs.*/
-	std::map<uintptr_t,void*> doneCondMap;
-	/**Avoid allocating many conditions.*/
-	std::vector<void*> saveConds;
+	/**Joins wait on this.*/
+	void* doneCond;
+	/**The number of joins waiting.*/
+	uintptr_t numJoinWait;
+	/**The number of tasks that have been added.*/
+	uintptr_t numPushed;
+	/**The queue to add the next task from outside the pool to.*/
+	uintptr_t nextQueue;
+	/**The number of slots in use.*/
+	uintptr_t numLive;
+	/**The task slots, in chunks so they do not move.*/
+	std::vector<ThreadPoolTaskInfo*> slotChunks;
+	/**The slots not in use.*/
+	std::vector<uintptr_t> freeSlots;
+	/**The threads and their queues.*/
+	std::vector<ThreadPoolWorker*> allWorkers;
 	/**Whether the pool is live.*/
 	bool poolLive;
 	/**The live threads.*/
@@ -104,6 +189,24 @@ public:
 	ReusableContainerCache<OfT> actCache;
 };
 
+/**How a producer consumer queue has been used.*/
+typedef struct{
+	/**The number of things added.*/
+	uintmax_t numAdd;
+	/**The number of things taken.*/
+	uintmax_t numGet;
+	/**The number of things in the queue right now.*/
+	uintmax_t curDepth;
+	/**The most things that have been in the queue at once.*/
+	uintmax_t maxDepth;
+	/**The most things the queue can hold.*/
+	uintmax_t maxQueue;
+	/**The total time (in nanoseconds) adds spent waiting for room.*/
+	uintmax_t addWait;
+	/**The total time (in nanoseconds) gets spent waiting for something.*/
+	uintmax_t getWait;
+} ThreadProdComStats;
+
 /**Collect stuff between threads.*/
 template <typename OfT>
 class ThreadProdComCollector{
@@ -122,6 +225,8 @@ public:
 	std::deque<OfT*> waitQueue;
 	/**Protect by a lock.*/
 	ThreadsafeReusableContainerCache<OfT> taskCache;
+	/**How this has been used (protected by myMut).*/
+	ThreadProdComStats myStats;
 	
 	/**
 	 * Set up a producer consumer thing.
@@ -133,6 +238,8 @@ public:
 		myMut = makeMutex();
 		myConMore = makeCondition(myMut);
 		myConLess = makeCondition(myMut);
+		ThreadProdComStats initStats = {0, 0, 0, 0, maxQueueSize, 0, 0};
+		myStats = initStats;
 	}
 	
 	~ThreadProdComCollector(){
@@ -150,8 +257,14 @@ public:
 	 */
 	void addThing(OfT* toAdd){
 		lockMutex(myMut);
-			while(waitQueue.size() >= maxQueue){ if(queueEnded){ break; } waitCondition(myMut, myConLess); }
+			if(waitQueue.size() >= maxQueue){
+				uintmax_t waitStart = getMonotonicTime();
+				while(waitQueue.size() >= maxQueue){ if(queueEnded){ break; } waitCondition(myMut, myConLess); }
+				myStats.addWait += (getMonotonicTime() - waitStart);
+			}
 			waitQueue.push_back(toAdd);
+			myStats.numAdd++;
+			if(waitQueue.size() > myStats.maxDepth){ myStats.maxDepth = waitQueue.size(); }
 			signalCondition(myMut, myConMore);
 		unlockMutex(myMut);
 	}
@@ -162,11 +275,16 @@ public:
 	 */
 	OfT* getThing(){
 		lockMutex(myMut);
-			while(waitQueue.size() == 0){ if(queueEnded){ break; } waitCondition(myMut, myConMore); }
+			if((waitQueue.size() == 0) && !queueEnded){
+				uintmax_t waitStart = getMonotonicTime();
+				while(waitQueue.size() == 0){ if(queueEnded){ break; } waitCondition(myMut, myConMore); }
+				myStats.getWait += (getMonotonicTime() - waitStart);
+			}
 			OfT* nxtThing = 0;
 			if(waitQueue.size()){
 				nxtThing = waitQueue[0];
 				waitQueue.pop_front();
+				myStats.numGet++;
 				signalCondition(myMut, myConLess);
 			}
 		unlockMutex(myMut);
@@ -183,12 +301,24 @@ public:
 			if(waitQueue.size()){
 				nxtThing = waitQueue[0];
 				waitQueue.pop_front();
+				myStats.numGet++;
 				signalCondition(myMut, myConLess);
 			}
 		unlockMutex(myMut);
 		return nxtThing;
 	}
 	
+	/**
+	 * Get how this has been used.
+	 * @param toFill The place to put the counts.
+	 */
+	void getStats(ThreadProdComStats* toFill){
+		lockMutex(myMut);
+			*toFill = myStats;
+			toFill->curDepth = waitQueue.size();
+		unlockMutex(myMut);
+	}
+	
 	/**Wake up ALL waiters, let all know things are ending.*/
 	void end(){
 		if(queueEnded){ return; }
@@ -0,0 +1,91 @@
+#ifndef PROSYNAR_BATCH_H
+#define PROSYNAR_BATCH_H 1
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "whodun_thread.h"
+#include "whodun_parse_table_genome.h"
+
+#include "prosynar_task.h"
+
+/**The number of pairs a thread takes at a time during a batch.*/
+#define PROSYNAR_BATCH_BLOCK 64
+
+/**What happened to one pair of a batch.*/
+class ProsynarBatchResult{
+public:
+	/**Whether the pair was merged.*/
+	bool merged;
+	/**The merged sequence, if merged.*/
+	std::string mergeSeq;
+	/**The merged qualities, as ascii phred scores, if merged.*/
+	std::string mergePhred;
+	/**Any complaint from the filters or merger.*/
+	std::string errMess;
+};
+
+/**Merge pairs already in memory, keeping the loaded data and the threads between batches.*/
+class ProsynarBatchMerger{
+public:
+	/**
+	 * Load everything and get ready to merge.
+	 * @param useArgs The arguments, parsed but not set up: inputs and outputs are ignored (its failure dump is cleared, so no file is made). Must outlive this. If it has no pool, one is made with numThread threads.
+	 */
+	ProsynarBatchMerger(ProsynarArgumentParser* useArgs);
+	/**Tear down.*/
+	~ProsynarBatchMerger();
+	/**
+	 * Merge a batch of pairs. Only one batch runs at a time: other callers wait their turn. If anything throws, the whole batch is abandoned and the first problem is rethrown.
+	 * @param numPair The number of pairs.
+	 * @param read1s The first alignment of each pair.
+	 * @param read2s The second alignment of each pair.
+	 * @param toFill The place to put what happened to each pair: resized to numPair.
+	 * @return The number of pairs merged.
+	 */
+	uintptr_t mergePairs(uintptr_t numPair, CRBSAMFileContents** read1s, CRBSAMFileContents** read2s, std::vector<ProsynarBatchResult>* toFill);
+	/**
+	 * Merge pairs for one thread, until the batch runs out.
+	 * @param threadInd The index of the thread.
+	 */
+	void mergeBlocks(int threadInd);
+	/**
+	 * Note a problem with the current batch, and stop handing out pairs.
+	 * @param errMess The problem.
+	 */
+	void noteBatchFailure(const char* errMess);
+	/**
+	 * Merge one pair.
+	 * @param threadInd The index of the thread.
+	 * @param pairCtx The pair.
+	 * @param toFill The place to put what happened.
+	 * @param tmpQuals Storage for log10 qualities.
+	 */
+	void mergeOne(int threadInd, ProsynarPairContext* pairCtx, ProsynarBatchResult* toFill, std::vector<double>* tmpQuals);
+
+	/**The arguments.*/
+	ProsynarArgumentParser* useArgs;
+	/**The pool made here, if any.*/
+	ThreadPool* ownPool;
+	/**Only one batch at a time.*/
+	void* batchLock;
+	/**Protect the next pair to hand out.*/
+	void* nextLock;
+	/**The next pair to hand out in the current batch.*/
+	uintptr_t nextPair;
+	/**The number of pairs in the current batch.*/
+	uintptr_t curNumPair;
+	/**The first alignments of the current batch.*/
+	CRBSAMFileContents** curRead1s;
+	/**The second alignments of the current batch.*/
+	CRBSAMFileContents** curRead2s;
+	/**The results of the current batch.*/
+	ProsynarBatchResult* curResults;
+	/**Whether the current batch has hit a problem (protected by nextLock).*/
+	bool batchFailed;
+	/**The first problem the current batch hit (protected by nextLock).*/
+	std::string batchErr;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,188 @@
+#ifndef PROSYNAR_BENCH_H
+#define PROSYNAR_BENCH_H 1
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "whodun_args.h"
+#include "whodun_randoms.h"
+#include "whodun_datread.h"
+#include "whodun_align_affinepd.h"
+
+/**Time table preparation for the position dependent alignment.*/
+#define PROSYNAR_KERNEL_PREPARE 0
+/**Time finding the best alignment scores.*/
+#define PROSYNAR_KERNEL_SCORES 1
+/**Time walking through the alignments with those scores.*/
+#define PROSYNAR_KERNEL_FUZZY 2
+/**Time the flash overlap search.*/
+#define PROSYNAR_KERNEL_FLASH 3
+/**Time the pear overlap search.*/
+#define PROSYNAR_KERNEL_PEAR 4
+/**Time looking up costs in the kd tree.*/
+#define PROSYNAR_KERNEL_KDTREE 5
+/**The number of kernels.*/
+#define PROSYNAR_KERNEL_COUNT 6
+
+/**Parse arguments for timing the inner loops.*/
+class ProsynarBenchArgumentParser : public ArgumentParser{
+public:
+	/**Set up a basic parser.*/
+	ProsynarBenchArgumentParser();
+	/**Tear down.*/
+	~ProsynarBenchArgumentParser();
+	int posteriorCheck();
+
+	/**The file to write to.*/
+	char* outFile;
+	/**The seed for the random numbers.*/
+	intptr_t randSeed;
+	/**The number of pairs to run in each repeat.*/
+	intptr_t numPairs;
+	/**The number of repeats to run and throw away first.*/
+	intptr_t numWarm;
+	/**The number of repeats to time.*/
+	intptr_t numRep;
+	/**The processor to run on: negative to let the system decide.*/
+	intptr_t pinCPU;
+	/**The number of extra reference bases on each side of a read to align against.*/
+	intptr_t refPad;
+	/**The probability of a base being changed.*/
+	double subRate;
+	/**The number of alignment scores to look for.*/
+	intptr_t numScore;
+	/**The maximum number of times to examine a score during score search.*/
+	intptr_t hotfuzz;
+	/**The required overlap for flash.*/
+	intptr_t minOver;
+	/**The read lengths to try.*/
+	std::vector<intptr_t> readLens;
+	/**The numbers of cost regions to try.*/
+	std::vector<intptr_t> regionCounts;
+	/**The names of the kernels to run.*/
+	std::vector<char*> kernelNames;
+	/**Whether to run each kernel, by index.*/
+	bool runKernel[PROSYNAR_KERNEL_COUNT];
+	/**The default output name.*/
+	char defOutFN[2];
+};
+
+/**Made up data for one read length.*/
+class ProsynarBenchData{
+public:
+	/**The read length.*/
+	uintptr_t readLen;
+	/**The reference windows to align against.*/
+	std::vector<std::string> alnRefs;
+	/**The reads to align.*/
+	std::vector<std::string> alnReads;
+	/**The left reads of the overlapping pairs.*/
+	std::vector< std::vector<char> > seqLs;
+	/**The left phred qualities.*/
+	std::vector< std::vector<char> > qualLs;
+	/**The left log10 error probabilities.*/
+	std::vector< std::vector<double> > qualdLs;
+	/**The right reads of the overlapping pairs, already turned to face the left.*/
+	std::vector< std::vector<char> > seqRs;
+	/**The right phred qualities.*/
+	std::vector< std::vector<char> > qualRs;
+	/**The right log10 error probabilities.*/
+	std::vector< std::vector<double> > qualdRs;
+};
+
+/**Time the inner loops of the filters and mergers on made up data.*/
+class ProsynarKernelBench{
+public:
+	/**
+	 * Set up.
+	 * @param useArgs The arguments.
+	 */
+	ProsynarKernelBench(ProsynarBenchArgumentParser* useArgs);
+	/**Tear down.*/
+	~ProsynarKernelBench();
+	/**
+	 * Run everything asked for.
+	 * @param toDump The place to write the table of results.
+	 */
+	void runAll(OutStream* toDump);
+	/**
+	 * Make up reads.
+	 * @param readLen The length of the reads.
+	 * @param toFill The place to put them.
+	 */
+	void makeData(uintptr_t readLen, ProsynarBenchData* toFill);
+	/**
+	 * Make up a cost tree, by writing out a cost file and parsing it.
+	 * @param refLen The length of the reference windows.
+	 * @param numRegion The number of regions (past the default) to add.
+	 * @param toFill The tree to fill.
+	 */
+	void makeCosts(uintptr_t refLen, uintptr_t numRegion, PositionDependentCostKDTree* toFill);
+	/**
+	 * Run the alignment kernels once over all the pairs.
+	 * @param useData The data to run.
+	 * @param useCost The costs to use.
+	 * @param kernTimes The place to add the time (in nanoseconds) spent in prepare, score search and iteration.
+	 */
+	void runAlignment(ProsynarBenchData* useData, PositionDependentCostKDTree* useCost, uintmax_t* kernTimes);
+	/**
+	 * Run the kd tree lookup once over all the pairs.
+	 * @param useData The data to run.
+	 * @param useCost The costs to use.
+	 * @return The time (in nanoseconds) it took.
+	 */
+	uintmax_t runCostLookup(ProsynarBenchData* useData, PositionDependentCostKDTree* useCost);
+	/**
+	 * Run the flash overlap search once over all the pairs.
+	 * @param useData The data to run.
+	 * @return The time (in nanoseconds) it took.
+	 */
+	uintmax_t runFlash(ProsynarBenchData* useData);
+	/**
+	 * Run the pear overlap search once over all the pairs.
+	 * @param useData The data to run.
+	 * @return The time (in nanoseconds) it took.
+	 */
+	uintmax_t runPear(ProsynarBenchData* useData);
+	/**
+	 * Write a line of results.
+	 * @param kernI The kernel.
+	 * @param readLen The read length.
+	 * @param numRegion The number of cost regions: negative if it does not matter.
+	 * @param cellsPerPair The amount of work done for each pair.
+	 * @param repTimes The time (in nanoseconds) each repeat took.
+	 * @param toDump The place to write.
+	 */
+	void writeResult(int kernI, uintptr_t readLen, intptr_t numRegion, double cellsPerPair, std::vector<uintmax_t>* repTimes, OutStream* toDump);
+	/**
+	 * Get a random base.
+	 * @return The base.
+	 */
+	char nextBase();
+
+	/**The arguments.*/
+	ProsynarBenchArgumentParser* useArgs;
+	/**The random numbers.*/
+	BufferedRandomSource randSrc;
+	/**The alignment to reuse.*/
+	PositionDependentAffineGapLinearPairwiseAlignment workAln;
+	/**The iteration to reuse.*/
+	LinearPairwiseAlignmentIteration* workIter;
+	/**Storage for scores.*/
+	std::vector<intptr_t> scoreStore;
+	/**Storage for cost lookups.*/
+	std::vector<AlignCostAffine*> costStore;
+	/**Something to keep results in, so the work cannot be skipped.*/
+	uintmax_t sinkVal;
+};
+
+/**
+ * Run the kernel benchmarks.
+ * @param argc The number of arguments (including the name of the subcommand).
+ * @param argv The arguments.
+ * @return The exit code.
+ */
+int prosynarBenchMain(int argc, char** argv);
+
+#endif
\ No newline at end of file
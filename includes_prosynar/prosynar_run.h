@@ -0,0 +1,21 @@
+#ifndef PROSYNAR_RUN_H
+#define PROSYNAR_RUN_H 1
+
+#include <stdint.h>
+
+#include "prosynar_task.h"
+
+/**
+ * Figure out how many threads a run needs: each stage (the workers, the outputs, any bam readers) gets one.
+ * @param argsP The parsed arguments.
+ * @return The number of stages.
+ */
+uintptr_t prosynarRunStageCount(ProsynarArgumentParser* argsP);
+
+/**
+ * Merge the pairs in the input files, and write the results.
+ * @param argsP The arguments, already set up: the stages run on its pool, which needs room for all of them.
+ */
+void prosynarRunMerge(ProsynarArgumentParser* argsP);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,168 @@
+#ifndef PROSYNAR_SERVE_H
+#define PROSYNAR_SERVE_H 1
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "whodun_args.h"
+#include "whodun_thread.h"
+
+#include "prosynar_task.h"
+
+/**The longest request a server will take, in bytes.*/
+#define PROSYNAR_SERVE_MAX_REQUEST 0x100000
+/**The number of bytes to read from a connection at a time.*/
+#define PROSYNAR_SERVE_READ_BLOCK 0x01000
+/**The longest a sender gets to send its request, or take its report, in nanoseconds.*/
+#define PROSYNAR_SERVE_TIMEOUT 10000000000ULL
+/**The threads each job gets past its merge threads: its runner, its two outputs and its progress reports.*/
+#define PROSYNAR_SERVE_EXTRA_STAGE 4
+
+/**A job slot with nothing in it.*/
+#define PROSYNAR_JOB_FREE 0
+/**A job slot with a running job.*/
+#define PROSYNAR_JOB_RUNNING 1
+/**A job slot whose job is done, but not yet joined.*/
+#define PROSYNAR_JOB_DONE 2
+
+/**Parse arguments for running as a server.*/
+class ProsynarServeArgumentParser : public ArgumentParser{
+public:
+	/**Set up a basic parser.*/
+	ProsynarServeArgumentParser();
+	/**Tear down.*/
+	~ProsynarServeArgumentParser();
+	int posteriorCheck();
+
+	/**The socket to listen on.*/
+	char* sockFile;
+	/**The number of jobs to run at once.*/
+	intptr_t numJobs;
+	/**The most merge threads a job can use.*/
+	intptr_t numThread;
+	/**The reference file.*/
+	char* refFile;
+	/**The packed reference image.*/
+	char* refPackFile;
+	/**The problem region file.*/
+	char* probFile;
+	/**The cost specification file.*/
+	char* costFile;
+	/**The quality mangle file.*/
+	char* qualmFile;
+};
+
+/**Parse arguments for sending a job to a server.*/
+class ProsynarSubmitArgumentParser : public ArgumentParser{
+public:
+	/**Set up a basic parser.*/
+	ProsynarSubmitArgumentParser();
+	/**Tear down.*/
+	~ProsynarSubmitArgumentParser();
+	int handleUnknownArgument(int argc, char** argv, std::ostream* helpOut);
+	int posteriorCheck();
+
+	/**The socket the server is listening on.*/
+	char* sockFile;
+	/**Whether to tell the server to stop, rather than send a job.*/
+	bool stopServer;
+	/**The arguments of the job.*/
+	std::vector<char*> jobArgs;
+};
+
+class ProsynarServer;
+
+/**A slot for a job in a server.*/
+class ProsynarServeJob{
+public:
+	/**The server this is for.*/
+	ProsynarServer* forServer;
+	/**The connection the job came in on.*/
+	void* theConn;
+	/**What the slot is doing (protected by the server's lock).*/
+	int jobState;
+	/**The task running the job.*/
+	uintptr_t jobTask;
+};
+
+/**Keeps the reference and defaults loaded, and runs jobs sent over a local socket.*/
+class ProsynarServer{
+public:
+	/**
+	 * Set up, loading the reference and defaults.
+	 * @param useArgs The arguments.
+	 */
+	ProsynarServer(ProsynarServeArgumentParser* useArgs);
+	/**Tear down.*/
+	~ProsynarServer();
+	/**
+	 * Take connections until told to stop, then wait for the running jobs.
+	 */
+	void serve();
+	/**
+	 * Wait for a job slot to open up.
+	 * @return The slot, or null if the server is stopping.
+	 */
+	ProsynarServeJob* waitForFreeJob();
+	/**
+	 * Run a job, and tell whoever sent it how it went.
+	 * @param theJob The job.
+	 */
+	void runJob(ProsynarServeJob* theJob);
+	/**
+	 * Run the arguments of a job.
+	 * @param jobArgc The number of arguments.
+	 * @param jobArgv The arguments.
+	 * @param toOutput The place to put anything the sender should write to its stdout.
+	 * @param toReport The place to put problems and reports from the job, for the sender's stderr.
+	 * @return The exit code.
+	 */
+	int runJobArguments(int jobArgc, char** jobArgv, std::string* toOutput, std::string* toReport);
+	/**
+	 * Read a request: arguments, each ending in a null, then an empty argument. Gives up if the whole thing takes too long.
+	 * @param theConn The connection to read from.
+	 * @param toFill The place to put the arguments (with their nulls).
+	 * @return Whether a full request came in.
+	 */
+	bool readRequest(void* theConn, std::string* toFill);
+	/**
+	 * Note that the server should stop, and wake it up if it is waiting on a connection.
+	 */
+	void noteStop();
+
+	/**The arguments.*/
+	ProsynarServeArgumentParser* useArgs;
+	/**The reference and defaults, shared by the jobs.*/
+	ProsynarArgumentParser sharedArgs;
+	/**The threads the jobs run on.*/
+	ThreadPool* jobPool;
+	/**The socket being listened on.*/
+	void* servSock;
+	/**The job slots.*/
+	std::vector<ProsynarServeJob> allJobs;
+	/**Protect the job slots and the stop flag.*/
+	void* jobMut;
+	/**Signalled when a job finishes.*/
+	void* jobCond;
+	/**Whether the server has been told to stop.*/
+	bool stopping;
+};
+
+/**
+ * Run the server.
+ * @param argc The number of arguments (including the name of the subcommand).
+ * @param argv The arguments.
+ * @return The exit code.
+ */
+int prosynarServeMain(int argc, char** argv);
+
+/**
+ * Send a job to a server, and wait for it to finish.
+ * @param argc The number of arguments (including the name of the subcommand).
+ * @param argv The arguments.
+ * @return The exit code of the job.
+ */
+int prosynarSubmitMain(int argc, char** argv);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,108 @@
+#ifndef PROSYNAR_STATS_H
+#define PROSYNAR_STATS_H 1
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdint.h>
+
+#include "whodun_thread.h"
+
+#include "prosynar_task.h"
+
+/**How often a filter (or the merger) was run on one thread, and how that went.*/
+class ProsynarStepStats{
+public:
+	/**Start at zero.*/
+	ProsynarStepStats();
+	/**
+	 * Note a run.
+	 * @param stepRes What came back: one to keep going, zero to throw the pair out, negative on error.
+	 * @param stepTime The time (in nanoseconds) it took.
+	 */
+	void noteRun(int stepRes, uintmax_t stepTime);
+	/**
+	 * Add in the counts from another thread.
+	 * @param toAdd The counts to add.
+	 */
+	void addIn(ProsynarStepStats* toAdd);
+	/**The number of pairs looked at.*/
+	uintmax_t numCall;
+	/**The number of pairs thrown out.*/
+	uintmax_t numReject;
+	/**The number of pairs that hit an error.*/
+	uintmax_t numError;
+	/**The time (in nanoseconds) spent.*/
+	uintmax_t useTime;
+};
+
+/**How one of the merge threads spent its time.*/
+class ProsynarWorkerStats{
+public:
+	/**Start at zero.*/
+	ProsynarWorkerStats();
+	/**
+	 * Reorder the filters so the ones that throw out the most pairs for the time they take go first.
+	 * Filters that cannot be moved stay put: the others only move within the stretches between them.
+	 * The recent counts are halved afterwards, so that older pairs count for less.
+	 * @param argsP The arguments to ProSynAr.
+	 */
+	void adaptFilterOrder(ProsynarArgumentParser* argsP);
+	/**The number of pairs looked at.*/
+	uintmax_t numPair;
+	/**The number of pairs merged.*/
+	uintmax_t numMerge;
+	/**The time (in nanoseconds) spent on pairs.*/
+	uintmax_t busyTime;
+	/**The time (in nanoseconds) spent helping with other work while there were no pairs.*/
+	uintmax_t helpTime;
+	/**How each filter has done, by position on the command line.*/
+	std::vector<ProsynarStepStats> filterStats;
+	/**How each filter has done since the last reordering (with older counts halved away), by position on the command line.*/
+	std::vector<ProsynarStepStats> recentStats;
+	/**The order this thread runs the filters in, as positions on the command line.*/
+	std::vector<uintptr_t> filterOrder;
+	/**How the merger has done: rejects are failed merges.*/
+	ProsynarStepStats mergeStats;
+};
+
+/**Numbers on how a run went.*/
+class ProsynarRunStats{
+public:
+	/**
+	 * Set up for a run starting now.
+	 * @param numWorker The number of merge threads.
+	 * @param numFilter The number of filters.
+	 */
+	ProsynarRunStats(uintptr_t numWorker, uintptr_t numFilter);
+	/**Clean up.*/
+	~ProsynarRunStats();
+	/**
+	 * Note a queue to report on.
+	 * @param queueName The name of the queue.
+	 * @return The place to put its counts.
+	 */
+	ThreadProdComStats* addQueue(const char* queueName);
+	/**
+	 * Write a one line summary of where things are.
+	 * @param toPrint The place to write.
+	 */
+	void writeProgress(std::ostream* toPrint);
+	/**
+	 * Write a full report, as json.
+	 * @param fileName The file to write to.
+	 * @param argsP The arguments to ProSynAr.
+	 */
+	void writeReport(const char* fileName, ProsynarArgumentParser* argsP);
+
+	/**When the run started.*/
+	uintmax_t startTime;
+	/**How each merge thread spent its time.*/
+	std::vector<ProsynarWorkerStats> workStats;
+	/**The names of the queues.*/
+	std::vector<std::string> queueNames;
+	/**The last counts for the queues (allocated, so they do not move).*/
+	std::vector<ThreadProdComStats*> queueStats;
+};
+
+#endif
\ No newline at end of file
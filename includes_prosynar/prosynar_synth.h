@@ -0,0 +1,157 @@
+#ifndef PROSYNAR_SYNTH_H
+#define PROSYNAR_SYNTH_H 1
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "whodun_args.h"
+#include "whodun_randoms.h"
+#include "whodun_parse_table_genome.h"
+
+/**Parse arguments for making up reads.*/
+class ProsynarSynthArgumentParser : public ArgumentParser{
+public:
+	/**Set up a basic parser.*/
+	ProsynarSynthArgumentParser();
+	/**Tear down.*/
+	~ProsynarSynthArgumentParser();
+	int posteriorCheck();
+
+	/**The reference file.*/
+	char* refFile;
+	/**The problem region file.*/
+	char* probFile;
+	/**The file to write to.*/
+	char* outFile;
+	/**The seed for the random numbers.*/
+	intptr_t randSeed;
+	/**The number of pairs to make, about: zero to go by depth.*/
+	intptr_t numPairs;
+	/**The depth of coverage to make, if not going by pairs.*/
+	double depth;
+	/**The length of the reads.*/
+	intptr_t readLen;
+	/**The mean length of the fragments.*/
+	double insertMean;
+	/**The standard deviation of the fragment length.*/
+	double insertSD;
+	/**The probability of a base being changed.*/
+	double subRate;
+	/**The probability of a base being inserted or deleted.*/
+	double indelRate;
+	/**The longest insertion or deletion.*/
+	intptr_t maxIndel;
+	/**How much deeper to cover the problem regions.*/
+	double probBoost;
+	/**The fraction of pairs that should not look like proper pairs.*/
+	double discordFrac;
+	/**Whether to write the pairs together (name sorted), rather than by position.*/
+	bool nameSort;
+	/**The default output name.*/
+	char defOutFN[2];
+};
+
+/**A stretch of reference with the same rate of fragments.*/
+typedef struct{
+	/**The first base.*/
+	uintptr_t fromI;
+	/**The base after the last.*/
+	uintptr_t toI;
+	/**How much more common fragments are here.*/
+	double rateMult;
+} ProsynarSynthStretch;
+
+/**Make up read pairs from a reference.*/
+class ProsynarReadSynthesizer{
+public:
+	/**
+	 * Set up, loading the problem regions and the names and lengths of the references.
+	 * @param useArgs The arguments.
+	 */
+	ProsynarReadSynthesizer(ProsynarSynthArgumentParser* useArgs);
+	/**Tear down.*/
+	~ProsynarReadSynthesizer();
+	/**
+	 * Make the reads.
+	 * @param toDump The place to write them.
+	 */
+	void synthesize(CRBSAMFileWriter* toDump);
+	/**
+	 * Make the reads for one reference.
+	 * @param refI The index of the reference.
+	 * @param refSeq The sequence of the reference.
+	 * @param toDump The place to write them.
+	 */
+	void synthesizeReference(uintptr_t refI, const char* refSeq, CRBSAMFileWriter* toDump);
+	/**
+	 * Split a reference into stretches with the same rate of fragments.
+	 * @param refI The index of the reference.
+	 * @return The expected number of fragments, in units of the normal rate.
+	 */
+	double makeStretches(uintptr_t refI);
+	/**
+	 * Make a pair.
+	 * @param refI The index of the reference.
+	 * @param refSeq The sequence of the reference.
+	 * @param fragI The first base of the fragment.
+	 * @param toDump The place to write them.
+	 */
+	void synthesizeFragment(uintptr_t refI, const char* refSeq, uintptr_t fragI, CRBSAMFileWriter* toDump);
+	/**
+	 * Make a read, with errors.
+	 * @param refSeq The sequence of the reference.
+	 * @param refLen The length of the reference.
+	 * @param startI The first base of the read.
+	 * @param numBase The number of bases in the read.
+	 * @param toFill The place to put the sequence, quality, cigar and position.
+	 */
+	void synthesizeRead(const char* refSeq, uintptr_t refLen, uintptr_t startI, uintptr_t numBase, CRBSAMFileContents* toFill);
+	/**
+	 * Get the number of bases before the next error.
+	 * @return The number of clean bases.
+	 */
+	uintptr_t nextErrorSkip();
+	/**
+	 * Write out any waiting reads that start at or before a position.
+	 * @param maxPos The last position to write: -1 for everything.
+	 * @param toDump The place to write them.
+	 */
+	void flushWaiting(intptr_t maxPos, CRBSAMFileWriter* toDump);
+
+	/**The arguments.*/
+	ProsynarSynthArgumentParser* useArgs;
+	/**The random numbers.*/
+	BufferedRandomSource randSrc;
+	/**The names of the references, in file order.*/
+	std::vector<std::string> refNames;
+	/**The lengths of the references.*/
+	std::vector<uintptr_t> refLens;
+	/**The problem regions, by reference, sorted.*/
+	std::map< std::string, std::vector< std::pair<uintptr_t,uintptr_t> > > probRegs;
+	/**The number of fragments to start per base (at normal depth).*/
+	double pairRate;
+	/**The log of the chance of a base being clean.*/
+	double logClean;
+	/**The number of pairs made so far.*/
+	uintmax_t numMade;
+	/**The number of reads waiting to be written so far: used to keep ties in order.*/
+	uintmax_t numWaited;
+	/**Reads waiting for the reads before them to be written.*/
+	std::map< std::pair<intptr_t,uintmax_t>, CRBSAMFileContents* > waitEnts;
+	/**Entries free for use.*/
+	std::vector<CRBSAMFileContents*> freeEnts;
+	/**Storage for the stretches of a reference.*/
+	std::vector<ProsynarSynthStretch> refStretches;
+};
+
+/**
+ * Run the read synthesizer.
+ * @param argc The number of arguments (including the name of the subcommand).
+ * @param argv The arguments.
+ * @return The exit code.
+ */
+int prosynarSynthMain(int argc, char** argv);
+
+#endif
\ No newline at end of file
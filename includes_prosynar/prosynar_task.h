@@ -6,6 +6,135 @@
 #include "whodun_parse_table_genome.h"
 
 class ProsynarArgumentParser;
+class PackedSequenceStore;
+class GZipCompressionMethod;
+class BlockCompInStream;
+class GailAQSequenceReader;
+
+/**The number of reference bases a gail reference cache pulls in at a time.*/
+#define PROSYNAR_GAIL_CACHE_BLOCK 0x010000
+
+/**Random access to a gail reference for one thread, keeping the last stretch of reference it loaded.*/
+class ProsynarGailReferenceCache{
+public:
+	/**
+	 * Open the reference.
+	 * @param mainFN The name of the gail data file.
+	 * @param annotFN The name of the block annotation file.
+	 * @param indexFN The name of the entry index file.
+	 */
+	ProsynarGailReferenceCache(const char* mainFN, const char* annotFN, const char* indexFN);
+	/**Close the reference.*/
+	~ProsynarGailReferenceCache();
+	/**
+	 * Get part of a reference.
+	 * @param entInd The index of the entry in the gail file.
+	 * @param entLen The length of the entry.
+	 * @param fromI The first base to get.
+	 * @param toI The base after the last to get.
+	 * @param toFill The place to put the bases (replaces any contents).
+	 */
+	void getWindow(uintptr_t entInd, uintptr_t entLen, uintptr_t fromI, uintptr_t toI, std::string* toFill);
+	
+	/**The compression used for the blocks.*/
+	GZipCompressionMethod* blockComp;
+	/**The block compressed data.*/
+	BlockCompInStream* blockStr;
+	/**The gail reader.*/
+	GailAQSequenceReader* gailRead;
+	/**The entry in the cache: -1 if nothing loaded.*/
+	intptr_t cacheEnt;
+	/**The first base in the cache.*/
+	uintptr_t cacheFrom;
+	/**The cached bases.*/
+	std::string cacheSeq;
+};
+
+/**Facts about a pair, worked out as needed and shared between the filters and the merger.*/
+class ProsynarPairContext{
+public:
+	/**Set up an empty context.*/
+	ProsynarPairContext();
+	/**Tear down.*/
+	~ProsynarPairContext();
+	/**
+	 * Start looking at a new pair: forget everything about the last.
+	 * @param baseArgs The base arguments (to find the reference).
+	 * @param read1 The first part of the pair.
+	 * @param read2 The second part of the pair.
+	 */
+	void changePair(ProsynarArgumentParser* baseArgs, CRBSAMFileContents* read1, CRBSAMFileContents* read2);
+	/**
+	 * Expand the cigar string of one of the reads, if not already done: fills in cigLocs, softClips and refBounds.
+	 * @param readI The read to expand (0 or 1).
+	 * @param errRep The place to put an error message, if any.
+	 * @return Whether there was a problem.
+	 */
+	int expandCigar(int readI, std::string* errRep);
+	/**
+	 * Decode the qualities of one of the reads, if not already done.
+	 * @param readI The read (0 or 1).
+	 * @return The log10 error probabilities for the entire read.
+	 */
+	double* getQualLog10(int readI);
+	/**
+	 * Get the id of the reference the first read is on.
+	 * @return The id of the reference, or -1 if nothing knows about it.
+	 */
+	intptr_t getReferenceID();
+	/**
+	 * Get whether the sequence of the reference the first read is on is available.
+	 * @return Whether it was loaded.
+	 */
+	bool haveReference();
+	/**
+	 * Get the length of the reference the first read is on.
+	 * @return The number of bases in the reference.
+	 */
+	uintptr_t getReferenceLength();
+	/**
+	 * Get part of the reference the first read is on.
+	 * @param fromI The first base to get.
+	 * @param toI The base after the last to get.
+	 * @param toFill The place to put the bases (replaces any contents).
+	 */
+	void getReferenceWindow(uintptr_t fromI, uintptr_t toI, std::string* toFill);
+	/**
+	 * Get whether both reads are mapped to the same reference.
+	 * @return Whether both have a position and the same reference name.
+	 */
+	bool sameReference();
+	
+	/**The reads in question.*/
+	CRBSAMFileContents* reads[2];
+	/**The reference position of each base in the reads, after expandCigar.*/
+	std::vector<intptr_t> cigLocs[2];
+	/**The number of soft clipped bases at the start and end of the reads, after expandCigar.*/
+	std::pair<uintptr_t,uintptr_t> softClips[2];
+	/**The low and high reference indices covered by the reads (inclusive), after expandCigar.*/
+	std::pair<intptr_t,intptr_t> refBounds[2];
+	
+	/**The base arguments.*/
+	ProsynarArgumentParser* saveArgs;
+	/**Whether the cigars have been expanded: zero if not, one if so, negative on error.*/
+	int cigarState[2];
+	/**The problem with each cigar, if any.*/
+	std::string cigarError[2];
+	/**Whether the qualities have been decoded.*/
+	bool haveQuals[2];
+	/**The decoded qualities.*/
+	std::vector<double> qualLog10[2];
+	/**Whether the reference has been looked up.*/
+	bool haveRef;
+	/**The id of the reference.*/
+	intptr_t refID;
+	/**The name of the last reference looked up: kept between pairs.*/
+	std::string lastRefName;
+	/**The id of the last reference looked up.*/
+	intptr_t lastRefID;
+	/**The reference cache for this thread, if the reference is a gail file.*/
+	ProsynarGailReferenceCache* refCache;
+};
 
 /**Filter out pairs that should not be merged.*/
 class ProsynarFilter : public ArgumentParser{
@@ -29,6 +158,26 @@ public:
 	 * @return Whether the two can be merged (1), or should be abandoned (0) or encountered an error (-1).
 	 */
 	virtual int filterPair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* errRep) = 0;
+	/**
+	 * Examine two parts of a pair and determine whether a merge should be abandoned.
+	 * @param threadInd The thread this is.
+	 * @param pairCtx The pair, and anything already figured out about it.
+	 * @param errRep The place to put an error message, if any.
+	 * @return Whether the two can be merged (1), or should be abandoned (0) or encountered an error (-1).
+	 */
+	virtual int filterPair(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep);
+	/**
+	 * Cheaply decide whether a pair will certainly be abandoned, before it is handed to a thread.
+	 * May be called from several reading threads at once, and should not complain about anything.
+	 * @param pairCtx The pair, and anything already figured out about it.
+	 * @return Whether filterPair would return zero: false if not sure.
+	 */
+	virtual bool quickReject(ProsynarPairContext* pairCtx);
+	/**
+	 * Get whether this filter can be run before or after its neighbors without changing which pairs get through.
+	 * @return Whether the filter can be moved by --adaptive-order.
+	 */
+	virtual bool canReorder();
 };
 
 /**Merger survivors.*/
@@ -55,6 +204,47 @@ public:
 	 * @return Whether there was an error (-1) or the merge otherwise failed (1).
 	 */
 	virtual int mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep) = 0;
+	/**
+	 * Get whether this merger can produce phred scores directly.
+	 * @return Whether mergePairPhred is supported.
+	 */
+	virtual bool havePhredMerge();
+	/**
+	 * Examine two parts of a pair and determine whether a merge should be abandoned.
+	 * @param threadInd The thread this is.
+	 * @param read1 The first part of the pair.
+	 * @param read2 The second part of the pair.
+	 * @param mergeSeq The place to put the merged sequence.
+	 * @param mergePhred The place to put the merged quality, as ascii phred scores.
+	 * @param errRep The place to put an error message, if any.
+	 * @return Whether there was an error (-1) or the merge otherwise failed (1).
+	 */
+	virtual int mergePairPhred(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::string* mergePhred, std::string* errRep);
+	/**
+	 * Examine two parts of a pair and determine whether a merge should be abandoned.
+	 * @param threadInd The thread this is.
+	 * @param pairCtx The pair, and anything already figured out about it.
+	 * @param mergeSeq The place to put the merged sequence.
+	 * @param mergeQual The place to put the merged quality.
+	 * @param errRep The place to put an error message, if any.
+	 * @return Whether there was an error (-1) or the merge otherwise failed (1).
+	 */
+	virtual int mergePair(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep);
+	/**
+	 * Examine two parts of a pair and determine whether a merge should be abandoned.
+	 * @param threadInd The thread this is.
+	 * @param pairCtx The pair, and anything already figured out about it.
+	 * @param mergeSeq The place to put the merged sequence.
+	 * @param mergePhred The place to put the merged quality, as ascii phred scores.
+	 * @param errRep The place to put an error message, if any.
+	 * @return Whether there was an error (-1) or the merge otherwise failed (1).
+	 */
+	virtual int mergePairPhred(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::string* mergePhred, std::string* errRep);
+	/**
+	 * Get the number of pairs thrown out by any cheap bounds, before the full merge was attempted.
+	 * @param toFill The place to add the counts, by bound name.
+	 */
+	virtual void getPruneCounts(std::map<std::string,uintptr_t>* toFill);
 };
 
 /**Parse common arguments for prosynar.*/
@@ -69,19 +259,85 @@ public:
 	 * Load and let the sub pieces load.
 	 */
 	void performSetup();
+	/**
+	 * Load the things that do not change between runs: the reference, costs, quality mangles and problem regions.
+	 */
+	void loadShared();
+	/**
+	 * Use the things another parser has loaded, rather than loading them again.
+	 * @param loadedArgs The parser to use: must outlive this one, and must not be changed while this one is in use.
+	 */
+	void adoptShared(ProsynarArgumentParser* loadedArgs);
+	/**
+	 * Let the filters and merger prepare, and open the fail dump.
+	 */
+	void prepareRun();
 	
 	int handleUnknownArgument(int argc, char** argv, std::ostream* helpOut);
 	void printExtraGUIInformation(std::ostream* toPrint);
 	int posteriorCheck();
+	/**
+	 * Get the id for a reference, adding it if new. Only call during setup.
+	 * @param refName The name of the reference.
+	 * @return The id of the reference.
+	 */
+	uintptr_t internReference(const std::string& refName);
+	/**
+	 * Look up the id of a reference.
+	 * @param refName The name of the reference.
+	 * @return The id of the reference, or -1 if nothing knows about it.
+	 */
+	intptr_t findReferenceID(const std::string& refName);
+	/**
+	 * Get whether the sequence of a reference is available.
+	 * @param refID The id of the reference.
+	 * @return Whether it was loaded.
+	 */
+	bool haveReferenceSequence(intptr_t refID);
+	/**
+	 * Get the length of a reference.
+	 * @param refID The id of the reference: must have a sequence.
+	 * @return The number of bases in the reference.
+	 */
+	uintptr_t getReferenceLength(uintptr_t refID);
+	/**
+	 * Get part of a reference. Safe to call from multiple threads, so long as each has its own cache.
+	 * @param refID The id of the reference: must have a sequence.
+	 * @param fromI The first base to get.
+	 * @param toI The base after the last to get.
+	 * @param toFill The place to put the bases (replaces any contents).
+	 * @param useCache The place to remember a gail reference: made if needed.
+	 */
+	void getReferenceWindow(uintptr_t refID, uintptr_t fromI, uintptr_t toI, std::string* toFill, ProsynarGailReferenceCache** useCache);
+	/**
+	 * Get whether the reference is a gail file.
+	 * @return Whether the reference is read on demand from a gail file.
+	 */
+	bool referenceIsGail();
+	/**
+	 * Open the gail reference for a thread.
+	 * @return The opened reference: will need to delete.
+	 */
+	ProsynarGailReferenceCache* openGailReference();
+	/**
+	 * Convert the --ref file into a gail reference.
+	 */
+	void makeGailReference();
 	
 	/**Standard lock on stderr.*/
 	void* errLock;
+	/**The place to write problems and reports during a run (protected by errLock): stderr, unless whoever runs this wants them elsewhere.*/
+	std::ostream* errOut;
 	/**The file to write merged sequences to.*/
 	char* seqOutFile;
 	/**The sam file to write merged sequences to.*/
 	char* mergeSamOutFile;
 	/**The reference file.*/
 	char* refFile;
+	/**The packed reference image.*/
+	char* refPackFile;
+	/**The gail reference to build.*/
+	char* makeGailFile;
 	/**The problem region file.*/
 	char* probFile;
 	/**The cost specification file.*/
@@ -92,15 +348,55 @@ public:
 	char* failDumpFile;
 	/**The number of threads to use.*/
 	intptr_t numThread;
+	/**The number of threads to read indexed bam files with, in stretches: zero to read straight through.*/
+	intptr_t numShardThread;
+	/**The threads everything runs on, once set up: filters and mergers can hand work off to these.*/
+	ThreadPool* usePool;
+	/**Whether to report how many pairs the merger bounds threw out.*/
+	bool reportPrune;
+	/**The number of seconds between progress reports: zero for none.*/
+	intptr_t progressSecs;
+	/**The file to write a report on the run to, if any.*/
+	char* statsFile;
+	/**Whether each thread should reorder the filters as it learns which are cheap and which throw out the most.*/
+	bool adaptiveOrder;
+	/**Whether to write merged pairs in the order they were read, rather than as they finish.*/
+	bool orderedOutput;
 	/**The names of the sam files to read from.*/
 	std::vector<const char*> samNames;
 	/**The filters to use.*/
 	std::vector<ProsynarFilter*> useFilters;
+	/**The name each filter was asked for by.*/
+	std::vector<std::string> filterNames;
 	/**The merge method to use.*/
 	ProsynarMerger* useMerger;
+	/**The name the merger was asked for by.*/
+	std::string mergerName;
 	
 	/**the reference sequences: map from reference name to reference sequence*/
 	std::map< std::string, std::string > allRefs;
+	/**The name of each known reference, by id.*/
+	std::vector<std::string> refNames;
+	/**The id of each known reference, by name.*/
+	std::map<std::string,uintptr_t> refIDs;
+	/**The sequence of each known reference, by id: null if not loaded (or in the packed image).*/
+	std::vector<std::string*> refSeqs;
+	/**The packed reference, if in use.*/
+	PackedSequenceStore* refPack;
+	/**The parser the reference and defaults were taken from, if not loaded here.*/
+	ProsynarArgumentParser* sharedFrom;
+	/**The index of each known reference in the packed reference, by id: -1 if not present.*/
+	std::vector<intptr_t> refPackInds;
+	/**The block annotation file of a gail reference.*/
+	std::string refGailAnnot;
+	/**The entry index file of a gail reference.*/
+	std::string refGailIndex;
+	/**The index of each entry in the gail reference, by name.*/
+	std::map<std::string,uintptr_t> refGailEntries;
+	/**The length of each entry in the gail reference.*/
+	std::vector<uintptr_t> refGailLens;
+	/**The index of each known reference in the gail reference, by id: -1 if not present.*/
+	std::vector<intptr_t> refGailInds;
 	/**The sam file to write failed merges to.*/
 	OutStream* failDumpS;
 	/**The sam file to write failed merges to.*/
@@ -128,6 +424,35 @@ public:
 	char defOutFN[2];
 };
 
+/**
+ * Lay out a table keyed by reference name by reference id, interning any new names.
+ * @param baseArgs The base arguments (holding the ids).
+ * @param fromMap The table to lay out.
+ * @param toFill The place to put the entries: null for references not in the table.
+ */
+template<typename T>
+void prosynarTableByReferenceID(ProsynarArgumentParser* baseArgs, std::map<std::string,T>* fromMap, std::vector<T*>* toFill){
+	toFill->clear();
+	typename std::map<std::string,T>::iterator mapIt;
+	for(mapIt = fromMap->begin(); mapIt != fromMap->end(); mapIt++){
+		uintptr_t curID = baseArgs->internReference(mapIt->first);
+		if(curID >= toFill->size()){ toFill->resize(curID+1, 0); }
+		(*toFill)[curID] = &(mapIt->second);
+	}
+}
+
+/**
+ * Get an entry of a table laid out by reference id.
+ * @param fromTable The table.
+ * @param refID The id of the reference.
+ * @return The entry, or null if not present.
+ */
+template<typename T>
+T* prosynarGetByReferenceID(std::vector<T*>* fromTable, intptr_t refID){
+	if((refID < 0) || ((uintptr_t)refID >= fromTable->size())){ return 0; }
+	return (*fromTable)[refID];
+}
+
 /**
  * Get the names of the prosynar filters, and factories for them.
  * @param toFill The place to put the stuff.
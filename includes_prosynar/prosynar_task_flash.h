@@ -2,6 +2,7 @@
 #define PROSYNAR_TASK_FLASH_H 1
 
 #include "prosynar_task.h"
+#include "whodun_align_merge.h"
 
 /**Merge by sliding until the largest number of matches found.*/
 class FLASHMerger : public ProsynarMerger{
@@ -15,6 +16,31 @@ public:
 	int posteriorCheck();
 	void initialize(ProsynarArgumentParser* baseArgs);
 	int mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep);
+	int mergePair(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep);
+	bool havePhredMerge();
+	int mergePairPhred(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::string* mergePhred, std::string* errRep);
+	int mergePairPhred(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::string* mergePhred, std::string* errRep);
+	void getPruneCounts(std::map<std::string,uintptr_t>* toFill);
+	
+	/**
+	 * Do the work of merging, leaving the result in the merger for this thread.
+	 * @param threadInd The thread this is.
+	 * @param pairCtx The pair, and anything already figured out about it.
+	 * @param errRep The place to put an error message, if any.
+	 * @return Whether there was an error (-1) or the merge otherwise failed (1).
+	 */
+	int buildMerge(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep);
+	
+	/**
+	 * Find the best overlap between two (oriented) sequences.
+	 * @param threadInd The thread this is.
+	 * @param seqL The left sequence.
+	 * @param qualL The left quality.
+	 * @param seqR The right sequence.
+	 * @param qualR The right quality.
+	 * @return The amount of overlap and its mismatch ratio.
+	 */
+	virtual std::pair<uintptr_t,double> findBestOverlap(int threadInd, std::vector<char>* seqL, std::vector<char>* qualL, std::vector<char>* seqR, std::vector<char>* qualR);
 	
 	/**The required number of bases of overlap.*/
 	intptr_t reqOverlap;
@@ -29,36 +55,51 @@ public:
 	
 	/**Save the base arguments.*/
 	ProsynarArgumentParser* saveArgs;
-	/**Places to store the cigar locations.*/
-	std::vector< std::vector<intptr_t> > cigLocSet;
 	/**Places to store sequences.*/
 	std::vector< std::vector<char> > seqASet;
 	/**Places to store sequences.*/
 	std::vector< std::vector<char> > seqqASet;
 	/**Places to store sequences.*/
-	std::vector< std::vector<double> > seqqdASet;
-	/**Places to store sequences.*/
 	std::vector< std::vector<char> > seqBSet;
 	/**Places to store sequences.*/
 	std::vector< std::vector<char> > seqqBSet;
 	/**Places to store sequences.*/
-	std::vector< std::vector<double> > seqqdBSet;
-	/**Places to store sequences.*/
 	std::vector< std::vector<char> > seqBRSet;
 	/**Places to store sequences.*/
 	std::vector< std::vector<char> > seqqBRSet;
-	/**Places to store sequences.*/
-	std::vector< std::vector<double> > seqqdBRSet;
-	/**Places to store infix.*/
-	std::vector< std::vector<int> > seqILSet;
-	/**Places to store sequences.*/
-	std::vector< std::vector<double> > seqdILSet;
-	/**Places to store infix.*/
-	std::vector< std::vector<int> > seqIRSet;
-	/**Places to store sequences.*/
-	std::vector< std::vector<double> > seqdIRSet;
+	/**Places to build merged sequences.*/
+	std::vector<AlignedSequenceMerger> mergeSet;
+	/**The number of pairs where every overlap went over the mismatch budget, by thread.*/
+	std::vector<uintptr_t> misPruneSet;
 };
 
+/**
+ * Find the best overlap using the flash method.
+ * @param seqL The left sequence.
+ * @param qualL The left quality;
+ * @param seqR The right sequence.
+ * @param qualR The right quality.
+ * @param minOver The minimum possible overlap.
+ * @param maxExp THe maximum expected overlap.
+ * @param worstRat The worst mismatch ratio of interest: overlaps past this are abandoned early.
+ * @return The amount of overlap and its mismatch ratio (infinite if nothing was under worstRat).
+ */
+std::pair<uintptr_t,double> flashFindBestOverlap(std::vector<char>* seqL, std::vector<char>* qualL, std::vector<char>* seqR, std::vector<char>* qualR, uintptr_t minOver, uintptr_t maxExp, double worstRat);
+
+/**
+ * Find the best overlap using the flash method, only looking at some overlaps.
+ * @param seqL The left sequence.
+ * @param qualL The left quality;
+ * @param seqR The right sequence.
+ * @param qualR The right quality.
+ * @param numCand The number of candidate overlaps.
+ * @param candOver The candidate overlaps, in ascending order.
+ * @param maxExp THe maximum expected overlap.
+ * @param worstRat The worst mismatch ratio of interest: overlaps past this are abandoned early.
+ * @return The amount of overlap and its mismatch ratio (infinite if nothing was under worstRat).
+ */
+std::pair<uintptr_t,double> flashFindBestCandidateOverlap(std::vector<char>* seqL, std::vector<char>* qualL, std::vector<char>* seqR, std::vector<char>* qualR, uintptr_t numCand, uintptr_t* candOver, uintptr_t maxExp, double worstRat);
+
 /**Factory function.*/
 ProsynarMerger* factoryFlashMerger();
 
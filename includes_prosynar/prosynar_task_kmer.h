@@ -0,0 +1,37 @@
+#ifndef PROSYNAR_TASK_KMER_H
+#define PROSYNAR_TASK_KMER_H 1
+
+#include "prosynar_task_flash.h"
+
+/**Merge the way flash does, but only look at overlaps that share a kmer.*/
+class KmerSeedMerger : public FLASHMerger{
+public:
+	/**Set up a basic parser.*/
+	KmerSeedMerger();
+	/**Tear down.*/
+	~KmerSeedMerger();
+	int posteriorCheck();
+	void initialize(ProsynarArgumentParser* baseArgs);
+	std::pair<uintptr_t,double> findBestOverlap(int threadInd, std::vector<char>* seqL, std::vector<char>* qualL, std::vector<char>* seqR, std::vector<char>* qualR);
+
+	/**The size of the kmers to seed with.*/
+	intptr_t kmerSize;
+	/**The number of shared kmers an overlap needs to be considered.*/
+	intptr_t minSeedHits;
+
+	/**The first kmer index for each hash bucket.*/
+	std::vector< std::vector<intptr_t> > hashHeadSet;
+	/**The next kmer index in the bucket.*/
+	std::vector< std::vector<intptr_t> > hashNextSet;
+	/**The packed kmers of the left sequence.*/
+	std::vector< std::vector<uint32_t> > kmerValSet;
+	/**The number of hits for each overlap.*/
+	std::vector< std::vector<uintptr_t> > overHitSet;
+	/**The overlaps to verify.*/
+	std::vector< std::vector<uintptr_t> > candOverSet;
+};
+
+/**Factory function.*/
+ProsynarMerger* factoryKmerSeedMerger();
+
+#endif
\ No newline at end of file
@@ -2,17 +2,7 @@
 #define PROSYNAR_TASK_NAIMERGE_H 1
 
 #include "prosynar_task.h"
-
-/**
- * Merge two sequences with expanded indels (-1 in the sequence): both sequences have basewise correspondence.
- * @param seqA THe first sequence.
- * @param qualA The qualities.
- * @param seqB THe second sequence.
- * @param qualB The qualities.
- * @param mergeSeq The place to put the merged sequence.
- * @param mergeQual The place to put the merged quality.
- */
-void mergeIndelExpandedSequences(std::vector<int>* seqA, std::vector<double>* qualA, std::vector<int>* seqB, std::vector<double>* qualB, std::string* mergeSeq, std::vector<double>* mergeQual);
+#include "whodun_align_merge.h"
 
 /**Merge by alignment, with a simple overlap threshold.*/
 class SimpleAlignMerger : public ProsynarMerger{
@@ -26,6 +16,20 @@ public:
 	int posteriorCheck();
 	void initialize(ProsynarArgumentParser* baseArgs);
 	int mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep);
+	int mergePair(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep);
+	bool havePhredMerge();
+	int mergePairPhred(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::string* mergePhred, std::string* errRep);
+	int mergePairPhred(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::string* mergePhred, std::string* errRep);
+	void getPruneCounts(std::map<std::string,uintptr_t>* toFill);
+	
+	/**
+	 * Do the work of merging, leaving the result in the merger for this thread.
+	 * @param threadInd The thread this is.
+	 * @param pairCtx The pair, and anything already figured out about it.
+	 * @param errRep The place to put an error message, if any.
+	 * @return Whether there was an error (-1) or the merge otherwise failed (1).
+	 */
+	int buildMerge(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep);
 	
 	/**The required number of bases of overlap.*/
 	intptr_t reqOverlap;
@@ -35,6 +39,10 @@ public:
 	bool softReclaim;
 	/**The biquality mangle.*/
 	char* qualmFile;
+	/**The size of the kmers to look for before aligning.*/
+	intptr_t seedSize;
+	/**The number of distinct shared kmers needed before aligning: zero to always align.*/
+	intptr_t minSeedHits;
 	
 	/**Save the base arguments.*/
 	ProsynarArgumentParser* saveArgs;
@@ -45,8 +53,6 @@ public:
 	/**The quality mangle.*/
 	PositionalBiQualityMangleSet bigMang;
 	
-	/**Places to store the cigar locations.*/
-	std::vector< std::vector<intptr_t> > cigLocSet;
 	/**Places to store mangled costs.*/
 	std::vector<PositionDependentCostKDTree> costSet;
 	/**Places to store sequences.*/
@@ -54,27 +60,34 @@ public:
 	/**Places to store sequences.*/
 	std::vector< std::vector<char> > seqqASet;
 	/**Places to store sequences.*/
-	std::vector< std::vector<double> > seqqdASet;
-	/**Places to store sequences.*/
 	std::vector< std::string > seqBSet;
 	/**Places to store sequences.*/
 	std::vector< std::vector<char> > seqqBSet;
-	/**Places to store sequences.*/
-	std::vector< std::vector<double> > seqqdBSet;
-	/**Places to store infix.*/
-	std::vector< std::vector<int> > seqILSet;
-	/**Places to store sequences.*/
-	std::vector< std::vector<double> > seqdILSet;
-	/**Places to store infix.*/
-	std::vector< std::vector<int> > seqIRSet;
-	/**Places to store sequences.*/
-	std::vector< std::vector<double> > seqdIRSet;
+	/**Places to build merged sequences.*/
+	std::vector<AlignedSequenceMerger> mergeSet;
 	/**Saved iterations.*/
 	std::vector<LinearPairwiseAlignmentIteration*> runIters;
 	/**Place to store running alignments.*/
 	std::vector<PositionDependentAffineGapLinearPairwiseAlignment> saveAlns;
+	/**Places to store the kmers of the first sequence.*/
+	std::vector< std::vector<uint32_t> > kmerASet;
+	/**Places to store the kmers of the second sequence.*/
+	std::vector< std::vector<uint32_t> > kmerBSet;
+	/**The number of pairs thrown out for lack of shared kmers, by thread.*/
+	std::vector<uintptr_t> seedPruneSet;
 };
 
+/**
+ * Count the number of distinct kmers two sequences share.
+ * @param seqA The first sequence.
+ * @param seqB The second sequence.
+ * @param kmerSize The size of the kmers (at most 16).
+ * @param kmerA Storage for the kmers of the first sequence.
+ * @param kmerB Storage for the kmers of the second sequence.
+ * @return The number of distinct shared kmers.
+ */
+uintptr_t alignMergeCountSharedKmers(std::string* seqA, std::string* seqB, uintptr_t kmerSize, std::vector<uint32_t>* kmerA, std::vector<uint32_t>* kmerB);
+
 /**Factory function.*/
 ProsynarMerger* factorySimpleAlignMerger();
 
@@ -2,6 +2,7 @@
 #define PROSYNAR_TASK_PEAR_H 1
 
 #include "prosynar_task.h"
+#include "whodun_align_merge.h"
 
 /**Merge by sliding until the largest number of matches found.*/
 class PEARMerger : public ProsynarMerger{
@@ -15,6 +16,20 @@ public:
 	int posteriorCheck();
 	void initialize(ProsynarArgumentParser* baseArgs);
 	int mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep);
+	int mergePair(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep);
+	bool havePhredMerge();
+	int mergePairPhred(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::string* mergePhred, std::string* errRep);
+	int mergePairPhred(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::string* mergePhred, std::string* errRep);
+	void getPruneCounts(std::map<std::string,uintptr_t>* toFill);
+	
+	/**
+	 * Do the work of merging, leaving the result in the merger for this thread.
+	 * @param threadInd The thread this is.
+	 * @param pairCtx The pair, and anything already figured out about it.
+	 * @param errRep The place to put an error message, if any.
+	 * @return Whether there was an error (-1) or the merge otherwise failed (1).
+	 */
+	int buildMerge(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep);
 	
 	/**The required number of bases of overlap.*/
 	intptr_t reqOverlap;
@@ -33,8 +48,6 @@ public:
 	
 	/**Save the base arguments.*/
 	ProsynarArgumentParser* saveArgs;
-	/**Places to store the cigar locations.*/
-	std::vector< std::vector<intptr_t> > cigLocSet;
 	/**Places to store sequences.*/
 	std::vector< std::vector<char> > seqASet;
 	/**Places to store sequences.*/
@@ -53,16 +66,25 @@ public:
 	std::vector< std::vector<char> > seqqBRSet;
 	/**Places to store sequences.*/
 	std::vector< std::vector<double> > seqqdBRSet;
-	/**Places to store infix.*/
-	std::vector< std::vector<int> > seqILSet;
-	/**Places to store sequences.*/
-	std::vector< std::vector<double> > seqdILSet;
-	/**Places to store infix.*/
-	std::vector< std::vector<int> > seqIRSet;
-	/**Places to store sequences.*/
-	std::vector< std::vector<double> > seqdIRSet;
+	/**Places to build merged sequences.*/
+	std::vector<AlignedSequenceMerger> mergeSet;
+	/**The number of pairs thrown out as soon as the significance test was sure to fail, by thread.*/
+	std::vector<uintptr_t> pvalPruneSet;
 };
 
+/**
+ * Find the best overlap using the pear method.
+ * @param seqL The left sequence.
+ * @param qualL The left quality (log10 of the error probability);
+ * @param seqR The right sequence.
+ * @param qualR The right quality (log10 of the error probability).
+ * @param matPts The points for a match.
+ * @param mmatPts The points for a mismatch.
+ * @param beatScore The score to beat: overlaps that cannot do better are abandoned early.
+ * @return The number of bases of overlap, and the score.
+ */
+std::pair<uintptr_t,double> pearFindBestOverlap(std::vector<char>* seqL, std::vector<double>* qualL, std::vector<char>* seqR, std::vector<double>* qualR, double matPts, double mmatPts, double beatScore);
+
 /**Factory function.*/
 ProsynarMerger* factoryPearMerger();
 
@@ -15,16 +15,13 @@ public:
 	int posteriorCheck();
 	void initialize(ProsynarArgumentParser* baseArgs);
 	int filterPair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* errRep);
+	int filterPair(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep);
+	bool quickReject(ProsynarPairContext* pairCtx);
 	
 	/**The required number of bases of overlap.*/
 	intptr_t reqOverlap;
 	/**Save the base arguments.*/
 	ProsynarArgumentParser* saveArgs;
-	
-	/**Places to store the cigar locations.*/
-	std::vector< std::vector<intptr_t> > cigLocSet;
-	/**Places to store names.*/
-	std::vector<std::string> nameTmpSet;
 };
 
 /**Factory function.*/
@@ -41,6 +38,8 @@ public:
 	int posteriorCheck();
 	void initialize(ProsynarArgumentParser* baseArgs);
 	int filterPair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* errRep);
+	int filterPair(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep);
+	bool quickReject(ProsynarPairContext* pairCtx);
 	
 	/**The reference cost specification file.*/
 	char* costRefFile;
@@ -77,9 +76,11 @@ public:
 	std::map<std::string,PositionDependentCostKDTree> allRegCosts;
 	/**The quality mangle stuff, if provided.*/
 	std::map<std::string, PositionDependentQualityMangleSet> allQualMangs;
+	/**The cost information in use, by reference id.*/
+	std::vector<PositionDependentCostKDTree*> idRegCosts;
+	/**The quality mangles in use, by reference id.*/
+	std::vector<PositionDependentQualityMangleSet*> idQualMangs;
 	
-	/**Places to store names.*/
-	std::vector<std::string> nameTmpSet;
 	/**Places to store alignment bounds.*/
 	std::vector< std::vector< std::pair<intptr_t,intptr_t> > > alnBndsSet1;
 	/**Places to store alignment probabilities.*/
@@ -88,8 +89,6 @@ public:
 	std::vector< std::vector< std::pair<intptr_t,intptr_t> > > alnBndsSet2;
 	/**Places to store alignment probabilities.*/
 	std::vector< std::vector<double> > alnProsSet2;
-	/**Places to store the cigar locations.*/
-	std::vector< std::vector<intptr_t> > cigLocSet;
 	/**Places to store reference.*/
 	std::vector<std::string> refTmpSet;
 	/**Places to store read.*/
@@ -100,8 +99,6 @@ public:
 	std::vector< std::vector<intptr_t> > scoreSet;
 	/**Places to store the scores.*/
 	std::vector< std::vector<uintptr_t> > scoreSeenSet;
-	/**Places to store read qvalues.*/
-	std::vector< std::vector<double> > readQPTmpSet;
 	/**Save rebased costs.*/
 	std::vector<PositionDependentCostKDTree> rebaseCosts;
 	/**Save mangled costs.*/
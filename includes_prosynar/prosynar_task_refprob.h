@@ -3,6 +3,134 @@
 
 #include "prosynar_task.h"
 
+/**The number of bases (as a shift) in each bucket of a problem region index.*/
+#define PROBREG_BUCKET_SHIFT 10
+
+/**The regions of one reference, laid out so the region holding a base can be found without a search.*/
+class ProblematicRegionIndex{
+public:
+	/**
+	 * Lay out the regions of a reference.
+	 * @param probRegs The problem regions, sorted and not overlapping.
+	 * @param refLen The length of the reference.
+	 * @param refName The name of the reference, for errors.
+	 */
+	void build(std::vector< std::pair<intptr_t,intptr_t> >* probRegs, uintptr_t refLen, const std::string& refName);
+	/**
+	 * Find the region a base is in.
+	 * @param baseI The base in question: must be on the reference.
+	 * @return The index of the last region starting at or before the base.
+	 */
+	uintptr_t findRegion(intptr_t baseI);
+	/**
+	 * Find the region the last base before a point is in.
+	 * @param endI The point in question: must be on the reference, and positive.
+	 * @return The index of the first region ending at or after the point.
+	 */
+	uintptr_t findRegionEnd(intptr_t endI);
+	
+	/**The regions, problematic and not, covering the reference.*/
+	std::vector< std::pair<intptr_t,intptr_t> > regions;
+	/**Whether each region is problematic.*/
+	std::vector<bool> regionProb;
+	/**The region holding the first base of each bucket.*/
+	std::vector<uintptr_t> bucketRegion;
+};
+
+/**Where a pair falls relative to the problem regions.*/
+class ProblematicRegionPairLocus{
+public:
+	/**The index of the leftmost read in the pair context.*/
+	int read1I;
+	/**The index of the rightmost read in the pair context.*/
+	int read2I;
+	/**The bounds of the leftmost read (end exclusive).*/
+	std::pair<intptr_t,intptr_t> read1B;
+	/**The bounds of the rightmost read (end exclusive).*/
+	std::pair<intptr_t,intptr_t> read2B;
+	/**The length of the reference.*/
+	uintptr_t selRefLen;
+	/**The regions of the reference.*/
+	ProblematicRegionIndex* selIndex;
+	/**The costs for the reference.*/
+	PositionDependentCostKDTree* selCost;
+	/**The quality mangles for the reference, if any.*/
+	PositionDependentQualityMangleSet* selMang;
+	/**The region the leftmost read starts in.*/
+	uintptr_t read1LPI;
+	/**The region the leftmost read ends in.*/
+	uintptr_t read1HPI;
+	/**The region the rightmost read starts in.*/
+	uintptr_t read2LPI;
+	/**The region the rightmost read ends in.*/
+	uintptr_t read2HPI;
+};
+
+/**A pair that can be merged, as far as the problem regions go.*/
+#define PROBREG_CLASS_GOOD 1
+/**A pair that should not be merged.*/
+#define PROBREG_CLASS_BAD 0
+/**A pair with a problem.*/
+#define PROBREG_CLASS_ERROR -1
+/**A pair that needs a closer look.*/
+#define PROBREG_CLASS_CHECK 2
+
+/**The number of alignment cells (summed over a pair) it takes to be worth handing likelihoods off to other threads.*/
+#define PROBREG_SPLIT_CELLS 0x004000
+
+class ProblematicRegionFilter;
+
+/**One of the likelihoods the problem region filter needs: that a stretch of read came from a stretch of reference.*/
+class ProblematicRegionLikelihoodJob{
+public:
+	/**Set up empty.*/
+	ProblematicRegionLikelihoodJob();
+	/**Tear down.*/
+	~ProblematicRegionLikelihoodJob();
+	/**The filter this is for.*/
+	ProblematicRegionFilter* forFilter;
+	/**The stretch of read.*/
+	std::string* readSeq;
+	/**The qualities of the stretch of read.*/
+	std::vector<char>* readQual;
+	/**The (log10) error probabilities of the stretch of read.*/
+	double* readQualP;
+	/**The first base of the stretch of reference.*/
+	uintptr_t refFrom;
+	/**The base after the last of the stretch of reference.*/
+	uintptr_t refTo;
+	/**The stretch of reference.*/
+	std::string refSeq;
+	/**The costs for the reference.*/
+	PositionDependentCostKDTree* selCost;
+	/**The quality mangles for the reference, if any.*/
+	PositionDependentQualityMangleSet* selMang;
+	/**The likelihood, once run.*/
+	double result;
+	/**The problem running it, if any.*/
+	std::string errMess;
+	/**Storage for rebased costs.*/
+	PositionDependentCostKDTree rebaseCost;
+	/**Storage for mangled costs.*/
+	PositionDependentCostKDTree mangleCost;
+	/**Storage for rebased mangles.*/
+	PositionDependentQualityMangleSet rebaseMang;
+	/**Storage for the alignment.*/
+	PositionDependentAffineGapLinearPairwiseAlignment workAln;
+	/**The iteration token for the alignment, if made.*/
+	LinearPairwiseAlignmentIteration* workIter;
+	/**Storage for the scores.*/
+	std::vector<intptr_t> mainScores;
+	/**Storage for the number of times to see each score.*/
+	std::vector<uintptr_t> scoreSeen;
+};
+
+/**
+ * Work out a likelihood.
+ * @param theJob The ProblematicRegionLikelihoodJob to run.
+ */
+void problematicRegionLikelihood(void* theJob);
+
 class ProblematicRegionFilter : public ProsynarFilter{
 public:
 	/**Set up a default filter.*/
@@ -14,6 +142,33 @@ public:
 	int posteriorCheck();
 	void initialize(ProsynarArgumentParser* baseArgs);
 	int filterPair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* errRep);
+	int filterPair(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep);
+	bool quickReject(ProsynarPairContext* pairCtx);
+	/**
+	 * Set up a likelihood to work out.
+	 * @param toFill The job to set up.
+	 * @param pairCtx The pair.
+	 * @param readSeq The stretch of read.
+	 * @param readQual The qualities of the stretch of read.
+	 * @param readQualP The (log10) error probabilities of the stretch of read.
+	 * @param refGot The stretch of reference.
+	 * @param pairLoc Where the pair is.
+	 */
+	void prepareLikelihood(ProblematicRegionLikelihoodJob* toFill, ProsynarPairContext* pairCtx, std::string* readSeq, std::vector<char>* readQual, double* readQualP, std::pair<uintptr_t,uintptr_t> refGot, ProblematicRegionPairLocus* pairLoc);
+	/**
+	 * Work out some likelihoods, handing them off to other threads if they are big.
+	 * @param allJobs The jobs to run.
+	 * @param numJob The number of jobs.
+	 */
+	void runLikelihoods(ProblematicRegionLikelihoodJob* allJobs, uintptr_t numJob);
+	/**
+	 * Figure out where a pair falls, and whether that settles things. Safe to call from any thread.
+	 * @param pairCtx The pair, and anything already figured out about it.
+	 * @param errRep The place to put an error message, if any.
+	 * @param toFill The place to put the location of the pair, if it needs a closer look.
+	 * @return PROBREG_CLASS_GOOD, PROBREG_CLASS_BAD, PROBREG_CLASS_ERROR or PROBREG_CLASS_CHECK.
+	 */
+	int classifyPair(ProsynarPairContext* pairCtx, std::string* errRep, ProblematicRegionPairLocus* toFill);
 	
 	/**The problem region file.*/
 	char* probFile;
@@ -41,10 +196,8 @@ public:
 	/**Save the base arguments.*/
 	ProsynarArgumentParser* saveArgs;
 	
-	/**Whether the expanded regions are problematic.*/
-	std::map<std::string, std::vector<bool> > expandProbRegP;
-	/**The regions of intereset.*/
-	std::map<std::string, std::vector< std::pair<intptr_t,intptr_t> > > expandProbReg;
+	/**The regions of interest, by reference id.*/
+	std::vector<ProblematicRegionIndex> expandProbIndex;
 	
 	/**The problematic regions this uses.*/
 	std::map< std::string , std::vector< std::pair<intptr_t,intptr_t> > >* useProbReg;
@@ -59,37 +212,19 @@ public:
 	std::map<std::string,PositionDependentCostKDTree> allRegCosts;
 	/**The quality mangle stuff, if provided.*/
 	std::map<std::string, PositionDependentQualityMangleSet> allQualMangs;
+	/**The cost information in use, by reference id.*/
+	std::vector<PositionDependentCostKDTree*> idRegCosts;
+	/**The quality mangles in use, by reference id.*/
+	std::vector<PositionDependentQualityMangleSet*> idQualMangs;
 	
-	/**Places to store the cigar locations.*/
-	std::vector< std::vector<intptr_t> > cigLocSet1;
-	/**Places to store the cigar locations.*/
-	std::vector< std::vector<intptr_t> > cigLocSet2;
-	/**Places to store names.*/
-	std::vector<std::string> nameTmpSet;
-	/**Places to store read sequence.*/
+	/**Places to store read sequence: two per thread.*/
 	std::vector<std::string> seqTmpSet;
-	/**Places to store read sequence.*/
+	/**Places to store read quality: two per thread.*/
 	std::vector< std::vector<char> > qualTmpSet;
-	/**Places to store reference sequence.*/
-	std::vector<std::string> refATmpSet;
-	/**Places to store reference sequence.*/
-	std::vector<std::string> refBTmpSet;
-	/**Places to store the scores.*/
-	std::vector< std::vector<intptr_t> > scoreSet;
-	/**Places to store the scores.*/
-	std::vector< std::vector<uintptr_t> > scoreSeenSet;
-	/**Places to store read qvalues.*/
-	std::vector< std::vector<double> > readQPTmpSet;
-	/**Save rebased costs.*/
-	std::vector<PositionDependentCostKDTree> rebaseCosts;
-	/**Save mangled costs.*/
-	std::vector<PositionDependentCostKDTree> mangleCosts;
-	/**Save rebased mangles.*/
-	std::vector<PositionDependentQualityMangleSet> rebaseMangs;
-	/**Save alignments.*/
-	std::vector<PositionDependentAffineGapLinearPairwiseAlignment> workAlns;
-	/**Save iteration tokens.*/
-	std::vector<LinearPairwiseAlignmentIteration*> workIters;
+	/**The likelihoods to work out: four per thread.*/
+	std::vector<ProblematicRegionLikelihoodJob> likeJobs;
+	/**The threads to hand big likelihoods off to, if more than one thread (not owned).*/
+	ThreadPool* subPool;
 };
 
 /**Factory function.*/
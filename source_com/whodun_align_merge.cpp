@@ -1,173 +1,296 @@
 #include "whodun_align_merge.h"
 
 #include <math.h>
+#include <string.h>
+#include <algorithm>
+
+unsigned char alignMergeAsciiToPhred(unsigned char toConv){
+	if(toConv < 33){ return 0; }
+	if(toConv > (33 + ALIGNMERGE_PHRED_MAX)){ return ALIGNMERGE_PHRED_MAX; }
+	return toConv - 33;
+}
+
+/**
+ * Turn a log10 probability into a phred score, rounding the same way writing a fastq would.
+ * @param toConv The log10 probability.
+ * @return The phred score.
+ */
+unsigned char AlignedSequenceMerger_log10ToPhred(double toConv){
+	return fastaLog10ProbToPhred(toConv) - 33;
+}
+
+AlignedSequenceMerger::AlignedSequenceMerger(){
+	curIter = 0;
+	numInfix = 0;
+	mergeLen = 0;
+	changeMethod(ALIGNMERGE_METHOD_POSTERIOR);
+}
+
+AlignedSequenceMerger::AlignedSequenceMerger(int mergeMeth){
+	curIter = 0;
+	numInfix = 0;
+	mergeLen = 0;
+	changeMethod(mergeMeth);
+}
 
-AlignedSequenceMerger::AlignedSequenceMerger(){}
 AlignedSequenceMerger::~AlignedSequenceMerger(){}
 
+void AlignedSequenceMerger::changeMethod(int mergeMeth){
+	mergeMethod = mergeMeth;
+	double phredErr[ALIGNMERGE_PHRED_COUNT];
+	for(int i = 0; i<ALIGNMERGE_PHRED_COUNT; i++){
+		phredLog10[i] = fastaPhredToLog10Prob(i + 33);
+		phredErr[i] = pow(10.0, phredLog10[i]);
+	}
+	for(int wi = 0; wi<ALIGNMERGE_PHRED_COUNT; wi++){
+		double errW = phredErr[wi];
+		for(int li = 0; li<ALIGNMERGE_PHRED_COUNT; li++){
+			double errL = phredErr[li];
+			int tabI = wi*ALIGNMERGE_PHRED_COUNT + li;
+			gapQual[tabI] = AlignedSequenceMerger_log10ToPhred(log10((errW + errL)/2.0));
+			switch(mergeMeth){
+				case ALIGNMERGE_METHOD_FLASH:
+					matchQual[tabI] = wi;
+					mismatchQual[tabI] = AlignedSequenceMerger_log10ToPhred(-0.2);
+					break;
+				case ALIGNMERGE_METHOD_PEAR:
+					matchQual[tabI] = std::min(wi + li, ALIGNMERGE_PHRED_MAX);
+					mismatchQual[tabI] = wi;
+					break;
+				case ALIGNMERGE_METHOD_POSTERIOR:
+				default:
+				{
+					double numVal = errW*errL / 3;
+					double denVal = 1 - errW - errL + 4*errW*errL/3.0;
+					matchQual[tabI] = AlignedSequenceMerger_log10ToPhred(log10(numVal/denVal));
+					numVal = errW * (1.0 - errL/3.0);
+					denVal = errW + errL - 4*errW*errL/3.0;
+					mismatchQual[tabI] = AlignedSequenceMerger_log10ToPhred(log10(numVal/denVal));
+				}
+			}
+		}
+	}
+}
+
+void AlignedSequenceMerger::prepareStorage(){
+	uintptr_t maxMerge = saveSeqA.size() + saveSeqB.size();
+	if(mergeSeq.size() < maxMerge){
+		mergeSeq.resize(maxMerge);
+		mergeQual.resize(maxMerge);
+	}
+	if(seqIL.size() < maxMerge){
+		seqIL.resize(maxMerge);
+		seqpIL.resize(maxMerge);
+		seqIR.resize(maxMerge);
+		seqpIR.resize(maxMerge);
+	}
+	numInfix = 0;
+	mergeLen = 0;
+}
+
 void AlignedSequenceMerger::changeFocus(uintptr_t seq1Len, const char* seq1, const double* qual1, uintptr_t seq2Len, const char* seq2, const double* qual2, LinearPairwiseAlignmentIteration* alnUse){
-	saveSeqA.clear(); saveSeqA.insert(saveSeqA.end(), seq1, seq1 + seq1Len);
-	saveQualA.clear(); saveQualA.insert(saveQualA.end(), qual1, qual1 + seq1Len);
-	saveSeqB.clear(); saveSeqB.insert(saveSeqB.end(), seq2, seq2 + seq2Len);
-	saveQualB.clear(); saveQualB.insert(saveQualB.end(), qual2, qual2 + seq2Len);
+	saveSeqA.assign(seq1, seq1Len);
+	saveQualA.resize(seq1Len);
+	for(uintptr_t i = 0; i<seq1Len; i++){ saveQualA[i] = AlignedSequenceMerger_log10ToPhred(qual1[i]); }
+	saveSeqB.assign(seq2, seq2Len);
+	saveQualB.resize(seq2Len);
+	for(uintptr_t i = 0; i<seq2Len; i++){ saveQualB[i] = AlignedSequenceMerger_log10ToPhred(qual2[i]); }
 	curIter = alnUse;
-	seqIL.clear();
-	seqdIL.clear();
-	seqIR.clear();
-	seqdIR.clear();
-	mergeSeq.clear();
-	mergeQual.clear();
+	uintptr_t alnLen = curIter->aInds.size();
+	alnStartA = curIter->aInds[0];
+	alnStartB = curIter->bInds[0];
+	alnEndA = curIter->aInds[alnLen-1];
+	alnEndB = curIter->bInds[alnLen-1];
+	prepareStorage();
 }
 
 void AlignedSequenceMerger::changeFocus(uintptr_t seq1Len, const char* seq1, const char* qual1, uintptr_t seq2Len, const char* seq2, const char* qual2, LinearPairwiseAlignmentIteration* alnUse){
-	saveSeqA.clear(); saveSeqA.insert(saveSeqA.end(), seq1, seq1 + seq1Len);
-	saveQualA.resize(seq1Len); fastaPhredsToLog10Prob(seq1Len, (const unsigned char*)qual1, &(saveQualA[0]));
-	saveSeqB.clear(); saveSeqB.insert(saveSeqB.end(), seq2, seq2 + seq2Len);
-	saveQualB.resize(seq2Len); fastaPhredsToLog10Prob(seq2Len, (const unsigned char*)qual2, &(saveQualB[0]));
+	saveSeqA.assign(seq1, seq1Len);
+	saveQualA.resize(seq1Len);
+	for(uintptr_t i = 0; i<seq1Len; i++){ saveQualA[i] = alignMergeAsciiToPhred(qual1[i]); }
+	saveSeqB.assign(seq2, seq2Len);
+	saveQualB.resize(seq2Len);
+	for(uintptr_t i = 0; i<seq2Len; i++){ saveQualB[i] = alignMergeAsciiToPhred(qual2[i]); }
 	curIter = alnUse;
-	seqIL.clear();
-	seqdIL.clear();
-	seqIR.clear();
-	seqdIR.clear();
-	mergeSeq.clear();
-	mergeQual.clear();
+	uintptr_t alnLen = curIter->aInds.size();
+	alnStartA = curIter->aInds[0];
+	alnStartB = curIter->bInds[0];
+	alnEndA = curIter->aInds[alnLen-1];
+	alnEndB = curIter->bInds[alnLen-1];
+	prepareStorage();
+}
+
+void AlignedSequenceMerger::changeFocus(uintptr_t seq1Len, const char* seq1, const char* qual1, uintptr_t seq2Len, const char* seq2, const char* qual2, uintptr_t overLen){
+	saveSeqA.assign(seq1, seq1Len);
+	saveQualA.resize(seq1Len);
+	for(uintptr_t i = 0; i<seq1Len; i++){ saveQualA[i] = alignMergeAsciiToPhred(qual1[i]); }
+	saveSeqB.assign(seq2, seq2Len);
+	saveQualB.resize(seq2Len);
+	for(uintptr_t i = 0; i<seq2Len; i++){ saveQualB[i] = alignMergeAsciiToPhred(qual2[i]); }
+	curIter = 0;
+	alnStartA = seq1Len - overLen;
+	alnStartB = 0;
+	alnEndA = seq1Len;
+	alnEndB = overLen;
+	prepareStorage();
 }
 
 /**
  * Fill in quality for indels.
+ * @param numEnt The number of entries in the sequence.
  * @param forSeq The sequence to fill quality for: -1 means indel.
  * @param forQual The quality to update.
+ * @param gapQual The quality to use for a gap, by the quality on either side.
  */
-void AlignedSequenceMerger_fillInIndelQuality(std::vector<int>* forSeq, std::vector<double>* forQual){
+void AlignedSequenceMerger_fillInIndelQuality(uintptr_t numEnt, int* forSeq, unsigned char* forQual, unsigned char* gapQual){
 	uintptr_t ai = 0;
-	while(ai < forSeq->size()){
-		if((*forSeq)[ai] >= 0){
+	while(ai < numEnt){
+		if(forSeq[ai] >= 0){
 			ai++; continue;
 		}
 		uintptr_t nai = ai + 1;
-		while((nai < forSeq->size()) && ((*forSeq)[nai] < 0)){
+		while((nai < numEnt) && (forSeq[nai] < 0)){
 			nai++;
 		}
-		double winQual;
-		if(ai && (nai < forSeq->size())){
-			double leftQ = (*forQual)[ai-1];
-			double rightQ = (*forQual)[nai];
-			winQual = log10((pow(10.0, leftQ) + pow(10.0, rightQ))/2.0);
-		}
-		else if(ai){ winQual = (*forQual)[ai-1]; }
-		else if(nai < forSeq->size()){ winQual = (*forQual)[nai]; }
-		else{ winQual = -1.0 / 0.0; }
+		unsigned char winQual;
+		if(ai && (nai < numEnt)){ winQual = gapQual[forQual[ai-1]*ALIGNMERGE_PHRED_COUNT + forQual[nai]]; }
+		else if(ai){ winQual = forQual[ai-1]; }
+		else if(nai < numEnt){ winQual = forQual[nai]; }
+		else{ winQual = ALIGNMERGE_PHRED_MAX; }
 		for(uintptr_t ci = ai; ci < nai; ci++){
-			(*forQual)[ci] = winQual;
+			forQual[ci] = winQual;
 		}
 		ai = nai;
 	}
 }
 
 void AlignedSequenceMerger::expandIndels(){
-	uintptr_t alnLen = curIter->aInds.size();
+	int* curIL = &(seqIL[0]);
+	unsigned char* curpIL = &(seqpIL[0]);
+	int* curIR = &(seqIR[0]);
+	unsigned char* curpIR = &(seqpIR[0]);
+	const char* curSA = saveSeqA.c_str();
+	const unsigned char* curQA = &(saveQualA[0]);
+	const char* curSB = saveSeqB.c_str();
+	const unsigned char* curQB = &(saveQualB[0]);
+	uintptr_t numI = 0;
+	if(curIter == 0){
+		//no indels, just copy
+		uintptr_t overLen = alnEndB;
+		for(uintptr_t i = 0; i<overLen; i++){
+			curIL[i] = 0x00FF & curSA[alnStartA + i];
+			curpIL[i] = curQA[alnStartA + i];
+			curIR[i] = 0x00FF & curSB[i];
+			curpIR[i] = curQB[i];
+		}
+		numInfix = overLen;
+		return;
+	}
 	//expand out indels
-	seqIL.clear(); seqdIL.clear();
-	seqIR.clear(); seqdIR.clear();
+	intptr_t* aInds = &(curIter->aInds[0]);
+	intptr_t* bInds = &(curIter->bInds[0]);
+	uintptr_t alnLen = curIter->aInds.size();
 	for(uintptr_t i = 1; i<alnLen; i++){
-		if(curIter->aInds[i] != curIter->aInds[i-1]){
-			if(curIter->bInds[i] != curIter->bInds[i-1]){
-				//consume both
-				seqIL.push_back(saveSeqA[curIter->aInds[i-1]]);
-				seqdIL.push_back(saveQualA[curIter->aInds[i-1]]);
-				seqIR.push_back(saveSeqB[curIter->bInds[i-1]]);
-				seqdIR.push_back(saveQualB[curIter->bInds[i-1]]);
-			}
-			else{
-				//insert a, skip b
-				seqIL.push_back(saveSeqA[curIter->aInds[i-1]]);
-				seqdIL.push_back(saveQualA[curIter->aInds[i-1]]);
-				seqIR.push_back(-1);
-				seqdIR.push_back(0.0);
-			}
+		if(aInds[i] != aInds[i-1]){
+			curIL[numI] = 0x00FF & curSA[aInds[i-1]];
+			curpIL[numI] = curQA[aInds[i-1]];
+		}
+		else{
+			curIL[numI] = -1;
+			curpIL[numI] = 0;
+		}
+		if(bInds[i] != bInds[i-1]){
+			curIR[numI] = 0x00FF & curSB[bInds[i-1]];
+			curpIR[numI] = curQB[bInds[i-1]];
 		}
 		else{
-			//insert b, skip a
-			seqIL.push_back(-1);
-			seqdIL.push_back(0.0);
-			seqIR.push_back(saveSeqB[curIter->bInds[i-1]]);
-			seqdIR.push_back(saveQualB[curIter->bInds[i-1]]);
+			curIR[numI] = -1;
+			curpIR[numI] = 0;
 		}
+		numI++;
 	}
+	numInfix = numI;
 	//fill in any indel qualities
-	AlignedSequenceMerger_fillInIndelQuality(&seqIL, &seqdIL);
-	AlignedSequenceMerger_fillInIndelQuality(&seqIR, &seqdIR);
+	AlignedSequenceMerger_fillInIndelQuality(numI, curIL, curpIL, gapQual);
+	AlignedSequenceMerger_fillInIndelQuality(numI, curIR, curpIR, gapQual);
 }
 
 void AlignedSequenceMerger::addInPrefix(){
-	if(curIter->aInds[0] != 0){
-		if(curIter->bInds[0] != 0){
+	char* curMS = &(mergeSeq[0]) + mergeLen;
+	unsigned char* curMQ = &(mergeQual[0]) + mergeLen;
+	if(alnStartA != 0){
+		if(alnStartB != 0){
 			throw std::runtime_error("No clear prefix to add.");
 		}
-		mergeSeq.insert(mergeSeq.end(), saveSeqA.begin(), saveSeqA.begin() + curIter->aInds[0]);
-		mergeQual.insert(mergeQual.end(), saveQualA.begin(), saveQualA.begin() + curIter->aInds[0]);
+		memcpy(curMS, saveSeqA.c_str(), alnStartA);
+		memcpy(curMQ, &(saveQualA[0]), alnStartA);
+		mergeLen += alnStartA;
 	}
 	else{
-		mergeSeq.insert(mergeSeq.end(), saveSeqB.begin(), saveSeqB.begin() + curIter->bInds[0]);
-		mergeQual.insert(mergeQual.end(), saveQualB.begin(), saveQualB.begin() + curIter->bInds[0]);
+		memcpy(curMS, saveSeqB.c_str(), alnStartB);
+		memcpy(curMQ, &(saveQualB[0]), alnStartB);
+		mergeLen += alnStartB;
 	}
 }
 
 void AlignedSequenceMerger::mergeOverlap(){
-	for(uintptr_t i = 0; i<seqIL.size(); i++){
+	char* curMS = &(mergeSeq[0]);
+	unsigned char* curMQ = &(mergeQual[0]);
+	uintptr_t curML = mergeLen;
+	for(uintptr_t i = 0; i<numInfix; i++){
 		int sac = seqIL[i];
-		double lqac = seqdIL[i];
+		unsigned char qac = seqpIL[i];
 		int sbc = seqIR[i];
-		double lqbc = seqdIR[i];
-		double errA = pow(10.0, lqac);
-		double errB = pow(10.0, lqbc);
-		if(lqac < lqbc){
-			if(sac >= 0){
-				mergeSeq.push_back(sac);
-				if(sac != sbc){
-					double numVal = errA * (1.0 - errB/3.0);
-					double denVal = errA + errB - 4*errA*errB/3.0;
-					mergeQual.push_back(log10(numVal/denVal));
-				}
-				else{
-					double numVal = errA*errB / 3;
-					double denVal = 1 - errA - errB + 4*errA*errB/3.0;
-					mergeQual.push_back(log10(numVal/denVal));
-				}
-			}
-		}
-		else{
-			if(sbc >= 0){
-				mergeSeq.push_back(sbc);
-				if(sac != sbc){
-					double numVal = errB * (1.0 - errA/3.0);
-					double denVal = errA + errB - 4*errA*errB/3.0;
-					mergeQual.push_back(log10(numVal/denVal));
-				}
-				else{
-					double numVal = errA*errB / 3;
-					double denVal = 1 - errA - errB + 4*errA*errB/3.0;
-					mergeQual.push_back(log10(numVal/denVal));
-				}
-			}
+		unsigned char qbc = seqpIR[i];
+		//ties go to b
+		int winS = sbc; int tabI = qbc*ALIGNMERGE_PHRED_COUNT + qac;
+		if(qac > qbc){
+			winS = sac; tabI = qac*ALIGNMERGE_PHRED_COUNT + qbc;
 		}
+		if(winS < 0){ continue; }
+		curMS[curML] = winS;
+		curMQ[curML] = (sac == sbc) ? matchQual[tabI] : mismatchQual[tabI];
+		curML++;
 	}
+	mergeLen = curML;
 }
 
 void AlignedSequenceMerger::addInSuffix(){
-	uintptr_t alnLen = curIter->aInds.size();
-	if((uintptr_t)(curIter->aInds[alnLen-1]) < saveSeqA.size()){
-		if((uintptr_t)(curIter->bInds[alnLen-1]) < saveSeqB.size()){
+	char* curMS = &(mergeSeq[0]) + mergeLen;
+	unsigned char* curMQ = &(mergeQual[0]) + mergeLen;
+	if(alnEndA < saveSeqA.size()){
+		if(alnEndB < saveSeqB.size()){
 			throw std::runtime_error("No obvious suffix.");
 		}
-		mergeSeq.insert(mergeSeq.end(), saveSeqA.begin() + curIter->aInds[alnLen-1], saveSeqA.end());
-		mergeQual.insert(mergeQual.end(), saveQualA.begin() + curIter->aInds[alnLen-1], saveQualA.end());
+		uintptr_t numAdd = saveSeqA.size() - alnEndA;
+		memcpy(curMS, saveSeqA.c_str() + alnEndA, numAdd);
+		memcpy(curMQ, &(saveQualA[0]) + alnEndA, numAdd);
+		mergeLen += numAdd;
 	}
 	else{
-		mergeSeq.insert(mergeSeq.end(), saveSeqB.begin() + curIter->bInds[alnLen-1], saveSeqB.end());
-		mergeQual.insert(mergeQual.end(), saveQualB.begin() + curIter->bInds[alnLen-1], saveQualB.end());
+		uintptr_t numAdd = saveSeqB.size() - alnEndB;
+		memcpy(curMS, saveSeqB.c_str() + alnEndB, numAdd);
+		memcpy(curMQ, &(saveQualB[0]) + alnEndB, numAdd);
+		mergeLen += numAdd;
 	}
 }
 
+void AlignedSequenceMerger::getMerged(std::string* toSeq, std::vector<double>* toQual){
+	toSeq->assign(&(mergeSeq[0]), mergeLen);
+	toQual->resize(mergeLen);
+	double* curQD = &((*toQual)[0]);
+	const unsigned char* curMQ = &(mergeQual[0]);
+	for(uintptr_t i = 0; i<mergeLen; i++){
+		curQD[i] = phredLog10[curMQ[i]];
+	}
+}
 
-
+void AlignedSequenceMerger::getMergedPhred(std::string* toSeq, std::string* toQual){
+	toSeq->assign(&(mergeSeq[0]), mergeLen);
+	toQual->resize(mergeLen);
+	char* curQA = &((*toQual)[0]);
+	const unsigned char* curMQ = &(mergeQual[0]);
+	for(uintptr_t i = 0; i<mergeLen; i++){
+		curQA[i] = curMQ[i] + 33;
+	}
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "whodun_compress.h"
 
 #include <string>
+#include <string.h>
 #include <stdlib.h>
 #include <stdexcept>
 #include <algorithm>
@@ -364,7 +365,7 @@ void MultithreadBlockCompOutStream::writeByte(int toW){
 	MultithreadBlockCompOutStreamUniform* curUni = getOpenUniform();
 	curUni->compMeth->theData.push_back(toW);
 	if(curUni->compMeth->theData.size() >= chunkSize){
-		curUni->threadID = compThreads->addTask(multithreadBlockCompOutCompress, curUni);
+		curUni->threadID = compThreads->addTask(multithreadBlockCompOutCompress, curUni, THREADPOOL_PRIORITY_IO);
 		curUni->hasWait = 0;
 		compressingUnis.push_back(curUni);
 	}
@@ -384,7 +385,7 @@ void MultithreadBlockCompOutStream::writeBytes(const char* toW, uintptr_t numW){
 		uintptr_t endSize = curUni->compMeth->theData.size() + numPosAdd;
 		curUni->insertFrom = leftW;
 		curUni->insertNum = numPosAdd;
-		curUni->threadID = compThreads->addTask(multithreadBlockCompOutFill, curUni);
+		curUni->threadID = compThreads->addTask(multithreadBlockCompOutFill, curUni, THREADPOOL_PRIORITY_IO);
 		curUni->hasWait = 0;
 		if(endSize == chunkSize){
 			fillingFull.push_back(curUni);
@@ -401,7 +402,7 @@ void MultithreadBlockCompOutStream::writeBytes(const char* toW, uintptr_t numW){
 		MultithreadBlockCompOutStreamUniform* curUni = fillingFull[0];
 		fillingFull.pop_front();
 		compThreads->joinTask(curUni->threadID);
-		curUni->threadID = compThreads->addTask(multithreadBlockCompOutCompress, curUni);
+		curUni->threadID = compThreads->addTask(multithreadBlockCompOutCompress, curUni, THREADPOOL_PRIORITY_IO);
 		curUni->hasWait = 0;
 		compressingUnis.push_back(curUni);
 	}
@@ -415,7 +416,7 @@ void MultithreadBlockCompOutStream::writeBytes(const char* toW, uintptr_t numW){
 
 void MultithreadBlockCompOutStream::flush(){
 	if(fillingTmp){
-		fillingTmp->threadID = compThreads->addTask(multithreadBlockCompOutCompress, fillingTmp);
+		fillingTmp->threadID = compThreads->addTask(multithreadBlockCompOutCompress, fillingTmp, THREADPOOL_PRIORITY_IO);
 		fillingTmp->hasWait = 0;
 		compressingUnis.push_back(fillingTmp);
 		fillingTmp = 0;
@@ -473,7 +474,7 @@ MultithreadBlockCompOutStreamUniform* MultithreadBlockCompOutStream::getOpenUnif
 		curUni = fillingFull[0];
 		fillingFull.pop_front();
 		compThreads->joinTask(curUni->threadID);
-		curUni->threadID = compThreads->addTask(multithreadBlockCompOutCompress, curUni);
+		curUni->threadID = compThreads->addTask(multithreadBlockCompOutCompress, curUni, THREADPOOL_PRIORITY_IO);
 		curUni->hasWait = 0;
 		compressingUnis.push_back(curUni);
 	}
@@ -608,7 +609,7 @@ uintptr_t MultithreadBlockCompInStream::readBytes(char* toR, uintptr_t numR){
 			cUni->copyFrom = &((*prelude)[nextLeftover]);
 			cUni->dumpToB = 0;
 			cUni->numDumpB = 0;
-			cUni->threadID = compThreads->addTask(multithreadBlockCompInFill, cUni);
+			cUni->threadID = compThreads->addTask(multithreadBlockCompInFill, cUni, THREADPOOL_PRIORITY_IO);
 			leftR -= cUni->numDumpA;
 			nextR += cUni->numDumpA;
 			prelude = 0;
@@ -640,7 +641,7 @@ uintptr_t MultithreadBlockCompInStream::readBytes(char* toR, uintptr_t numR){
 			cUni->dumpToB = 0;
 			cUni->numDumpB = 0;
 		}
-		cUni->threadID = compThreads->addTask(multithreadBlockCompInDecompress, cUni);
+		cUni->threadID = compThreads->addTask(multithreadBlockCompInDecompress, cUni, THREADPOOL_PRIORITY_IO);
 		leftR -= cUni->numDumpA;
 		nextR += cUni->numDumpA;
 		PREPARE_NEXT_JOB
@@ -721,6 +722,196 @@ uintptr_t GZipInStream::readBytes(char* toR, uintptr_t numR){
 	return toRet;
 }
 
+/**The number of bytes in the fixed part of a bgzf block header.*/
+#define BGZF_HEAD_LEN 12
+/**The number of bytes after the compressed data in a bgzf block.*/
+#define BGZF_TAIL_LEN 8
+
+BGZipInStream::BGZipInStream(const char* fileName){
+	myName = fileName;
+	baseFile = fopen(fileName, "rb");
+	if(baseFile == 0){
+		throw std::runtime_error("Could not open file " + myName);
+	}
+	blockAddr = 0;
+	nextBlockAddr = 0;
+	nextReadI = 0;
+}
+BGZipInStream::~BGZipInStream(){
+	fclose(baseFile);
+}
+int BGZipInStream::readByte(){
+	while(nextReadI >= theData.size()){
+		if(!loadBlock()){ return -1; }
+	}
+	int toRet = 0x00FF & theData[nextReadI];
+	nextReadI++;
+	return toRet;
+}
+uintptr_t BGZipInStream::readBytes(char* toR, uintptr_t numR){
+	uintptr_t totRead = 0;
+	while(totRead < numR){
+		if(nextReadI >= theData.size()){
+			if(!loadBlock()){ break; }
+			continue;
+		}
+		uintptr_t numCopy = std::min(numR - totRead, (uintptr_t)(theData.size() - nextReadI));
+		memcpy(toR + totRead, &(theData[nextReadI]), numCopy);
+		nextReadI += numCopy;
+		totRead += numCopy;
+	}
+	return totRead;
+}
+void BGZipInStream::seek(uint64_t toAddr){
+	uintptr_t toBlock = toAddr >> 16;
+	uintptr_t toOff = toAddr & 0x00FFFF;
+	if(fseekPointer(baseFile, toBlock, SEEK_SET)){ throw std::runtime_error("Problem seeking file " + myName); }
+	nextBlockAddr = toBlock;
+	if(!loadBlock()){
+		if(toOff){ throw std::runtime_error("Seek past end of " + myName); }
+		return;
+	}
+	if(toOff > theData.size()){ throw std::runtime_error("Seek past end of block in " + myName); }
+	nextReadI = toOff;
+}
+uint64_t BGZipInStream::tell(){
+	if(nextReadI >= theData.size()){
+		return ((uint64_t)nextBlockAddr) << 16;
+	}
+	return (((uint64_t)blockAddr) << 16) | nextReadI;
+}
+bool BGZipInStream::loadBlock(){
+	blockAddr = nextBlockAddr;
+	theData.clear();
+	nextReadI = 0;
+	//the fixed header
+	char headBuff[BGZF_HEAD_LEN];
+	uintptr_t numRead = fread(headBuff, 1, BGZF_HEAD_LEN, baseFile);
+	if(numRead == 0){
+		if(ferror(baseFile)){ throw std::runtime_error("Problem reading file " + myName); }
+		return false;
+	}
+	if((numRead != BGZF_HEAD_LEN) || ((0x00FF & headBuff[0]) != 31) || ((0x00FF & headBuff[1]) != 139) || (headBuff[2] != 8) || !(headBuff[3] & 4)){
+		throw std::runtime_error("Malformed block gzip header in " + myName);
+	}
+	//the extra fields, one of which is the block size
+	uintptr_t extraLen = le2nat16(headBuff + 10);
+	compData.resize(extraLen);
+	if(extraLen && (fread(&(compData[0]), 1, extraLen, baseFile) != extraLen)){ throw std::runtime_error("Truncated block gzip header in " + myName); }
+	uintptr_t blockSize = 0;
+	uintptr_t extraI = 0;
+	while((extraI + 4) <= extraLen){
+		uintptr_t subLen = le2nat16(&(compData[extraI+2]));
+		if((compData[extraI] == 'B') && (compData[extraI+1] == 'C') && (subLen == 2) && ((extraI + 6) <= extraLen)){
+			blockSize = le2nat16(&(compData[extraI+4])) + 1;
+		}
+		extraI += (4 + subLen);
+	}
+	if(blockSize < (BGZF_HEAD_LEN + extraLen + BGZF_TAIL_LEN)){ throw std::runtime_error("Missing block size in " + myName); }
+	//the data
+	uintptr_t restLen = blockSize - (BGZF_HEAD_LEN + extraLen);
+	compData.resize(restLen);
+	if(fread(&(compData[0]), 1, restLen, baseFile) != restLen){ throw std::runtime_error("Truncated block in " + myName); }
+	uintptr_t fullLen = le2nat32(&(compData[restLen - 4]));
+	theData.resize(fullLen);
+	if(fullLen){
+		z_stream inflateS;
+		memset(&inflateS, 0, sizeof(z_stream));
+		if(inflateInit2(&inflateS, -15) != Z_OK){ throw std::runtime_error("Problem setting up decompression."); }
+		inflateS.next_in = (unsigned char*)(&(compData[0]));
+		inflateS.avail_in = restLen - BGZF_TAIL_LEN;
+		inflateS.next_out = (unsigned char*)(&(theData[0]));
+		inflateS.avail_out = fullLen;
+		int infRes = inflate(&inflateS, Z_FINISH);
+		inflateEnd(&inflateS);
+		if((infRes != Z_STREAM_END) || inflateS.avail_out){ throw std::runtime_error("Problem decompressing block in " + myName); }
+	}
+	nextBlockAddr = blockAddr + blockSize;
+	return true;
+}
+
+BGZipOutStream::BGZipOutStream(int append, const char* fileName){
+	myName = fileName;
+	baseFile = fopen(fileName, append ? "ab" : "wb");
+	if(baseFile == 0){
+		throw std::runtime_error("Could not open file " + myName);
+	}
+	theData.reserve(BGZF_BLOCK_DATA);
+}
+BGZipOutStream::~BGZipOutStream(){
+	//nothing can be thrown from here: a failure is only reported by finish
+	if(baseFile){
+		try{
+			finish();
+		}catch(std::exception& err){}
+		if(baseFile){ fclose(baseFile); }
+	}
+}
+void BGZipOutStream::writeByte(int toW){
+	theData.push_back(toW);
+	if(theData.size() >= BGZF_BLOCK_DATA){
+		dumpBlock();
+	}
+}
+void BGZipOutStream::writeBytes(const char* toW, uintptr_t numW){
+	while(numW){
+		uintptr_t numCopy = std::min(numW, (uintptr_t)(BGZF_BLOCK_DATA - theData.size()));
+		theData.insert(theData.end(), toW, toW + numCopy);
+		toW += numCopy;
+		numW -= numCopy;
+		if(theData.size() >= BGZF_BLOCK_DATA){
+			dumpBlock();
+		}
+	}
+}
+void BGZipOutStream::finish(){
+	if(!baseFile){ return; }
+	if(theData.size()){
+		dumpBlock();
+	}
+	//an empty block marks the end
+	dumpBlock();
+	FILE* toClose = baseFile;
+	baseFile = 0;
+	if(fclose(toClose)){
+		throw std::runtime_error("Problem writing file " + myName);
+	}
+}
+void BGZipOutStream::dumpBlock(){
+	//compress
+	z_stream deflateS;
+	memset(&deflateS, 0, sizeof(z_stream));
+	if(deflateInit2(&deflateS, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK){ throw std::runtime_error("Problem setting up compression."); }
+	uintptr_t maxComp = deflateBound(&deflateS, theData.size());
+	compData.resize(BGZF_HEAD_LEN + 6 + maxComp + BGZF_TAIL_LEN);
+	deflateS.next_in = (unsigned char*)(theData.size() ? &(theData[0]) : 0);
+	deflateS.avail_in = theData.size();
+	deflateS.next_out = (unsigned char*)(&(compData[BGZF_HEAD_LEN + 6]));
+	deflateS.avail_out = maxComp;
+	int defRes = deflate(&deflateS, Z_FINISH);
+	uintptr_t compLen = maxComp - deflateS.avail_out;
+	deflateEnd(&deflateS);
+	if(defRes != Z_STREAM_END){ throw std::runtime_error("Problem compressing block for " + myName); }
+	//the header, with the block size in the extra field
+	uintptr_t blockSize = BGZF_HEAD_LEN + 6 + compLen + BGZF_TAIL_LEN;
+	char* headBuff = &(compData[0]);
+	headBuff[0] = 31; headBuff[1] = (char)139; headBuff[2] = 8; headBuff[3] = 4;
+	nat2le32(0, headBuff + 4);
+	headBuff[8] = 0; headBuff[9] = (char)255;
+	nat2le16(6, headBuff + 10);
+	headBuff[12] = 'B'; headBuff[13] = 'C';
+	nat2le16(2, headBuff + 14);
+	nat2le16(blockSize - 1, headBuff + 16);
+	//the tail
+	char* tailBuff = headBuff + BGZF_HEAD_LEN + 6 + compLen;
+	nat2le32(crc32(crc32(0, 0, 0), (unsigned char*)(theData.size() ? &(theData[0]) : 0), theData.size()), tailBuff);
+	nat2le32(theData.size(), tailBuff + 4);
+	if(fwrite(headBuff, 1, blockSize, baseFile) != blockSize){
+		throw std::runtime_error("Problem writing file " + myName);
+	}
+	theData.clear();
+}
+
 /**The uniform used by threads.*/
 class MultithreadGZipOutStreamUniform{
 public:
@@ -831,7 +1022,7 @@ void MultithreadGZipOutStream::writeBytes(const char* toW, uintptr_t numW){
 
 void MultithreadGZipOutStream::startCompressing(){
 	MultithreadGZipOutStreamUniform* curUni = &(threadUnis[nextTUni]);
-	curUni->threadID = compThreads->addTask(multithreadGZipOutThreadFunc, curUni);
+	curUni->threadID = compThreads->addTask(multithreadGZipOutThreadFunc, curUni, THREADPOOL_PRIORITY_IO);
 	nextTUni = (nextTUni + 1) % numThread;
 	if(nextTUni == nextOUni){
 		startDumping();
@@ -14,6 +14,10 @@ void OutStream::writeBytes(const char* toW, uintptr_t numW){
 
 void OutStream::flush(){}
 
+void OutStream::finish(){
+	flush();
+}
+
 InStream::InStream(){}
 
 InStream::~InStream(){}
@@ -5,6 +5,7 @@
 
 #include "whodun_compress.h"
 #include "whodun_stringext.h"
+#include "whodun_stringext_seq.h"
 
 #define WHITESPACE " \t\r"
 #define NLWHITESPACE " \t\r\n"
@@ -23,31 +24,18 @@ unsigned char fastaLog10ProbToPhred(double toConv){
 }
 
 void fastaPhredsToLog10Prob(uintptr_t numConv, const unsigned char* toConv, double* toStore){
-	for(uintptr_t i = 0; i<numConv; i++){
-		toStore[i] = fastaPhredToLog10Prob(toConv[i]);
-	}
+	memphredtolog10(toConv, numConv, toStore);
 }
 
 void fastaLog10ProbsToPhred(uintptr_t numConv, const double* toConv, unsigned char* toStore){
-	for(uintptr_t i = 0; i<numConv; i++){
-		toStore[i] = fastaLog10ProbToPhred(toConv[i]);
-	}
+	memlog10tophred(toConv, numConv, toStore);
 }
 
 void sequenceReverseCompliment(uintptr_t revLen, char* toRev, double* toRevQ){
-	std::reverse(toRev, toRev+revLen);
+	memrevcomp(toRev, revLen);
 	if(toRevQ){
 		std::reverse(toRevQ, toRevQ+revLen);
 	}
-	char compArr[256];
-	for(uintptr_t i = 0; i<256; i++){ compArr[i] = i; }
-		compArr[0x00FF & 'A'] = 'T';
-		compArr[0x00FF & 'T'] = 'A';
-		compArr[0x00FF & 'C'] = 'G';
-		compArr[0x00FF & 'G'] = 'C';
-	for(uintptr_t i = 0; i<revLen; i++){
-		toRev[i] = compArr[0x00FF & toRev[i]];
-	}
 }
 
 SequenceReader::SequenceReader(){
@@ -223,6 +211,7 @@ SequenceWriter::SequenceWriter(){
 	nextSeq = 0;
 	nextHaveQual = 0;
 	nextQual = 0;
+	nextQualPhred = 0;
 }
 
 SequenceWriter::~SequenceWriter(){}
@@ -242,9 +231,14 @@ void FastAQSequenceWriter::writeNextEntry(){
 	if(nextHaveQual){
 		theStr->writeByte('+');
 		theStr->writeByte('\n');
-		tmpQualS.resize(nextSeqLen);
-		fastaLog10ProbsToPhred(nextSeqLen, nextQual, &(tmpQualS[0]));
-		theStr->writeBytes((char*)(&(tmpQualS[0])), nextSeqLen);
+		if(nextQualPhred){
+			theStr->writeBytes(nextQualPhred, nextSeqLen);
+		}
+		else{
+			tmpQualS.resize(nextSeqLen);
+			fastaLog10ProbsToPhred(nextSeqLen, nextQual, &(tmpQualS[0]));
+			theStr->writeBytes((char*)(&(tmpQualS[0])), nextSeqLen);
+		}
 		theStr->writeByte('\n');
 	}
 }
@@ -448,34 +442,58 @@ int SequentialGailAQSequenceReader::readNextEntry(){
 
 GailAQSequenceWriter::GailAQSequenceWriter(int append, BlockCompOutStream* toFlit, const char* indFName){
 	theStr = toFlit;
+	theStrMT = 0;
 	intptr_t annotLen = getFileSize(indFName);
 	if((annotLen >= 0) && (annotLen % GAIL_INDEX_ENTLEN)){throw std::runtime_error("Malformed index file.");}
 	indF = fopen(indFName, append ? "ab" : "wb");
 	if(indF == 0){ throw std::runtime_error("Could not open index file."); }
 }
 
+GailAQSequenceWriter::GailAQSequenceWriter(MultithreadBlockCompOutStream* toFlit, const char* indFName){
+	theStr = 0;
+	theStrMT = toFlit;
+	indF = fopen(indFName, "wb");
+	if(indF == 0){ throw std::runtime_error("Could not open index file."); }
+}
+
 GailAQSequenceWriter::~GailAQSequenceWriter(){
 	fclose(indF);
 }
 
 void GailAQSequenceWriter::writeNextEntry(){
+	OutStream* focStr = theStr ? (OutStream*)theStr : (OutStream*)theStrMT;
 	char indOutBuff[GAIL_INDEX_ENTLEN];
-	nat2be64(theStr->tell(), indOutBuff);
+	nat2be64(theStr ? theStr->tell() : theStrMT->tell(), indOutBuff);
 	nat2be64(nextShortNameLen, indOutBuff+8);
-	theStr->writeBytes(nextName, nextNameLen);
-	nat2be64(theStr->tell(), indOutBuff+16);
-	theStr->writeBytes(nextSeq, nextSeqLen);
-	nat2be64(theStr->tell(), indOutBuff+24);
+	focStr->writeBytes(nextName, nextNameLen);
+	nat2be64(theStr ? theStr->tell() : theStrMT->tell(), indOutBuff+16);
+	focStr->writeBytes(nextSeq, nextSeqLen);
+	nat2be64(theStr ? theStr->tell() : theStrMT->tell(), indOutBuff+24);
 	nat2be64(nextHaveQual, indOutBuff+32);
 	if(nextHaveQual){
-		tmpQualS.resize(nextSeqLen);
-		fastaLog10ProbsToPhred(nextSeqLen, nextQual, &(tmpQualS[0]));
-		theStr->writeBytes((char*)&(tmpQualS[0]), nextSeqLen);
+		if(nextQualPhred){
+			focStr->writeBytes(nextQualPhred, nextSeqLen);
+		}
+		else{
+			tmpQualS.resize(nextSeqLen);
+			fastaLog10ProbsToPhred(nextSeqLen, nextQual, &(tmpQualS[0]));
+			focStr->writeBytes((char*)&(tmpQualS[0]), nextSeqLen);
+		}
 	}
-	theStr->flush();
+	focStr->flush();
 	if(fwrite(indOutBuff, 1, GAIL_INDEX_ENTLEN, indF)!=GAIL_INDEX_ENTLEN){throw std::runtime_error("Problem writing index file.");}
 }
 
+/**
+ * Get whether a sequence file name is for gzipped fasta/fastq.
+ * @param fileName The name of the file.
+ * @return Whether it ends with a gzip extension.
+ */
+bool sequenceFileNameIsGZip(const char* fileName){
+	return strendswith(fileName, ".fasta.gz") || strendswith(fileName, ".fa.gz") || strendswith(fileName, ".fastq.gz") || strendswith(fileName, ".fq.gz")
+		|| strendswith(fileName, ".fasta.gzip") || strendswith(fileName, ".fa.gzip") || strendswith(fileName, ".fastq.gzip") || strendswith(fileName, ".fq.gzip");
+}
+
 void openSequenceFileRead(const char* fileName, InStream** saveIS, SequenceReader** saveSS){
 	if(strcmp(fileName, "-")==0){
 		*saveIS = new ConsoleInStream();
@@ -513,9 +531,28 @@ void openSequenceFileWrite(const char* fileName, OutStream** saveIS, SequenceWri
 		*saveSS = new FastAQSequenceWriter(*saveIS);
 		return;
 	}
+	if(sequenceFileNameIsGZip(fileName)){
+		*saveIS = new GZipOutStream(0, fileName);
+		*saveSS = new FastAQSequenceWriter(*saveIS);
+		return;
+	}
 	//TODO
 	//fasta is the default
 	*saveIS = new FileOutStream(0, fileName);
 	*saveSS = new FastAQSequenceWriter(*saveIS);
 }
 
+void openSequenceFileWrite(const char* fileName, OutStream** saveIS, SequenceWriter** saveSS, int numThread, ThreadPool* useThreads){
+	if((numThread <= 1) || !sequenceFileNameIsGZip(fileName)){
+		openSequenceFileWrite(fileName, saveIS, saveSS);
+		return;
+	}
+	if(useThreads){
+		*saveIS = new MultithreadGZipOutStream(0, fileName, numThread, useThreads);
+	}
+	else{
+		*saveIS = new MultithreadGZipOutStream(0, fileName, numThread);
+	}
+	*saveSS = new FastAQSequenceWriter(*saveIS);
+}
+
@@ -0,0 +1,268 @@
+#include "whodun_parse_seq_pack.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "whodun_oshook.h"
+#include "whodun_stringext.h"
+
+/**The magic at the end of a packed image.*/
+#define PACKSEQ_MAGIC "WHOD2BIT"
+/**The number of bytes in each number in the image.*/
+#define PACKSEQ_NUMSIZE 8
+
+/**
+ * Add a number to the end of a buffer.
+ * @param toAdd The number to add.
+ * @param toFill The buffer to add to.
+ */
+void packSequenceAddNumber(uintptr_t toAdd, std::string* toFill){
+	char numBuff[PACKSEQ_NUMSIZE];
+	nat2le64(toAdd, numBuff);
+	toFill->append(numBuff, PACKSEQ_NUMSIZE);
+}
+
+void packSequenceFile(SequenceReader* fromRead, OutStream* toWrite){
+	std::string packIndex;
+	std::vector<char> packData;
+	std::vector<uintptr_t> oddStart;
+	std::vector<uintptr_t> oddLen;
+	std::vector<char> oddChar;
+	std::vector<uintptr_t> lowStart;
+	std::vector<uintptr_t> lowLen;
+	uintptr_t numSeq = 0;
+	uintptr_t dataOffset = 0;
+	while(fromRead->readNextEntry()){
+		numSeq++;
+		uintptr_t curLen = fromRead->lastReadSeqLen;
+		const char* curSeq = fromRead->lastReadSeq;
+		//pack the bases, noting anything odd
+		packData.clear(); packData.resize((curLen + 3) >> 2);
+		oddStart.clear(); oddLen.clear(); oddChar.clear();
+		lowStart.clear(); lowLen.clear();
+		for(uintptr_t i = 0; i<curLen; i++){
+			char curC = curSeq[i];
+			if((curC >= 'a') && (curC <= 'z')){
+				if(lowStart.size() && ((lowStart[lowStart.size()-1] + lowLen[lowLen.size()-1]) == i)){
+					lowLen[lowLen.size()-1]++;
+				}
+				else{
+					lowStart.push_back(i);
+					lowLen.push_back(1);
+				}
+				curC = curC - 'a' + 'A';
+			}
+			int curCode;
+			switch(curC){
+				case 'A': curCode = 0; break;
+				case 'C': curCode = 1; break;
+				case 'G': curCode = 2; break;
+				case 'T': curCode = 3; break;
+				default:
+					curCode = 0;
+					if(oddStart.size() && (oddChar[oddChar.size()-1] == curC) && ((oddStart[oddStart.size()-1] + oddLen[oddLen.size()-1]) == i)){
+						oddLen[oddLen.size()-1]++;
+					}
+					else{
+						oddStart.push_back(i);
+						oddLen.push_back(1);
+						oddChar.push_back(curC);
+					}
+			}
+			packData[i >> 2] |= (curCode << (2*(i & 3)));
+		}
+		if(packData.size()){
+			toWrite->writeBytes(&(packData[0]), packData.size());
+		}
+		//note in the index
+		packSequenceAddNumber(fromRead->lastReadShortNameLen, &packIndex);
+		packIndex.append(fromRead->lastReadName, fromRead->lastReadShortNameLen);
+		packSequenceAddNumber(curLen, &packIndex);
+		packSequenceAddNumber(dataOffset, &packIndex);
+		packSequenceAddNumber(oddStart.size(), &packIndex);
+		for(uintptr_t i = 0; i<oddStart.size(); i++){
+			packSequenceAddNumber(oddStart[i], &packIndex);
+			packSequenceAddNumber(oddLen[i], &packIndex);
+			packSequenceAddNumber(0x00FF & oddChar[i], &packIndex);
+		}
+		packSequenceAddNumber(lowStart.size(), &packIndex);
+		for(uintptr_t i = 0; i<lowStart.size(); i++){
+			packSequenceAddNumber(lowStart[i], &packIndex);
+			packSequenceAddNumber(lowLen[i], &packIndex);
+		}
+		dataOffset += packData.size();
+	}
+	//index, then where the index is
+	std::string packHead;
+	packSequenceAddNumber(numSeq, &packHead);
+	toWrite->writeBytes(packHead.c_str(), packHead.size());
+	toWrite->writeBytes(packIndex.c_str(), packIndex.size());
+	std::string packTail;
+	packSequenceAddNumber(dataOffset, &packTail);
+	packTail.append(PACKSEQ_MAGIC);
+	toWrite->writeBytes(packTail.c_str(), packTail.size());
+}
+
+void packSequenceFile(const char* fromFile, const char* toFile){
+	InStream* redFile = 0;
+	SequenceReader* refRead = 0;
+	FileOutStream* packOut = 0;
+	try{
+		openSequenceFileRead(fromFile, &redFile, &refRead);
+		packOut = new FileOutStream(0, toFile);
+		packSequenceFile(refRead, packOut);
+		delete(packOut); packOut = 0;
+		delete(refRead); refRead = 0;
+		delete(redFile); redFile = 0;
+	}catch(...){
+		if(packOut){ delete(packOut); killFile(toFile); }
+		if(refRead){ delete(refRead); }
+		if(redFile){ delete(redFile); }
+		throw;
+	}
+}
+
+/**
+ * Read a number from an image, complaining if it is past the end.
+ * @param curLoc The place to read from: advanced.
+ * @param endLoc The end of the index.
+ * @param fileName The name of the image, for errors.
+ * @return The number.
+ */
+uintptr_t packSequenceGetNumber(const char** curLoc, const char* endLoc, const std::string& fileName){
+	if((endLoc - *curLoc) < PACKSEQ_NUMSIZE){
+		throw std::runtime_error("Truncated index in packed sequence " + fileName);
+	}
+	uintptr_t toRet = le2nat64(*curLoc);
+	*curLoc += PACKSEQ_NUMSIZE;
+	return toRet;
+}
+
+PackedSequenceStore::PackedSequenceStore(const char* fileName){
+	myName = fileName;
+	mapSize = 0;
+	mapAddr = mapFileRead(fileName, &mapSize);
+	if(mapAddr == 0){
+		throw std::runtime_error("Could not map packed sequence " + myName);
+	}
+	try{
+		const char* fileStart = (const char*)mapAddr;
+		const char* fileEnd = fileStart + mapSize;
+		uintptr_t tailLen = PACKSEQ_NUMSIZE + strlen(PACKSEQ_MAGIC);
+		if((mapSize < tailLen) || memcmp(fileEnd - strlen(PACKSEQ_MAGIC), PACKSEQ_MAGIC, strlen(PACKSEQ_MAGIC))){
+			throw std::runtime_error(myName + " is not a packed sequence.");
+		}
+		const char* indEnd = fileEnd - tailLen;
+		const char* curLoc = indEnd;
+		uintptr_t indexOffset = packSequenceGetNumber(&curLoc, fileEnd, myName);
+		if(indexOffset > (uintptr_t)(indEnd - fileStart)){
+			throw std::runtime_error("Bad index location in packed sequence " + myName);
+		}
+		curLoc = fileStart + indexOffset;
+		uintptr_t numSeq = packSequenceGetNumber(&curLoc, indEnd, myName);
+		allSeqs.resize(numSeq);
+		for(uintptr_t si = 0; si<numSeq; si++){
+			PackedSequenceEntry* curEnt = &(allSeqs[si]);
+			uintptr_t nameLen = packSequenceGetNumber(&curLoc, indEnd, myName);
+			if((uintptr_t)(indEnd - curLoc) < nameLen){
+				throw std::runtime_error("Truncated index in packed sequence " + myName);
+			}
+			curEnt->seqName.insert(curEnt->seqName.end(), curLoc, curLoc + nameLen);
+			curLoc += nameLen;
+			curEnt->seqLen = packSequenceGetNumber(&curLoc, indEnd, myName);
+			uintptr_t dataOffset = packSequenceGetNumber(&curLoc, indEnd, myName);
+			if((dataOffset > indexOffset) || (((curEnt->seqLen + 3) >> 2) > (indexOffset - dataOffset))){
+				throw std::runtime_error("Bad data location in packed sequence " + myName);
+			}
+			curEnt->seqData = (const unsigned char*)(fileStart + dataOffset);
+			uintptr_t numOdd = packSequenceGetNumber(&curLoc, indEnd, myName);
+			for(uintptr_t i = 0; i<numOdd; i++){
+				uintptr_t curStart = packSequenceGetNumber(&curLoc, indEnd, myName);
+				uintptr_t curLen = packSequenceGetNumber(&curLoc, indEnd, myName);
+				uintptr_t curChar = packSequenceGetNumber(&curLoc, indEnd, myName);
+				if((curStart > curEnt->seqLen) || (curLen > (curEnt->seqLen - curStart))){
+					throw std::runtime_error("Bad run in packed sequence " + myName);
+				}
+				curEnt->oddStart.push_back(curStart);
+				curEnt->oddLen.push_back(curLen);
+				curEnt->oddChar.push_back(curChar);
+			}
+			uintptr_t numLow = packSequenceGetNumber(&curLoc, indEnd, myName);
+			for(uintptr_t i = 0; i<numLow; i++){
+				uintptr_t curStart = packSequenceGetNumber(&curLoc, indEnd, myName);
+				uintptr_t curLen = packSequenceGetNumber(&curLoc, indEnd, myName);
+				if((curStart > curEnt->seqLen) || (curLen > (curEnt->seqLen - curStart))){
+					throw std::runtime_error("Bad run in packed sequence " + myName);
+				}
+				curEnt->lowStart.push_back(curStart);
+				curEnt->lowLen.push_back(curLen);
+			}
+			seqInds[curEnt->seqName] = si;
+		}
+	}catch(...){
+		unmapFile(mapAddr, mapSize);
+		throw;
+	}
+	//build the unpack table
+	const char* codeBases = "ACGT";
+	for(int i = 0; i<256; i++){
+		for(int j = 0; j<4; j++){
+			unpackTable[4*i + j] = codeBases[(i >> (2*j)) & 3];
+		}
+	}
+}
+
+PackedSequenceStore::~PackedSequenceStore(){
+	unmapFile(mapAddr, mapSize);
+}
+
+intptr_t PackedSequenceStore::findSequence(const std::string& seqName){
+	std::map<std::string,uintptr_t>::iterator seqIt = seqInds.find(seqName);
+	if(seqIt == seqInds.end()){ return -1; }
+	return seqIt->second;
+}
+
+uintptr_t PackedSequenceStore::getLength(uintptr_t seqI){
+	return allSeqs[seqI].seqLen;
+}
+
+void PackedSequenceStore::getWindow(uintptr_t seqI, uintptr_t fromI, uintptr_t toI, std::string* toFill){
+	PackedSequenceEntry* curEnt = &(allSeqs[seqI]);
+	toFill->resize(toI - fromI);
+	if(toI == fromI){ return; }
+	char* curFill = &((*toFill)[0]);
+	//unpack the bases
+	for(uintptr_t i = fromI; i<toI; i++){
+		*curFill = unpackTable[4*curEnt->seqData[i >> 2] + (i & 3)];
+		curFill++;
+	}
+	curFill = &((*toFill)[0]);
+	//put in the odd bases
+	uintptr_t runI = std::upper_bound(curEnt->oddStart.begin(), curEnt->oddStart.end(), fromI) - curEnt->oddStart.begin();
+	if(runI){ runI--; }
+	for(; runI < curEnt->oddStart.size(); runI++){
+		uintptr_t runS = curEnt->oddStart[runI];
+		uintptr_t runE = runS + curEnt->oddLen[runI];
+		if(runS >= toI){ break; }
+		runS = std::max(runS, fromI);
+		runE = std::min(runE, toI);
+		if(runS < runE){
+			memset(curFill + (runS - fromI), curEnt->oddChar[runI], runE - runS);
+		}
+	}
+	//and the lower case
+	runI = std::upper_bound(curEnt->lowStart.begin(), curEnt->lowStart.end(), fromI) - curEnt->lowStart.begin();
+	if(runI){ runI--; }
+	for(; runI < curEnt->lowStart.size(); runI++){
+		uintptr_t runS = curEnt->lowStart[runI];
+		uintptr_t runE = runS + curEnt->lowLen[runI];
+		if(runS >= toI){ break; }
+		runS = std::max(runS, fromI);
+		runE = std::min(runE, toI);
+		for(uintptr_t i = runS; i<runE; i++){
+			char* curC = curFill + (i - fromI);
+			if((*curC >= 'A') && (*curC <= 'Z')){ *curC = *curC - 'A' + 'a'; }
+		}
+	}
+}
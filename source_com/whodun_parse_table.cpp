@@ -17,6 +17,8 @@ TabularReader::~TabularReader(){}
 
 #define TSV_EVENT_CHARS "\n\r\t\\"
 #define NUM_TSV_EVENT_CHARS 4
+/**The characters that need the careful path (the escape is only special if escapes are on).*/
+#define TSV_SLOW_CHARS "\r\\"
 
 TSVTabularReader::TSVTabularReader(int escapes, InStream* mainFrom){
 	theStr = mainFrom;
@@ -35,6 +37,26 @@ int TSVTabularReader::readNextEntry(){
 		if(readBuffS == 0){ return 0; }
 		recordCount++;
 		headTmp.push_back(0);
+	//if the whole line is here and has nothing odd, just find the tabs
+	{
+		const char* lineS = readBuff + readBuffO;
+		const char* lineE = (const char*)memchr(lineS, '\n', readBuffS);
+		uintptr_t lineL = lineE ? (lineE - lineS) : 0;
+		if(lineE && (memcspn(lineS, lineL, TSV_SLOW_CHARS, escEnable ? 2 : 1) == lineL)){
+			const char* curField = lineS;
+			const char* curTab = (const char*)memchr(curField, '\t', lineL);
+			while(curTab){
+				entryFlat.insert(entryFlat.end(), curField, curTab);
+				headTmp.push_back(entryFlat.size());
+				curField = curTab + 1;
+				curTab = (const char*)memchr(curField, '\t', lineE - curField);
+			}
+			entryFlat.insert(entryFlat.end(), curField, lineE);
+			headTmp.push_back(entryFlat.size());
+			readBuffO += (lineL + 1); readBuffS -= (lineL + 1);
+			goto hitEndOfLine;
+		}
+	}
 	//read down the line
 		while(true){
 			int evtcspn = memcspn(readBuff + readBuffO, readBuffS, TSV_EVENT_CHARS, NUM_TSV_EVENT_CHARS);
@@ -1,6 +1,8 @@
 #include "whodun_parse_table_genome.h"
 
 #include <iostream>
+#include <ctype.h>
+#include <algorithm>
 #include <string.h>
 #include <stdexcept>
 
@@ -154,6 +156,7 @@ int CRBSAMFileReader::readNextEntry(){
 }
 CRBSAMFileWriter::CRBSAMFileWriter(){}
 CRBSAMFileWriter::~CRBSAMFileWriter(){}
+void CRBSAMFileWriter::finish(){}
 void CRBSAMFileWriter::writeNextEntry(){
 	writeNextEntry(&curEnt);
 }
@@ -168,26 +171,31 @@ int SAMFileReader::readNextEntry(CRBSAMFileContents* toFill){
 		if(fromTsv->readNextEntry() == 0){ return 0; }
 	}
 	curEntry++;
+	parseSAMEntry(fromTsv->numEntries, fromTsv->entrySizes, fromTsv->curEntries, toFill, &tempStore);
+	return 1;
+}
+
+void parseSAMEntry(uintptr_t numFields, uintptr_t* fieldSizes, char** fieldTexts, CRBSAMFileContents* toFill, std::string* tempStore){
 	toFill->clear();
-	if(fromTsv->numEntries && fromTsv->entrySizes[0] && (fromTsv->curEntries[0][0]=='@')){
+	if(numFields && fieldSizes[0] && (fieldTexts[0][0]=='@')){
 		//is a header, expand and quit
 		toFill->lastReadHead = 1;
-		for(uintptr_t i = 0; i<fromTsv->numEntries; i++){
+		for(uintptr_t i = 0; i<numFields; i++){
 			if(i){ toFill->headerTxt.push_back('\t'); }
-			const char* curEntTxt = fromTsv->curEntries[i];
-			toFill->headerTxt.insert(toFill->headerTxt.end(), curEntTxt, curEntTxt + fromTsv->entrySizes[i]);
+			const char* curEntTxt = fieldTexts[i];
+			toFill->headerTxt.insert(toFill->headerTxt.end(), curEntTxt, curEntTxt + fieldSizes[i]);
 		}
-		return 1;
+		return;
 	}
-	if(fromTsv->numEntries < 11){ throw std::runtime_error("Data entry in SAM file too short."); }
+	if(numFields < 11){ throw std::runtime_error("Data entry in SAM file too short."); }
 	toFill->lastReadHead = 0;
 	#define SAM_HANDLE_ELIDABLE_STRING(varName, varInd) \
-		toFill->varName.insert(toFill->varName.end(), fromTsv->curEntries[varInd], fromTsv->curEntries[varInd] + fromTsv->entrySizes[varInd]);\
+		toFill->varName.insert(toFill->varName.end(), fieldTexts[varInd], fieldTexts[varInd] + fieldSizes[varInd]);\
 		if((toFill->varName.size() == 1) && (toFill->varName[0] == '*')){ toFill->varName.clear(); }
 	#define SAM_HANDLE_INTEGER(varName, varInd) \
-		tempStore.clear();\
-		tempStore.insert(tempStore.end(), fromTsv->curEntries[varInd], fromTsv->curEntries[varInd] + fromTsv->entrySizes[varInd]);\
-		toFill->varName = atol(tempStore.c_str());
+		tempStore->clear();\
+		tempStore->insert(tempStore->end(), fieldTexts[varInd], fieldTexts[varInd] + fieldSizes[varInd]);\
+		toFill->varName = atol(tempStore->c_str());
 	SAM_HANDLE_ELIDABLE_STRING(entryName, 0)
 	SAM_HANDLE_INTEGER(entryFlag, 1)
 	SAM_HANDLE_ELIDABLE_STRING(entryReference, 2)
@@ -200,11 +208,143 @@ int SAMFileReader::readNextEntry(CRBSAMFileContents* toFill){
 	SAM_HANDLE_ELIDABLE_STRING(entrySeq, 9)
 	SAM_HANDLE_ELIDABLE_STRING(entryQual, 10)
 	if(toFill->entryQual.size() && (toFill->entryQual.size() != toFill->entrySeq.size())){throw std::runtime_error("Quality and sequence must have the same length.");}
-	for(uintptr_t i = 11; i<fromTsv->numEntries; i++){
+	for(uintptr_t i = 11; i<numFields; i++){
 		if(i > 11){ toFill->entryExtra.push_back('\t'); }
-		toFill->entryExtra.insert(toFill->entryExtra.end(), fromTsv->curEntries[i], fromTsv->curEntries[i] + fromTsv->entrySizes[i]);
+		toFill->entryExtra.insert(toFill->entryExtra.end(), fieldTexts[i], fieldTexts[i] + fieldSizes[i]);
 	}
-	return 1;
+}
+
+MultithreadSAMFileReaderChunk::MultithreadSAMFileReaderChunk(){
+	numEnts = 0;
+	nextEnt = 0;
+	needJoin = false;
+	taskID = 0;
+}
+MultithreadSAMFileReaderChunk::~MultithreadSAMFileReaderChunk(){}
+
+/**
+ * Parse the lines in a chunk of sam text.
+ * @param theChunk The chunk.
+ */
+void multithreadSAMFileReaderParse(void* theChunk){
+	MultithreadSAMFileReaderChunk* myC = (MultithreadSAMFileReaderChunk*)theChunk;
+	try{
+		if(myC->chunkText.size() == 0){ return; }
+		char* curText = &(myC->chunkText[0]);
+		char* endText = curText + myC->chunkText.size();
+		while(curText < endText){
+			char* lineEnd = (char*)memchr(curText, '\n', endText - curText);
+			char* nextText = lineEnd ? (lineEnd + 1) : endText;
+			lineEnd = lineEnd ? lineEnd : endText;
+			//carriage returns are dropped wherever they are
+			if(memchr(curText, '\r', lineEnd - curText)){
+				char* keepEnd = curText;
+				for(char* lineC = curText; lineC < lineEnd; lineC++){
+					if(*lineC != '\r'){ *keepEnd = *lineC; keepEnd++; }
+				}
+				lineEnd = keepEnd;
+			}
+			//split on tabs
+			myC->fieldTexts.clear();
+			myC->fieldSizes.clear();
+			char* fieldS = curText;
+			while(true){
+				char* fieldE = (char*)memchr(fieldS, '\t', lineEnd - fieldS);
+				if(fieldE == 0){ break; }
+				myC->fieldTexts.push_back(fieldS);
+				myC->fieldSizes.push_back(fieldE - fieldS);
+				fieldS = fieldE + 1;
+			}
+			myC->fieldTexts.push_back(fieldS);
+			myC->fieldSizes.push_back(lineEnd - fieldS);
+			//and parse
+			if(myC->numEnts >= myC->ents.size()){ myC->ents.push_back(CRBSAMFileContents()); }
+			parseSAMEntry(myC->fieldTexts.size(), &(myC->fieldSizes[0]), &(myC->fieldTexts[0]), &(myC->ents[myC->numEnts]), &(myC->tempStore));
+			myC->numEnts++;
+			curText = nextText;
+		}
+	}catch(std::exception& err){
+		myC->errMess = err.what();
+	}
+}
+
+MultithreadSAMFileReader::MultithreadSAMFileReader(InStream* toParse, int numThread, ThreadPool* useThreads){
+	fromSrc = toParse;
+	hitEnd = false;
+	killPool = (useThreads == 0);
+	parseThreads = killPool ? new ThreadPool(numThread) : useThreads;
+	allChunks.resize(2*numThread);
+	try{
+		for(uintptr_t i = 0; i<allChunks.size(); i++){
+			if(!startChunk(&(allChunks[i]))){ break; }
+			liveChunks.push_back(&(allChunks[i]));
+		}
+	}catch(...){
+		for(uintptr_t i = 0; i<liveChunks.size(); i++){ parseThreads->joinTask(liveChunks[i]->taskID); }
+		if(killPool){ delete(parseThreads); }
+		throw;
+	}
+}
+MultithreadSAMFileReader::~MultithreadSAMFileReader(){
+	for(uintptr_t i = 0; i<liveChunks.size(); i++){
+		if(liveChunks[i]->needJoin){ parseThreads->joinTask(liveChunks[i]->taskID); }
+	}
+	if(killPool){ delete(parseThreads); }
+}
+int MultithreadSAMFileReader::readNextEntry(CRBSAMFileContents* toFill){
+	while(liveChunks.size()){
+		MultithreadSAMFileReaderChunk* curChunk = liveChunks[0];
+		if(curChunk->needJoin){
+			parseThreads->joinTask(curChunk->taskID);
+			curChunk->needJoin = false;
+		}
+		if(curChunk->nextEnt < curChunk->numEnts){
+			*toFill = curChunk->ents[curChunk->nextEnt];
+			curChunk->nextEnt++;
+			curEntry++;
+			return 1;
+		}
+		if(curChunk->errMess.size()){ throw std::runtime_error(curChunk->errMess); }
+		liveChunks.pop_front();
+		if(startChunk(curChunk)){ liveChunks.push_back(curChunk); }
+	}
+	return 0;
+}
+bool MultithreadSAMFileReader::startChunk(MultithreadSAMFileReaderChunk* toFill){
+	if(hitEnd){ return false; }
+	std::vector<char>* chunkText = &(toFill->chunkText);
+	chunkText->clear();
+	chunkText->insert(chunkText->end(), carryText.begin(), carryText.end());
+	carryText.clear();
+	//read until there is a full line (or no more text)
+	while(true){
+		uintptr_t oldSize = chunkText->size();
+		chunkText->resize(oldSize + MTSAMREAD_CHUNK_SIZE);
+		uintptr_t numRead = fromSrc->readBytes(&((*chunkText)[oldSize]), MTSAMREAD_CHUNK_SIZE);
+		chunkText->resize(oldSize + numRead);
+		if(numRead == 0){
+			hitEnd = true;
+			break;
+		}
+		uintptr_t lastNL = chunkText->size();
+		while(lastNL > oldSize){
+			if((*chunkText)[lastNL-1] == '\n'){ break; }
+			lastNL--;
+		}
+		if(lastNL > oldSize){
+			carryText.insert(carryText.end(), chunkText->begin() + lastNL, chunkText->end());
+			chunkText->resize(lastNL);
+			break;
+		}
+	}
+	if(chunkText->size() == 0){ return false; }
+	//start parsing
+	toFill->numEnts = 0;
+	toFill->nextEnt = 0;
+	toFill->errMess.clear();
+	toFill->taskID = parseThreads->addTask(multithreadSAMFileReaderParse, toFill, THREADPOOL_PRIORITY_IO);
+	toFill->needJoin = true;
+	return true;
 }
 
 #define SAM_DUMP_ELIDABLE_STRING(varName) \
@@ -259,7 +399,9 @@ void SAMFileWriter::writeNextEntry(CRBSAMFileContents* toFill){
 			tmpS.push_back(flatInit + tmpFlatS[i]);
 			tmpE.push_back(flatInit + tmpFlatE[i]);
 		}
-		splitOnCharacter(&(toFill->entryExtra[0]), &(toFill->entryExtra[0]) + toFill->entryExtra.size(), '\t', &tmpS, &tmpE);
+		if(toFill->entryExtra.size()){
+			splitOnCharacter(&(toFill->entryExtra[0]), &(toFill->entryExtra[0]) + toFill->entryExtra.size(), '\t', &tmpS, &tmpE);
+		}
 		fromTsv->numEntries = tmpS.size();
 		for(uintptr_t i = 0; i<tmpS.size(); i++){ tmpL.push_back(tmpE[i] - tmpS[i]); }
 		fromTsv->entrySizes = &(tmpL[0]);
@@ -649,6 +791,286 @@ int BAMFileReader::readNextEntry(CRBSAMFileContents* toFill){
 	return readNextEntry(toFill);
 }
 
+BAMFileWriter::BAMFileWriter(OutStream* toDump){
+	this->toDump = toDump;
+	doneHead = 0;
+}
+BAMFileWriter::~BAMFileWriter(){
+	//nothing can be thrown from here: a failure is only reported by finish
+	if(!doneHead){
+		try{
+			writeHeader();
+		}catch(std::exception& err){}
+	}
+}
+
+void BAMFileWriter::finish(){
+	if(!doneHead){ writeHeader(); }
+	toDump->finish();
+}
+
+void BAMFileWriter::writeHeader(){
+	doneHead = 1;
+	char tmpBuff[4];
+	toDump->writeBytes("BAM\1", 4);
+	nat2le32(headerTxt.size(), tmpBuff);
+	toDump->writeBytes(tmpBuff, 4);
+	if(headerTxt.size()){ toDump->writeBytes(&(headerTxt[0]), headerTxt.size()); }
+	nat2le32(refNames.size(), tmpBuff);
+	toDump->writeBytes(tmpBuff, 4);
+	for(uintptr_t i = 0; i<refNames.size(); i++){
+		nat2le32(refNames[i].size() + 1, tmpBuff);
+		toDump->writeBytes(tmpBuff, 4);
+		toDump->writeBytes(refNames[i].c_str(), refNames[i].size() + 1);
+		nat2le32(refLens[i], tmpBuff);
+		toDump->writeBytes(tmpBuff, 4);
+	}
+}
+
+int32_t BAMFileWriter::getReferenceIndex(std::vector<char>* refName){
+	if(refName->size() == 0){ return -1; }
+	tempName.clear();
+	tempName.insert(tempName.end(), refName->begin(), refName->end());
+	std::map<std::string,int32_t>::iterator refIt = refInds.find(tempName);
+	if(refIt == refInds.end()){ throw std::runtime_error("Reference " + tempName + " not in BAM header."); }
+	return refIt->second;
+}
+
+uint32_t bamRegionToBin(intptr_t fromI, intptr_t toI){
+	toI--;
+	if((fromI >> 14) == (toI >> 14)){ return ((1<<15)-1)/7 + (fromI >> 14); }
+	if((fromI >> 17) == (toI >> 17)){ return ((1<<12)-1)/7 + (fromI >> 17); }
+	if((fromI >> 20) == (toI >> 20)){ return ((1<<9)-1)/7 + (fromI >> 20); }
+	if((fromI >> 23) == (toI >> 23)){ return ((1<<6)-1)/7 + (fromI >> 23); }
+	if((fromI >> 26) == (toI >> 26)){ return ((1<<3)-1)/7 + (fromI >> 26); }
+	return 0;
+}
+
+void BAMFileWriter::writeNextEntry(CRBSAMFileContents* toFill){
+	if(toFill->lastReadHead){
+		if(doneHead){ throw std::runtime_error("BAM header entries must come before any alignments."); }
+		headerTxt.insert(headerTxt.end(), toFill->headerTxt.begin(), toFill->headerTxt.end());
+		headerTxt.push_back('\n');
+		//note any references
+		if((toFill->headerTxt.size() < 3) || (memcmp(&(toFill->headerTxt[0]), "@SQ", 3) != 0)){ return; }
+		char* headS = &(toFill->headerTxt[0]);
+		tmpS.clear(); tmpE.clear();
+		splitOnCharacter(headS, headS + toFill->headerTxt.size(), '\t', &tmpS, &tmpE);
+		std::string refName;
+		uintptr_t refLen = 0;
+		for(uintptr_t i = 1; i<tmpS.size(); i++){
+			if((tmpE[i] - tmpS[i]) < 3){ continue; }
+			if(memcmp(tmpS[i], "SN:", 3)==0){ refName.insert(refName.end(), tmpS[i] + 3, tmpE[i]); }
+			if(memcmp(tmpS[i], "LN:", 3)==0){ tempName.clear(); tempName.insert(tempName.end(), tmpS[i] + 3, tmpE[i]); refLen = atol(tempName.c_str()); }
+		}
+		if(refInds.find(refName) != refInds.end()){ throw std::runtime_error("Reference " + refName + " in BAM header twice."); }
+		refInds[refName] = refNames.size();
+		refNames.push_back(refName);
+		refLens.push_back(refLen);
+		return;
+	}
+	if(!doneHead){ writeHeader(); }
+	#define BAM_WRITE_BYTE(fromVal) tempStore.push_back(fromVal);
+	#define BAM_WRITE_I16(fromVal) {char tmpBuff[2]; nat2le16(fromVal, tmpBuff); tempStore.insert(tempStore.end(), tmpBuff, tmpBuff + 2);}
+	#define BAM_WRITE_I32(fromVal) {char tmpBuff[4]; nat2le32(fromVal, tmpBuff); tempStore.insert(tempStore.end(), tmpBuff, tmpBuff + 4);}
+	tempStore.clear();
+	tempStore.resize(4); //the length, filled in at the end
+	uintptr_t seqLen = toFill->entrySeq.size();
+	//the constant stuff
+		intptr_t refSpan = 0;
+		uintptr_t numCigOp = 0;
+		for(uintptr_t i = 0; i<toFill->entryCigar.size(); i++){
+			char curC = toFill->entryCigar[i];
+			numCigOp += ((curC < '0') || (curC > '9'));
+		}
+		if(toFill->entryCigar.size()){
+			refSpan = cigarStringReferenceSpan(&(toFill->entryCigar));
+			if(refSpan < 0){ throw std::runtime_error("Malformed cigar string."); }
+		}
+		int32_t refInd = getReferenceIndex(&(toFill->entryReference));
+		//sam uses = for a mate on the same reference
+		std::vector<char>* nextRef = &(toFill->nextReference);
+		int32_t nextRefInd = ((nextRef->size() == 1) && ((*nextRef)[0] == '=')) ? refInd : getReferenceIndex(nextRef);
+		//unplaced entries get the bin of (-1,0)
+		uint32_t entBin = (toFill->entryPos < 0) ? bamRegionToBin(-1, 0) : bamRegionToBin(toFill->entryPos, toFill->entryPos + std::max(refSpan, (intptr_t)1));
+		BAM_WRITE_I32(refInd)
+		BAM_WRITE_I32(toFill->entryPos)
+		BAM_WRITE_BYTE(toFill->entryName.size() + 1)
+		BAM_WRITE_BYTE(toFill->entryMapq)
+		BAM_WRITE_I16(entBin)
+		BAM_WRITE_I16(numCigOp)
+		BAM_WRITE_I16(toFill->entryFlag)
+		BAM_WRITE_I32(seqLen)
+		BAM_WRITE_I32(nextRefInd)
+		BAM_WRITE_I32(toFill->nextPos)
+		BAM_WRITE_I32(toFill->entryTempLen)
+	//name
+		tempStore.insert(tempStore.end(), toFill->entryName.begin(), toFill->entryName.end());
+		tempStore.push_back(0);
+	//cigar
+		const char* cigOpMap = "MIDNSHP=X";
+		uint32_t opCount = 0;
+		for(uintptr_t i = 0; i<toFill->entryCigar.size(); i++){
+			char curC = toFill->entryCigar[i];
+			if((curC >= '0') && (curC <= '9')){
+				opCount = 10*opCount + (curC - '0');
+				continue;
+			}
+			BAM_WRITE_I32((opCount << 4) | (strchr(cigOpMap, curC) - cigOpMap))
+			opCount = 0;
+		}
+	//sequence
+		const char* seqBaseMap = "=ACMGRSVTWYHKDBN";
+		uintptr_t seqStart = tempStore.size();
+		tempStore.resize(seqStart + ((seqLen + 1)/2));
+		for(uintptr_t i = 0; i<seqLen; i++){
+			const char* baseLoc = strchr(seqBaseMap, toupper(toFill->entrySeq[i]));
+			char baseCode = (baseLoc && *baseLoc) ? (baseLoc - seqBaseMap) : 15;
+			tempStore[seqStart + (i>>1)] |= (i & 1) ? baseCode : (baseCode << 4);
+		}
+	//quality
+		if(toFill->entryQual.size()){
+			for(uintptr_t i = 0; i<seqLen; i++){
+				tempStore.push_back(toFill->entryQual[i] - 33);
+			}
+		}
+		else{
+			tempStore.insert(tempStore.end(), seqLen, (char)0x00FF);
+		}
+	//extra tags
+		if(toFill->entryExtra.size()){
+			char* extS = &(toFill->entryExtra[0]);
+			tmpS.clear(); tmpE.clear();
+			splitOnCharacter(extS, extS + toFill->entryExtra.size(), '\t', &tmpS, &tmpE);
+			for(uintptr_t i = 0; i<tmpS.size(); i++){
+				char* tagS = tmpS[i];
+				char* tagE = tmpE[i];
+				if(((tagE - tagS) < 5) || (tagS[2] != ':') || (tagS[4] != ':')){ throw std::runtime_error("Malformed extra field."); }
+				tempName.clear();
+				tempName.insert(tempName.end(), tagS + 5, tagE);
+				tempStore.push_back(tagS[0]);
+				tempStore.push_back(tagS[1]);
+				switch(tagS[3]){
+					case 'A':
+						if(tempName.size() != 1){ throw std::runtime_error("Character extra field must be one character."); }
+						tempStore.push_back('A');
+						tempStore.push_back(tempName[0]);
+						break;
+					case 'i':{
+						long long tagV = atoll(tempName.c_str());
+						if(tagV > 0x7FFFFFFFLL){
+							tempStore.push_back('I');
+						}
+						else{
+							tempStore.push_back('i');
+						}
+						BAM_WRITE_I32(tagV)
+						}break;
+					case 'f':{
+						float tagV = atof(tempName.c_str());
+						uint32_t tagB;
+						memcpy(&tagB, &tagV, 4);
+						tempStore.push_back('f');
+						BAM_WRITE_I32(tagB)
+						}break;
+					case 'Z':
+					case 'H':
+						tempStore.push_back(tagS[3]);
+						tempStore.insert(tempStore.end(), tempName.begin(), tempName.end());
+						tempStore.push_back(0);
+						break;
+					case 'B':{
+						if(tempName.size() == 0){ throw std::runtime_error("Array extra field missing type."); }
+						char subTp = tempName[0];
+						tempStore.push_back('B');
+						tempStore.push_back(subTp);
+						uintptr_t countI = tempStore.size();
+						BAM_WRITE_I32(0)
+						uint32_t numVal = 0;
+						const char* curV = tempName.c_str() + 1;
+						while(*curV == ','){
+							curV++;
+							switch(subTp){
+								case 'c':
+								case 'C':
+									BAM_WRITE_BYTE(atol(curV)) break;
+								case 's':
+								case 'S':
+									BAM_WRITE_I16(atol(curV)) break;
+								case 'i':
+								case 'I':
+									BAM_WRITE_I32(atoll(curV)) break;
+								case 'f':{
+									float tagV = atof(curV);
+									uint32_t tagB;
+									memcpy(&tagB, &tagV, 4);
+									BAM_WRITE_I32(tagB)
+									}break;
+								default:
+									throw std::runtime_error("Unknown array extra field type code.");
+							}
+							numVal++;
+							curV = strchr(curV, ',');
+							if(curV == 0){ break; }
+						}
+						nat2le32(numVal, &(tempStore[countI]));
+						}break;
+					default:
+						throw std::runtime_error("Unknown extra field type code.");
+				}
+			}
+		}
+	//and dump
+		nat2le32(tempStore.size() - 4, &(tempStore[0]));
+		toDump->writeBytes(&(tempStore[0]), tempStore.size());
+}
+
+BAMIndexReference::BAMIndexReference(){
+	maxChunkEnd = 0;
+}
+BAMIndexReference::~BAMIndexReference(){}
+
+BAMFileIndex::BAMFileIndex(InStream* toParse){
+	char tmpBuff[16];
+	#define BAI_READ(numBytes, errMess) if(toParse->readBytes(tmpBuff, numBytes) != numBytes){ throw std::runtime_error(errMess); }
+	BAI_READ(4, "No magic in BAM index.")
+	if(memcmp(tmpBuff, "BAI\1", 4)!=0){ throw std::runtime_error("Bad magic in BAM index."); }
+	BAI_READ(4, "BAM index missing reference count.")
+	uint32_t numRef = le2nat32(tmpBuff);
+	refIndex.resize(numRef);
+	for(uint32_t ri = 0; ri<numRef; ri++){
+		BAMIndexReference* curRef = &(refIndex[ri]);
+		BAI_READ(4, "BAM index missing bin count.")
+		uint32_t numBin = le2nat32(tmpBuff);
+		for(uint32_t bi = 0; bi<numBin; bi++){
+			BAI_READ(8, "BAM index missing bin.")
+			uint32_t binID = le2nat32(tmpBuff);
+			uint32_t numChunk = le2nat32(tmpBuff + 4);
+			std::vector< std::pair<uint64_t,uint64_t> >* curChunks = &(curRef->binChunks[binID]);
+			for(uint32_t ci = 0; ci<numChunk; ci++){
+				BAI_READ(16, "BAM index missing chunk.")
+				std::pair<uint64_t,uint64_t> curChunk(le2nat64(tmpBuff), le2nat64(tmpBuff + 8));
+				curChunks->push_back(curChunk);
+				if((binID != BAM_INDEX_METABIN) && (curChunk.second > curRef->maxChunkEnd)){
+					curRef->maxChunkEnd = curChunk.second;
+				}
+			}
+		}
+		BAI_READ(4, "BAM index missing linear index size.")
+		uint32_t numIntv = le2nat32(tmpBuff);
+		curRef->linearIndex.resize(numIntv);
+		for(uint32_t ii = 0; ii<numIntv; ii++){
+			BAI_READ(8, "BAM index missing linear index entry.")
+			curRef->linearIndex[ii] = le2nat64(tmpBuff);
+		}
+	}
+	numNoCoord = -1;
+	if(toParse->readBytes(tmpBuff, 8) == 8){
+		numNoCoord = le2nat64(tmpBuff);
+	}
+}
+BAMFileIndex::~BAMFileIndex(){}
+
 std::pair<uintptr_t,uintptr_t> cigarStringToReferencePositions(uintptr_t refPos0, std::vector<char>* cigStr, std::vector<intptr_t>* fillPos){
 	uintptr_t curRef = refPos0;
 	int seenAction = 0;
@@ -734,6 +1156,41 @@ std::pair<intptr_t,intptr_t> getCigarReferenceBounds(std::vector<intptr_t>* look
 	return std::pair<intptr_t,intptr_t>(-1,-1);
 }
 
+intptr_t cigarStringReferenceSpan(std::vector<char>* cigStr){
+	intptr_t totSpan = 0;
+	intptr_t opCount = 0;
+	bool haveCount = false;
+	for(uintptr_t i = 0; i<cigStr->size(); i++){
+		char curC = (*cigStr)[i];
+		if((curC >= '0') && (curC <= '9')){
+			opCount = 10*opCount + (curC - '0');
+			haveCount = true;
+			continue;
+		}
+		if(!haveCount){ return -1; }
+		switch(curC){
+			case 'M':
+			case '=':
+			case 'X':
+			case 'D':
+			case 'N':
+				totSpan += opCount;
+				break;
+			case 'I':
+			case 'S':
+			case 'H':
+			case 'P':
+				break;
+			default:
+				return -1;
+		}
+		opCount = 0;
+		haveCount = false;
+	}
+	if(haveCount){ return -1; }
+	return totSpan;
+}
+
 void openCRBSamFileRead(const char* fileName, InStream** saveIS, TabularReader** saveTS, CRBSAMFileReader** saveSS){
 	if(strcmp(fileName, "-")==0){
 		*saveIS = new ConsoleInStream();
@@ -759,6 +1216,30 @@ void openCRBSamFileRead(const char* fileName, InStream** saveIS, TabularReader**
 	*saveSS = new SAMFileReader(*saveTS);
 }
 
+void openCRBSamFileRead(const char* fileName, InStream** saveIS, TabularReader** saveTS, CRBSAMFileReader** saveSS, int numThread, ThreadPool* useThreads){
+	if((numThread <= 1) || (strendswith(fileName, ".bam") && strcmp(fileName, "-"))){
+		openCRBSamFileRead(fileName, saveIS, saveTS, saveSS);
+		return;
+	}
+	if(strcmp(fileName, "-")==0){
+		*saveIS = new ConsoleInStream();
+	}
+	else if(strendswith(fileName, ".sam.gz") || strendswith(fileName, ".sam.gzip")){
+		*saveIS = new GZipInStream(fileName);
+	}
+	else{
+		*saveIS = new FileInStream(fileName);
+	}
+	*saveTS = 0;
+	try{
+		*saveSS = new MultithreadSAMFileReader(*saveIS, numThread, useThreads);
+	}catch(...){
+		delete(*saveIS);
+		*saveIS = 0;
+		throw;
+	}
+}
+
 void openCRBSamFileWrite(const char* fileName, OutStream** saveIS, TabularWriter** saveTS, CRBSAMFileWriter** saveSS){
 	if(strcmp(fileName, "-")==0){
 		*saveIS = new ConsoleOutStream();
@@ -775,7 +1256,12 @@ void openCRBSamFileWrite(const char* fileName, OutStream** saveIS, TabularWriter
 		return;
 		*/
 	}
-	//TODO write BAM
+	if(strendswith(fileName, ".bam")){
+		*saveIS = new BGZipOutStream(0, fileName);
+		*saveTS = 0;
+		*saveSS = new BAMFileWriter(*saveIS);
+		return;
+	}
 	//sam is the default
 	*saveIS = new FileOutStream(0, fileName);
 	*saveTS = new TSVTabularWriter(0, *saveIS);
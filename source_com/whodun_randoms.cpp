@@ -1,6 +1,7 @@
 #include "whodun_randoms.h"
 
 #include <math.h>
+#include <vector>
 
 RandomGenerator::~RandomGenerator(){}
 
@@ -140,3 +141,46 @@ char MersenneTwisterGenerator::getByte(){
 	return getByte();
 }
 
+void seedRandomGenerator(RandomGenerator* toSeed, uint64_t seedVal){
+	std::vector<char> seedBytes(toSeed->seedSize());
+	uint64_t seedState = seedVal;
+	for(uintptr_t i = 0; i<seedBytes.size(); i+=8){
+		seedState += 0x9E3779B97F4A7C15ULL;
+		uint64_t curMix = seedState;
+		curMix = (curMix ^ (curMix >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		curMix = (curMix ^ (curMix >> 27)) * 0x94D049BB133111EBULL;
+		curMix = curMix ^ (curMix >> 31);
+		for(uintptr_t j = 0; (j<8) && ((i+j) < seedBytes.size()); j++){
+			seedBytes[i+j] = (char)(curMix >> (8*j));
+		}
+	}
+	toSeed->seed(&(seedBytes[0]));
+}
+
+BufferedRandomSource::BufferedRandomSource(uint64_t seedVal){
+	uniNext = RANDOM_BUFFER_SIZE;
+	normNext = RANDOM_BUFFER_SIZE;
+	seedRandomGenerator(&randGen, seedVal);
+}
+
+BufferedRandomSource::~BufferedRandomSource(){}
+
+double BufferedRandomSource::nextUniform(){
+	if(uniNext >= RANDOM_BUFFER_SIZE){
+		randGen.getDoubles(RANDOM_BUFFER_SIZE, uniBuff);
+		uniNext = 0;
+	}
+	double toRet = 1.0 - uniBuff[uniNext];
+	uniNext++;
+	return toRet;
+}
+
+double BufferedRandomSource::nextNormal(){
+	if(normNext >= RANDOM_BUFFER_SIZE){
+		randGen.getStandardNormal(RANDOM_BUFFER_SIZE, normBuff);
+		normNext = 0;
+	}
+	double toRet = normBuff[normNext];
+	normNext++;
+	return toRet;
+}
@@ -8,8 +8,6 @@ typedef struct{
 	const void* myFrom;
 	/**The number of bytes to copy.*/
 	size_t myNumB;
-	/**The ID of this task.*/
-	uintptr_t threadID;
 } MTMemcpyUniform;
 
 /**
@@ -35,12 +33,9 @@ void* memcpymt(void* cpyTo, const void* cpyFrom, size_t numBts, unsigned numThre
 			curUniD->myTo = curTo;
 			curUniD->myFrom = curFrom;
 			curUniD->myNumB = curNum;
-		curUniD->threadID = mainPool->addTask(memcpymt_sub, curUniD);
 		curOff += curNum;
 	}
-	for(uintptr_t i = 0; i<numThread; i++){
-		mainPool->joinTask(memcpyUnis[i].threadID);
-	}
+	mainPool->forkJoin(memcpymt_sub, numThread, &(memcpyUnis[0]), sizeof(MTMemcpyUniform));
 	return cpyTo;
 }
 
@@ -52,8 +47,6 @@ typedef struct{
 	int myVal;
 	/**The number of bytes.*/
 	size_t myNumB;
-	/**The ID of this task.*/
-	uintptr_t threadID;
 } MTMemsetUniform;
 
 /**
@@ -78,12 +71,9 @@ void* memsetmt(void* setP, int value, size_t numBts, unsigned numThread, ThreadP
 			curUniD->myTo = curTo;
 			curUniD->myVal = value;
 			curUniD->myNumB = curNum;
-		curUniD->threadID = mainPool->addTask(memsetmt_sub, curUniD);
 		curOff += curNum;
 	}
-	for(uintptr_t i = 0; i<numThread; i++){
-		mainPool->joinTask(memcpyUnis[i].threadID);
-	}
+	mainPool->forkJoin(memsetmt_sub, numThread, &(memcpyUnis[0]), sizeof(MTMemsetUniform));
 	return setP;
 }
 
@@ -95,8 +85,6 @@ typedef struct{
 	char* myFrom;
 	/**The number of bytes.*/
 	size_t myNumB;
-	/**The ID of this task.*/
-	uintptr_t threadID;
 } MTMemswapUniform;
 
 /**
@@ -122,12 +110,9 @@ void memswapmt(char* arrA, char* arrB, size_t numBts, unsigned numThread, Thread
 			curUniD->myTo = curTo;
 			curUniD->myFrom = curFrom;
 			curUniD->myNumB = curNum;
-		curUniD->threadID = mainPool->addTask(memswapmt_sub, curUniD);
 		curOff += curNum;
 	}
-	for(uintptr_t i = 0; i<numThread; i++){
-		mainPool->joinTask(memcpyUnis[i].threadID);
-	}
+	mainPool->forkJoin(memswapmt_sub, numThread, &(memcpyUnis[0]), sizeof(MTMemswapUniform));
 }
 
 
@@ -5,40 +5,57 @@
 #include "whodun_thread.h"
 #include "whodun_oshook.h"
 
-void threadFunc(void* thePoolP){
-	ThreadPool* thePool = (ThreadPool*)thePoolP;
+/**The pool thread running on this thread, if any.*/
+static thread_local ThreadPoolWorker* threadPoolCurWorker = 0;
+
+void threadFunc(void* theWorkP){
+	ThreadPoolWorker* theWork = (ThreadPoolWorker*)theWorkP;
+	ThreadPool* thePool = theWork->myPool;
+	threadPoolCurWorker = theWork;
 	lockMutex(thePool->taskMut);
-	while(thePool->poolLive){
-		if(thePool->waitTask.size()){
-			//run the task
-			ThreadPoolTaskInfo curTask = thePool->waitTask[0];
-			thePool->waitTask.pop_front();
-			unlockMutex(thePool->taskMut);
-			curTask.taskFun(curTask.taskUni);
-			lockMutex(thePool->taskMut);
-			//let things know they're done
-			thePool->doneTasks.insert(curTask.taskID);
-			thePool->hotTasks.erase(curTask.taskID);
-			std::map<uintptr_t,void*>::iterator idIt = thePool->doneCondMap.find(curTask.taskID);
-			if(idIt != thePool->doneCondMap.end()){
-				signalCondition(thePool->taskMut, idIt->second);
-			}
-		}
-		else{
-			waitCondition(thePool->taskMut, thePool->taskCond);
+		uintptr_t seenPush = thePool->numPushed;
+	unlockMutex(thePool->taskMut);
+	while(true){
+		//look for something to do
+		ThreadPoolTaskInfo* curTask = thePool->takeTask(theWork, THREADPOOL_PRIORITY_STAGE);
+		if(curTask){
+			thePool->runTask(curTask);
+			continue;
 		}
+		//sleep until something new shows up
+		lockMutex(thePool->taskMut);
+			while(thePool->poolLive && (thePool->numPushed == seenPush)){
+				waitCondition(thePool->taskMut, thePool->taskCond);
+			}
+			if(!(thePool->poolLive)){
+				unlockMutex(thePool->taskMut);
+				break;
+			}
+			seenPush = thePool->numPushed;
+		unlockMutex(thePool->taskMut);
 	}
-	unlockMutex(thePool->taskMut);
+	threadPoolCurWorker = 0;
 }
 
 ThreadPool::ThreadPool(int numThread){
-	nextID = 0;
 	numThr = numThread;
+	numJoinWait = 0;
+	numPushed = 0;
+	nextQueue = 0;
+	numLive = 0;
 	poolLive = true;
 	taskMut = makeMutex();
 	taskCond = makeCondition(taskMut);
+	doneCond = makeCondition(taskMut);
+	for(int i = 0; i<numThread; i++){
+		ThreadPoolWorker* curWork = new ThreadPoolWorker();
+		curWork->myPool = this;
+		curWork->myIndex = i;
+		curWork->queueMut = makeMutex();
+		allWorkers.push_back(curWork);
+	}
 	for(int i = 0; i<numThread; i++){
-		liveThread.push_back(startThread(threadFunc, this));
+		liveThread.push_back(startThread(threadFunc, allWorkers[i]));
 	}
 }
 
@@ -50,55 +67,214 @@ ThreadPool::~ThreadPool(){
 	for(unsigned i = 0; i<liveThread.size(); i++){
 		joinThread(liveThread[i]);
 	}
-	if(hotTasks.size() || doneTasks.size()){
+	if(numLive){
 		//killing pool with stuff in the queue
 		std::terminate();
 	}
-	for(uintptr_t i = 0; i<saveConds.size(); i++){
-		killCondition(saveConds[i]);
+	for(uintptr_t i = 0; i<allWorkers.size(); i++){
+		killMutex(allWorkers[i]->queueMut);
+		delete(allWorkers[i]);
+	}
+	for(uintptr_t i = 0; i<slotChunks.size(); i++){
+		delete[](slotChunks[i]);
 	}
+	killCondition(doneCond);
 	killCondition(taskCond);
 	killMutex(taskMut);
 }
 
 uintptr_t ThreadPool::addTask(void (*toDo)(void*), void* toPass){
+	return addTask(toDo, toPass, THREADPOOL_PRIORITY_COMPUTE);
+}
+
+uintptr_t ThreadPool::addTask(void (*toDo)(void*), void* toPass, int priority){
+	ThreadPoolWorker* curWork = threadPoolCurWorker;
 	lockMutex(taskMut);
-		while(hotTasks.count(nextID) || doneTasks.count(nextID)){
-			nextID++;
+		//get a slot
+		if(freeSlots.size() == 0){
+			ThreadPoolTaskInfo* newChunk = new ThreadPoolTaskInfo[THREADPOOL_SLOT_CHUNK];
+			uintptr_t baseID = THREADPOOL_SLOT_CHUNK * slotChunks.size();
+			for(uintptr_t i = 0; i<THREADPOOL_SLOT_CHUNK; i++){
+				newChunk[i].taskID = baseID + i;
+				newChunk[i].taskGen = 0;
+				newChunk[i].taskState = THREADPOOL_TASK_FREE;
+			}
+			slotChunks.push_back(newChunk);
+			for(uintptr_t i = THREADPOOL_SLOT_CHUNK; i>0; i--){
+				freeSlots.push_back(baseID + i - 1);
+			}
+		}
+		uintptr_t slotI = freeSlots[freeSlots.size()-1];
+		freeSlots.pop_back();
+		numLive++;
+		ThreadPoolTaskInfo* curTask = slotChunks[slotI / THREADPOOL_SLOT_CHUNK] + (slotI % THREADPOOL_SLOT_CHUNK);
+		curTask->taskFun = toDo;
+		curTask->taskUni = toPass;
+		curTask->taskState = THREADPOOL_TASK_QUEUED;
+		curTask->taskPriority = priority;
+		uintptr_t toRet = (curTask->taskGen << THREADPOOL_SLOT_BITS) | slotI;
+		//pick a queue: our own if on a pool thread, otherwise spread it around
+		if(allWorkers.size()){
+			if(curWork && (curWork->myPool == this)){
+				curTask->taskQueue = curWork->myIndex;
+			}
+			else{
+				curTask->taskQueue = nextQueue;
+				nextQueue = (nextQueue + 1) % allWorkers.size();
+			}
+			ThreadPoolWorker* toWork = allWorkers[curTask->taskQueue];
+			lockMutex(toWork->queueMut);
+				toWork->waitTask[priority].push_back(curTask);
+			unlockMutex(toWork->queueMut);
 		}
-		ThreadPoolTaskInfo nextTask = {nextID, toDo, toPass};
-		waitTask.push_back( nextTask );
-		hotTasks.insert(nextID);
-		nextID++;
+		//wake somebody up
+		numPushed++;
 		signalCondition(taskMut, taskCond);
 	unlockMutex(taskMut);
-	return nextTask.taskID;
+	return toRet;
 }
 
 void ThreadPool::joinTask(uintptr_t taskID){
-	lockMutex(taskMut);
-		std::set<uintptr_t>::iterator doneIt = doneTasks.find(taskID);
-		if(doneIt == doneTasks.end()){
-			//make a unique condition to wait on
-				void* newCond;
-				if(saveConds.size()){
-					newCond = saveConds[saveConds.size()-1];
-					saveConds.pop_back();
-				}
-				else{
-					newCond = makeCondition(taskMut);
-				}
-			//note the wait and wait
-				doneCondMap[taskID] = newCond;
-				while(doneIt == doneTasks.end()){
-					waitCondition(taskMut, newCond);
-					doneIt = doneTasks.find(taskID);
+	uintptr_t slotI = taskID & ((((uintptr_t)1) << THREADPOOL_SLOT_BITS) - 1);
+	uintptr_t slotG = taskID >> THREADPOOL_SLOT_BITS;
+	//find the slot
+		lockMutex(taskMut);
+			ThreadPoolTaskInfo* curTask = 0;
+			if((slotI / THREADPOOL_SLOT_CHUNK) < slotChunks.size()){
+				curTask = slotChunks[slotI / THREADPOOL_SLOT_CHUNK] + (slotI % THREADPOOL_SLOT_CHUNK);
+				if((curTask->taskGen != slotG) || (curTask->taskState == THREADPOOL_TASK_FREE)){ curTask = 0; }
+			}
+		unlockMutex(taskMut);
+		if(curTask == 0){
+			throw std::runtime_error("Join on a task that is not in the pool.");
+		}
+	//if it has not started, run it here
+		bool runHere = false;
+		if(allWorkers.size()){
+			ThreadPoolWorker* inWork = allWorkers[curTask->taskQueue];
+			lockMutex(inWork->queueMut);
+				if(curTask->taskState == THREADPOOL_TASK_QUEUED){
+					std::deque<ThreadPoolTaskInfo*>* inQueue = &(inWork->waitTask[curTask->taskPriority]);
+					std::deque<ThreadPoolTaskInfo*>::iterator taskIt = inQueue->end();
+					while(taskIt != inQueue->begin()){
+						taskIt--;
+						if(*taskIt == curTask){ break; }
+					}
+					inQueue->erase(taskIt);
+					curTask->taskState = THREADPOOL_TASK_RUNNING;
+					runHere = true;
 				}
-			//clean up
-				saveConds.push_back(newCond);
-				doneCondMap.erase(taskID);
+			unlockMutex(inWork->queueMut);
+		}
+		else{
+			curTask->taskState = THREADPOOL_TASK_RUNNING;
+			runHere = true;
+		}
+		if(runHere){
+			try{
+				curTask->taskFun(curTask->taskUni);
+			}catch(...){
+				lockMutex(taskMut);
+					curTask->taskState = THREADPOOL_TASK_FREE;
+					curTask->taskGen++;
+					freeSlots.push_back(slotI);
+					numLive--;
+				unlockMutex(taskMut);
+				throw;
+			}
+		}
+	//wait for it to finish, then free the slot
+		lockMutex(taskMut);
+			if(runHere){
+				curTask->taskState = THREADPOOL_TASK_DONE;
+			}
+			while(curTask->taskState != THREADPOOL_TASK_DONE){
+				numJoinWait++;
+				waitCondition(taskMut, doneCond);
+				numJoinWait--;
+			}
+			curTask->taskState = THREADPOOL_TASK_FREE;
+			curTask->taskGen++;
+			freeSlots.push_back(slotI);
+			numLive--;
+		unlockMutex(taskMut);
+}
+
+void ThreadPool::forkJoin(void (*toDo)(void*), uintptr_t numTask, void* toPass, uintptr_t passSize){
+	if(numTask == 0){ return; }
+	char* passBase = (char*)toPass;
+	std::vector<uintptr_t> forkIDs;
+	for(uintptr_t i = 1; i<numTask; i++){
+		forkIDs.push_back(addTask(toDo, passBase + i*passSize));
+	}
+	//join in reverse: any still waiting on this thread's queue will be at the back
+	uintptr_t i = forkIDs.size();
+	try{
+		toDo(toPass);
+		while(i){
+			i--;
+			joinTask(forkIDs[i]);
+		}
+	}catch(...){
+		while(i){
+			i--;
+			try{ joinTask(forkIDs[i]); }catch(...){}
+		}
+		throw;
+	}
+}
+
+bool ThreadPool::helpTask(){
+	ThreadPoolWorker* curWork = threadPoolCurWorker;
+	if(curWork && (curWork->myPool != this)){ curWork = 0; }
+	ThreadPoolTaskInfo* curTask = takeTask(curWork, THREADPOOL_PRIORITY_IO);
+	if(curTask == 0){ return false; }
+	runTask(curTask);
+	return true;
+}
+
+ThreadPoolTaskInfo* ThreadPool::takeTask(ThreadPoolWorker* forWork, int firstPriority){
+	ThreadPoolTaskInfo* toRet = 0;
+	uintptr_t numWork = allWorkers.size();
+	for(int pi = firstPriority; pi < THREADPOOL_NUM_PRIORITY; pi++){
+		//newest from our own queue
+			if(forWork){
+				lockMutex(forWork->queueMut);
+					std::deque<ThreadPoolTaskInfo*>* ownQueue = &(forWork->waitTask[pi]);
+					if(ownQueue->size()){
+						toRet = ownQueue->back();
+						ownQueue->pop_back();
+						toRet->taskState = THREADPOOL_TASK_RUNNING;
+					}
+				unlockMutex(forWork->queueMut);
+				if(toRet){ return toRet; }
+			}
+		//oldest from somebody else
+			uintptr_t startI = forWork ? (forWork->myIndex + 1) : 0;
+			uintptr_t numOth = forWork ? (numWork - 1) : numWork;
+			for(uintptr_t i = 0; i<numOth; i++){
+				ThreadPoolWorker* othWork = allWorkers[(startI + i) % numWork];
+				lockMutex(othWork->queueMut);
+					std::deque<ThreadPoolTaskInfo*>* othQueue = &(othWork->waitTask[pi]);
+					if(othQueue->size()){
+						toRet = othQueue->front();
+						othQueue->pop_front();
+						toRet->taskState = THREADPOOL_TASK_RUNNING;
+					}
+				unlockMutex(othWork->queueMut);
+				if(toRet){ return toRet; }
+			}
+	}
+	return 0;
+}
+
+void ThreadPool::runTask(ThreadPoolTaskInfo* toRun){
+	toRun->taskFun(toRun->taskUni);
+	lockMutex(taskMut);
+		toRun->taskState = THREADPOOL_TASK_DONE;
+		if(numJoinWait){
+			broadcastCondition(taskMut, doneCond);
 		}
-		doneTasks.erase(doneIt);
 	unlockMutex(taskMut);
 }
 
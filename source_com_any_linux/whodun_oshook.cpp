@@ -6,13 +6,20 @@
 #include <iostream>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <errno.h>
 
+#include <fcntl.h>
 #include <dlfcn.h>
 #include <dirent.h>
 #include <unistd.h>
+#include <sched.h>
 #include <pthread.h>
+#include <sys/un.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 
 const char* pathElementSep = "/";
 
@@ -42,6 +49,25 @@ intptr_t ftellPointer(FILE* stream){
 	return ftell(stream);
 }
 
+void* mapFileRead(const char* fileName, uintptr_t* mapSize){
+	int fileD = open(fileName, O_RDONLY);
+	if(fileD < 0){ return 0; }
+	struct stat fdatBuff;
+	if(fstat(fileD, &fdatBuff) || (fdatBuff.st_size == 0)){
+		close(fileD);
+		return 0;
+	}
+	void* toRet = mmap(0, fdatBuff.st_size, PROT_READ, MAP_SHARED, fileD, 0);
+	close(fileD);
+	if(toRet == MAP_FAILED){ return 0; }
+	*mapSize = fdatBuff.st_size;
+	return toRet;
+}
+
+void unmapFile(void* mapAddr, uintptr_t mapSize){
+	munmap(mapAddr, mapSize);
+}
+
 /**Passable info for a thread.*/
 typedef struct{
 	/**The function.*/
@@ -113,6 +139,17 @@ void waitCondition(void* forMutex, void* forCondition){
     pthread_cond_wait(curCond, curSect);
 }
 
+void waitConditionTimed(void* forMutex, void* forCondition, uintmax_t maxWait){
+	pthread_cond_t* curCond = (pthread_cond_t*)forCondition;
+	pthread_mutex_t* curSect = (pthread_mutex_t*)forMutex;
+	struct timespec waitTo;
+	clock_gettime(CLOCK_REALTIME, &waitTo);
+	uintmax_t totNano = waitTo.tv_nsec + maxWait;
+	waitTo.tv_sec += totNano / 1000000000;
+	waitTo.tv_nsec = totNano % 1000000000;
+	pthread_cond_timedwait(curCond, curSect, &waitTo);
+}
+
 void signalCondition(void* forMutex, void* forCondition){
 	pthread_cond_t* curCond = (pthread_cond_t*)forCondition;
     pthread_cond_signal(curCond);
@@ -129,6 +166,133 @@ void killCondition(void* forCondition){
     free(curCond);
 }
 
+uintmax_t getMonotonicTime(){
+	struct timespec curTime;
+	clock_gettime(CLOCK_MONOTONIC, &curTime);
+	return ((uintmax_t)curTime.tv_sec)*1000000000 + curTime.tv_nsec;
+}
+
+bool pinThisThread(uintptr_t cpuI){
+	if(cpuI >= CPU_SETSIZE){
+		return false;
+	}
+	cpu_set_t useSet;
+	CPU_ZERO(&useSet);
+	CPU_SET(cpuI, &useSet);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &useSet) == 0;
+}
+
+/**A listening local socket.*/
+typedef struct{
+	/**The socket.*/
+	int sockD;
+	/**The name of the socket file.*/
+	struct sockaddr_un sockAddr;
+} LocalServerStruct;
+
+/**
+ * Fill in the address of a local socket.
+ * @param sockName The name of the socket file.
+ * @param toFill The address to fill.
+ * @return Whether the name fit.
+ */
+bool fillLocalAddress(const char* sockName, struct sockaddr_un* toFill){
+	memset(toFill, 0, sizeof(struct sockaddr_un));
+	toFill->sun_family = AF_UNIX;
+	if(strlen(sockName) >= sizeof(toFill->sun_path)){ return false; }
+	strcpy(toFill->sun_path, sockName);
+	return true;
+}
+
+void* openLocalServer(const char* sockName){
+	LocalServerStruct* toRet = (LocalServerStruct*)malloc(sizeof(LocalServerStruct));
+	if(!fillLocalAddress(sockName, &(toRet->sockAddr))){ free(toRet); return 0; }
+	toRet->sockD = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(toRet->sockD < 0){ free(toRet); return 0; }
+	unlink(sockName);
+	if(bind(toRet->sockD, (struct sockaddr*)&(toRet->sockAddr), sizeof(struct sockaddr_un)) || listen(toRet->sockD, SOMAXCONN)){
+		close(toRet->sockD);
+		free(toRet);
+		return 0;
+	}
+	return toRet;
+}
+
+void* acceptLocalConnection(void* theServer){
+	LocalServerStruct* theServ = (LocalServerStruct*)theServer;
+	int connD = accept(theServ->sockD, 0, 0);
+	while((connD < 0) && (errno == EINTR)){
+		connD = accept(theServ->sockD, 0, 0);
+	}
+	if(connD < 0){ return 0; }
+	int* toRet = (int*)malloc(sizeof(int));
+	*toRet = connD;
+	return toRet;
+}
+
+void closeLocalServer(void* theServer){
+	LocalServerStruct* theServ = (LocalServerStruct*)theServer;
+	close(theServ->sockD);
+	unlink(theServ->sockAddr.sun_path);
+	free(theServ);
+}
+
+void* connectLocalServer(const char* sockName){
+	struct sockaddr_un sockAddr;
+	if(!fillLocalAddress(sockName, &sockAddr)){ return 0; }
+	int connD = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(connD < 0){ return 0; }
+	if(connect(connD, (struct sockaddr*)&sockAddr, sizeof(struct sockaddr_un))){
+		close(connD);
+		return 0;
+	}
+	int* toRet = (int*)malloc(sizeof(int));
+	*toRet = connD;
+	return toRet;
+}
+
+intptr_t readLocalConnection(void* theConn, char* toFill, uintptr_t numRead){
+	int connD = *((int*)theConn);
+	ssize_t numGot = recv(connD, toFill, numRead, 0);
+	while((numGot < 0) && (errno == EINTR)){
+		numGot = recv(connD, toFill, numRead, 0);
+	}
+	return numGot;
+}
+
+bool writeLocalConnection(void* theConn, const char* toWrite, uintptr_t numWrite){
+	int connD = *((int*)theConn);
+	while(numWrite){
+		//a closed connection should be an error, not a signal
+		ssize_t numPut = send(connD, toWrite, numWrite, MSG_NOSIGNAL);
+		if(numPut < 0){
+			if(errno == EINTR){ continue; }
+			return false;
+		}
+		toWrite += numPut;
+		numWrite -= numPut;
+	}
+	return true;
+}
+
+bool setLocalConnectionTimeout(void* theConn, uintmax_t maxWait){
+	int connD = *((int*)theConn);
+	struct timeval waitTime;
+	waitTime.tv_sec = maxWait / 1000000000;
+	waitTime.tv_usec = (maxWait % 1000000000) / 1000;
+	//a zero timeval waits forever, so round anything short up
+	if(maxWait && (waitTime.tv_sec == 0) && (waitTime.tv_usec == 0)){ waitTime.tv_usec = 1; }
+	if(setsockopt(connD, SOL_SOCKET, SO_RCVTIMEO, &waitTime, sizeof(waitTime))){ return false; }
+	if(setsockopt(connD, SOL_SOCKET, SO_SNDTIMEO, &waitTime, sizeof(waitTime))){ return false; }
+	return true;
+}
+
+void closeLocalConnection(void* theConn){
+	int* connD = (int*)theConn;
+	close(*connD);
+	free(connD);
+}
+
 typedef struct{
 	void* dllMod;
 } DLLibStruct;
@@ -38,6 +38,28 @@ intptr_t ftellPointer(FILE* stream){
 	return _ftelli64(stream);
 }
 
+void* mapFileRead(const char* fileName, uintptr_t* mapSize){
+	HANDLE fileH = CreateFile(fileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if(fileH == INVALID_HANDLE_VALUE){ return 0; }
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(fileH, &fileSize) || (fileSize.QuadPart == 0)){
+		CloseHandle(fileH);
+		return 0;
+	}
+	HANDLE mapH = CreateFileMapping(fileH, 0, PAGE_READONLY, 0, 0, 0);
+	CloseHandle(fileH);
+	if(mapH == 0){ return 0; }
+	void* toRet = MapViewOfFile(mapH, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapH);
+	if(toRet == 0){ return 0; }
+	*mapSize = fileSize.QuadPart;
+	return toRet;
+}
+
+void unmapFile(void* mapAddr, uintptr_t mapSize){
+	UnmapViewOfFile(mapAddr);
+}
+
 /**Passable info for a thread.*/
 typedef struct{
 	/**The function.*/
@@ -110,6 +132,12 @@ void waitCondition(void* forMutex, void* forCondition){
 	SleepConditionVariableCS(curCond, curSect, INFINITE);
 }
 
+void waitConditionTimed(void* forMutex, void* forCondition, uintmax_t maxWait){
+	CRITICAL_SECTION* curSect = (CRITICAL_SECTION*)forMutex;
+	CONDITION_VARIABLE* curCond = (CONDITION_VARIABLE*)forCondition;
+	SleepConditionVariableCS(curCond, curSect, (DWORD)(maxWait / 1000000));
+}
+
 void signalCondition(void* forMutex, void* forCondition){
 	//CRITICAL_SECTION* curSect = (CRITICAL_SECTION*)forMutex;
 	CONDITION_VARIABLE* curCond = (CONDITION_VARIABLE*)forCondition;
@@ -127,6 +155,54 @@ void killCondition(void* forCondition){
 	free(curCond);
 }
 
+uintmax_t getMonotonicTime(){
+	LARGE_INTEGER curCount;
+	LARGE_INTEGER countFreq;
+	QueryPerformanceCounter(&curCount);
+	QueryPerformanceFrequency(&countFreq);
+	uintmax_t fullSec = curCount.QuadPart / countFreq.QuadPart;
+	uintmax_t partSec = curCount.QuadPart % countFreq.QuadPart;
+	return fullSec*1000000000 + (partSec*1000000000) / countFreq.QuadPart;
+}
+
+bool pinThisThread(uintptr_t cpuI){
+	if(cpuI >= 8*sizeof(DWORD_PTR)){
+		return false;
+	}
+	DWORD_PTR useMask = ((DWORD_PTR)1) << cpuI;
+	return SetThreadAffinityMask(GetCurrentThread(), useMask) != 0;
+}
+
+//local sockets are not available here: the server and client will say so
+
+void* openLocalServer(const char* sockName){
+	return 0;
+}
+
+void* acceptLocalConnection(void* theServer){
+	return 0;
+}
+
+void closeLocalServer(void* theServer){}
+
+void* connectLocalServer(const char* sockName){
+	return 0;
+}
+
+intptr_t readLocalConnection(void* theConn, char* toFill, uintptr_t numRead){
+	return -1;
+}
+
+bool writeLocalConnection(void* theConn, const char* toWrite, uintptr_t numWrite){
+	return false;
+}
+
+bool setLocalConnectionTimeout(void* theConn, uintmax_t maxWait){
+	return false;
+}
+
+void closeLocalConnection(void* theConn){}
+
 typedef struct{
 	HMODULE dllMod;
 } DLLibStruct;
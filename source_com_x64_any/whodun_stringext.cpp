@@ -1,5 +1,7 @@
 #include "whodun_stringext.h"
 
+#include <immintrin.h>
+
 int strendswith(const char* str1, const char* str2){
 	size_t str1L = strlen(str1);
 	size_t str2L = strlen(str2);
@@ -7,61 +9,133 @@ int strendswith(const char* str1, const char* str2){
 	return strcmp(str1 + (str1L - str2L), str2) == 0;
 }
 
+//the baseline (sse2) searches are always available, avx2 is checked for at run time
+
+/**The largest set of characters the vector searches will handle.*/
+#define MEMSPN_VECTOR_MAXSET 16
+
+/**
+ * Find which bytes in a block are in a set.
+ * @param curBlock The block to test.
+ * @param setVecs The characters in the set, each broadcast.
+ * @param numB2 The number of characters in the set.
+ * @return A mask of the bytes in the set.
+ */
+static inline uint32_t memspn_sse_hits(__m128i curBlock, __m128i* setVecs, size_t numB2){
+	__m128i anyHit = _mm_cmpeq_epi8(curBlock, setVecs[0]);
+	for(size_t i = 1; i<numB2; i++){
+		anyHit = _mm_or_si128(anyHit, _mm_cmpeq_epi8(curBlock, setVecs[i]));
+	}
+	return _mm_movemask_epi8(anyHit);
+}
+
+/**
+ * Find which bytes in a block are in a set.
+ * @param curBlock The block to test.
+ * @param setVecs The characters in the set, each broadcast.
+ * @param numB2 The number of characters in the set.
+ * @return A mask of the bytes in the set.
+ */
+__attribute__((target("avx2"))) static inline uint32_t memspn_avx_hits(__m256i curBlock, __m256i* setVecs, size_t numB2){
+	__m256i anyHit = _mm256_cmpeq_epi8(curBlock, setVecs[0]);
+	for(size_t i = 1; i<numB2; i++){
+		anyHit = _mm256_or_si256(anyHit, _mm256_cmpeq_epi8(curBlock, setVecs[i]));
+	}
+	return _mm256_movemask_epi8(anyHit);
+}
+
+/**
+ * Walk along a string until a byte is (or is not) in a set, using avx2.
+ * @param str1 The string to walk along.
+ * @param numB1 The length of said string.
+ * @param str2 The characters in the set.
+ * @param numB2 The number of characters in the set: at most MEMSPN_VECTOR_MAXSET.
+ * @param flipMask Zero to stop at a member of the set, all ones to stop at a non-member.
+ * @return The number of characters before the stop.
+ */
+__attribute__((target("avx2"))) static size_t memspn_avx(const char* str1, size_t numB1, const char* str2, size_t numB2, uint32_t flipMask){
+	__m256i setVecs[MEMSPN_VECTOR_MAXSET];
+	for(size_t i = 0; i<numB2; i++){ setVecs[i] = _mm256_set1_epi8(str2[i]); }
+	size_t curCS = 0;
+	while((numB1 - curCS) >= 32){
+		uint32_t stopMask = flipMask ^ memspn_avx_hits(_mm256_loadu_si256((const __m256i*)(str1 + curCS)), setVecs, numB2);
+		if(stopMask){ return curCS + __builtin_ctz(stopMask); }
+		curCS += 32;
+	}
+	return curCS;
+}
+
+/**
+ * Walk along a string until a byte is (or is not) in a set, using sse2.
+ * @param str1 The string to walk along.
+ * @param numB1 The length of said string.
+ * @param str2 The characters in the set.
+ * @param numB2 The number of characters in the set: at most MEMSPN_VECTOR_MAXSET.
+ * @param flipMask Zero to stop at a member of the set, all ones to stop at a non-member.
+ * @return The number of characters before the stop (or before the unhandled tail).
+ */
+static size_t memspn_sse(const char* str1, size_t numB1, const char* str2, size_t numB2, uint32_t flipMask){
+	__m128i setVecs[MEMSPN_VECTOR_MAXSET];
+	for(size_t i = 0; i<numB2; i++){ setVecs[i] = _mm_set1_epi8(str2[i]); }
+	flipMask = flipMask & 0x0000FFFF;
+	size_t curCS = 0;
+	while((numB1 - curCS) >= 16){
+		uint32_t stopMask = flipMask ^ memspn_sse_hits(_mm_loadu_si128((const __m128i*)(str1 + curCS)), setVecs, numB2);
+		if(stopMask){ return curCS + __builtin_ctz(stopMask); }
+		curCS += 16;
+	}
+	return curCS;
+}
+
+/**
+ * Walk along a string until a byte is (or is not) in a set, picking the best vector code.
+ * @param str1 The string to walk along.
+ * @param numB1 The length of said string.
+ * @param str2 The characters in the set.
+ * @param numB2 The number of characters in the set: at most MEMSPN_VECTOR_MAXSET.
+ * @param wantIn Whether to stop at a member of the set.
+ * @return The number of characters before the stop.
+ */
+static size_t memspn_vector(const char* str1, size_t numB1, const char* str2, size_t numB2, bool wantIn){
+	uint32_t flipMask = wantIn ? 0 : 0xFFFFFFFF;
+	size_t curCS = 0;
+	if((numB1 >= 32) && __builtin_cpu_supports("avx2")){
+		curCS = memspn_avx(str1, numB1, str2, numB2, flipMask);
+		if((numB1 - curCS) >= 32){ return curCS; }
+	}
+	size_t subCS = memspn_sse(str1 + curCS, numB1 - curCS, str2, numB2, flipMask);
+	curCS += subCS;
+	if((numB1 - curCS) >= 16){ return curCS; }
+	//and the tail
+	for(; curCS < numB1; curCS++){
+		bool isIn = memchr(str2, str1[curCS], numB2) != 0;
+		if(isIn == wantIn){ return curCS; }
+	}
+	return numB1;
+}
+
 size_t memcspn(const char* str1, size_t numB1, const char* str2, size_t numB2){
 	if(numB1 == 0){ return numB1; }
 	if(numB2 == 0){ return numB1; }
-	if(numB2 < 8){
-		uint64_t bvecSearch = 0;
-		uint64_t bvecMask = -1;
-		for(size_t i = 0; i<numB2; i++){
-			uint64_t curBt = 0x00FF & str2[i];
-			bvecSearch |= (curBt << (i<<3));
-			bvecMask = (bvecMask << 8);
-		}
-		//bvecSearch = str2[0] << 0 | str2[1] << 8 ...
-		//bvecMask = FFFFFFFF << 8*numB2
-		//str1[i] in bvecSearch = anyByteZero(((0x0101010101010101 * str1[i])^bvecSearch)|bvecMask)
-		//anyByteZero(v) = (v-0x0101010101010101) & ~v & 0x8080808080808080
-		const char* endPt;
-		asm volatile (
-			"movq $0x0101010101010101, %%r8\n"
-			"movq $0x8080808080808080, %%r9\n"
-			"memcspn_rep%=:\n"
-			"xorq %%r10, %%r10\n"
-			"movb (%%rax), %%r10b\n"
-			"imulq %%r8, %%r10\n"
-			"xorq %%rcx, %%r10\n"
-			"orq %%rdx, %%r10\n"
-			"movq %%r10, %%r11\n"
-			"subq %%r8, %%r10\n"
-			"notq %%r11\n"
-			"andq %%r11, %%r10\n"
-			"andq %%r9, %%r10\n"
-			"jnz memcspn_done%=\n"
-			"addq $1, %%rax\n"
-			"addq $-1, %%rbx\n"
-			"jnz memcspn_rep%=\n"
-			"memcspn_done%=:\n"
-			"xorq %%r10, %%r10\n"
-		: "=a" (endPt)
-		: "a" (str1), "b" (numB1), "c" (bvecSearch), "d" (bvecMask)
-		: "cc", "r8", "r9", "r10", "r11"
-		);
-		return endPt - str1;
+	if(numB2 <= MEMSPN_VECTOR_MAXSET){
+		return memspn_vector(str1, numB1, str2, numB2, true);
 	}
-	{
-		for(size_t curCS = 0; curCS < numB1; curCS++){
-			for(size_t i = 0; i<numB2; i++){
-				if(str1[curCS] == str2[i]){
-					return curCS;
-				}
+	for(size_t curCS = 0; curCS < numB1; curCS++){
+		for(size_t i = 0; i<numB2; i++){
+			if(str1[curCS] == str2[i]){
+				return curCS;
 			}
 		}
-		return numB1;
 	}
+	return numB1;
 }
 
 size_t memspn(const char* str1, size_t numB1, const char* str2, size_t numB2){
+	if(numB1 == 0){ return numB1; }
+	if(numB2 == 0){ return 0; }
+	if(numB2 <= MEMSPN_VECTOR_MAXSET){
+		return memspn_vector(str1, numB1, str2, numB2, false);
+	}
 	for(size_t curCS = 0; curCS < numB1; curCS++){
 		for(size_t i = 0; i<numB2; i++){
 			if(str1[curCS] == str2[i]){
@@ -0,0 +1,328 @@
+#include "whodun_stringext_seq.h"
+
+#include <string.h>
+#include <algorithm>
+#include <immintrin.h>
+
+//the baseline (sse2) versions are always available, the rest are checked for at run time
+
+/**Reverse the bytes in an sse register.*/
+#define MEMREV_SSE_MASK _mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15)
+/**Reverse the bytes in each half of an avx register.*/
+#define MEMREV_AVX_MASK _mm256_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15, 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15)
+
+/**
+ * Complement bases in a register: A^T = 0x15, C^G = 0x04.
+ * @param toComp The bytes to complement.
+ * @return The complemented bytes.
+ */
+__attribute__((target("ssse3"))) static inline __m128i memrevcomp_sse_comp(__m128i toComp){
+	__m128i isAT = _mm_or_si128(_mm_cmpeq_epi8(toComp, _mm_set1_epi8('A')), _mm_cmpeq_epi8(toComp, _mm_set1_epi8('T')));
+	__m128i isCG = _mm_or_si128(_mm_cmpeq_epi8(toComp, _mm_set1_epi8('C')), _mm_cmpeq_epi8(toComp, _mm_set1_epi8('G')));
+	__m128i flipB = _mm_or_si128(_mm_and_si128(isAT, _mm_set1_epi8(0x15)), _mm_and_si128(isCG, _mm_set1_epi8(0x04)));
+	return _mm_xor_si128(toComp, flipB);
+}
+
+/**
+ * Complement bases in a register: A^T = 0x15, C^G = 0x04.
+ * @param toComp The bytes to complement.
+ * @return The complemented bytes.
+ */
+__attribute__((target("avx2"))) static inline __m256i memrevcomp_avx_comp(__m256i toComp){
+	__m256i isAT = _mm256_or_si256(_mm256_cmpeq_epi8(toComp, _mm256_set1_epi8('A')), _mm256_cmpeq_epi8(toComp, _mm256_set1_epi8('T')));
+	__m256i isCG = _mm256_or_si256(_mm256_cmpeq_epi8(toComp, _mm256_set1_epi8('C')), _mm256_cmpeq_epi8(toComp, _mm256_set1_epi8('G')));
+	__m256i flipB = _mm256_or_si256(_mm256_and_si256(isAT, _mm256_set1_epi8(0x15)), _mm256_and_si256(isCG, _mm256_set1_epi8(0x04)));
+	return _mm256_xor_si256(toComp, flipB);
+}
+
+/**
+ * Reverse an avx register.
+ * @param toRev The bytes to reverse.
+ * @return The reversed bytes.
+ */
+__attribute__((target("avx2"))) static inline __m256i memreverse_avx_rev(__m256i toRev){
+	__m256i halfRev = _mm256_shuffle_epi8(toRev, MEMREV_AVX_MASK);
+	return _mm256_permute4x64_epi64(halfRev, 0x4E);
+}
+
+/**
+ * Reverse complement the middle of a sequence, one base at a time.
+ * @param revS The first base.
+ * @param revE The last base.
+ */
+static void memrevcomp_scalar(char* revS, char* revE){
+	while(revS < revE){
+		char tmpS = *revS;
+		char tmpE = *revE;
+		switch(tmpS){
+			case 'A': tmpS = 'T'; break;
+			case 'T': tmpS = 'A'; break;
+			case 'C': tmpS = 'G'; break;
+			case 'G': tmpS = 'C'; break;
+			default: break;
+		}
+		switch(tmpE){
+			case 'A': tmpE = 'T'; break;
+			case 'T': tmpE = 'A'; break;
+			case 'C': tmpE = 'G'; break;
+			case 'G': tmpE = 'C'; break;
+			default: break;
+		}
+		*revS = tmpE;
+		*revE = tmpS;
+		revS++;
+		revE--;
+	}
+	if(revS == revE){
+		switch(*revS){
+			case 'A': *revS = 'T'; break;
+			case 'T': *revS = 'A'; break;
+			case 'C': *revS = 'G'; break;
+			case 'G': *revS = 'C'; break;
+			default: break;
+		}
+	}
+}
+
+__attribute__((target("avx2"))) static void memreverse_avx(char* toRev, size_t numBts){
+	char* revS = toRev;
+	char* revE = toRev + numBts;
+	while((revE - revS) >= 64){
+		revE -= 32;
+		__m256i blkS = _mm256_loadu_si256((__m256i*)revS);
+		__m256i blkE = _mm256_loadu_si256((__m256i*)revE);
+		_mm256_storeu_si256((__m256i*)revS, memreverse_avx_rev(blkE));
+		_mm256_storeu_si256((__m256i*)revE, memreverse_avx_rev(blkS));
+		revS += 32;
+	}
+	std::reverse(revS, revE);
+}
+
+__attribute__((target("ssse3"))) static void memreverse_sse(char* toRev, size_t numBts){
+	char* revS = toRev;
+	char* revE = toRev + numBts;
+	while((revE - revS) >= 32){
+		revE -= 16;
+		__m128i blkS = _mm_loadu_si128((__m128i*)revS);
+		__m128i blkE = _mm_loadu_si128((__m128i*)revE);
+		_mm_storeu_si128((__m128i*)revS, _mm_shuffle_epi8(blkE, MEMREV_SSE_MASK));
+		_mm_storeu_si128((__m128i*)revE, _mm_shuffle_epi8(blkS, MEMREV_SSE_MASK));
+		revS += 16;
+	}
+	std::reverse(revS, revE);
+}
+
+void memreverse(char* toRev, size_t numBts){
+	if(__builtin_cpu_supports("avx2")){
+		memreverse_avx(toRev, numBts);
+	}
+	else if(__builtin_cpu_supports("ssse3")){
+		memreverse_sse(toRev, numBts);
+	}
+	else{
+		std::reverse(toRev, toRev + numBts);
+	}
+}
+
+__attribute__((target("avx2"))) static void memrevcomp_avx(char* toRev, size_t numBts){
+	char* revS = toRev;
+	char* revE = toRev + numBts;
+	while((revE - revS) >= 64){
+		revE -= 32;
+		__m256i blkS = _mm256_loadu_si256((__m256i*)revS);
+		__m256i blkE = _mm256_loadu_si256((__m256i*)revE);
+		_mm256_storeu_si256((__m256i*)revS, memrevcomp_avx_comp(memreverse_avx_rev(blkE)));
+		_mm256_storeu_si256((__m256i*)revE, memrevcomp_avx_comp(memreverse_avx_rev(blkS)));
+		revS += 32;
+	}
+	memrevcomp_scalar(revS, revE - 1);
+}
+
+__attribute__((target("ssse3"))) static void memrevcomp_sse(char* toRev, size_t numBts){
+	char* revS = toRev;
+	char* revE = toRev + numBts;
+	while((revE - revS) >= 32){
+		revE -= 16;
+		__m128i blkS = _mm_loadu_si128((__m128i*)revS);
+		__m128i blkE = _mm_loadu_si128((__m128i*)revE);
+		_mm_storeu_si128((__m128i*)revS, memrevcomp_sse_comp(_mm_shuffle_epi8(blkE, MEMREV_SSE_MASK)));
+		_mm_storeu_si128((__m128i*)revE, memrevcomp_sse_comp(_mm_shuffle_epi8(blkS, MEMREV_SSE_MASK)));
+		revS += 16;
+	}
+	memrevcomp_scalar(revS, revE - 1);
+}
+
+void memrevcomp(char* toRev, size_t numBts){
+	if(numBts == 0){ return; }
+	if(__builtin_cpu_supports("avx2")){
+		memrevcomp_avx(toRev, numBts);
+	}
+	else if(__builtin_cpu_supports("ssse3")){
+		memrevcomp_sse(toRev, numBts);
+	}
+	else{
+		memrevcomp_scalar(toRev, toRev + numBts - 1);
+	}
+}
+
+__attribute__((target("avx2"))) static void memphredtolog10_avx(const unsigned char* toConv, size_t numConv, double* toStore){
+	__m256i phredOff = _mm256_set1_epi32(33);
+	__m256d phredDiv = _mm256_set1_pd(-10.0);
+	size_t numBlock = numConv >> 3;
+	for(size_t i = 0; i<numBlock; i++){
+		__m256i curPhred = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)toConv)), phredOff);
+		__m256d curLo = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(curPhred)), phredDiv);
+		__m256d curHi = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(curPhred, 1)), phredDiv);
+		_mm256_storeu_pd(toStore, curLo);
+		_mm256_storeu_pd(toStore + 4, curHi);
+		toConv += 8;
+		toStore += 8;
+	}
+	for(size_t i = numBlock << 3; i<numConv; i++){
+		*toStore = (*toConv - 33)/-10.0;
+		toConv++;
+		toStore++;
+	}
+}
+
+static void memphredtolog10_sse(const unsigned char* toConv, size_t numConv, double* toStore){
+	__m128i phredOff = _mm_set1_epi32(33);
+	__m128d phredDiv = _mm_set1_pd(-10.0);
+	__m128i allZero = _mm_setzero_si128();
+	size_t numBlock = numConv >> 2;
+	for(size_t i = 0; i<numBlock; i++){
+		int curRaw;
+		memcpy(&curRaw, toConv, 4);
+		__m128i curPhred = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(curRaw), allZero), allZero);
+		curPhred = _mm_sub_epi32(curPhred, phredOff);
+		__m128d curLo = _mm_div_pd(_mm_cvtepi32_pd(curPhred), phredDiv);
+		__m128d curHi = _mm_div_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(curPhred, 0x0E)), phredDiv);
+		_mm_storeu_pd(toStore, curLo);
+		_mm_storeu_pd(toStore + 2, curHi);
+		toConv += 4;
+		toStore += 4;
+	}
+	for(size_t i = numBlock << 2; i<numConv; i++){
+		*toStore = (*toConv - 33)/-10.0;
+		toConv++;
+		toStore++;
+	}
+}
+
+void memphredtolog10(const unsigned char* toConv, size_t numConv, double* toStore){
+	if(__builtin_cpu_supports("avx2")){
+		memphredtolog10_avx(toConv, numConv, toStore);
+	}
+	else{
+		memphredtolog10_sse(toConv, numConv, toStore);
+	}
+}
+
+__attribute__((target("avx2"))) static void memlog10tophred_avx(const double* toConv, size_t numConv, unsigned char* toStore){
+	__m256d phredMul = _mm256_set1_pd(-10.0);
+	__m256d phredOff = _mm256_set1_pd(33.0);
+	__m256d phredMax = _mm256_set1_pd(126.0);
+	size_t numBlock = numConv >> 2;
+	for(size_t i = 0; i<numBlock; i++){
+		__m256d curConv = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(toConv), phredMul), phredOff);
+		curConv = _mm256_min_pd(_mm256_max_pd(curConv, phredOff), phredMax);
+		__m128i curInt = _mm256_cvttpd_epi32(curConv);
+		curInt = _mm_packus_epi16(_mm_packs_epi32(curInt, curInt), curInt);
+		int curRaw = _mm_cvtsi128_si32(curInt);
+		memcpy(toStore, &curRaw, 4);
+		toConv += 4;
+		toStore += 4;
+	}
+	for(size_t i = numBlock << 2; i<numConv; i++){
+		double curConv = (*toConv * -10.0) + 33;
+		if(curConv < 33){ curConv = 33; }
+		if(curConv > 126){ curConv = 126; }
+		*toStore = (unsigned char)curConv;
+		toConv++;
+		toStore++;
+	}
+}
+
+static void memlog10tophred_sse(const double* toConv, size_t numConv, unsigned char* toStore){
+	__m128d phredMul = _mm_set1_pd(-10.0);
+	__m128d phredOff = _mm_set1_pd(33.0);
+	__m128d phredMax = _mm_set1_pd(126.0);
+	size_t numBlock = numConv >> 1;
+	for(size_t i = 0; i<numBlock; i++){
+		__m128d curConv = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(toConv), phredMul), phredOff);
+		curConv = _mm_min_pd(_mm_max_pd(curConv, phredOff), phredMax);
+		__m128i curInt = _mm_cvttpd_epi32(curConv);
+		toStore[0] = _mm_cvtsi128_si32(curInt);
+		toStore[1] = _mm_cvtsi128_si32(_mm_shuffle_epi32(curInt, 0x01));
+		toConv += 2;
+		toStore += 2;
+	}
+	if(numConv & 1){
+		double curConv = (*toConv * -10.0) + 33;
+		if(curConv < 33){ curConv = 33; }
+		if(curConv > 126){ curConv = 126; }
+		*toStore = (unsigned char)curConv;
+	}
+}
+
+void memlog10tophred(const double* toConv, size_t numConv, unsigned char* toStore){
+	if(__builtin_cpu_supports("avx2")){
+		memlog10tophred_avx(toConv, numConv, toStore);
+	}
+	else{
+		memlog10tophred_sse(toConv, numConv, toStore);
+	}
+}
+
+/**
+ * Count bytes one at a time.
+ * @param toCount The bytes to count.
+ * @param numBts The number of bytes.
+ * @param toFill The counts to add to.
+ */
+static void membytecount_scalar(const unsigned char* toCount, size_t numBts, uintptr_t* toFill){
+	for(size_t i = 0; i<numBts; i++){
+		toFill[toCount[i]]++;
+	}
+}
+
+__attribute__((target("avx2,popcnt"))) static void membytecount_avx(const char* toCount, size_t numBts, uintptr_t* toFill){
+	//most of the bytes in a sequence are ACGT: count those in bulk, fall back to scalar for any block that has something else
+	uintptr_t numA = 0; uintptr_t numC = 0; uintptr_t numG = 0; uintptr_t numT = 0;
+	__m256i lookA = _mm256_set1_epi8('A');
+	__m256i lookC = _mm256_set1_epi8('C');
+	__m256i lookG = _mm256_set1_epi8('G');
+	__m256i lookT = _mm256_set1_epi8('T');
+	size_t numBlock = numBts >> 5;
+	for(size_t i = 0; i<numBlock; i++){
+		__m256i curBlk = _mm256_loadu_si256((const __m256i*)toCount);
+		unsigned int hitA = _mm256_movemask_epi8(_mm256_cmpeq_epi8(curBlk, lookA));
+		unsigned int hitC = _mm256_movemask_epi8(_mm256_cmpeq_epi8(curBlk, lookC));
+		unsigned int hitG = _mm256_movemask_epi8(_mm256_cmpeq_epi8(curBlk, lookG));
+		unsigned int hitT = _mm256_movemask_epi8(_mm256_cmpeq_epi8(curBlk, lookT));
+		if((hitA | hitC | hitG | hitT) == 0xFFFFFFFFu){
+			numA += _mm_popcnt_u32(hitA);
+			numC += _mm_popcnt_u32(hitC);
+			numG += _mm_popcnt_u32(hitG);
+			numT += _mm_popcnt_u32(hitT);
+		}
+		else{
+			membytecount_scalar((const unsigned char*)toCount, 32, toFill);
+		}
+		toCount += 32;
+	}
+	membytecount_scalar((const unsigned char*)toCount, numBts & 0x1F, toFill);
+	toFill[0x00FF & 'A'] += numA;
+	toFill[0x00FF & 'C'] += numC;
+	toFill[0x00FF & 'G'] += numG;
+	toFill[0x00FF & 'T'] += numT;
+}
+
+void membytecount(const char* toCount, size_t numBts, uintptr_t* toFill){
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")){
+		membytecount_avx(toCount, numBts, toFill);
+	}
+	else{
+		membytecount_scalar((const unsigned char*)toCount, numBts, toFill);
+	}
+}
\ No newline at end of file
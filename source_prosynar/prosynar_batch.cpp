@@ -0,0 +1,166 @@
+#include "prosynar_batch.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "whodun_oshook.h"
+#include "whodun_parse_seq.h"
+
+ProsynarBatchMerger::ProsynarBatchMerger(ProsynarArgumentParser* useArgs){
+	this->useArgs = useArgs;
+	ownPool = 0;
+	if(!(useArgs->usePool)){
+		ownPool = new ThreadPool(useArgs->numThread);
+		useArgs->usePool = ownPool;
+	}
+	//nothing here writes failures, so do not leave an empty dump behind
+	useArgs->failDumpFile = 0;
+	try{
+		useArgs->performSetup();
+	}catch(...){
+		if(ownPool){ useArgs->usePool = 0; delete(ownPool); }
+		throw;
+	}
+	batchLock = makeMutex();
+	nextLock = makeMutex();
+	nextPair = 0;
+	curNumPair = 0;
+	curRead1s = 0;
+	curRead2s = 0;
+	curResults = 0;
+	batchFailed = false;
+}
+
+ProsynarBatchMerger::~ProsynarBatchMerger(){
+	killMutex(nextLock);
+	killMutex(batchLock);
+	if(ownPool){
+		useArgs->usePool = 0;
+		delete(ownPool);
+	}
+}
+
+/**Batch thread arguments.*/
+typedef struct{
+	/**The batch being run.*/
+	ProsynarBatchMerger* forBatch;
+	/**The index of this thread.*/
+	int threadInd;
+} ProsynarBatchThreadArgs;
+
+/**
+ * Merge pairs from a batch.
+ * @param tmpArg The arguments.
+ */
+void mergeBatchBlocks(void* tmpArg){
+	ProsynarBatchThreadArgs* myArgs = (ProsynarBatchThreadArgs*)tmpArg;
+	myArgs->forBatch->mergeBlocks(myArgs->threadInd);
+}
+
+uintptr_t ProsynarBatchMerger::mergePairs(uintptr_t numPair, CRBSAMFileContents** read1s, CRBSAMFileContents** read2s, std::vector<ProsynarBatchResult>* toFill){
+	toFill->resize(numPair);
+	if(numPair == 0){ return 0; }
+	lockMutex(batchLock);
+		nextPair = 0;
+		curNumPair = numPair;
+		curRead1s = read1s;
+		curRead2s = read2s;
+		curResults = &((*toFill)[0]);
+		batchFailed = false;
+		batchErr.clear();
+		//each thread needs its own index: the filters and merger keep storage by thread
+		uintptr_t numRun = std::min((uintptr_t)(useArgs->numThread), (numPair + PROSYNAR_BATCH_BLOCK - 1) / PROSYNAR_BATCH_BLOCK);
+		std::vector<ProsynarBatchThreadArgs> thrArgs(numRun);
+		std::vector<uintptr_t> runTasks;
+		try{
+			for(uintptr_t i = 1; i<numRun; i++){
+				ProsynarBatchThreadArgs newArg = {this, (int)i};
+				thrArgs[i] = newArg;
+				runTasks.push_back(useArgs->usePool->addTask(mergeBatchBlocks, &(thrArgs[i]), THREADPOOL_PRIORITY_COMPUTE));
+			}
+			//this thread does its part too
+			mergeBlocks(0);
+		}catch(std::exception& err){
+			noteBatchFailure(err.what());
+		}
+		//the tasks use thrArgs and the batch, so wait on all of them before anything leaves
+		for(uintptr_t i = 0; i<runTasks.size(); i++){
+			useArgs->usePool->joinTask(runTasks[i]);
+		}
+		uintptr_t numMerge = 0;
+		for(uintptr_t i = 0; i<numPair; i++){
+			numMerge += (curResults[i].merged ? 1 : 0);
+		}
+		curResults = 0;
+		bool haveErr = batchFailed;
+		std::string errMess = batchErr;
+	unlockMutex(batchLock);
+	if(haveErr){ throw std::runtime_error(errMess); }
+	return numMerge;
+}
+
+void ProsynarBatchMerger::mergeBlocks(int threadInd){
+	ProsynarPairContext pairCtx;
+	std::vector<double> tmpQuals;
+	while(true){
+		lockMutex(nextLock);
+			uintptr_t fromI = nextPair;
+			uintptr_t toI = std::min(fromI + PROSYNAR_BATCH_BLOCK, curNumPair);
+			nextPair = toI;
+		unlockMutex(nextLock);
+		if(fromI >= toI){ break; }
+		try{
+			for(uintptr_t i = fromI; i<toI; i++){
+				pairCtx.changePair(useArgs, curRead1s[i], curRead2s[i]);
+				mergeOne(threadInd, &pairCtx, curResults + i, &tmpQuals);
+			}
+		}catch(std::exception& err){
+			//this may be on a pool thread: nothing should escape
+			noteBatchFailure(err.what());
+			return;
+		}
+	}
+}
+
+void ProsynarBatchMerger::noteBatchFailure(const char* errMess){
+	lockMutex(nextLock);
+		if(!batchFailed){
+			batchFailed = true;
+			batchErr = errMess;
+		}
+		nextPair = curNumPair;
+	unlockMutex(nextLock);
+}
+
+void ProsynarBatchMerger::mergeOne(int threadInd, ProsynarPairContext* pairCtx, ProsynarBatchResult* toFill, std::vector<double>* tmpQuals){
+	toFill->merged = false;
+	toFill->mergeSeq.clear();
+	toFill->mergePhred.clear();
+	toFill->errMess.clear();
+	//filter
+	for(uintptr_t i = 0; i<useArgs->useFilters.size(); i++){
+		int filtR = useArgs->useFilters[i]->filterPair(threadInd, pairCtx, &(toFill->errMess));
+		if(filtR == 0){ toFill->errMess.clear(); }
+		if(filtR <= 0){ return; }
+	}
+	//merge
+	int mergR;
+	if(useArgs->useMerger->havePhredMerge()){
+		mergR = useArgs->useMerger->mergePairPhred(threadInd, pairCtx, &(toFill->mergeSeq), &(toFill->mergePhred), &(toFill->errMess));
+	}
+	else{
+		tmpQuals->clear();
+		mergR = useArgs->useMerger->mergePair(threadInd, pairCtx, &(toFill->mergeSeq), tmpQuals, &(toFill->errMess));
+		if((mergR == 0) && tmpQuals->size()){
+			toFill->mergePhred.resize(tmpQuals->size());
+			fastaLog10ProbsToPhred(tmpQuals->size(), &((*tmpQuals)[0]), (unsigned char*)(&(toFill->mergePhred[0])));
+		}
+	}
+	if(mergR){
+		if(mergR > 0){ toFill->errMess.clear(); }
+		toFill->mergeSeq.clear();
+		toFill->mergePhred.clear();
+		return;
+	}
+	toFill->merged = true;
+}
@@ -0,0 +1,430 @@
+#include "prosynar_bench.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "whodun_oshook.h"
+#include "prosynar_task_flash.h"
+#include "prosynar_task_pear.h"
+
+/**The names of the kernels, by index.*/
+const char* prosynarKernelNames[] = {"prepare", "scores", "fuzzy", "flash", "pear", "kdtree"};
+
+ProsynarBenchArgumentParser::ProsynarBenchArgumentParser(){
+	defOutFN[0] = '-';
+	defOutFN[1] = 0;
+	outFile = defOutFN;
+	randSeed = 1;
+	numPairs = 200;
+	numWarm = 2;
+	numRep = 10;
+	pinCPU = -1;
+	refPad = 10;
+	subRate = 0.01;
+	numScore = 5;
+	hotfuzz = 1000;
+	minOver = 10;
+	for(int i = 0; i<PROSYNAR_KERNEL_COUNT; i++){ runKernel[i] = false; }
+	myMainDoc = "Usage: prosynar bench [OPTION]\nTimes the alignment and overlap loops on made up reads.\nEach line of output is one loop at one read length (and number of cost regions), in nanoseconds per pair.\nThe loops are prepare, scores, fuzzy, flash, pear and kdtree.\nThe OPTIONS are:\n";
+	myVersionDoc = "ProSynAr bench 1.0";
+	myCopyrightDoc = "Copyright (C) 2019 UNT HSC Center for Human Identification";
+	ArgumentParserStrMeta outMeta("Output File");
+		outMeta.isFile = true;
+		outMeta.fileWrite = true;
+		outMeta.fileExts.insert(".tsv");
+		addStringOption("--out", &outFile, 0, "    Specify where to write the results.\n    --out File.tsv\n", &outMeta);
+	ArgumentParserIntMeta seedMeta("Random Seed");
+		addIntegerOption("--seed", &randSeed, 0, "    The seed for the random numbers.\n    --seed 1\n", &seedMeta);
+	ArgumentParserIntMeta pairMeta("Pairs per Repeat");
+		addIntegerOption("--pairs", &numPairs, 0, "    The number of pairs to run through each loop, each repeat.\n    --pairs 200\n", &pairMeta);
+	ArgumentParserIntMeta warmMeta("Warm Up Repeats");
+		addIntegerOption("--warmup", &numWarm, 0, "    The number of repeats to run (and throw away) before timing.\n    --warmup 2\n", &warmMeta);
+	ArgumentParserIntMeta repMeta("Timed Repeats");
+		addIntegerOption("--reps", &numRep, 0, "    The number of repeats to time.\n    --reps 10\n", &repMeta);
+	ArgumentParserIntMeta cpuMeta("Processor");
+		addIntegerOption("--cpu", &pinCPU, 0, "    The processor to run on: negative to let the system decide.\n    --cpu -1\n", &cpuMeta);
+	ArgumentParserIntMeta padMeta("Reference Padding");
+		addIntegerOption("--pad", &refPad, 0, "    The number of reference bases on each side of a read to align against.\n    --pad 10\n", &padMeta);
+	ArgumentParserFltMeta subMeta("Substitution Rate");
+		addFloatOption("--sub", &subRate, 0, "    The chance of a base being changed.\n    --sub 0.01\n", &subMeta);
+	ArgumentParserIntMeta scoreMeta("Number of Scores");
+		addIntegerOption("--numscore", &numScore, 0, "    The number of alignment scores to look for.\n    --numscore 5\n", &scoreMeta);
+	ArgumentParserIntMeta hfuzzMeta("Score Search Fuzz");
+		addIntegerOption("--hfuzz", &hotfuzz, 0, "    The maximum number of times to examine a score during score search.\n    Zero for a FULL traversal.\n    --hfuzz 1000\n", &hfuzzMeta);
+	ArgumentParserIntMeta overMeta("Overlap Threshold");
+		addIntegerOption("--over", &minOver, 0, "    The number of bases of overlap flash requires.\n    --over 10\n", &overMeta);
+	ArgumentParserIntVecMeta lenMeta("Read Lengths");
+		addIntegerVectorOption("--len", &readLens, 0, "    Add a read length to try.\n    If none given, 100, 150 and 250 are tried.\n    --len 150\n", &lenMeta);
+	ArgumentParserIntVecMeta regMeta("Cost Regions");
+		addIntegerVectorOption("--regions", &regionCounts, 0, "    Add a number of cost regions to try.\n    If none given, 0, 16 and 64 are tried.\n    --regions 16\n", &regMeta);
+	ArgumentParserStrVecMeta kernMeta("Loops");
+		addStringVectorOption("--kernel", &kernelNames, 0, "    Add a loop to time.\n    If none given, all are timed.\n    --kernel flash\n", &kernMeta);
+}
+
+ProsynarBenchArgumentParser::~ProsynarBenchArgumentParser(){}
+
+int ProsynarBenchArgumentParser::posteriorCheck(){
+	if(!outFile || (strlen(outFile)==0)){
+		outFile = defOutFN;
+	}
+	if(numPairs <= 0){
+		argumentError = "pairs must be positive.";
+		return 1;
+	}
+	if((numWarm < 0) || (numRep <= 0)){
+		argumentError = "warmup cannot be negative, and reps must be positive.";
+		return 1;
+	}
+	if(refPad < 0){
+		argumentError = "pad cannot be negative.";
+		return 1;
+	}
+	if((subRate < 0.0) || (subRate >= 1.0)){
+		argumentError = "sub must be between zero and one.";
+		return 1;
+	}
+	if(numScore <= 0){
+		argumentError = "numscore must be positive.";
+		return 1;
+	}
+	if(hotfuzz < 0){
+		argumentError = "hfuzz cannot be negative.";
+		return 1;
+	}
+	if(minOver <= 0){
+		argumentError = "over must be positive.";
+		return 1;
+	}
+	if(readLens.size() == 0){
+		readLens.push_back(100);
+		readLens.push_back(150);
+		readLens.push_back(250);
+	}
+	for(uintptr_t i = 0; i<readLens.size(); i++){
+		if(readLens[i] < minOver){
+			argumentError = "len must be at least over.";
+			return 1;
+		}
+	}
+	if(regionCounts.size() == 0){
+		regionCounts.push_back(0);
+		regionCounts.push_back(16);
+		regionCounts.push_back(64);
+	}
+	for(uintptr_t i = 0; i<regionCounts.size(); i++){
+		if(regionCounts[i] < 0){
+			argumentError = "regions cannot be negative.";
+			return 1;
+		}
+	}
+	for(uintptr_t i = 0; i<kernelNames.size(); i++){
+		int kernI = 0;
+		while((kernI < PROSYNAR_KERNEL_COUNT) && (strcmp(kernelNames[i], prosynarKernelNames[kernI]) != 0)){
+			kernI++;
+		}
+		if(kernI >= PROSYNAR_KERNEL_COUNT){
+			argumentError = "Unknown loop ";
+			argumentError.append(kernelNames[i]);
+			return 1;
+		}
+		runKernel[kernI] = true;
+	}
+	if(kernelNames.size() == 0){
+		for(int i = 0; i<PROSYNAR_KERNEL_COUNT; i++){ runKernel[i] = true; }
+	}
+	return 0;
+}
+
+ProsynarKernelBench::ProsynarKernelBench(ProsynarBenchArgumentParser* useArgs) : randSrc(useArgs->randSeed){
+	this->useArgs = useArgs;
+	workIter = 0;
+	sinkVal = 0;
+	scoreStore.resize(useArgs->numScore);
+}
+
+ProsynarKernelBench::~ProsynarKernelBench(){
+	if(workIter){ delete(workIter); }
+}
+
+char ProsynarKernelBench::nextBase(){
+	const char* allBase = "ACGT";
+	uintptr_t baseI = (uintptr_t)(4 * randSrc.nextUniform());
+	return allBase[(baseI > 3) ? 3 : baseI];
+}
+
+void ProsynarKernelBench::makeData(uintptr_t readLen, ProsynarBenchData* toFill){
+	uintptr_t numPairs = useArgs->numPairs;
+	uintptr_t refLen = readLen + 2*useArgs->refPad;
+	uintptr_t minOver = useArgs->minOver;
+	double subRate = useArgs->subRate;
+	toFill->readLen = readLen;
+	toFill->alnRefs.resize(numPairs);
+	toFill->alnReads.resize(numPairs);
+	toFill->seqLs.resize(numPairs);
+	toFill->qualLs.resize(numPairs);
+	toFill->qualdLs.resize(numPairs);
+	toFill->seqRs.resize(numPairs);
+	toFill->qualRs.resize(numPairs);
+	toFill->qualdRs.resize(numPairs);
+	std::string fragSeq;
+	for(uintptr_t i = 0; i<numPairs; i++){
+		//a read in the middle of its reference window
+		std::string* curRef = &(toFill->alnRefs[i]);
+		std::string* curRead = &(toFill->alnReads[i]);
+		curRef->clear();
+		for(uintptr_t j = 0; j<refLen; j++){ curRef->push_back(nextBase()); }
+		curRead->clear();
+		curRead->insert(curRead->end(), curRef->begin() + useArgs->refPad, curRef->begin() + useArgs->refPad + readLen);
+		for(uintptr_t j = 0; j<readLen; j++){
+			if(randSrc.nextUniform() <= subRate){ (*curRead)[j] = nextBase(); }
+		}
+		//a pair with an overlap somewhere between the minimum and the full read
+		uintptr_t curOver = minOver + (uintptr_t)((readLen - minOver + 1) * randSrc.nextUniform());
+		if(curOver > readLen){ curOver = readLen; }
+		uintptr_t fragLen = 2*readLen - curOver;
+		fragSeq.clear();
+		for(uintptr_t j = 0; j<fragLen; j++){ fragSeq.push_back(nextBase()); }
+		for(int side = 0; side < 2; side++){
+			std::vector<char>* curSeq = side ? &(toFill->seqRs[i]) : &(toFill->seqLs[i]);
+			std::vector<char>* curQual = side ? &(toFill->qualRs[i]) : &(toFill->qualLs[i]);
+			std::vector<double>* curQualD = side ? &(toFill->qualdRs[i]) : &(toFill->qualdLs[i]);
+			uintptr_t fragFrom = side ? (fragLen - readLen) : 0;
+			curSeq->clear(); curQual->clear(); curQualD->clear();
+			for(uintptr_t j = 0; j<readLen; j++){
+				char curBase = fragSeq[fragFrom + j];
+				if(randSrc.nextUniform() <= subRate){ curBase = nextBase(); }
+				int curPhred = 20 + (int)(20 * randSrc.nextUniform());
+				curSeq->push_back(curBase);
+				curQual->push_back((char)(curPhred + 33));
+				curQualD->push_back(-curPhred / 10.0);
+			}
+		}
+	}
+}
+
+/**
+ * Write out a made up cost specification.
+ * @param openCost The cost to open a gap.
+ * @param extendCost The cost to extend a gap.
+ * @param closeCost The cost to close a gap.
+ * @param matchCost The score for a match.
+ * @param mismatchCost The score for a mismatch.
+ * @param toFill The place to add the text.
+ */
+void prosynarBenchWriteCostSpec(int openCost, int extendCost, int closeCost, int matchCost, int mismatchCost, std::string* toFill){
+	char numBuff[64];
+	sprintf(numBuff, "%d %d %d 4 65 67 71 84", openCost, extendCost, closeCost);
+	toFill->append(numBuff);
+	for(int i = 0; i<4; i++){
+		for(int j = 0; j<4; j++){
+			sprintf(numBuff, " %d", (i==j) ? matchCost : mismatchCost);
+			toFill->append(numBuff);
+		}
+	}
+	toFill->append("\n");
+}
+
+void ProsynarKernelBench::makeCosts(uintptr_t refLen, uintptr_t numRegion, PositionDependentCostKDTree* toFill){
+	char numBuff[128];
+	std::string costText;
+	prosynarBenchWriteCostSpec(-3, -1, -3, 1, -4, &costText);
+	sprintf(numBuff, "%ju\n", (uintmax_t)numRegion);
+	costText.append(numBuff);
+	for(uintptr_t i = 0; i<numRegion; i++){
+		//mostly stretches of the reference, like a real file, with some limited in the read as well
+		uintptr_t regLen = 1 + (uintptr_t)((refLen / 4) * randSrc.nextUniform());
+		uintptr_t regFrom = (uintptr_t)((refLen - 1) * randSrc.nextUniform());
+		uintptr_t regTo = std::min(regFrom + regLen, refLen);
+		if(i % 4 == 3){
+			uintptr_t readLen = refLen - 2*useArgs->refPad;
+			uintptr_t regFromB = (uintptr_t)(readLen * randSrc.nextUniform());
+			uintptr_t regToB = std::min(regFromB + regLen, readLen);
+			sprintf(numBuff, "%ju %ju %ju %ju ", (uintmax_t)regFrom, (uintmax_t)regTo, (uintmax_t)regFromB, (uintmax_t)regToB);
+		}
+		else{
+			sprintf(numBuff, "%ju %ju -1 -1 ", (uintmax_t)regFrom, (uintmax_t)regTo);
+		}
+		costText.append(numBuff);
+		int gapOpen = -1 - (int)(5 * randSrc.nextUniform());
+		prosynarBenchWriteCostSpec(gapOpen, -1, gapOpen, 1, -2 - (int)(4 * randSrc.nextUniform()), &costText);
+	}
+	toFill->regionsParse(costText.c_str(), costText.c_str() + costText.size());
+	toFill->produceFromRegions();
+}
+
+void ProsynarKernelBench::runAlignment(ProsynarBenchData* useData, PositionDependentCostKDTree* useCost, uintmax_t* kernTimes){
+	//NOTE: requires two's complement
+	intptr_t worstScore = -1; worstScore = worstScore << (8*sizeof(intptr_t)-1);
+	bool needScore = useArgs->runKernel[PROSYNAR_KERNEL_SCORES] || useArgs->runKernel[PROSYNAR_KERNEL_FUZZY];
+	bool needFuzzy = useArgs->runKernel[PROSYNAR_KERNEL_FUZZY];
+	for(uintptr_t i = 0; i<useData->alnRefs.size(); i++){
+		uintmax_t prepStart = getMonotonicTime();
+		workAln.changeProblem(2, &(useData->alnRefs[i]), &(useData->alnReads[i]), useCost);
+		workAln.prepareAlignmentStructure();
+		uintmax_t prepEnd = getMonotonicTime();
+		kernTimes[0] += (prepEnd - prepStart);
+		if(!needScore){ continue; }
+		if(!workIter){
+			workIter = workAln.getIteratorToken();
+		}
+		int numFound = workAln.findAlignmentScores(workIter, scoreStore.size(), &(scoreStore[0]), worstScore, useArgs->hotfuzz);
+		uintmax_t scoreEnd = getMonotonicTime();
+		kernTimes[1] += (scoreEnd - prepEnd);
+		if(!needFuzzy || (numFound == 0)){ continue; }
+		workAln.startFuzzyIteration(workIter, scoreStore[numFound-1], useArgs->hotfuzz, numFound);
+		while(workIter->getNextAlignment()){
+			sinkVal += workIter->aInds.size();
+		}
+		kernTimes[2] += (getMonotonicTime() - scoreEnd);
+	}
+}
+
+uintmax_t ProsynarKernelBench::runCostLookup(ProsynarBenchData* useData, PositionDependentCostKDTree* useCost){
+	uintmax_t runStart = getMonotonicTime();
+	for(uintptr_t i = 0; i<useData->alnRefs.size(); i++){
+		intptr_t lenA = useData->alnRefs[i].size();
+		intptr_t lenB = useData->alnReads[i].size();
+		//the same lines the alignment table asks for
+		for(intptr_t j = 1; j<=lenA; j++){
+			useCost->getCostsForA(j-1, -1, lenB, &costStore);
+			sinkVal += (uintptr_t)(costStore.back());
+		}
+	}
+	return getMonotonicTime() - runStart;
+}
+
+uintmax_t ProsynarKernelBench::runFlash(ProsynarBenchData* useData){
+	uintmax_t runStart = getMonotonicTime();
+	for(uintptr_t i = 0; i<useData->seqLs.size(); i++){
+		std::pair<uintptr_t,double> curRes = flashFindBestOverlap(&(useData->seqLs[i]), &(useData->qualLs[i]), &(useData->seqRs[i]), &(useData->qualRs[i]), useArgs->minOver, 70, 0.25);
+		sinkVal += curRes.first;
+	}
+	return getMonotonicTime() - runStart;
+}
+
+uintmax_t ProsynarKernelBench::runPear(ProsynarBenchData* useData){
+	uintmax_t runStart = getMonotonicTime();
+	for(uintptr_t i = 0; i<useData->seqLs.size(); i++){
+		std::pair<uintptr_t,double> curRes = pearFindBestOverlap(&(useData->seqLs[i]), &(useData->qualdLs[i]), &(useData->seqRs[i]), &(useData->qualdRs[i]), 1.0, -1.0, -1.0/0.0);
+		sinkVal += curRes.first;
+	}
+	return getMonotonicTime() - runStart;
+}
+
+void ProsynarKernelBench::writeResult(int kernI, uintptr_t readLen, intptr_t numRegion, double cellsPerPair, std::vector<uintmax_t>* repTimes, OutStream* toDump){
+	char numBuff[512];
+	double numPairs = useArgs->numPairs;
+	std::vector<double> perPair;
+	for(uintptr_t i = 0; i<repTimes->size(); i++){
+		perPair.push_back((*repTimes)[i] / numPairs);
+	}
+	std::sort(perPair.begin(), perPair.end());
+	uintptr_t numRep = perPair.size();
+	double medTime = (numRep % 2) ? perPair[numRep/2] : (0.5*(perPair[numRep/2 - 1] + perPair[numRep/2]));
+	double meanTime = 0.0;
+	for(uintptr_t i = 0; i<numRep; i++){ meanTime += perPair[i]; }
+	meanTime = meanTime / numRep;
+	double sdTime = 0.0;
+	for(uintptr_t i = 0; i<numRep; i++){ sdTime += (perPair[i] - meanTime)*(perPair[i] - meanTime); }
+	sdTime = (numRep > 1) ? sqrt(sdTime / (numRep - 1)) : 0.0;
+	char regBuff[32];
+	if(numRegion < 0){ strcpy(regBuff, "-"); }
+	else{ sprintf(regBuff, "%jd", (intmax_t)numRegion); }
+	sprintf(numBuff, "%s\t%ju\t%s\t%ju\t%ju\t%.0f\t%.1f\t%.1f\t%.1f\t%.1f\t%.4e\n", prosynarKernelNames[kernI], (uintmax_t)readLen, regBuff, (uintmax_t)(useArgs->numPairs), (uintmax_t)numRep, cellsPerPair, medTime, meanTime, sdTime, perPair[0], (medTime > 0.0) ? (1000000000.0 * cellsPerPair / medTime) : 0.0);
+	toDump->writeBytes(numBuff, strlen(numBuff));
+}
+
+void ProsynarKernelBench::runAll(OutStream* toDump){
+	const char* headText = "Loop\tReadLength\tRegions\tPairs\tRepeats\tCellsPerPair\tNsPerPairMedian\tNsPerPairMean\tNsPerPairSD\tNsPerPairMin\tCellsPerSecond\n";
+	toDump->writeBytes(headText, strlen(headText));
+	uintptr_t numWarm = useArgs->numWarm;
+	uintptr_t numRep = useArgs->numRep;
+	std::vector<uintmax_t> repTimes[PROSYNAR_KERNEL_COUNT];
+	for(uintptr_t li = 0; li<useArgs->readLens.size(); li++){
+		uintptr_t readLen = useArgs->readLens[li];
+		uintptr_t refLen = readLen + 2*useArgs->refPad;
+		ProsynarBenchData curData;
+		makeData(readLen, &curData);
+		//the overlap searches do not care about costs
+		double flashCells = 0.0;
+		for(uintptr_t i = useArgs->minOver; i<=readLen; i++){ flashCells += i; }
+		double pearCells = 0.5 * readLen * (readLen + 1.0);
+		if(useArgs->runKernel[PROSYNAR_KERNEL_FLASH]){
+			repTimes[PROSYNAR_KERNEL_FLASH].clear();
+			for(uintptr_t ri = 0; ri<numWarm; ri++){ runFlash(&curData); }
+			for(uintptr_t ri = 0; ri<numRep; ri++){ repTimes[PROSYNAR_KERNEL_FLASH].push_back(runFlash(&curData)); }
+			writeResult(PROSYNAR_KERNEL_FLASH, readLen, -1, flashCells, &(repTimes[PROSYNAR_KERNEL_FLASH]), toDump);
+		}
+		if(useArgs->runKernel[PROSYNAR_KERNEL_PEAR]){
+			repTimes[PROSYNAR_KERNEL_PEAR].clear();
+			for(uintptr_t ri = 0; ri<numWarm; ri++){ runPear(&curData); }
+			for(uintptr_t ri = 0; ri<numRep; ri++){ repTimes[PROSYNAR_KERNEL_PEAR].push_back(runPear(&curData)); }
+			writeResult(PROSYNAR_KERNEL_PEAR, readLen, -1, pearCells, &(repTimes[PROSYNAR_KERNEL_PEAR]), toDump);
+		}
+		//the alignment stuff, for each cost complexity
+		bool needAln = useArgs->runKernel[PROSYNAR_KERNEL_PREPARE] || useArgs->runKernel[PROSYNAR_KERNEL_SCORES] || useArgs->runKernel[PROSYNAR_KERNEL_FUZZY];
+		double alnCells = (refLen + 1.0) * (readLen + 1.0);
+		for(uintptr_t ci = 0; ci<useArgs->regionCounts.size(); ci++){
+			uintptr_t numRegion = useArgs->regionCounts[ci];
+			PositionDependentCostKDTree curCost;
+			makeCosts(refLen, numRegion, &curCost);
+			if(needAln){
+				uintmax_t kernTimes[3];
+				for(int ki = 0; ki<3; ki++){ repTimes[ki].clear(); }
+				for(uintptr_t ri = 0; ri<(numWarm + numRep); ri++){
+					for(int ki = 0; ki<3; ki++){ kernTimes[ki] = 0; }
+					runAlignment(&curData, &curCost, kernTimes);
+					if(ri < numWarm){ continue; }
+					for(int ki = 0; ki<3; ki++){ repTimes[ki].push_back(kernTimes[ki]); }
+				}
+				for(int ki = 0; ki<3; ki++){
+					if(useArgs->runKernel[ki]){
+						writeResult(ki, readLen, numRegion, alnCells, &(repTimes[ki]), toDump);
+					}
+				}
+			}
+			if(useArgs->runKernel[PROSYNAR_KERNEL_KDTREE]){
+				repTimes[PROSYNAR_KERNEL_KDTREE].clear();
+				for(uintptr_t ri = 0; ri<numWarm; ri++){ runCostLookup(&curData, &curCost); }
+				for(uintptr_t ri = 0; ri<numRep; ri++){ repTimes[PROSYNAR_KERNEL_KDTREE].push_back(runCostLookup(&curData, &curCost)); }
+				writeResult(PROSYNAR_KERNEL_KDTREE, readLen, numRegion, refLen * (readLen + 1.0), &(repTimes[PROSYNAR_KERNEL_KDTREE]), toDump);
+			}
+		}
+	}
+}
+
+int prosynarBenchMain(int argc, char** argv){
+	int retCode = 0;
+	OutStream* curOut = 0;
+	ProsynarKernelBench* theBench = 0;
+	ProsynarBenchArgumentParser argsP;
+	try{
+		if(argsP.parseArguments(argc-1, argv+1, &std::cout) < 0){
+			std::cerr << argsP.argumentError << std::endl;
+			retCode = 1;
+		}
+		else if(argsP.needRun){
+			if((argsP.pinCPU >= 0) && !pinThisThread(argsP.pinCPU)){
+				std::cerr << "Could not keep to processor " << argsP.pinCPU << ": times may be noisy." << std::endl;
+			}
+			theBench = new ProsynarKernelBench(&argsP);
+			if(strcmp(argsP.outFile, "-") == 0){
+				curOut = new ConsoleOutStream();
+			}
+			else{
+				curOut = new FileOutStream(0, argsP.outFile);
+			}
+			theBench->runAll(curOut);
+		}
+	}catch(std::exception& err){
+		std::cerr << err.what() << std::endl;
+		retCode = 1;
+	}
+	if(curOut){ delete(curOut); }
+	if(theBench){ delete(theBench); }
+	return retCode;
+}
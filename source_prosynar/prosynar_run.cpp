@@ -0,0 +1,1030 @@
+
+#include <string.h>
+#include <algorithm>
+
+#include "whodun_thread.h"
+#include "whodun_oshook.h"
+#include "whodun_compress.h"
+#include "whodun_parse_seq.h"
+#include "whodun_stringext.h"
+#include "whodun_genome_paired.h"
+
+#include "prosynar_task.h"
+#include "prosynar_run.h"
+#include "prosynar_stats.h"
+
+/**A pair to try to merge.*/
+class MergeAttemptTask{
+public:
+	/**The main alignment entry.*/
+	CRBSAMFileContents* mainEnt;
+	/**The pair entry.*/
+	CRBSAMFileContents* pairEnt;
+	/**The number of pairs handed out before this one.*/
+	uintptr_t pairID;
+};
+
+/**A merged sequence to output.*/
+class MergeSequenceData{
+public:
+	/**The name of the sequence.*/
+	std::string seqName;
+	/**The merged sequence.*/
+	std::string seqSeq;
+	/**The merged qualities, if the merger works in log10 probabilities.*/
+	std::vector<double> seqQuals;
+	/**The merged qualities, as ascii phred scores.*/
+	std::string seqPhreds;
+	/**The original main alignment entry.*/
+	CRBSAMFileContents* mainEnt;
+	/**The original pair entry.*/
+	CRBSAMFileContents* pairEnt;
+	/**The number of pairs handed out before this one.*/
+	uintptr_t pairID;
+};
+
+/**Keeps the merge threads from getting too far ahead of the output, when writing in order.*/
+class MergeOrderWindow{
+public:
+	/**
+	 * Set up.
+	 * @param windowSize The most pairs that can be done past the next one to write.
+	 */
+	MergeOrderWindow(uintptr_t windowSize);
+	/**Clean up.*/
+	~MergeOrderWindow();
+	/**
+	 * Wait until a pair is close enough to the next one to write.
+	 * @param pairID The pair.
+	 */
+	void waitForRoom(uintptr_t pairID);
+	/**
+	 * Note that pairs have been written.
+	 * @param nextWrite The next pair to write.
+	 */
+	void noteWritten(uintptr_t nextWrite);
+	/**Stop holding anything back: the output has stopped, or will stop before catching up.*/
+	void abandon();
+	/**The most pairs that can be done past the next one to write.*/
+	uintptr_t winSize;
+	/**The next pair to write (protected by myMut).*/
+	uintptr_t nextOut;
+	/**The number of threads waiting (protected by myMut).*/
+	uintptr_t numWaiting;
+	/**Whether the run is going down, and nothing should wait (protected by myMut).*/
+	bool abandoned;
+	/**Finished pairs waiting on earlier pairs, by id modulo the window size (only touched by the output).*/
+	std::vector<MergeSequenceData*> waitRes;
+	/**Protect the counts.*/
+	void* myMut;
+	/**Signalled when pairs are written.*/
+	void* myCond;
+};
+
+MergeOrderWindow::MergeOrderWindow(uintptr_t windowSize){
+	winSize = windowSize;
+	nextOut = 0;
+	numWaiting = 0;
+	abandoned = false;
+	waitRes.resize(windowSize);
+	myMut = makeMutex();
+	myCond = makeCondition(myMut);
+}
+
+MergeOrderWindow::~MergeOrderWindow(){
+	killCondition(myCond);
+	killMutex(myMut);
+}
+
+void MergeOrderWindow::waitForRoom(uintptr_t pairID){
+	lockMutex(myMut);
+	while(!abandoned && (pairID >= (nextOut + winSize))){
+		numWaiting++;
+		waitCondition(myMut, myCond);
+		numWaiting--;
+	}
+	unlockMutex(myMut);
+}
+
+void MergeOrderWindow::noteWritten(uintptr_t nextWrite){
+	lockMutex(myMut);
+		nextOut = nextWrite;
+		if(numWaiting){ broadcastCondition(myMut, myCond); }
+	unlockMutex(myMut);
+}
+
+void MergeOrderWindow::abandon(){
+	lockMutex(myMut);
+		abandoned = true;
+		if(numWaiting){ broadcastCondition(myMut, myCond); }
+	unlockMutex(myMut);
+}
+
+/**Notes the first problem in any stage of a run, and winds the other stages down.*/
+class MergeRunFailure{
+public:
+	/**
+	 * Set up.
+	 * @param argsP The arguments to ProSynAr: its errLock protects the message.
+	 * @param taskPCC The pairs to merge.
+	 * @param goodPCC The merged results.
+	 * @param failPCC The failed alignments.
+	 */
+	MergeRunFailure(ProsynarArgumentParser* argsP, ThreadProdComCollector<MergeAttemptTask>* taskPCC, ThreadProdComCollector<MergeSequenceData>* goodPCC, ThreadProdComCollector<CRBSAMFileContents>* failPCC);
+	/**
+	 * Note a problem, and end the queues so everything else drains.
+	 * @param errMess The problem.
+	 */
+	void noteFailure(const char* errMess);
+	/**
+	 * Get whether a problem has been noted.
+	 * @return Whether there was a problem.
+	 */
+	bool haveFailed();
+	/**Arguments to ProSynAr.*/
+	ProsynarArgumentParser* argsP;
+	/**The pairs to merge.*/
+	ThreadProdComCollector<MergeAttemptTask>* taskPCC;
+	/**The merged results.*/
+	ThreadProdComCollector<MergeSequenceData>* goodPCC;
+	/**The failed alignments.*/
+	ThreadProdComCollector<CRBSAMFileContents>* failPCC;
+	/**The order window, if writing in order and it has been made.*/
+	MergeOrderWindow* orderWin;
+	/**Whether anything has gone wrong (protected by errLock).*/
+	bool anyFail;
+	/**The first thing that went wrong (protected by errLock, and fixed once anyFail is set).*/
+	std::string firstErr;
+};
+
+MergeRunFailure::MergeRunFailure(ProsynarArgumentParser* argsP, ThreadProdComCollector<MergeAttemptTask>* taskPCC, ThreadProdComCollector<MergeSequenceData>* goodPCC, ThreadProdComCollector<CRBSAMFileContents>* failPCC){
+	this->argsP = argsP;
+	this->taskPCC = taskPCC;
+	this->goodPCC = goodPCC;
+	this->failPCC = failPCC;
+	orderWin = 0;
+	anyFail = false;
+}
+
+void MergeRunFailure::noteFailure(const char* errMess){
+	lockMutex(argsP->errLock);
+		if(!anyFail){
+			anyFail = true;
+			firstErr = errMess;
+		}
+	unlockMutex(argsP->errLock);
+	taskPCC->end();
+	goodPCC->end();
+	failPCC->end();
+	if(orderWin){ orderWin->abandon(); }
+}
+
+bool MergeRunFailure::haveFailed(){
+	lockMutex(argsP->errLock);
+		bool toRet = anyFail;
+	unlockMutex(argsP->errLock);
+	return toRet;
+}
+
+/**Merge sequence thread arguments.*/
+typedef struct{
+	/**The index of this thread.*/
+	int threadInd;
+	/**Arguments to ProSynAr.*/
+	ProsynarArgumentParser* argsP;
+	/**Get tasks.*/
+	ThreadProdComCollector<MergeAttemptTask>* getPCC;
+	/**Return entry data.*/
+	ThreadsafeReusableContainerCache<CRBSAMFileContents>* entC;
+	/**Output failed.*/
+	ThreadProdComCollector<CRBSAMFileContents>* failPCC;
+	/**Output results to write.*/
+	ThreadProdComCollector<MergeSequenceData>* goodPCC;
+	/**The place to note how this thread spent its time.*/
+	ProsynarWorkerStats* myStats;
+	/**Hold back results until they are close to being written, if writing in order.*/
+	MergeOrderWindow* orderWin;
+	/**The place to note a problem.*/
+	MergeRunFailure* runFail;
+} MergeThreadArgs;
+/**
+ * Get the next pair to merge, helping out with other work while there is none.
+ * @param getPCC The place to get pairs from.
+ * @param helpPool The threads to help out, if any.
+ * @param myStats The place to note time spent helping.
+ * @return The pair, or null if there will be no more.
+ */
+MergeAttemptTask* getMergeAttempt(ThreadProdComCollector<MergeAttemptTask>* getPCC, ThreadPool* helpPool, ProsynarWorkerStats* myStats){
+	while(true){
+		MergeAttemptTask* anyRes = getPCC->tryThing();
+		if(anyRes){ return anyRes; }
+		if(!helpPool){ return getPCC->getThing(); }
+		uintmax_t helpStart = getMonotonicTime();
+		bool didHelp = helpPool->helpTask();
+		if(!didHelp){ return getPCC->getThing(); }
+		myStats->helpTime += (getMonotonicTime() - helpStart);
+	}
+}
+
+/**The number of pairs a merge thread looks at between reorderings of the filters, under --adaptive-order.*/
+#define PROSYNAR_ADAPTIVE_PERIOD 1024
+
+/**
+ * Try to merge sequences.
+ * @param tmpArg The arguments.
+ */
+void attemptMerging(void* tmpArg){
+	MergeThreadArgs* myArgs = (MergeThreadArgs*)tmpArg;
+	int myInd = myArgs->threadInd;
+	std::string tmpErr;
+	ProsynarPairContext pairCtx;
+	ProsynarArgumentParser* argsP = myArgs->argsP;
+	ProsynarWorkerStats* myStats = myArgs->myStats;
+	try{
+		MergeAttemptTask* anyRes = getMergeAttempt(myArgs->getPCC, argsP->usePool, myStats);
+		while(anyRes){
+			uintmax_t pairStart = getMonotonicTime();
+			tmpErr.clear();
+			pairCtx.changePair(argsP, anyRes->mainEnt, anyRes->pairEnt);
+			int mergeGreen = 1;
+			for(uintptr_t oi = 0; oi<myStats->filterOrder.size(); oi++){
+				uintptr_t i = myStats->filterOrder[oi];
+				uintmax_t filtStart = getMonotonicTime();
+				int filtR = argsP->useFilters[i]->filterPair(myInd, &pairCtx, &tmpErr);
+				uintmax_t filtTime = getMonotonicTime() - filtStart;
+				myStats->filterStats[i].noteRun(filtR, filtTime);
+				myStats->recentStats[i].noteRun(filtR, filtTime);
+				if(filtR < 0){
+					mergeGreen = 0;
+					lockMutex(argsP->errLock);
+						*(argsP->errOut) << tmpErr << std::endl;
+					unlockMutex(argsP->errLock);
+					break;
+				}
+				else if(filtR == 0){
+					mergeGreen = 0;
+					break;
+				}
+			}
+			if(mergeGreen){
+				MergeSequenceData* mrgInt = myArgs->goodPCC->taskCache.alloc();
+				mrgInt->seqName.clear();
+				mrgInt->seqSeq.clear();
+				mrgInt->seqQuals.clear();
+				mrgInt->seqPhreds.clear();
+				mrgInt->seqName.insert(mrgInt->seqName.end(), anyRes->mainEnt->entryName.begin(), anyRes->mainEnt->entryName.end());
+				mrgInt->mainEnt = anyRes->mainEnt;
+				mrgInt->pairEnt = anyRes->pairEnt;
+				mrgInt->pairID = anyRes->pairID;
+				int mergR;
+				uintmax_t mergStart = getMonotonicTime();
+				if(argsP->useMerger->havePhredMerge()){
+					mergR = argsP->useMerger->mergePairPhred(myInd, &pairCtx, &(mrgInt->seqSeq), &(mrgInt->seqPhreds), &tmpErr);
+				}
+				else{
+					mergR = argsP->useMerger->mergePair(myInd, &pairCtx, &(mrgInt->seqSeq), &(mrgInt->seqQuals), &tmpErr);
+					if(mergR == 0){
+						mrgInt->seqPhreds.resize(mrgInt->seqQuals.size());
+						fastaLog10ProbsToPhred(mrgInt->seqQuals.size(), &(mrgInt->seqQuals[0]), (unsigned char*)(&(mrgInt->seqPhreds[0])));
+					}
+				}
+				myStats->mergeStats.noteRun(mergR ? ((mergR < 0) ? -1 : 0) : 1, getMonotonicTime() - mergStart);
+				if(mergR){
+					mergeGreen = 0;
+					if(mergR < 0){
+						lockMutex(argsP->errLock);
+							*(argsP->errOut) << tmpErr << std::endl;
+						unlockMutex(argsP->errLock);
+					}
+					myArgs->goodPCC->taskCache.dealloc(mrgInt);
+				}
+				else{
+					if(myArgs->orderWin){ myArgs->orderWin->waitForRoom(anyRes->pairID); }
+					myArgs->goodPCC->addThing(mrgInt);
+				}
+			}
+			if(mergeGreen == 0){
+				//when writing in order, the output needs to hear about every pair
+				if(myArgs->orderWin){
+					MergeSequenceData* mrgInt = myArgs->goodPCC->taskCache.alloc();
+					mrgInt->mainEnt = 0;
+					mrgInt->pairEnt = 0;
+					mrgInt->pairID = anyRes->pairID;
+					myArgs->orderWin->waitForRoom(anyRes->pairID);
+					myArgs->goodPCC->addThing(mrgInt);
+				}
+				if(argsP->failDumpB){
+					myArgs->failPCC->addThing(anyRes->mainEnt);
+					myArgs->failPCC->addThing(anyRes->pairEnt);
+				}
+				else{
+					myArgs->entC->dealloc(anyRes->mainEnt);
+					myArgs->entC->dealloc(anyRes->pairEnt);
+				}
+			}
+			myArgs->getPCC->taskCache.dealloc(anyRes);
+			myStats->numPair++;
+			myStats->numMerge += mergeGreen;
+			myStats->busyTime += (getMonotonicTime() - pairStart);
+			if(argsP->adaptiveOrder && ((myStats->numPair % PROSYNAR_ADAPTIVE_PERIOD) == 0)){
+				myStats->adaptFilterOrder(argsP);
+			}
+			anyRes = getMergeAttempt(myArgs->getPCC, argsP->usePool, myStats);
+		}
+	}catch(std::exception& err){
+		myArgs->runFail->noteFailure(err.what());
+	}
+}
+
+/**Arguments to the merge thread output.*/
+typedef struct{
+	/**The place to output.*/
+	SequenceWriter* curOut;
+	/**The place to output, if outputting sam.*/
+	CRBSAMFileWriter* samOut;
+	/**Arguments to ProSynAr.*/
+	ProsynarArgumentParser* argsP;
+	/**Output results to write.*/
+	ThreadProdComCollector<MergeSequenceData>* resPCC;
+	/**Return entry data.*/
+	ThreadsafeReusableContainerCache<CRBSAMFileContents>* entC;
+	/**The results waiting to be written, if writing in order.*/
+	MergeOrderWindow* orderWin;
+	/**The place to note a problem.*/
+	MergeRunFailure* runFail;
+} OutputMergeThreadArgs;
+/**
+ * Write a merged sequence, and return its storage.
+ * @param myArgs The arguments to the output.
+ * @param anyRes The merged sequence: if it has no entries, the pair was not merged and there is nothing to write.
+ */
+void outputMergedResult(OutputMergeThreadArgs* myArgs, MergeSequenceData* anyRes){
+	char numBuff[4*sizeof(uintmax_t)+4];
+	SequenceWriter* curOut = myArgs->curOut;
+	CRBSAMFileWriter* samOut = myArgs->samOut;
+	if(anyRes->mainEnt){
+		if(curOut){
+			curOut->nextNameLen = anyRes->seqName.size();
+			curOut->nextName = anyRes->seqName.c_str();
+			curOut->nextSeqLen = anyRes->seqSeq.size();
+			curOut->nextSeq = anyRes->seqSeq.c_str();
+			curOut->nextHaveQual = 1;
+			curOut->nextQualPhred = anyRes->seqPhreds.c_str();
+			curOut->writeNextEntry();
+		}
+		if(samOut){
+			CRBSAMFileContents* curEnt = &(samOut->curEnt);
+			curEnt->clear();
+			curEnt->lastReadHead = 0;
+			curEnt->entryName.insert(curEnt->entryName.end(), anyRes->seqName.begin(), anyRes->seqName.end());
+			curEnt->entryFlag = 0;
+			curEnt->entryReference.insert(curEnt->entryReference.end(), anyRes->mainEnt->entryReference.begin(), anyRes->mainEnt->entryReference.end());
+			curEnt->entryPos = std::min(anyRes->mainEnt->entryPos, anyRes->pairEnt->entryPos);
+			curEnt->entryMapq = std::min(anyRes->mainEnt->entryMapq, anyRes->pairEnt->entryMapq);
+			sprintf(numBuff, "%ju", (uintmax_t)(curEnt->entrySeq.size()));
+			curEnt->entryCigar.insert(curEnt->entryCigar.end(), numBuff, numBuff + strlen(numBuff));
+			curEnt->entryCigar.push_back('M');
+			curEnt->nextPos = -1;
+			curEnt->entryTempLen = 0;
+			curEnt->entrySeq.insert(curEnt->entrySeq.end(), anyRes->seqSeq.begin(), anyRes->seqSeq.end());
+			curEnt->entryQual.insert(curEnt->entryQual.end(), anyRes->seqPhreds.begin(), anyRes->seqPhreds.end());
+			samOut->writeNextEntry();
+		}
+		myArgs->entC->dealloc(anyRes->mainEnt);
+		myArgs->entC->dealloc(anyRes->pairEnt);
+	}
+	myArgs->resPCC->taskCache.dealloc(anyRes);
+}
+
+/**
+ * Output the merged sequences.
+ * @param tmpArg The arguments.
+ */
+void outputMergedResults(void* tmpArg){
+	OutputMergeThreadArgs* myArgs = (OutputMergeThreadArgs*)tmpArg;
+	MergeOrderWindow* orderWin = myArgs->orderWin;
+	try{
+		uintptr_t nextOut = 0;
+		MergeSequenceData* anyRes = myArgs->resPCC->getThing();
+		while(anyRes){
+			if(orderWin){
+				//park it, then write everything that is ready
+				orderWin->waitRes[anyRes->pairID % orderWin->winSize] = anyRes;
+				uintptr_t startOut = nextOut;
+				MergeSequenceData** nextRes = &(orderWin->waitRes[nextOut % orderWin->winSize]);
+				while(*nextRes){
+					outputMergedResult(myArgs, *nextRes);
+					*nextRes = 0;
+					nextOut++;
+					nextRes = &(orderWin->waitRes[nextOut % orderWin->winSize]);
+				}
+				if(nextOut != startOut){ orderWin->noteWritten(nextOut); }
+			}
+			else{
+				outputMergedResult(myArgs, anyRes);
+			}
+			anyRes = myArgs->resPCC->getThing();
+		}
+	}catch(std::exception& err){
+		myArgs->runFail->noteFailure(err.what());
+	}
+}
+
+/**Arguments to writing failed sequence.*/
+typedef struct{
+	/**The place to output.*/
+	CRBSAMFileWriter* curOut;
+	/**Arguments to ProSynAr.*/
+	ProsynarArgumentParser* argsP;
+	/**Return entry data.*/
+	ThreadsafeReusableContainerCache<CRBSAMFileContents>* entC;
+	/**Get tasks to do.*/
+	ThreadProdComCollector<CRBSAMFileContents>* taskPCC;
+	/**The place to note a problem.*/
+	MergeRunFailure* runFail;
+} OutputFailedThreadArgs;
+/**
+ * Output the failed sequences.
+ * @param tmpArg The arguments.
+ */
+void outputFailedResults(void* tmpArg){
+	OutputFailedThreadArgs* myArgs = (OutputFailedThreadArgs*)tmpArg;
+	CRBSAMFileWriter* curOut = myArgs->curOut;
+	try{
+		CRBSAMFileContents* anyRes = myArgs->taskPCC->getThing();
+		while(anyRes){
+			curOut->writeNextEntry(anyRes);
+			myArgs->entC->dealloc(anyRes);
+			anyRes = myArgs->taskPCC->getThing();
+		}
+	}catch(std::exception& err){
+		myArgs->runFail->noteFailure(err.what());
+	}
+}
+
+/**
+ * Send an alignment on: to the mergers if its pair has already shown up, to the failure dump (or the trash) if it is not paired.
+ * @param curEnt The alignment.
+ * @param entID The id to file it under if it has to wait for its pair.
+ * @param pairCache The alignments waiting for their pair.
+ * @param pairCtx Space to look at a pair before it is handed off.
+ * @param argsP The arguments to ProSynAr.
+ * @param entC The place to return entry data.
+ * @param taskPCC The place to send pairs to merge.
+ * @param failPCC The place to send alignments that will not be merged.
+ * @param numPairOut The number of pairs sent to merge so far, to number them with: updated. Null if the numbers are not needed.
+ */
+void routeAlignment(CRBSAMFileContents* curEnt, uintptr_t entID, PairedEndCache* pairCache, ProsynarPairContext* pairCtx, ProsynarArgumentParser* argsP, ThreadsafeReusableContainerCache<CRBSAMFileContents>* entC, ThreadProdComCollector<MergeAttemptTask>* taskPCC, ThreadProdComCollector<CRBSAMFileContents>* failPCC, uintptr_t* numPairOut){
+	if(samEntryNeedPair(curEnt)){
+		if(pairCache->havePair(curEnt)){
+			std::pair<uintptr_t,CRBSAMFileContents*> origEnt = pairCache->getPair(curEnt);
+			//pairs the first filter will certainly throw out never need a thread (only the first: an earlier one might have complained)
+			if(argsP->useFilters.size()){
+				pairCtx->changePair(argsP, curEnt, origEnt.second);
+				if(argsP->useFilters[0]->quickReject(pairCtx)){
+					if(argsP->failDumpB){
+						failPCC->addThing(curEnt);
+						failPCC->addThing(origEnt.second);
+					}
+					else{
+						entC->dealloc(curEnt);
+						entC->dealloc(origEnt.second);
+					}
+					return;
+				}
+			}
+			MergeAttemptTask* curPush = taskPCC->taskCache.alloc();
+			curPush->mainEnt = curEnt;
+			curPush->pairEnt = origEnt.second;
+			curPush->pairID = 0;
+			if(numPairOut){
+				curPush->pairID = *numPairOut;
+				(*numPairOut)++;
+			}
+			taskPCC->addThing(curPush);
+		}
+		else{
+			pairCache->waitForPair(entID, curEnt);
+		}
+	}
+	else if(argsP->failDumpB){
+		failPCC->addThing(curEnt);
+	}
+	else{
+		entC->dealloc(curEnt);
+	}
+}
+
+/**A stretch of a sorted bam file that can be read on its own.*/
+class BAMShard{
+public:
+	/**The index of the reference in the bam header: -1 for the alignments without a position.*/
+	intptr_t refInd;
+	/**The first position to take.*/
+	intptr_t startPos;
+	/**The position to stop at: -1 to run to the end of the reference.*/
+	intptr_t endPos;
+	/**The virtual offset to start reading at.*/
+	uint64_t startOffset;
+};
+
+/**The number of stretches to aim for for each reading thread, so a slow stretch does not hold up the rest.*/
+#define SHARDS_PER_THREAD 8
+
+/**
+ * Split a sorted, indexed bam file into stretches.
+ * @param bamInd The index.
+ * @param firstOffset The virtual offset of the first alignment.
+ * @param numThread The number of threads that will read.
+ * @param toFill The place to put the stretches, in file order.
+ */
+void planBAMShards(BAMFileIndex* bamInd, uint64_t firstOffset, uintptr_t numThread, std::vector<BAMShard>* toFill){
+	uintptr_t numWindow = 0;
+	for(uintptr_t ri = 0; ri<bamInd->refIndex.size(); ri++){
+		numWindow += bamInd->refIndex[ri].linearIndex.size();
+	}
+	uintptr_t winPerShard = std::max((uintptr_t)1, numWindow / (SHARDS_PER_THREAD*numThread));
+	uint64_t unplacedOffset = firstOffset;
+	for(uintptr_t ri = 0; ri<bamInd->refIndex.size(); ri++){
+		BAMIndexReference* curRef = &(bamInd->refIndex[ri]);
+		unplacedOffset = std::max(unplacedOffset, curRef->maxChunkEnd);
+		std::vector<uint64_t>* linInd = &(curRef->linearIndex);
+		for(uintptr_t wi = 0; wi<linInd->size(); wi += winPerShard){
+			uintptr_t endWI = std::min(wi + winPerShard, (uintptr_t)(linInd->size()));
+			//nothing overlaps an empty window, so the first alignment is at the first full one
+			uintptr_t firstWI = wi;
+			while((firstWI < endWI) && ((*linInd)[firstWI] == 0)){ firstWI++; }
+			if(firstWI == endWI){ continue; }
+			BAMShard newShard;
+			newShard.refInd = ri;
+			newShard.startPos = wi * BAM_INDEX_WINDOW;
+			newShard.endPos = (endWI == linInd->size()) ? -1 : (intptr_t)(endWI * BAM_INDEX_WINDOW);
+			newShard.startOffset = (*linInd)[firstWI];
+			toFill->push_back(newShard);
+		}
+	}
+	//anything without a position comes after everything with
+	BAMShard tailShard;
+	tailShard.refInd = -1;
+	tailShard.startPos = 0;
+	tailShard.endPos = -1;
+	tailShard.startOffset = unplacedOffset;
+	toFill->push_back(tailShard);
+}
+
+/**Sharded reading thread arguments.*/
+typedef struct{
+	/**Arguments to ProSynAr.*/
+	ProsynarArgumentParser* argsP;
+	/**The bam file to read.*/
+	const char* bamName;
+	/**The stretches of the file.*/
+	std::vector<BAMShard>* allShards;
+	/**The next stretch to read.*/
+	uintptr_t* nextShard;
+	/**Protect nextShard.*/
+	void* shardLock;
+	/**Return entry data.*/
+	ThreadsafeReusableContainerCache<CRBSAMFileContents>* entC;
+	/**Send pairs to merge.*/
+	ThreadProdComCollector<MergeAttemptTask>* taskPCC;
+	/**Output failed.*/
+	ThreadProdComCollector<CRBSAMFileContents>* failPCC;
+	/**The alignments this thread found but not the pair of.*/
+	PairedEndCache* pairCache;
+	/**The first id used for each stretch this thread read, and the index of the stretch.*/
+	std::vector< std::pair<uintptr_t,uintptr_t> >* shardStartIDs;
+	/**The place to note a problem.*/
+	std::string* errMess;
+} ShardReadThreadArgs;
+/**
+ * Read stretches of a bam file until there are none left.
+ * @param tmpArg The arguments.
+ */
+void readBAMShards(void* tmpArg){
+	ShardReadThreadArgs* myArgs = (ShardReadThreadArgs*)tmpArg;
+	std::vector<BAMShard>* allShards = myArgs->allShards;
+	BGZipInStream* curInpF = 0;
+	BAMFileReader* curInp = 0;
+	CRBSAMFileContents* curEnt = 0;
+	uintptr_t numWait = 0;
+	ProsynarPairContext pairCtx;
+	try{
+		curInpF = new BGZipInStream(myArgs->bamName);
+		curInp = new BAMFileReader(curInpF);
+		curInp->doneHead = 1;
+		curEnt = myArgs->entC->alloc();
+		while(true){
+			//get the next stretch
+			lockMutex(myArgs->shardLock);
+				uintptr_t curShardI = *(myArgs->nextShard);
+				if(curShardI < allShards->size()){ *(myArgs->nextShard) = curShardI + 1; }
+			unlockMutex(myArgs->shardLock);
+			if(curShardI >= allShards->size()){ break; }
+			BAMShard* curShard = &((*allShards)[curShardI]);
+			std::string* curRefName = (curShard->refInd >= 0) ? &(curInp->refNames[curShard->refInd]) : 0;
+			myArgs->shardStartIDs->push_back(std::pair<uintptr_t,uintptr_t>(numWait, curShardI));
+			//run down the stretch
+			curInpF->seek(curShard->startOffset);
+			while(curInp->readNextEntry(curEnt)){
+				if(curRefName){
+					std::vector<char>* entRef = &(curEnt->entryReference);
+					if((entRef->size() != curRefName->size()) || (entRef->size() && memcmp(&((*entRef)[0]), curRefName->c_str(), entRef->size()))){ break; }
+					if((curShard->endPos >= 0) && (curEnt->entryPos >= curShard->endPos)){ break; }
+					if(curEnt->entryPos < curShard->startPos){ continue; }
+				}
+				else if(curEnt->entryReference.size()){
+					continue;
+				}
+				if(!samEntryIsPrimary(curEnt)){ continue; }
+				routeAlignment(curEnt, numWait, myArgs->pairCache, &pairCtx, myArgs->argsP, myArgs->entC, myArgs->taskPCC, myArgs->failPCC, 0);
+				curEnt = myArgs->entC->alloc();
+				numWait++;
+			}
+		}
+	}catch(std::exception& err){
+		myArgs->errMess->append(err.what());
+	}
+	if(curEnt){ myArgs->entC->dealloc(curEnt); }
+	if(curInp){ delete(curInp); }
+	if(curInpF){ delete(curInpF); }
+}
+
+/**
+ * Find the index of a bam file.
+ * @param bamName The name of the bam file.
+ * @param toFill The place to put the name of the index.
+ * @return Whether there was an index.
+ */
+bool findBAMIndex(const char* bamName, std::string* toFill){
+	toFill->clear();
+	toFill->append(bamName);
+	toFill->append(".bai");
+	if(fileExists(toFill->c_str())){ return true; }
+	toFill->clear();
+	toFill->append(bamName, strlen(bamName) - 4);
+	toFill->append(".bai");
+	return fileExists(toFill->c_str());
+}
+
+/**
+ * Read a sorted, indexed bam file a stretch at a time, with multiple threads.
+ * @param bamName The name of the bam file.
+ * @param bamIndName The name of the index.
+ * @param argsP The arguments to ProSynAr.
+ * @param haveEndHead Whether the header has already been passed on: updated.
+ * @param numTaskIn The number of alignments handed out so far: updated.
+ * @param proCache The alignments (from any file) waiting for their pair.
+ * @param entC The place to return entry data.
+ * @param taskPCC The place to send pairs to merge.
+ * @param failPCC The place to send alignments that will not be merged.
+ * @param samOut The place merged alignments go, if any.
+ */
+void readShardedBAM(const char* bamName, const char* bamIndName, ProsynarArgumentParser* argsP, bool* haveEndHead, uintptr_t* numTaskIn, PairedEndCache* proCache, ThreadsafeReusableContainerCache<CRBSAMFileContents>* entC, ThreadProdComCollector<MergeAttemptTask>* taskPCC, ThreadProdComCollector<CRBSAMFileContents>* failPCC, CRBSAMFileWriter* samOut){
+	std::vector<BAMShard> allShards;
+	//pass on the header, and note where the alignments start
+	{
+		BGZipInStream headInpF(bamName);
+		BAMFileReader headInp(&headInpF);
+		uint64_t firstOffset = headInpF.tell();
+		CRBSAMFileContents* curEnt = &(headInp.curEnt);
+		while(headInp.readNextEntry(curEnt)){
+			if(!(curEnt->lastReadHead)){
+				*haveEndHead = true;
+				break;
+			}
+			if(*haveEndHead){ continue; }
+			if(argsP->failDumpB){ argsP->failDumpB->writeNextEntry(curEnt); }
+			if(samOut){ samOut->writeNextEntry(curEnt); }
+		}
+		FileInStream indInp(bamIndName);
+		BAMFileIndex bamInd(&indInp);
+		planBAMShards(&bamInd, firstOffset, argsP->numShardThread, &allShards);
+	}
+	//read the stretches
+	uintptr_t nextShard = 0;
+	void* shardLock = makeMutex();
+	std::vector<PairedEndCache> pairCaches(argsP->numShardThread);
+	std::vector< std::vector< std::pair<uintptr_t,uintptr_t> > > shardStartIDs(argsP->numShardThread);
+	std::vector<std::string> errMesses(argsP->numShardThread);
+	std::vector<ShardReadThreadArgs> readThrArgs(argsP->numShardThread);
+	std::vector<uintptr_t> readTasks;
+	for(intptr_t i = 0; i<argsP->numShardThread; i++){
+		ShardReadThreadArgs newArg = {argsP, bamName, &allShards, &nextShard, shardLock, entC, taskPCC, failPCC, &(pairCaches[i]), &(shardStartIDs[i]), &(errMesses[i])};
+		readThrArgs[i] = newArg;
+		readTasks.push_back(argsP->usePool->addTask(readBAMShards, &(readThrArgs[i]), THREADPOOL_PRIORITY_STAGE));
+	}
+	for(uintptr_t i = 0; i<readTasks.size(); i++){
+		argsP->usePool->joinTask(readTasks[i]);
+	}
+	killMutex(shardLock);
+	//pair up anything split between stretches, in file order (so the later alignment leads, as when read straight through)
+	std::vector< std::pair< std::pair<uintptr_t,uintptr_t>, CRBSAMFileContents* > > leftEnts;
+	for(uintptr_t i = 0; i<pairCaches.size(); i++){
+		std::vector< std::pair<uintptr_t,uintptr_t> >* curStarts = &(shardStartIDs[i]);
+		while(pairCaches[i].haveOutstanding()){
+			std::pair<uintptr_t,CRBSAMFileContents*> leftEnt = pairCaches[i].getOutstanding();
+			uintptr_t startI = std::upper_bound(curStarts->begin(), curStarts->end(), std::pair<uintptr_t,uintptr_t>(leftEnt.first, (uintptr_t)-1)) - curStarts->begin();
+			uintptr_t shardI = (*curStarts)[startI - 1].second;
+			leftEnts.push_back(std::pair< std::pair<uintptr_t,uintptr_t>, CRBSAMFileContents* >(std::pair<uintptr_t,uintptr_t>(shardI, leftEnt.first), leftEnt.second));
+		}
+	}
+	std::sort(leftEnts.begin(), leftEnts.end());
+	ProsynarPairContext pairCtx;
+	for(uintptr_t i = 0; i<leftEnts.size(); i++){
+		routeAlignment(leftEnts[i].second, *numTaskIn, proCache, &pairCtx, argsP, entC, taskPCC, failPCC, 0);
+		(*numTaskIn)++;
+	}
+	//complain about any problems
+	for(uintptr_t i = 0; i<errMesses.size(); i++){
+		if(errMesses[i].size()){
+			throw std::runtime_error(errMesses[i]);
+		}
+	}
+}
+
+/**
+ * Get the current counts for the queues between the stages.
+ * @param runStats The place to put them: queues added as task, good and fail.
+ * @param taskPCC The pairs to merge.
+ * @param goodPCC The merged results.
+ * @param failPCC The alignments that were not merged.
+ */
+void gatherQueueStats(ProsynarRunStats* runStats, ThreadProdComCollector<MergeAttemptTask>* taskPCC, ThreadProdComCollector<MergeSequenceData>* goodPCC, ThreadProdComCollector<CRBSAMFileContents>* failPCC){
+	taskPCC->getStats(runStats->queueStats[0]);
+	goodPCC->getStats(runStats->queueStats[1]);
+	failPCC->getStats(runStats->queueStats[2]);
+}
+
+/**Progress report thread arguments.*/
+typedef struct{
+	/**Arguments to ProSynAr.*/
+	ProsynarArgumentParser* argsP;
+	/**The numbers to report.*/
+	ProsynarRunStats* runStats;
+	/**The pairs to merge.*/
+	ThreadProdComCollector<MergeAttemptTask>* taskPCC;
+	/**The merged results.*/
+	ThreadProdComCollector<MergeSequenceData>* goodPCC;
+	/**The alignments that were not merged.*/
+	ThreadProdComCollector<CRBSAMFileContents>* failPCC;
+	/**Protect runDone.*/
+	void* doneMut;
+	/**Signalled when the run is done.*/
+	void* doneCond;
+	/**Whether the run is done.*/
+	bool runDone;
+} ProgressThreadArgs;
+/**
+ * Report progress every so often until the run is done.
+ * @param tmpArg The arguments.
+ */
+void reportProgress(void* tmpArg){
+	ProgressThreadArgs* myArgs = (ProgressThreadArgs*)tmpArg;
+	uintmax_t repInterval = ((uintmax_t)(myArgs->argsP->progressSecs)) * 1000000000;
+	uintmax_t nextReport = getMonotonicTime() + repInterval;
+	lockMutex(myArgs->doneMut);
+	while(!(myArgs->runDone)){
+		uintmax_t curTime = getMonotonicTime();
+		if(curTime < nextReport){
+			waitConditionTimed(myArgs->doneMut, myArgs->doneCond, nextReport - curTime);
+			continue;
+		}
+		nextReport = curTime + repInterval;
+		gatherQueueStats(myArgs->runStats, myArgs->taskPCC, myArgs->goodPCC, myArgs->failPCC);
+		lockMutex(myArgs->argsP->errLock);
+			myArgs->runStats->writeProgress(myArgs->argsP->errOut);
+		unlockMutex(myArgs->argsP->errLock);
+	}
+	unlockMutex(myArgs->doneMut);
+}
+
+/**
+ * Tell the progress thread the run is done.
+ * @param progArgs The arguments to the progress thread.
+ */
+void endProgress(ProgressThreadArgs* progArgs){
+	lockMutex(progArgs->doneMut);
+		progArgs->runDone = true;
+		signalCondition(progArgs->doneMut, progArgs->doneCond);
+	unlockMutex(progArgs->doneMut);
+}
+
+#define MAX_QUEUE_SIZE 16
+
+/**The number of pairs each merge thread can get ahead of the output, when writing in order.*/
+#define ORDER_WINDOW_PER_THREAD 64
+/**The number of pairs to read between checks for whether a stage has failed.*/
+#define RUN_FAILURE_CHECK_PERIOD 1024
+
+uintptr_t prosynarRunStageCount(ProsynarArgumentParser* argsP){
+	uintptr_t numStage = argsP->numThread + 1 + (argsP->failDumpFile ? 1 : 0) + (argsP->progressSecs ? 1 : 0);
+	bool anyShard = false;
+	for(uintptr_t si = 0; si < argsP->samNames.size(); si++){
+		anyShard = anyShard || strendswith(argsP->samNames[si], ".bam");
+	}
+	if(anyShard){ numStage += argsP->numShardThread; }
+	return numStage;
+}
+
+void prosynarRunMerge(ProsynarArgumentParser* argsP){
+	ThreadPool* mainPool = argsP->usePool;
+	bool haveErr = false;
+	std::string errMess;
+	InStream* curInpF = 0;
+	TabularReader* curInpT = 0;
+	CRBSAMFileReader* curInp = 0;
+	OutStream* curOutF = 0;
+	SequenceWriter* curOut = 0;
+	OutStream* curOutSF = 0;
+	TabularWriter* curOutST = 0;
+	CRBSAMFileWriter* curOutS = 0;
+	//thread state (keep alive until threads dead)
+	ThreadsafeReusableContainerCache<CRBSAMFileContents> entCache;
+	PairedEndCache proCache;
+	ProsynarPairContext proPairCtx;
+	ThreadProdComCollector<MergeAttemptTask> taskPCC(MAX_QUEUE_SIZE*argsP->numThread);
+	ThreadProdComCollector<MergeSequenceData> goodPCC(MAX_QUEUE_SIZE*argsP->numThread);
+	ThreadProdComCollector<CRBSAMFileContents> failPCC(MAX_QUEUE_SIZE*argsP->numThread);
+	MergeRunFailure runFail(argsP, &taskPCC, &goodPCC, &failPCC);
+	std::vector<MergeThreadArgs> workThrArgs;
+	std::vector<uintptr_t> liveTasks;
+	OutputMergeThreadArgs goodThrArg;
+	bool goodLive = false;
+	uintptr_t goodTask = 0;
+	OutputFailedThreadArgs failThrArg;
+	bool failLive = false;
+	uintptr_t failTask = 0;
+	ProsynarRunStats* runStats = 0;
+	MergeOrderWindow* orderWin = 0;
+	ProgressThreadArgs progArg = {argsP, 0, &taskPCC, &goodPCC, &failPCC, makeMutex(), 0, false};
+	progArg.doneCond = makeCondition(progArg.doneMut);
+	bool progLive = false;
+	uintptr_t progTask = 0;
+try{
+	//open the outputs
+		if(argsP->seqOutFile){
+			openSequenceFileWrite(argsP->seqOutFile, &curOutF, &curOut, argsP->numThread, mainPool);
+		}
+		if(argsP->mergeSamOutFile){
+			openCRBSamFileWrite(argsP->mergeSamOutFile, &curOutSF, &curOutST, &curOutS);
+		}
+	//start keeping track
+		runStats = new ProsynarRunStats(argsP->numThread, argsP->useFilters.size());
+		runStats->addQueue("task");
+		runStats->addQueue("good");
+		runStats->addQueue("fail");
+		if(argsP->progressSecs){
+			progArg.runStats = runStats;
+			progTask = mainPool->addTask(reportProgress, &progArg, THREADPOOL_PRIORITY_STAGE);
+			progLive = true;
+		}
+	//start up the work threads
+		if(argsP->orderedOutput){
+			orderWin = new MergeOrderWindow(ORDER_WINDOW_PER_THREAD*argsP->numThread);
+			runFail.orderWin = orderWin;
+		}
+		workThrArgs.resize(argsP->numThread);
+		for(intptr_t i = 0; i<argsP->numThread; i++){
+			MergeThreadArgs newArg = {(int)i, argsP, &taskPCC, &entCache, &failPCC, &goodPCC, &(runStats->workStats[i]), orderWin, &runFail};
+			workThrArgs[i] = newArg;
+			liveTasks.push_back(mainPool->addTask(attemptMerging, &(workThrArgs[i]), THREADPOOL_PRIORITY_STAGE));
+		}
+	//start the good output thread
+		{
+			OutputMergeThreadArgs makeThrArg = {curOut, curOutS, argsP, &goodPCC, &entCache, orderWin, &runFail};
+			goodThrArg = makeThrArg;
+		}
+		goodTask = mainPool->addTask(outputMergedResults, &goodThrArg, THREADPOOL_PRIORITY_STAGE);
+		goodLive = true;
+	//start the bad output thread
+		CRBSAMFileWriter* failDumpB = argsP->failDumpB;
+		if(failDumpB){
+			OutputFailedThreadArgs newFTArg = {failDumpB, argsP, &entCache, &failPCC, &runFail};
+			failThrArg = newFTArg;
+			failTask = mainPool->addTask(outputFailedResults, &failThrArg, THREADPOOL_PRIORITY_STAGE);
+			failLive = true;
+		}
+	//run down the files
+		CRBSAMFileContents* curEnt = entCache.alloc();
+		uintptr_t numTaskIn = 0;
+		uintptr_t numPairOut = 0;
+		bool haveEndHead = false;
+		std::string bamIndName;
+		for(uintptr_t si = 0; si < argsP->samNames.size(); si++){
+			//sorted and indexed bam can be read a stretch at a time
+			if(argsP->numShardThread && strendswith(argsP->samNames[si], ".bam") && findBAMIndex(argsP->samNames[si], &bamIndName)){
+				readShardedBAM(argsP->samNames[si], bamIndName.c_str(), argsP, &haveEndHead, &numTaskIn, &proCache, &entCache, &taskPCC, &failPCC, curOutS);
+				if(runFail.haveFailed()){ throw std::runtime_error(runFail.firstErr); }
+				continue;
+			}
+			//open
+			openCRBSamFileRead(argsP->samNames[si], &curInpF, &curInpT, &curInp, argsP->numThread, mainPool);
+			//run down the file looking for unpaired and paired
+			while(curInp->readNextEntry(curEnt)){
+				//manage the entry
+				if(curEnt->lastReadHead){
+					if(failDumpB && !haveEndHead){
+						failDumpB->writeNextEntry(curEnt);
+					}
+					if(curOutS && !haveEndHead){
+						curOutS->writeNextEntry(curEnt);
+					}
+				}
+				else{
+					haveEndHead = true;
+					//skip secondary/supplementary stuff
+					if(!samEntryIsPrimary(curEnt)){ continue; }
+					//if paired, handle
+					routeAlignment(curEnt, numTaskIn, &proCache, &proPairCtx, argsP, &entCache, &taskPCC, &failPCC, orderWin ? &numPairOut : 0);
+					curEnt = entCache.alloc();
+					numTaskIn++;
+					//no sense reading on if a stage has died
+					if(((numTaskIn % RUN_FAILURE_CHECK_PERIOD) == 0) && runFail.haveFailed()){
+						throw std::runtime_error(runFail.firstErr);
+					}
+				}
+			}
+			//close
+			delete(curInp); curInp = 0;
+			delete(curInpT); curInpT = 0;
+			delete(curInpF); curInpF = 0;
+		}
+		entCache.dealloc(curEnt); //got one too many
+	//drain any outstanding to fail
+		std::string badPairName;
+		while(proCache.haveOutstanding()){
+			std::pair<uintptr_t,CRBSAMFileContents*> origEntP = proCache.getOutstanding();
+			CRBSAMFileContents* origEnt = origEntP.second;
+			badPairName.clear(); badPairName.insert(badPairName.end(), origEnt->entryName.begin(), origEnt->entryName.end());
+			lockMutex(argsP->errLock);
+				*(argsP->errOut) << "Entry " << badPairName << " claims to be paired, but no pair is in file." << std::endl;
+			unlockMutex(argsP->errLock);
+			if(failDumpB){
+				failPCC.addThing(origEnt);
+			}
+			else{
+				entCache.dealloc(origEnt);
+			}
+		}
+	//end the task cache, join the threads
+		taskPCC.end();
+		for(uintptr_t i = 0; i<liveTasks.size(); i++){
+			mainPool->joinTask(liveTasks[i]);
+		}
+		liveTasks.clear();
+	//end the result caches, join the finals
+		goodPCC.end();
+		failPCC.end();
+		mainPool->joinTask(goodTask); goodLive = false;
+		if(failLive){ mainPool->joinTask(failTask); failLive = false; }
+		if(runFail.haveFailed()){
+			throw std::runtime_error(runFail.firstErr);
+		}
+	//finish the alignment outputs, so a problem writing their ends shows up
+		if(curOutS){ curOutS->finish(); }
+		if(failDumpB){ failDumpB->finish(); }
+	//report how it went
+		if(progLive){
+			endProgress(&progArg);
+			mainPool->joinTask(progTask); progLive = false;
+		}
+		gatherQueueStats(runStats, &taskPCC, &goodPCC, &failPCC);
+		if(argsP->progressSecs){
+			runStats->writeProgress(argsP->errOut);
+		}
+		if(argsP->statsFile){
+			runStats->writeReport(argsP->statsFile, argsP);
+		}
+	//report the bounds
+		if(argsP->reportPrune){
+			std::map<std::string,uintptr_t> pruneCounts;
+			argsP->useMerger->getPruneCounts(&pruneCounts);
+			for(std::map<std::string,uintptr_t>::iterator pruneIt = pruneCounts.begin(); pruneIt != pruneCounts.end(); pruneIt++){
+				*(argsP->errOut) << pruneIt->first << "\t" << pruneIt->second << std::endl;
+			}
+		}
+}catch(std::exception& err){
+	//keep the first problem: a dead stage may have caused this one
+	runFail.noteFailure(err.what());
+	haveErr = true;
+	errMess = runFail.firstErr;
+	for(uintptr_t i = 0; i<liveTasks.size(); i++){ mainPool->joinTask(liveTasks[i]); }
+	if(goodLive){ mainPool->joinTask(goodTask); }
+	if(failLive){ mainPool->joinTask(failTask); }
+	if(progLive){ endProgress(&progArg); mainPool->joinTask(progTask); }
+}
+	if(curInp){ delete(curInp); }
+	if(curInpT){ delete(curInpT); }
+	if(curInpF){ delete(curInpF); }
+	if(curOut){ delete(curOut); }
+	if(curOutF){ delete(curOutF); }
+	if(curOutS){ delete(curOutS); }
+	if(curOutST){ delete(curOutST); }
+	if(curOutSF){ delete(curOutSF); }
+	if(runStats){ delete(runStats); }
+	if(orderWin){ delete(orderWin); }
+	killCondition(progArg.doneCond);
+	killMutex(progArg.doneMut);
+	if(haveErr){ throw std::runtime_error(errMess); }
+}
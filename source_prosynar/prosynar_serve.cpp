@@ -0,0 +1,427 @@
+#include "prosynar_serve.h"
+
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "whodun_oshook.h"
+
+#include "prosynar_run.h"
+
+ProsynarServeArgumentParser::ProsynarServeArgumentParser(){
+	sockFile = 0;
+	numJobs = 2;
+	numThread = 1;
+	refFile = 0;
+	refPackFile = 0;
+	probFile = 0;
+	costFile = 0;
+	qualmFile = 0;
+	myMainDoc = "Usage: prosynar serve [OPTION]\nLoads the reference and defaults once, then runs merge jobs sent over a local socket.\nSend jobs with prosynar submit: file names are taken relative to where the server was started.\nThe OPTIONS are:\n";
+	myVersionDoc = "ProSynAr serve 1.0";
+	myCopyrightDoc = "Copyright (C) 2019 UNT HSC Center for Human Identification";
+	ArgumentParserStrMeta sockMeta("Socket File");
+		sockMeta.isFile = true;
+		sockMeta.fileWrite = true;
+		addStringOption("--socket", &sockFile, 0, "    Specify the socket to listen on (anything already there is replaced).\n    --socket File.sock\n", &sockMeta);
+	ArgumentParserIntMeta jobMeta("Concurrent Jobs");
+		addIntegerOption("--jobs", &numJobs, 0, "    The number of jobs to run at once: any more wait their turn.\n    --jobs 2\n", &jobMeta);
+	ArgumentParserIntMeta threadMeta("Threads Per Job");
+		addIntegerOption("--thread", &numThread, 0, "    The most merge threads a job can ask for.\n    --thread 1\n", &threadMeta);
+	ArgumentParserStrMeta refMeta("Reference File");
+		refMeta.isFile = true;
+		refMeta.fileExts.insert(".fa");
+		refMeta.fileExts.insert(".fa.gz");
+		refMeta.fileExts.insert(".fa.gzip");
+		refMeta.fileExts.insert(".gail");
+		addStringOption("--ref", &refFile, 0, "    Specify the reference sequences in a fasta file.\n    A gail file (with .blk and .ind files next to it) is read as needed, rather than loaded.\n    --ref File.fa\n", &refMeta);
+	ArgumentParserStrMeta refPackMeta("Packed Reference File");
+		refPackMeta.isFile = true;
+		refPackMeta.fileExts.insert(".w2b");
+		addStringOption("--refpack", &refPackFile, 0, "    Use a packed image of the reference, only unpacking the parts that are needed.\n    Built from the --ref file if it does not exist.\n    --refpack File.w2b\n", &refPackMeta);
+	ArgumentParserStrMeta probMeta("Problematic Region File");
+		probMeta.isFile = true;
+		probMeta.fileExts.insert(".bed");
+		addStringOption("--prob", &probFile, 0, "    Specify the problematic regions in a bed file.\n    --prob File.bed\n", &probMeta);
+	ArgumentParserStrMeta costMeta("Alignment Parameter File");
+		costMeta.isFile = true;
+		costMeta.fileExts.insert(".pdc");
+		addStringOption("--cost", &costFile, 0, "    Specify the position dependent cost function.\n    --cost File.pdc\n", &costMeta);
+	ArgumentParserStrMeta qualmMeta("Quality Mangle File");
+		qualmMeta.isFile = true;
+		qualmMeta.fileExts.insert(".qualm");
+		addStringOption("--qualm", &qualmFile, 0, "    Specify how to modify alignment parameters using their quality.\n    --qualm File.qualm\n", &qualmMeta);
+}
+
+ProsynarServeArgumentParser::~ProsynarServeArgumentParser(){}
+
+int ProsynarServeArgumentParser::posteriorCheck(){
+	if(!sockFile || (strlen(sockFile)==0)){
+		argumentError = "Need a socket to listen on.";
+		return 1;
+	}
+	if(numJobs <= 0){
+		argumentError = "jobs must be positive.";
+		return 1;
+	}
+	if(numThread <= 0){
+		argumentError = "thread must be positive.";
+		return 1;
+	}
+	if(refFile && (strlen(refFile)==0)){ refFile = 0; }
+	if(refPackFile && (strlen(refPackFile)==0)){ refPackFile = 0; }
+	if(probFile && (strlen(probFile)==0)){ probFile = 0; }
+	if(costFile && (strlen(costFile)==0)){ costFile = 0; }
+	if(qualmFile && (strlen(qualmFile)==0)){ qualmFile = 0; }
+	return 0;
+}
+
+ProsynarSubmitArgumentParser::ProsynarSubmitArgumentParser(){
+	sockFile = 0;
+	stopServer = false;
+	myMainDoc = "Usage: prosynar submit [OPTION] [JOB]\nSends a merge job to a server started with prosynar serve, and waits for it to finish.\nThe JOB is as for prosynar, without --ref, --refpack, --prob, --cost or --qualm (the server has them).\nFile names are taken relative to where the server was started, and the job must name its inputs and its output (--out or --samze): it cannot use stdin or stdout.\nThe OPTIONS are:\n";
+	myVersionDoc = "ProSynAr submit 1.0";
+	myCopyrightDoc = "Copyright (C) 2019 UNT HSC Center for Human Identification";
+	ArgumentParserStrMeta sockMeta("Socket File");
+		sockMeta.isFile = true;
+		addStringOption("--socket", &sockFile, 0, "    Specify the socket the server is listening on.\n    --socket File.sock\n", &sockMeta);
+	ArgumentParserBoolMeta stopMeta("Stop Server");
+		addBooleanFlag("--stop", &stopServer, 1, "    Tell the server to stop, once its running jobs finish.\n", &stopMeta);
+}
+
+ProsynarSubmitArgumentParser::~ProsynarSubmitArgumentParser(){}
+
+int ProsynarSubmitArgumentParser::handleUnknownArgument(int argc, char** argv, std::ostream* helpOut){
+	//everything from here on is for the job
+	jobArgs.insert(jobArgs.end(), argv, argv + argc);
+	return argc;
+}
+
+int ProsynarSubmitArgumentParser::posteriorCheck(){
+	if(!sockFile || (strlen(sockFile)==0)){
+		argumentError = "Need the socket of the server.";
+		return 1;
+	}
+	if(stopServer && jobArgs.size()){
+		argumentError = "Cannot send a job and stop the server at the same time.";
+		return 1;
+	}
+	return 0;
+}
+
+ProsynarServer::ProsynarServer(ProsynarServeArgumentParser* useArgs){
+	this->useArgs = useArgs;
+	jobPool = 0;
+	servSock = 0;
+	stopping = false;
+	jobMut = makeMutex();
+	jobCond = makeCondition(jobMut);
+	//load the shared things
+	sharedArgs.refFile = useArgs->refFile;
+	sharedArgs.refPackFile = useArgs->refPackFile;
+	sharedArgs.probFile = useArgs->probFile;
+	sharedArgs.costFile = useArgs->costFile;
+	sharedArgs.qualmFile = useArgs->qualmFile;
+	sharedArgs.loadShared();
+	//set up the job slots
+	allJobs.resize(useArgs->numJobs);
+	for(uintptr_t i = 0; i<allJobs.size(); i++){
+		allJobs[i].forServer = this;
+		allJobs[i].theConn = 0;
+		allJobs[i].jobState = PROSYNAR_JOB_FREE;
+		allJobs[i].jobTask = 0;
+	}
+	jobPool = new ThreadPool(useArgs->numJobs * (useArgs->numThread + PROSYNAR_SERVE_EXTRA_STAGE));
+}
+
+ProsynarServer::~ProsynarServer(){
+	if(servSock){ closeLocalServer(servSock); }
+	if(jobPool){ delete(jobPool); }
+	killCondition(jobCond);
+	killMutex(jobMut);
+}
+
+/**
+ * Get whether a file name means stdin or stdout.
+ * @param fileName The name, if any.
+ * @return Whether it is the standard stream.
+ */
+bool prosynarServeIsStdio(const char* fileName){
+	return fileName && (strcmp(fileName, "-") == 0);
+}
+
+/**
+ * Run a job in a server.
+ * @param tmpArg The job.
+ */
+void runServeJob(void* tmpArg){
+	ProsynarServeJob* theJob = (ProsynarServeJob*)tmpArg;
+	theJob->forServer->runJob(theJob);
+}
+
+void ProsynarServer::serve(){
+	servSock = openLocalServer(useArgs->sockFile);
+	if(!servSock){
+		throw std::runtime_error("Could not listen on " + std::string(useArgs->sockFile));
+	}
+	bool haveErr = false;
+	std::string errMess;
+	try{
+		ProsynarServeJob* useJob = waitForFreeJob();
+		while(useJob){
+			void* newConn = acceptLocalConnection(servSock);
+			if(!newConn){
+				throw std::runtime_error("Problem waiting for jobs on " + std::string(useArgs->sockFile));
+			}
+			lockMutex(jobMut);
+				bool wasStop = stopping;
+			unlockMutex(jobMut);
+			if(wasStop){
+				closeLocalConnection(newConn);
+				break;
+			}
+			useJob->theConn = newConn;
+			useJob->jobState = PROSYNAR_JOB_RUNNING;
+			useJob->jobTask = jobPool->addTask(runServeJob, useJob, THREADPOOL_PRIORITY_STAGE);
+			useJob = waitForFreeJob();
+		}
+	}catch(std::exception& err){
+		haveErr = true;
+		errMess = err.what();
+	}
+	//let the running jobs finish
+	for(uintptr_t i = 0; i<allJobs.size(); i++){
+		lockMutex(jobMut);
+			bool wasFree = (allJobs[i].jobState == PROSYNAR_JOB_FREE);
+		unlockMutex(jobMut);
+		if(!wasFree){
+			jobPool->joinTask(allJobs[i].jobTask);
+			allJobs[i].jobState = PROSYNAR_JOB_FREE;
+		}
+	}
+	if(haveErr){ throw std::runtime_error(errMess); }
+}
+
+ProsynarServeJob* ProsynarServer::waitForFreeJob(){
+	ProsynarServeJob* toRet = 0;
+	lockMutex(jobMut);
+	while(!stopping){
+		for(uintptr_t i = 0; i<allJobs.size(); i++){
+			if(allJobs[i].jobState == PROSYNAR_JOB_DONE){
+				jobPool->joinTask(allJobs[i].jobTask);
+				allJobs[i].jobState = PROSYNAR_JOB_FREE;
+			}
+			if(!toRet && (allJobs[i].jobState == PROSYNAR_JOB_FREE)){
+				toRet = &(allJobs[i]);
+			}
+		}
+		if(toRet){ break; }
+		waitCondition(jobMut, jobCond);
+	}
+	if(stopping){ toRet = 0; }
+	unlockMutex(jobMut);
+	return toRet;
+}
+
+void ProsynarServer::runJob(ProsynarServeJob* theJob){
+	std::string reqText;
+	std::string toOutput;
+	std::string toReport;
+	int exitCode = 1;
+	if(readRequest(theJob->theConn, &reqText)){
+		//split up the arguments
+		std::vector<char*> jobArgv;
+		uintptr_t argStart = 0;
+		while(reqText[argStart]){
+			jobArgv.push_back(&(reqText[argStart]));
+			argStart += (strlen(&(reqText[argStart])) + 1);
+		}
+		//stop or run
+		if((jobArgv.size() == 1) && (strcmp(jobArgv[0], "--stop") == 0)){
+			noteStop();
+			exitCode = 0;
+		}
+		else{
+			exitCode = runJobArguments(jobArgv.size(), jobArgv.size() ? &(jobArgv[0]) : (char**)0, &toOutput, &toReport);
+		}
+	}
+	else{
+		toReport.append("Incomplete request.\n");
+	}
+	//say how it went: output, a null, the reports, then the exit code
+	char numBuff[4*sizeof(uintmax_t)+4];
+	sprintf(numBuff, "exit %d\n", exitCode);
+	toOutput.push_back(0);
+	toOutput.append(toReport);
+	toOutput.append(numBuff);
+	setLocalConnectionTimeout(theJob->theConn, PROSYNAR_SERVE_TIMEOUT);
+	writeLocalConnection(theJob->theConn, toOutput.c_str(), toOutput.size());
+	closeLocalConnection(theJob->theConn);
+	theJob->theConn = 0;
+	lockMutex(jobMut);
+		theJob->jobState = PROSYNAR_JOB_DONE;
+		signalCondition(jobMut, jobCond);
+	unlockMutex(jobMut);
+}
+
+int ProsynarServer::runJobArguments(int jobArgc, char** jobArgv, std::string* toOutput, std::string* toReport){
+	std::ostringstream helpText;
+	std::ostringstream jobErr;
+	ProsynarArgumentParser jobArgs;
+	jobArgs.errOut = &jobErr;
+	try{
+		//parse
+		if(jobArgs.parseArguments(jobArgc, jobArgv, &helpText) < 0){
+			toReport->append(jobArgs.argumentError);
+			toReport->push_back('\n');
+			return 1;
+		}
+		if(jobArgs.needRun == 0){
+			toOutput->append(helpText.str());
+			return 0;
+		}
+		//the server handles the shared things
+		if(jobArgs.refFile || jobArgs.refPackFile || jobArgs.probFile || jobArgs.costFile || jobArgs.qualmFile || jobArgs.makeGailFile){
+			toReport->append("The server has loaded the reference and defaults: jobs cannot use --ref, --refpack, --prob, --cost, --qualm or --makegail.\n");
+			return 1;
+		}
+		//the server's own streams are no place for a job's data
+		bool useStdio = prosynarServeIsStdio(jobArgs.seqOutFile) || prosynarServeIsStdio(jobArgs.mergeSamOutFile) || prosynarServeIsStdio(jobArgs.failDumpFile) || prosynarServeIsStdio(jobArgs.statsFile);
+		for(uintptr_t i = 0; i<jobArgs.samNames.size(); i++){
+			useStdio = useStdio || prosynarServeIsStdio(jobArgs.samNames[i]);
+		}
+		if(useStdio){
+			toReport->append("Jobs run on the server, and cannot use stdin or stdout: name the input files, and give --out or --samze.\n");
+			return 1;
+		}
+		if(jobArgs.numThread > useArgs->numThread){
+			toReport->append("Job asks for more threads than the server allows.\n");
+			return 1;
+		}
+		if((prosynarRunStageCount(&jobArgs) + 1) > (uintptr_t)(useArgs->numThread + PROSYNAR_SERVE_EXTRA_STAGE)){
+			toReport->append("Job needs more threads than the server allows: lower --shard.\n");
+			return 1;
+		}
+		//set up and run
+		jobArgs.adoptShared(&sharedArgs);
+		jobArgs.usePool = jobPool;
+		jobArgs.prepareRun();
+		prosynarRunMerge(&jobArgs);
+	}catch(std::exception& err){
+		toReport->append(jobErr.str());
+		toReport->append(err.what());
+		toReport->push_back('\n');
+		return 1;
+	}
+	toReport->append(jobErr.str());
+	return 0;
+}
+
+bool ProsynarServer::readRequest(void* theConn, std::string* toFill){
+	char readBuff[PROSYNAR_SERVE_READ_BLOCK];
+	uintptr_t checkFrom = 0;
+	toFill->clear();
+	//a sender that dawdles should not hold a job slot
+	uintmax_t giveUp = getMonotonicTime() + PROSYNAR_SERVE_TIMEOUT;
+	while(toFill->size() < PROSYNAR_SERVE_MAX_REQUEST){
+		uintmax_t curTime = getMonotonicTime();
+		if(curTime >= giveUp){ return false; }
+		if(!setLocalConnectionTimeout(theConn, giveUp - curTime)){ return false; }
+		intptr_t numRead = readLocalConnection(theConn, readBuff, PROSYNAR_SERVE_READ_BLOCK);
+		if(numRead <= 0){ return false; }
+		toFill->append(readBuff, readBuff + numRead);
+		//look for an empty argument
+		for(uintptr_t i = checkFrom; i<toFill->size(); i++){
+			if((*toFill)[i]){ continue; }
+			if((i == 0) || ((*toFill)[i-1] == 0)){
+				toFill->resize(i+1);
+				return true;
+			}
+		}
+		checkFrom = toFill->size();
+	}
+	return false;
+}
+
+void ProsynarServer::noteStop(){
+	lockMutex(jobMut);
+		stopping = true;
+		signalCondition(jobMut, jobCond);
+	unlockMutex(jobMut);
+	//the server may be waiting on a connection
+	void* wakeConn = connectLocalServer(useArgs->sockFile);
+	if(wakeConn){ closeLocalConnection(wakeConn); }
+}
+
+int prosynarServeMain(int argc, char** argv){
+	int retCode = 0;
+	ProsynarServeArgumentParser argsP;
+	ProsynarServer* theServ = 0;
+	try{
+		if(argsP.parseArguments(argc-1, argv+1, &std::cout) < 0){
+			std::cerr << argsP.argumentError << std::endl;
+			retCode = 1;
+		}
+		else if(argsP.needRun){
+			theServ = new ProsynarServer(&argsP);
+			theServ->serve();
+		}
+	}catch(std::exception& err){
+		std::cerr << err.what() << std::endl;
+		retCode = 1;
+	}
+	if(theServ){ delete(theServ); }
+	return retCode;
+}
+
+int prosynarSubmitMain(int argc, char** argv){
+	ProsynarSubmitArgumentParser argsP;
+	if(argsP.parseArguments(argc-1, argv+1, &std::cout) < 0){
+		std::cerr << argsP.argumentError << std::endl;
+		return 1;
+	}
+	if(argsP.needRun == 0){ return 0; }
+	//send the request
+	std::string reqText;
+	if(argsP.stopServer){
+		reqText.append("--stop");
+		reqText.push_back(0);
+	}
+	for(uintptr_t i = 0; i<argsP.jobArgs.size(); i++){
+		reqText.append(argsP.jobArgs[i]);
+		reqText.push_back(0);
+	}
+	reqText.push_back(0);
+	void* theConn = connectLocalServer(argsP.sockFile);
+	if(!theConn){
+		std::cerr << "Could not connect to " << argsP.sockFile << std::endl;
+		return 1;
+	}
+	if(!writeLocalConnection(theConn, reqText.c_str(), reqText.size())){
+		closeLocalConnection(theConn);
+		std::cerr << "Could not send the job to " << argsP.sockFile << std::endl;
+		return 1;
+	}
+	//wait for the answer
+	std::string respText;
+	char readBuff[PROSYNAR_SERVE_READ_BLOCK];
+	intptr_t numRead = readLocalConnection(theConn, readBuff, PROSYNAR_SERVE_READ_BLOCK);
+	while(numRead > 0){
+		respText.append(readBuff, readBuff + numRead);
+		numRead = readLocalConnection(theConn, readBuff, PROSYNAR_SERVE_READ_BLOCK);
+	}
+	closeLocalConnection(theConn);
+	//output, then a null, then the reports: the last line is the exit code
+	uintptr_t repStart = respText.find((char)0);
+	uintptr_t lastStart = (respText.size() > 1) ? respText.rfind('\n', respText.size() - 2) : std::string::npos;
+	lastStart = ((lastStart == std::string::npos) || (lastStart < repStart)) ? (repStart + 1) : (lastStart + 1);
+	if((repStart == std::string::npos) || (respText.compare(lastStart, 5, "exit ") != 0)){
+		std::cerr << "Server hung up before the job finished." << std::endl;
+		return 1;
+	}
+	int exitCode = atoi(respText.c_str() + lastStart + 5);
+	std::cout << respText.substr(0, repStart);
+	std::cerr << respText.substr(repStart + 1, lastStart - (repStart + 1));
+	return exitCode;
+}
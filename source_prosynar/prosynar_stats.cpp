@@ -0,0 +1,215 @@
+#include "prosynar_stats.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "whodun_oshook.h"
+#include "whodun_datread.h"
+
+ProsynarStepStats::ProsynarStepStats(){
+	numCall = 0;
+	numReject = 0;
+	numError = 0;
+	useTime = 0;
+}
+
+void ProsynarStepStats::noteRun(int stepRes, uintmax_t stepTime){
+	numCall++;
+	numReject += (stepRes == 0);
+	numError += (stepRes < 0);
+	useTime += stepTime;
+}
+
+void ProsynarStepStats::addIn(ProsynarStepStats* toAdd){
+	numCall += toAdd->numCall;
+	numReject += toAdd->numReject;
+	numError += toAdd->numError;
+	useTime += toAdd->useTime;
+}
+
+ProsynarWorkerStats::ProsynarWorkerStats(){
+	numPair = 0;
+	numMerge = 0;
+	busyTime = 0;
+	helpTime = 0;
+}
+
+/**
+ * Sorting method for filters.
+ * @param itemA The first filter.
+ * @param itemB The second filter.
+ * @return Whether itemA's score should come before itemB. (greater than).
+ */
+bool prosynarFilterRateSortFunction(const std::pair<double,uintptr_t>& itemA, const std::pair<double,uintptr_t>& itemB){
+	return itemA.first > itemB.first;
+}
+
+void ProsynarWorkerStats::adaptFilterOrder(ProsynarArgumentParser* argsP){
+	std::vector< std::pair<double,uintptr_t> > filtScores;
+	uintptr_t fromI = 0;
+	while(fromI < filterOrder.size()){
+		//find a stretch of filters that can be moved
+		if(!(argsP->useFilters[filterOrder[fromI]]->canReorder())){
+			fromI++;
+			continue;
+		}
+		uintptr_t toI = fromI + 1;
+		while((toI < filterOrder.size()) && argsP->useFilters[filterOrder[toI]]->canReorder()){
+			toI++;
+		}
+		//score by pairs thrown out per nanosecond: filters not run lately go first, to see if they have gotten better
+		filtScores.clear();
+		for(uintptr_t i = fromI; i<toI; i++){
+			ProsynarStepStats* curStat = &(recentStats[filterOrder[i]]);
+			double curScore = curStat->numCall ? (curStat->numReject / (curStat->useTime + 1.0)) : 1.0;
+			filtScores.push_back(std::pair<double,uintptr_t>(curScore, filterOrder[i]));
+		}
+		std::stable_sort(filtScores.begin(), filtScores.end(), prosynarFilterRateSortFunction);
+		for(uintptr_t i = fromI; i<toI; i++){
+			filterOrder[i] = filtScores[i-fromI].second;
+		}
+		fromI = toI;
+	}
+	//let the old counts fade
+	for(uintptr_t i = 0; i<recentStats.size(); i++){
+		ProsynarStepStats* curStat = &(recentStats[i]);
+		curStat->numCall = curStat->numCall >> 1;
+		curStat->numReject = curStat->numReject >> 1;
+		curStat->numError = curStat->numError >> 1;
+		curStat->useTime = curStat->useTime >> 1;
+	}
+}
+
+ProsynarRunStats::ProsynarRunStats(uintptr_t numWorker, uintptr_t numFilter){
+	startTime = getMonotonicTime();
+	workStats.resize(numWorker);
+	for(uintptr_t i = 0; i<numWorker; i++){
+		ProsynarWorkerStats* curStat = &(workStats[i]);
+		curStat->filterStats.resize(numFilter);
+		curStat->recentStats.resize(numFilter);
+		for(uintptr_t j = 0; j<numFilter; j++){
+			curStat->filterOrder.push_back(j);
+		}
+	}
+}
+
+ProsynarRunStats::~ProsynarRunStats(){
+	for(uintptr_t i = 0; i<queueStats.size(); i++){
+		delete(queueStats[i]);
+	}
+}
+
+ThreadProdComStats* ProsynarRunStats::addQueue(const char* queueName){
+	ThreadProdComStats* newStats = new ThreadProdComStats();
+	ThreadProdComStats initStats = {0, 0, 0, 0, 0, 0, 0};
+	*newStats = initStats;
+	queueNames.push_back(queueName);
+	queueStats.push_back(newStats);
+	return newStats;
+}
+
+/**
+ * Turn nanoseconds into seconds.
+ * @param numNano The nanoseconds.
+ * @return The seconds.
+ */
+double prosynarNanoToSeconds(uintmax_t numNano){
+	return numNano / 1000000000.0;
+}
+
+/**
+ * Write the counts for a filter (or the merger) as json.
+ * @param stepName The name of the thing.
+ * @param curStat The counts.
+ * @param toFill The place to write.
+ */
+void prosynarWriteStepStats(const char* stepName, ProsynarStepStats* curStat, std::string* toFill){
+	char numBuff[256];
+	toFill->append("{\"name\": \""); toFill->append(stepName); toFill->append("\", ");
+	sprintf(numBuff, "\"calls\": %ju, \"rejects\": %ju, \"errors\": %ju, \"seconds\": %.6f, ", curStat->numCall, curStat->numReject, curStat->numError, prosynarNanoToSeconds(curStat->useTime));
+	toFill->append(numBuff);
+	sprintf(numBuff, "\"rejectRate\": %.4f, \"rejectsPerSecond\": %.3f}", curStat->numCall ? (curStat->numReject / (double)(curStat->numCall)) : 0.0, curStat->useTime ? (curStat->numReject / prosynarNanoToSeconds(curStat->useTime)) : 0.0);
+	toFill->append(numBuff);
+}
+
+void ProsynarRunStats::writeProgress(std::ostream* toPrint){
+	char numBuff[256];
+	double runTime = prosynarNanoToSeconds(getMonotonicTime() - startTime);
+	sprintf(numBuff, "%.1f", runTime);
+	(*toPrint) << "Progress " << numBuff << "s:";
+	for(uintptr_t i = 0; i<queueStats.size(); i++){
+		ThreadProdComStats* curStat = queueStats[i];
+		sprintf(numBuff, " %ju in, %ju out (%.1f/s), %ju/%ju waiting", curStat->numAdd, curStat->numGet, runTime > 0 ? (curStat->numGet / runTime) : 0.0, curStat->curDepth, curStat->maxQueue);
+		(*toPrint) << (i ? ";" : "") << " " << queueNames[i] << numBuff;
+	}
+	(*toPrint) << std::endl;
+}
+
+void ProsynarRunStats::writeReport(const char* fileName, ProsynarArgumentParser* argsP){
+	char numBuff[256];
+	double runTime = prosynarNanoToSeconds(getMonotonicTime() - startTime);
+	std::string repText;
+	repText.append("{\n");
+	sprintf(numBuff, "\t\"elapsedSeconds\": %.6f,\n", runTime);
+	repText.append(numBuff);
+	sprintf(numBuff, "\t\"threads\": %jd,\n", (intmax_t)(argsP->numThread));
+	repText.append(numBuff);
+	//the queues between the stages
+	repText.append("\t\"queues\": {");
+	for(uintptr_t i = 0; i<queueStats.size(); i++){
+		ThreadProdComStats* curStat = queueStats[i];
+		repText.append(i ? ",\n" : "\n");
+		repText.append("\t\t\""); repText.append(queueNames[i]); repText.append("\": {");
+		sprintf(numBuff, "\"added\": %ju, \"taken\": %ju, \"maxDepth\": %ju, \"capacity\": %ju, ", curStat->numAdd, curStat->numGet, curStat->maxDepth, curStat->maxQueue);
+		repText.append(numBuff);
+		sprintf(numBuff, "\"addWaitSeconds\": %.6f, \"getWaitSeconds\": %.6f, \"perSecond\": %.3f}", prosynarNanoToSeconds(curStat->addWait), prosynarNanoToSeconds(curStat->getWait), runTime > 0 ? (curStat->numGet / runTime) : 0.0);
+		repText.append(numBuff);
+	}
+	repText.append("\n\t},\n");
+	//the filters and merger, over all threads
+	repText.append("\t\"filters\": [");
+	for(uintptr_t i = 0; i<argsP->useFilters.size(); i++){
+		ProsynarStepStats totStat;
+		for(uintptr_t j = 0; j<workStats.size(); j++){
+			totStat.addIn(&(workStats[j].filterStats[i]));
+		}
+		repText.append(i ? ",\n\t\t" : "\n\t\t");
+		prosynarWriteStepStats(argsP->filterNames[i].c_str(), &totStat, &repText);
+	}
+	repText.append(argsP->useFilters.size() ? "\n\t],\n" : "],\n");
+	ProsynarStepStats totMerge;
+	for(uintptr_t j = 0; j<workStats.size(); j++){
+		totMerge.addIn(&(workStats[j].mergeStats));
+	}
+	repText.append("\t\"merger\": ");
+	prosynarWriteStepStats(argsP->mergerName.c_str(), &totMerge, &repText);
+	repText.append(",\n");
+	//the merge threads
+	repText.append("\t\"workers\": [");
+	for(uintptr_t i = 0; i<workStats.size(); i++){
+		ProsynarWorkerStats* curStat = &(workStats[i]);
+		repText.append(i ? ",\n" : "\n");
+		sprintf(numBuff, "\t\t{\"pairs\": %ju, \"merged\": %ju, \"busySeconds\": %.6f, \"helpSeconds\": %.6f, \"utilization\": %.4f,\n", curStat->numPair, curStat->numMerge, prosynarNanoToSeconds(curStat->busyTime), prosynarNanoToSeconds(curStat->helpTime), runTime > 0 ? (prosynarNanoToSeconds(curStat->busyTime + curStat->helpTime) / runTime) : 0.0);
+		repText.append(numBuff);
+		repText.append("\t\t\t\"filterOrder\": [");
+		for(uintptr_t j = 0; j<curStat->filterOrder.size(); j++){
+			repText.append(j ? ", \"" : "\"");
+			repText.append(argsP->filterNames[curStat->filterOrder[j]]);
+			repText.append("\"");
+		}
+		repText.append("],\n\t\t\t\"filters\": [");
+		for(uintptr_t j = 0; j<curStat->filterStats.size(); j++){
+			repText.append(j ? ",\n\t\t\t\t" : "\n\t\t\t\t");
+			prosynarWriteStepStats(argsP->filterNames[j].c_str(), &(curStat->filterStats[j]), &repText);
+		}
+		repText.append(curStat->filterStats.size() ? "\n\t\t\t],\n" : "],\n");
+		repText.append("\t\t\t\"merger\": ");
+		prosynarWriteStepStats(argsP->mergerName.c_str(), &(curStat->mergeStats), &repText);
+		repText.append("}");
+	}
+	repText.append("\n\t]\n");
+	repText.append("}\n");
+	FileOutStream repOut(0, fileName);
+	repOut.writeBytes(repText.c_str(), repText.size());
+}
+
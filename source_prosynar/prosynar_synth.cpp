@@ -0,0 +1,481 @@
+#include "prosynar_synth.h"
+
+#include <math.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "whodun_parse_seq.h"
+#include "whodun_parse_table.h"
+
+ProsynarSynthArgumentParser::ProsynarSynthArgumentParser(){
+	defOutFN[0] = '-';
+	defOutFN[1] = 0;
+	refFile = 0;
+	probFile = 0;
+	outFile = defOutFN;
+	randSeed = 1;
+	numPairs = 0;
+	depth = 10.0;
+	readLen = 150;
+	insertMean = 300.0;
+	insertSD = 50.0;
+	subRate = 0.001;
+	indelRate = 0.0001;
+	maxIndel = 3;
+	probBoost = 1.0;
+	discordFrac = 0.0;
+	nameSort = false;
+	myMainDoc = "Usage: prosynar synth [OPTION]\nMakes up read pairs from a reference, to test with.\nThe same seed and options always give the same reads.\nThe OPTIONS are:\n";
+	myVersionDoc = "ProSynAr synth 1.0";
+	myCopyrightDoc = "Copyright (C) 2019 UNT HSC Center for Human Identification";
+	ArgumentParserStrMeta refMeta("Reference File");
+		refMeta.isFile = true;
+		refMeta.fileExts.insert(".fa");
+		refMeta.fileExts.insert(".fa.gz");
+		refMeta.fileExts.insert(".fa.gzip");
+		addStringOption("--ref", &refFile, 0, "    Specify the reference sequences in a fasta file.\n    --ref File.fa\n", &refMeta);
+	ArgumentParserStrMeta probMeta("Problematic Region File");
+		probMeta.isFile = true;
+		probMeta.fileExts.insert(".bed");
+		addStringOption("--prob", &probFile, 0, "    Specify the problematic regions in a bed file: see --probboost.\n    --prob File.bed\n", &probMeta);
+	ArgumentParserStrMeta outMeta("Output File");
+		outMeta.isFile = true;
+		outMeta.fileWrite = true;
+		outMeta.fileExts.insert(".sam");
+		outMeta.fileExts.insert(".bam");
+		addStringOption("--out", &outFile, 0, "    Specify where to write the reads (sam, or bam if it ends in .bam).\n    --out File.sam\n", &outMeta);
+	ArgumentParserIntMeta seedMeta("Random Seed");
+		addIntegerOption("--seed", &randSeed, 0, "    The seed for the random numbers.\n    --seed 1\n", &seedMeta);
+	ArgumentParserIntMeta pairMeta("Number of Pairs");
+		addIntegerOption("--pairs", &numPairs, 0, "    About how many pairs to make: zero to go by --depth.\n    --pairs 0\n", &pairMeta);
+	ArgumentParserFltMeta depthMeta("Depth");
+		addFloatOption("--depth", &depth, 0, "    The depth of coverage to make.\n    --depth 10.0\n", &depthMeta);
+	ArgumentParserIntMeta lenMeta("Read Length");
+		addIntegerOption("--readlen", &readLen, 0, "    The length of the reads.\n    --readlen 150\n", &lenMeta);
+	ArgumentParserFltMeta insMeta("Mean Fragment Length");
+		addFloatOption("--insert", &insertMean, 0, "    The mean length of the fragments.\n    --insert 300.0\n", &insMeta);
+	ArgumentParserFltMeta insSDMeta("Fragment Length Deviation");
+		addFloatOption("--insertsd", &insertSD, 0, "    The standard deviation of the fragment length.\n    --insertsd 50.0\n", &insSDMeta);
+	ArgumentParserFltMeta subMeta("Substitution Rate");
+		addFloatOption("--sub", &subRate, 0, "    The chance of a base being changed.\n    --sub 0.001\n", &subMeta);
+	ArgumentParserFltMeta indelMeta("Indel Rate");
+		addFloatOption("--indel", &indelRate, 0, "    The chance of an insertion or deletion at a base.\n    --indel 0.0001\n", &indelMeta);
+	ArgumentParserIntMeta maxIndelMeta("Longest Indel");
+		addIntegerOption("--maxindel", &maxIndel, 0, "    The longest insertion or deletion.\n    --maxindel 3\n", &maxIndelMeta);
+	ArgumentParserFltMeta boostMeta("Problem Region Boost");
+		addFloatOption("--probboost", &probBoost, 0, "    How many times deeper to cover the problematic regions.\n    --probboost 1.0\n", &boostMeta);
+	ArgumentParserFltMeta discMeta("Discordant Fraction");
+		addFloatOption("--discord", &discordFrac, 0, "    The fraction of pairs that are not proper pairs (facing the wrong way, or too far apart).\n    --discord 0.0\n", &discMeta);
+	ArgumentParserBoolMeta nameMeta("Name Sorted");
+		addBooleanFlag("--namesort", &nameSort, 1, "    Write each pair together, rather than sorted by position.\n", &nameMeta);
+}
+
+ProsynarSynthArgumentParser::~ProsynarSynthArgumentParser(){}
+
+int ProsynarSynthArgumentParser::posteriorCheck(){
+	if(!refFile || (strlen(refFile)==0)){
+		argumentError = "Need a reference to make reads from.";
+		return 1;
+	}
+	if(probFile && (strlen(probFile)==0)){
+		probFile = 0;
+	}
+	if(!outFile || (strlen(outFile)==0)){
+		outFile = defOutFN;
+	}
+	if(numPairs < 0){
+		argumentError = "pairs cannot be negative.";
+		return 1;
+	}
+	if(!numPairs && (depth <= 0.0)){
+		argumentError = "depth must be positive.";
+		return 1;
+	}
+	if(readLen <= 0){
+		argumentError = "readlen must be positive.";
+		return 1;
+	}
+	if((insertMean < 1.0) || (insertSD < 0.0)){
+		argumentError = "insert must be at least one, and insertsd cannot be negative.";
+		return 1;
+	}
+	if((subRate < 0.0) || (indelRate < 0.0) || ((subRate + indelRate) >= 1.0)){
+		argumentError = "sub and indel must be non-negative, and add up to less than one.";
+		return 1;
+	}
+	if(maxIndel <= 0){
+		argumentError = "maxindel must be positive.";
+		return 1;
+	}
+	if(probBoost < 0.0){
+		argumentError = "probboost cannot be negative.";
+		return 1;
+	}
+	if((discordFrac < 0.0) || (discordFrac > 1.0)){
+		argumentError = "discord must be between zero and one.";
+		return 1;
+	}
+	return 0;
+}
+
+ProsynarReadSynthesizer::ProsynarReadSynthesizer(ProsynarSynthArgumentParser* useArgs) : randSrc(useArgs->randSeed){
+	this->useArgs = useArgs;
+	numMade = 0;
+	numWaited = 0;
+	double errRate = useArgs->subRate + useArgs->indelRate;
+	logClean = (errRate > 0.0) ? log(1.0 - errRate) : 0.0;
+	//get the names and lengths of the references (the sequences are loaded one at a time later)
+	{
+		InStream* redFile = 0;
+		SequenceReader* refRead = 0;
+		try{
+			openSequenceFileRead(useArgs->refFile, &redFile, &refRead);
+			while(refRead->readNextEntry()){
+				refNames.push_back(std::string(refRead->lastReadName, refRead->lastReadName + refRead->lastReadShortNameLen));
+				refLens.push_back(refRead->lastReadSeqLen);
+			}
+			delete(refRead); refRead = 0;
+			delete(redFile); redFile = 0;
+		}catch(...){
+			if(refRead){ delete(refRead); }
+			if(redFile){ delete(redFile); }
+			throw;
+		}
+	}
+	//problem regions
+	if(useArgs->probFile){
+		InStream* redFile = 0;
+		TabularReader* tabRead = 0;
+		try{
+			redFile = new FileInStream(useArgs->probFile);
+			tabRead = new TSVTabularReader(0, redFile);
+			BedFileReader proBed(tabRead);
+			delete(tabRead); tabRead = 0;
+			delete(redFile); redFile = 0;
+			for(uintptr_t i = 0; i<proBed.chromosomes.size(); i++){
+				probRegs[proBed.chromosomes[i]].push_back(std::pair<uintptr_t,uintptr_t>(proBed.locStarts[i], proBed.locEnds[i]));
+			}
+			for(std::map< std::string, std::vector< std::pair<uintptr_t,uintptr_t> > >::iterator probIt = probRegs.begin(); probIt != probRegs.end(); probIt++){
+				std::sort(probIt->second.begin(), probIt->second.end());
+			}
+		}catch(...){
+			if(redFile){ delete(redFile); }
+			if(tabRead){ delete(tabRead); }
+			throw;
+		}
+	}
+	//figure out how often to start a fragment
+	if(useArgs->numPairs){
+		double totWeight = 0.0;
+		for(uintptr_t i = 0; i<refNames.size(); i++){
+			totWeight += makeStretches(i);
+		}
+		if(totWeight <= 0.0){ throw std::runtime_error("Reference has nowhere to put reads."); }
+		pairRate = useArgs->numPairs / totWeight;
+	}
+	else{
+		pairRate = useArgs->depth / (2.0 * useArgs->readLen);
+	}
+}
+
+ProsynarReadSynthesizer::~ProsynarReadSynthesizer(){
+	for(std::map< std::pair<intptr_t,uintmax_t>, CRBSAMFileContents* >::iterator waitIt = waitEnts.begin(); waitIt != waitEnts.end(); waitIt++){
+		delete(waitIt->second);
+	}
+	for(uintptr_t i = 0; i<freeEnts.size(); i++){
+		delete(freeEnts[i]);
+	}
+}
+
+uintptr_t ProsynarReadSynthesizer::nextErrorSkip(){
+	if(logClean == 0.0){ return (uintptr_t)-1; }
+	double numSkip = floor(log(randSrc.nextUniform()) / logClean);
+	if(numSkip >= 1.0e15){ return (uintptr_t)-1; }
+	return (uintptr_t)numSkip;
+}
+
+double ProsynarReadSynthesizer::makeStretches(uintptr_t refI){
+	refStretches.clear();
+	uintptr_t refLen = refLens[refI];
+	uintptr_t curI = 0;
+	double totWeight = 0.0;
+	std::map< std::string, std::vector< std::pair<uintptr_t,uintptr_t> > >::iterator probIt = probRegs.find(refNames[refI]);
+	if(probIt != probRegs.end()){
+		uintptr_t leadIn = (uintptr_t)(useArgs->insertMean);
+		std::vector< std::pair<uintptr_t,uintptr_t> >* curRegs = &(probIt->second);
+		for(uintptr_t i = 0; i<curRegs->size(); i++){
+			//fragments starting a little before the region also land in it
+			uintptr_t regFrom = (*curRegs)[i].first;
+			regFrom = (regFrom > leadIn) ? (regFrom - leadIn) : 0;
+			regFrom = std::max(regFrom, curI);
+			uintptr_t regTo = std::min((*curRegs)[i].second, refLen);
+			if(regTo <= regFrom){ continue; }
+			if(regFrom > curI){
+				ProsynarSynthStretch normStr = {curI, regFrom, 1.0};
+				refStretches.push_back(normStr);
+				totWeight += (regFrom - curI);
+			}
+			ProsynarSynthStretch probStr = {regFrom, regTo, useArgs->probBoost};
+			refStretches.push_back(probStr);
+			totWeight += useArgs->probBoost * (regTo - regFrom);
+			curI = regTo;
+		}
+	}
+	if(curI < refLen){
+		ProsynarSynthStretch normStr = {curI, refLen, 1.0};
+		refStretches.push_back(normStr);
+		totWeight += (refLen - curI);
+	}
+	return totWeight;
+}
+
+void ProsynarReadSynthesizer::synthesize(CRBSAMFileWriter* toDump){
+	//the header
+	CRBSAMFileContents* headEnt = &(toDump->curEnt);
+	headEnt->clear();
+	headEnt->lastReadHead = 1;
+	const char* hdText = useArgs->nameSort ? "@HD\tVN:1.6\tSO:queryname" : "@HD\tVN:1.6\tSO:coordinate";
+	headEnt->headerTxt.insert(headEnt->headerTxt.end(), hdText, hdText + strlen(hdText));
+	toDump->writeNextEntry();
+	char numBuff[4*sizeof(uintmax_t)+4];
+	for(uintptr_t i = 0; i<refNames.size(); i++){
+		headEnt->headerTxt.clear();
+		const char* sqText = "@SQ\tSN:";
+		headEnt->headerTxt.insert(headEnt->headerTxt.end(), sqText, sqText + strlen(sqText));
+		headEnt->headerTxt.insert(headEnt->headerTxt.end(), refNames[i].begin(), refNames[i].end());
+		sprintf(numBuff, "\tLN:%ju", (uintmax_t)(refLens[i]));
+		headEnt->headerTxt.insert(headEnt->headerTxt.end(), numBuff, numBuff + strlen(numBuff));
+		toDump->writeNextEntry();
+	}
+	//the references, one at a time
+	InStream* redFile = 0;
+	SequenceReader* refRead = 0;
+	try{
+		openSequenceFileRead(useArgs->refFile, &redFile, &refRead);
+		uintptr_t refI = 0;
+		while(refRead->readNextEntry()){
+			if((refI >= refLens.size()) || (refRead->lastReadSeqLen != refLens[refI])){ throw std::runtime_error("Reference changed while reading."); }
+			synthesizeReference(refI, refRead->lastReadSeq, toDump);
+			refI++;
+		}
+		delete(refRead); refRead = 0;
+		delete(redFile); redFile = 0;
+	}catch(...){
+		if(refRead){ delete(refRead); }
+		if(redFile){ delete(redFile); }
+		throw;
+	}
+}
+
+void ProsynarReadSynthesizer::synthesizeReference(uintptr_t refI, const char* refSeq, CRBSAMFileWriter* toDump){
+	//fragment starts are a poisson process, with the rate changing between stretches (so they come out sorted)
+	makeStretches(refI);
+	for(uintptr_t si = 0; si<refStretches.size(); si++){
+		ProsynarSynthStretch* curStr = &(refStretches[si]);
+		double curRate = pairRate * curStr->rateMult;
+		if(curRate <= 0.0){ continue; }
+		double curPos = curStr->fromI;
+		while(true){
+			curPos -= log(randSrc.nextUniform()) / curRate;
+			if(curPos >= curStr->toI){ break; }
+			synthesizeFragment(refI, refSeq, (uintptr_t)curPos, toDump);
+		}
+	}
+	flushWaiting(-1, toDump);
+}
+
+void ProsynarReadSynthesizer::synthesizeFragment(uintptr_t refI, const char* refSeq, uintptr_t fragI, CRBSAMFileWriter* toDump){
+	uintptr_t refLen = refLens[refI];
+	//how long, and which way
+		double insLen = floor(useArgs->insertMean + useArgs->insertSD * randSrc.nextNormal() + 0.5);
+		bool isProper = true;
+		int strandA = 0;
+		int strandB = SAM_FLAG_SEQREVCOMP;
+		if((useArgs->discordFrac > 0.0) && (randSrc.nextUniform() <= useArgs->discordFrac)){
+			isProper = false;
+			if(randSrc.nextUniform() <= 0.5){
+				//both facing the same way
+				strandA = (randSrc.nextUniform() <= 0.5) ? 0 : SAM_FLAG_SEQREVCOMP;
+				strandB = strandA;
+			}
+			else{
+				//much too far apart
+				insLen = insLen * (2.0 + 8.0*randSrc.nextUniform());
+			}
+		}
+		if(insLen < 1.0){ insLen = 1.0; }
+		if((fragI + insLen) > refLen){ return; }
+		uintptr_t fragLen = (uintptr_t)insLen;
+		uintptr_t numBase = std::min((uintptr_t)(useArgs->readLen), fragLen);
+	//make the reads
+		CRBSAMFileContents* readA;
+		CRBSAMFileContents* readB;
+		if(freeEnts.size()){ readA = freeEnts[freeEnts.size()-1]; freeEnts.pop_back(); } else{ readA = new CRBSAMFileContents(); }
+		if(freeEnts.size()){ readB = freeEnts[freeEnts.size()-1]; freeEnts.pop_back(); } else{ readB = new CRBSAMFileContents(); }
+		synthesizeRead(refSeq, refLen, fragI, numBase, readA);
+		synthesizeRead(refSeq, refLen, fragI + fragLen - numBase, numBase, readB);
+	//fill in the rest
+		char nameBuff[4*sizeof(uintmax_t)+16];
+		sprintf(nameBuff, "synth%012ju", numMade);
+		numMade++;
+		int firstFlag = (randSrc.nextUniform() <= 0.5) ? SAM_FLAG_FIRST : SAM_FLAG_LAST;
+		intptr_t endB = readB->entryPos + cigarStringReferenceSpan(&(readB->entryCigar));
+		intptr_t tempLen = endB - readA->entryPos;
+		CRBSAMFileContents* pairEnts[2] = {readA, readB};
+		for(int i = 0; i<2; i++){
+			CRBSAMFileContents* curEnt = pairEnts[i];
+			CRBSAMFileContents* othEnt = pairEnts[1-i];
+			curEnt->entryName.insert(curEnt->entryName.end(), nameBuff, nameBuff + strlen(nameBuff));
+			curEnt->entryFlag = SAM_FLAG_MULTSEG | (isProper ? SAM_FLAG_ALLALN : 0);
+			curEnt->entryFlag |= (i ? strandB : strandA) | ((i ? strandA : strandB) ? SAM_FLAG_NEXTSEQREVCOMP : 0);
+			curEnt->entryFlag |= i ? (SAM_FLAG_FIRST + SAM_FLAG_LAST - firstFlag) : firstFlag;
+			curEnt->entryReference.insert(curEnt->entryReference.end(), refNames[refI].begin(), refNames[refI].end());
+			curEnt->entryMapq = 60;
+			curEnt->nextReference.insert(curEnt->nextReference.end(), refNames[refI].begin(), refNames[refI].end());
+			curEnt->nextPos = othEnt->entryPos;
+			curEnt->entryTempLen = i ? -tempLen : tempLen;
+		}
+	//write them, or hold them until everything before them is written
+		if(useArgs->nameSort){
+			toDump->writeNextEntry(readA);
+			toDump->writeNextEntry(readB);
+			freeEnts.push_back(readA);
+			freeEnts.push_back(readB);
+		}
+		else{
+			flushWaiting(fragI, toDump);
+			toDump->writeNextEntry(readA);
+			freeEnts.push_back(readA);
+			waitEnts[std::pair<intptr_t,uintmax_t>(readB->entryPos, numWaited)] = readB;
+			numWaited++;
+		}
+}
+
+void ProsynarReadSynthesizer::flushWaiting(intptr_t maxPos, CRBSAMFileWriter* toDump){
+	while(waitEnts.size()){
+		std::map< std::pair<intptr_t,uintmax_t>, CRBSAMFileContents* >::iterator waitIt = waitEnts.begin();
+		if((maxPos >= 0) && (waitIt->first.first > maxPos)){ break; }
+		toDump->writeNextEntry(waitIt->second);
+		freeEnts.push_back(waitIt->second);
+		waitEnts.erase(waitIt);
+	}
+}
+
+/**The bases a read error can produce.*/
+#define PROSYNAR_SYNTH_BASES "ACGT"
+
+/**
+ * Add to a cigar string, merging with the last operation if the same.
+ * @param cigOp The operation.
+ * @param lastOp The last operation: updated.
+ * @param lastCount The number of times the last operation has been done: updated.
+ * @param toFill The cigar string.
+ */
+void prosynarSynthCigarAdd(char cigOp, char* lastOp, uintptr_t* lastCount, std::vector<char>* toFill){
+	if(cigOp == *lastOp){
+		*lastCount = *lastCount + 1;
+		return;
+	}
+	if(*lastCount){
+		char numBuff[4*sizeof(uintmax_t)+4];
+		sprintf(numBuff, "%ju", (uintmax_t)(*lastCount));
+		toFill->insert(toFill->end(), numBuff, numBuff + strlen(numBuff));
+		toFill->push_back(*lastOp);
+	}
+	*lastOp = cigOp;
+	*lastCount = 1;
+}
+
+void ProsynarReadSynthesizer::synthesizeRead(const char* refSeq, uintptr_t refLen, uintptr_t startI, uintptr_t numBase, CRBSAMFileContents* toFill){
+	toFill->clear();
+	toFill->lastReadHead = 0;
+	toFill->entryPos = startI;
+	double errRate = useArgs->subRate + useArgs->indelRate;
+	char goodQual = 33 + std::min(40, std::max(2, (int)(errRate > 0.0 ? -10.0*log10(errRate) : 40.0)));
+	char badQual = 33 + 10;
+	char lastOp = 0;
+	uintptr_t lastCount = 0;
+	uintptr_t refI = startI;
+	uintptr_t errSkip = nextErrorSkip();
+	while(toFill->entrySeq.size() < numBase){
+		//ran off the end: make the rest up
+		if(refI >= refLen){
+			toFill->entrySeq.push_back(PROSYNAR_SYNTH_BASES[(int)(4*randSrc.nextUniform()) & 3]);
+			toFill->entryQual.push_back(badQual);
+			prosynarSynthCigarAdd('S', &lastOp, &lastCount, &(toFill->entryCigar));
+			continue;
+		}
+		char refBase = toupper(refSeq[refI]);
+		if(errSkip){
+			errSkip--;
+			toFill->entrySeq.push_back(refBase);
+			toFill->entryQual.push_back(goodQual);
+			prosynarSynthCigarAdd('M', &lastOp, &lastCount, &(toFill->entryCigar));
+			refI++;
+			continue;
+		}
+		errSkip = nextErrorSkip();
+		if(randSrc.nextUniform() * errRate <= useArgs->subRate){
+			//change the base
+			const char* baseLoc = strchr(PROSYNAR_SYNTH_BASES, refBase);
+			int baseOff = 1 + (int)(3*randSrc.nextUniform());
+			toFill->entrySeq.push_back(PROSYNAR_SYNTH_BASES[((baseLoc ? (baseLoc - PROSYNAR_SYNTH_BASES) : 0) + std::min(baseOff, 3)) & 3]);
+			toFill->entryQual.push_back(badQual);
+			prosynarSynthCigarAdd('M', &lastOp, &lastCount, &(toFill->entryCigar));
+			refI++;
+			continue;
+		}
+		uintptr_t indelLen = 1 + (uintptr_t)(useArgs->maxIndel * randSrc.nextUniform());
+		indelLen = std::min(indelLen, (uintptr_t)(useArgs->maxIndel));
+		if(randSrc.nextUniform() <= 0.5){
+			//insertion
+			indelLen = std::min(indelLen, numBase - toFill->entrySeq.size());
+			for(uintptr_t i = 0; i<indelLen; i++){
+				toFill->entrySeq.push_back(PROSYNAR_SYNTH_BASES[(int)(4*randSrc.nextUniform()) & 3]);
+				toFill->entryQual.push_back(badQual);
+				prosynarSynthCigarAdd('I', &lastOp, &lastCount, &(toFill->entryCigar));
+			}
+		}
+		else if(toFill->entrySeq.size() && ((refI + indelLen) < refLen)){
+			//deletion (not at the start, or the read would start somewhere else)
+			for(uintptr_t i = 0; i<indelLen; i++){
+				prosynarSynthCigarAdd('D', &lastOp, &lastCount, &(toFill->entryCigar));
+			}
+			refI += indelLen;
+		}
+	}
+	prosynarSynthCigarAdd(0, &lastOp, &lastCount, &(toFill->entryCigar));
+}
+
+int prosynarSynthMain(int argc, char** argv){
+	int retCode = 0;
+	OutStream* curOutF = 0;
+	TabularWriter* curOutT = 0;
+	CRBSAMFileWriter* curOut = 0;
+	ProsynarReadSynthesizer* theSynth = 0;
+	ProsynarSynthArgumentParser argsP;
+	try{
+		if(argsP.parseArguments(argc-1, argv+1, &std::cout) < 0){
+			std::cerr << argsP.argumentError << std::endl;
+			retCode = 1;
+		}
+		else if(argsP.needRun){
+			theSynth = new ProsynarReadSynthesizer(&argsP);
+			openCRBSamFileWrite(argsP.outFile, &curOutF, &curOutT, &curOut);
+			theSynth->synthesize(curOut);
+			curOut->finish();
+		}
+	}catch(std::exception& err){
+		std::cerr << err.what() << std::endl;
+		retCode = 1;
+	}
+	if(curOut){ delete(curOut); }
+	if(curOutT){ delete(curOutT); }
+	if(curOutF){ delete(curOutF); }
+	if(theSynth){ delete(theSynth); }
+	return retCode;
+}
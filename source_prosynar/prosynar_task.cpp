@@ -4,23 +4,195 @@
 #include <algorithm>
 
 #include "whodun_oshook.h"
+#include "whodun_compress.h"
 #include "whodun_parse_seq.h"
+#include "whodun_stringext.h"
+#include "whodun_parse_seq_pack.h"
+
+/**The size of the compressed blocks in a gail reference.*/
+#define PROSYNAR_GAIL_COMP_BLOCK 0x010000
+
+ProsynarGailReferenceCache::ProsynarGailReferenceCache(const char* mainFN, const char* annotFN, const char* indexFN){
+	blockComp = new GZipCompressionMethod();
+	blockStr = 0;
+	gailRead = 0;
+	try{
+		blockStr = new BlockCompInStream(mainFN, annotFN, blockComp);
+		gailRead = new GailAQSequenceReader(blockStr, indexFN);
+	}catch(...){
+		if(blockStr){ delete(blockStr); }
+		delete(blockComp);
+		throw;
+	}
+	cacheEnt = -1;
+	cacheFrom = 0;
+}
+ProsynarGailReferenceCache::~ProsynarGailReferenceCache(){
+	delete(gailRead);
+	delete(blockStr);
+	delete(blockComp);
+}
+void ProsynarGailReferenceCache::getWindow(uintptr_t entInd, uintptr_t entLen, uintptr_t fromI, uintptr_t toI, std::string* toFill){
+	toFill->clear();
+	if(toI == fromI){ return; }
+	//load a new stretch if needed
+	if((cacheEnt != (intptr_t)entInd) || (fromI < cacheFrom) || (toI > (cacheFrom + cacheSeq.size()))){
+		uintptr_t loadFrom = fromI - (fromI % PROSYNAR_GAIL_CACHE_BLOCK);
+		uintptr_t loadTo = toI + PROSYNAR_GAIL_CACHE_BLOCK - 1;
+		loadTo = std::min(entLen, loadTo - (loadTo % PROSYNAR_GAIL_CACHE_BLOCK));
+		cacheEnt = -1;
+		gailRead->getEntrySubsequence(entInd, loadFrom, loadTo);
+		cacheSeq.clear();
+		cacheSeq.insert(cacheSeq.end(), gailRead->lastReadSeq, gailRead->lastReadSeq + gailRead->lastReadSeqLen);
+		cacheEnt = entInd;
+		cacheFrom = loadFrom;
+	}
+	toFill->insert(toFill->end(), cacheSeq.begin() + (fromI - cacheFrom), cacheSeq.begin() + (toI - cacheFrom));
+}
+
+ProsynarPairContext::ProsynarPairContext(){
+	saveArgs = 0;
+	reads[0] = 0;
+	reads[1] = 0;
+	cigarState[0] = 0;
+	cigarState[1] = 0;
+	haveQuals[0] = false;
+	haveQuals[1] = false;
+	haveRef = false;
+	refID = -1;
+	lastRefID = -1;
+	refCache = 0;
+}
+ProsynarPairContext::~ProsynarPairContext(){
+	if(refCache){ delete(refCache); }
+}
+void ProsynarPairContext::changePair(ProsynarArgumentParser* baseArgs, CRBSAMFileContents* read1, CRBSAMFileContents* read2){
+	if(baseArgs != saveArgs){
+		lastRefName.clear();
+		lastRefID = -1;
+		if(refCache){ delete(refCache); refCache = 0; }
+	}
+	saveArgs = baseArgs;
+	reads[0] = read1;
+	reads[1] = read2;
+	cigarState[0] = 0;
+	cigarState[1] = 0;
+	haveQuals[0] = false;
+	haveQuals[1] = false;
+	haveRef = false;
+}
+int ProsynarPairContext::expandCigar(int readI, std::string* errRep){
+	if(cigarState[readI] == 0){
+		CRBSAMFileContents* curRead = reads[readI];
+		std::vector<intptr_t>* cigVec = &(cigLocs[readI]);
+		try{
+			cigVec->clear();
+			softClips[readI] = cigarStringToReferencePositions(curRead->entryPos, &(curRead->entryCigar), cigVec);
+			refBounds[readI] = getCigarReferenceBounds(cigVec);
+			cigarState[readI] = 1;
+		}catch(std::exception& err){
+			std::string* curErr = &(cigarError[readI]);
+			curErr->clear();
+			curErr->insert(curErr->end(), curRead->entryName.begin(), curRead->entryName.end());
+			curErr->push_back(':');
+			curErr->push_back(' ');
+			curErr->append(err.what());
+			cigarState[readI] = -1;
+		}
+	}
+	if(cigarState[readI] < 0){
+		errRep->append(cigarError[readI]);
+		return 1;
+	}
+	return 0;
+}
+double* ProsynarPairContext::getQualLog10(int readI){
+	std::vector<double>* curQual = &(qualLog10[readI]);
+	if(!haveQuals[readI]){
+		std::vector<char>* rawQual = &(reads[readI]->entryQual);
+		curQual->resize(rawQual->size() + 1);
+		fastaPhredsToLog10Prob(rawQual->size(), (unsigned char*)(&((*rawQual)[0])), &((*curQual)[0]));
+		haveQuals[readI] = true;
+	}
+	return &((*curQual)[0]);
+}
+intptr_t ProsynarPairContext::getReferenceID(){
+	if(!haveRef){
+		//input is usually sorted: most pairs are on the same reference as the last
+		std::vector<char>* curName = &(reads[0]->entryReference);
+		if((curName->size() != lastRefName.size()) || (curName->size() && memcmp(&((*curName)[0]), lastRefName.c_str(), curName->size()))){
+			lastRefName.clear();
+			lastRefName.insert(lastRefName.end(), curName->begin(), curName->end());
+			lastRefID = saveArgs->findReferenceID(lastRefName);
+		}
+		refID = lastRefID;
+		haveRef = true;
+	}
+	return refID;
+}
+bool ProsynarPairContext::haveReference(){
+	return saveArgs->haveReferenceSequence(getReferenceID());
+}
+uintptr_t ProsynarPairContext::getReferenceLength(){
+	return saveArgs->getReferenceLength(getReferenceID());
+}
+void ProsynarPairContext::getReferenceWindow(uintptr_t fromI, uintptr_t toI, std::string* toFill){
+	saveArgs->getReferenceWindow(getReferenceID(), fromI, toI, toFill, &refCache);
+}
+bool ProsynarPairContext::sameReference(){
+	CRBSAMFileContents* read1 = reads[0];
+	CRBSAMFileContents* read2 = reads[1];
+	if((read1->entryPos < 0) || (read2->entryPos < 0)){ return false; }
+	if((read1->entryReference.size() == 0) || (read2->entryReference.size() == 0)){ return false; }
+	if(read1->entryReference.size() != read2->entryReference.size()){ return false; }
+	return memcmp(&(read1->entryReference[0]), &(read2->entryReference[0]), read1->entryReference.size()) == 0;
+}
 
 ProsynarFilter::ProsynarFilter(){}
 ProsynarFilter::~ProsynarFilter(){}
+int ProsynarFilter::filterPair(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep){
+	return filterPair(threadInd, pairCtx->reads[0], pairCtx->reads[1], errRep);
+}
+bool ProsynarFilter::quickReject(ProsynarPairContext* pairCtx){
+	return false;
+}
+bool ProsynarFilter::canReorder(){
+	return true;
+}
 
 ProsynarMerger::ProsynarMerger(){}
 ProsynarMerger::~ProsynarMerger(){}
+bool ProsynarMerger::havePhredMerge(){
+	return false;
+}
+int ProsynarMerger::mergePairPhred(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::string* mergePhred, std::string* errRep){
+	errRep->append("Merge method cannot produce phred scores directly.");
+	return -1;
+}
+int ProsynarMerger::mergePair(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep){
+	return mergePair(threadInd, pairCtx->reads[0], pairCtx->reads[1], mergeSeq, mergeQual, errRep);
+}
+int ProsynarMerger::mergePairPhred(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::string* mergePhred, std::string* errRep){
+	return mergePairPhred(threadInd, pairCtx->reads[0], pairCtx->reads[1], mergeSeq, mergePhred, errRep);
+}
+void ProsynarMerger::getPruneCounts(std::map<std::string,uintptr_t>* toFill){
+	//no bounds by default
+}
 
 ProsynarArgumentParser::ProsynarArgumentParser(){
 	defOutFN[0] = '-'; defOutFN[1] = 0;
 	errLock = makeMutex();
+	errOut = &std::cerr;
 	failDumpS = 0;
 	failDumpT = 0;
 	failDumpB = 0;
 	seqOutFile = 0;
 	mergeSamOutFile = 0;
 	refFile = 0;
+	refPackFile = 0;
+	makeGailFile = 0;
+	refPack = 0;
+	sharedFrom = 0;
 	probFile = 0;
 	costFile = 0;
 	qualmFile = 0;
@@ -29,6 +201,13 @@ ProsynarArgumentParser::ProsynarArgumentParser(){
 	defAllRegCosts = 0;
 	defAllQualMangs = 0;
 	numThread = 1;
+	numShardThread = 0;
+	usePool = 0;
+	reportPrune = false;
+	progressSecs = 0;
+	statsFile = 0;
+	adaptiveOrder = false;
+	orderedOutput = false;
 	useMerger = 0;
 	std::map<std::string,ProsynarFilter*(*)()> filtStore;
 	getAllProsynarFilters(&filtStore);
@@ -58,7 +237,17 @@ ProsynarArgumentParser::ProsynarArgumentParser(){
 		refMeta.fileExts.insert(".fa");
 		refMeta.fileExts.insert(".fa.gz");
 		refMeta.fileExts.insert(".fa.gzip");
-		addStringOption("--ref", &refFile, 0, "    Specify the reference sequences in a fasta file.\n    --ref File.fa\n", &refMeta);
+		refMeta.fileExts.insert(".gail");
+		addStringOption("--ref", &refFile, 0, "    Specify the reference sequences in a fasta file.\n    A gail file (with .blk and .ind files next to it) is read as needed, rather than loaded.\n    --ref File.fa\n", &refMeta);
+	ArgumentParserStrMeta refPackMeta("Packed Reference File");
+		refPackMeta.isFile = true;
+		refPackMeta.fileExts.insert(".w2b");
+		addStringOption("--refpack", &refPackFile, 0, "    Use a packed image of the reference, only unpacking the parts that are needed.\n    Built from the --ref file if it does not exist.\n    --refpack File.w2b\n", &refPackMeta);
+	ArgumentParserStrMeta makeGailMeta("Gail Reference To Build");
+		makeGailMeta.isFile = true;
+		makeGailMeta.fileWrite = true;
+		makeGailMeta.fileExts.insert(".gail");
+		addStringOption("--makegail", &makeGailFile, 0, "    Instead of merging, convert the --ref file to a gail file (and its .blk and .ind files).\n    --makegail File.gail\n", &makeGailMeta);
 	ArgumentParserStrMeta probMeta("Problematic Region File");
 		probMeta.isFile = true;
 		probMeta.fileExts.insert(".bed");
@@ -78,6 +267,21 @@ ProsynarArgumentParser::ProsynarArgumentParser(){
 		addStringOption("--faildump", &failDumpFile, 0, "    Specify a file to write reads that were not merged.\n    --faildump File.sam\n", &filDumpMeta);
 	ArgumentParserIntMeta threadMeta("Threads");
 		addIntegerOption("--thread", &numThread, 0, "    The number of threads to use.\n    --thread 1\n", &threadMeta);
+	ArgumentParserIntMeta shardMeta("Sharded Reading Threads");
+		addIntegerOption("--shard", &numShardThread, 0, "    The number of threads to read sorted bam files with, a stretch of genome at a time.\n    Needs an index (File.bam.bai or File.bai): files without one are read straight through.\n    --shard 0\n", &shardMeta);
+	ArgumentParserBoolMeta pruneMeta("Report Bound Pruning");
+		addBooleanFlag("--prunestat", &reportPrune, 1, "    Report how many pairs the merger threw out early.\n", &pruneMeta);
+	ArgumentParserIntMeta progMeta("Progress Interval");
+		addIntegerOption("--progress", &progressSecs, 0, "    Report how far along things are every so many seconds: zero for no reports.\n    --progress 0\n", &progMeta);
+	ArgumentParserStrMeta statsMeta("Run Report File");
+		statsMeta.isFile = true;
+		statsMeta.fileWrite = true;
+		statsMeta.fileExts.insert(".json");
+		addStringOption("--stats", &statsFile, 0, "    Write a report on where the time went (queue waits, thread use, filter costs) when done.\n    --stats File.json\n", &statsMeta);
+	ArgumentParserBoolMeta adaptMeta("Adaptive Filter Order");
+		addBooleanFlag("--adaptive-order", &adaptiveOrder, 1, "    Let each thread reorder the filters, running the ones that throw out the most pairs for their cost first.\n    The same pairs get through, but which error messages show up may change.\n", &adaptMeta);
+	ArgumentParserBoolMeta orderMeta("Ordered Output");
+		addBooleanFlag("--ordered", &orderedOutput, 1, "    Write merged pairs in input order, no matter how many threads are running.\n    Sorted bam files are read straight through (--shard is ignored).\n    The failure dump is still written as pairs finish.\n", &orderMeta);
 	ArgumentParserStrMeta fastOutMeta("Sequence Output File");
 		fastOutMeta.isFile = true;
 		fastOutMeta.fileWrite = true;
@@ -87,7 +291,7 @@ ProsynarArgumentParser::ProsynarArgumentParser(){
 		fastOutMeta.fileExts.insert(".fastq");
 		fastOutMeta.fileExts.insert(".fastq.gz");
 		fastOutMeta.fileExts.insert(".fastq.gzip");
-		addStringOption("--out", &seqOutFile, 0, "    Specify a raw sequence output file.\n    --out File.fq\n", &fastOutMeta);
+		addStringOption("--out", &seqOutFile, 0, "    Specify a raw sequence output file (end it in .gz to compress).\n    --out File.fq\n", &fastOutMeta);
 	ArgumentParserStrMeta samOutMeta("Alignment Hint Output File");
 		samOutMeta.isFile = true;
 		samOutMeta.fileWrite = true;
@@ -102,6 +306,7 @@ ProsynarArgumentParser::~ProsynarArgumentParser(){
 	if(failDumpB){ delete(failDumpB); }
 	if(failDumpT){ delete(failDumpT); }
 	if(failDumpS){ delete(failDumpS); }
+	if(refPack && !sharedFrom){ delete(refPack); }
 }
 
 int ProsynarArgumentParser::handleUnknownArgument(int argc, char** argv, std::ostream* helpOut){
@@ -123,6 +328,7 @@ int ProsynarArgumentParser::handleUnknownArgument(int argc, char** argv, std::os
 			if(filtIt != filtStore.end()){
 				ProsynarFilter* newFilt = (filtIt->second)();
 				useFilters.push_back(newFilt);
+				filterNames.push_back(filtIt->first);
 				int numAte = newFilt->parseArguments(workAC, workAV, helpOut);
 				if(numAte < 0){ argumentError = newFilt->argumentError; }
 				else{ workAC -= numAte; workAV += numAte; }
@@ -134,6 +340,7 @@ int ProsynarArgumentParser::handleUnknownArgument(int argc, char** argv, std::os
 					return -1;
 				}
 				useMerger = (mergIt->second)();
+				mergerName = mergIt->first;
 				int numAte = useMerger->parseArguments(workAC, workAV, helpOut);
 				if(numAte < 0){ argumentError = useMerger->argumentError; }
 				else{ workAC -= numAte; workAV += numAte; }
@@ -178,6 +385,35 @@ int ProsynarArgumentParser::posteriorCheck(){
 		argumentError = "thread must be positive.";
 		return 1;
 	}
+	if(numShardThread < 0){
+		argumentError = "shard cannot be negative.";
+		return 1;
+	}
+	if(progressSecs < 0){
+		argumentError = "progress cannot be negative.";
+		return 1;
+	}
+	if(orderedOutput){
+		//stretches of a bam file finish in any order
+		numShardThread = 0;
+	}
+	if(statsFile && (strlen(statsFile)==0)){
+		statsFile = 0;
+	}
+	if(makeGailFile && (strlen(makeGailFile)==0)){
+		makeGailFile = 0;
+	}
+	if(makeGailFile){
+		if(!refFile){
+			argumentError = "makegail needs a reference to convert.";
+			return 1;
+		}
+		if(referenceIsGail()){
+			argumentError = "Reference is already a gail file.";
+			return 1;
+		}
+		return 0;
+	}
 	if(useMerger == 0){
 		argumentError = "No merge operation specified.";
 		return 1;
@@ -210,10 +446,166 @@ int ProsynarArgumentParser::posteriorCheck(){
 	return 0;
 }
 
+uintptr_t ProsynarArgumentParser::internReference(const std::string& refName){
+	std::map<std::string,uintptr_t>::iterator idIt = refIDs.find(refName);
+	if(idIt != refIDs.end()){ return idIt->second; }
+	uintptr_t newID = refNames.size();
+	refNames.push_back(refName);
+	refIDs[refName] = newID;
+	std::map< std::string, std::string >::iterator refIt = allRefs.find(refName);
+	refSeqs.push_back((refIt == allRefs.end()) ? (std::string*)0 : &(refIt->second));
+	refPackInds.push_back(refPack ? refPack->findSequence(refName) : -1);
+	std::map<std::string,uintptr_t>::iterator gailIt = refGailEntries.find(refName);
+	refGailInds.push_back((gailIt == refGailEntries.end()) ? -1 : (intptr_t)(gailIt->second));
+	return newID;
+}
+
+bool ProsynarArgumentParser::haveReferenceSequence(intptr_t refID){
+	if(refID < 0){ return false; }
+	return refSeqs[refID] || (refPackInds[refID] >= 0) || (refGailInds[refID] >= 0);
+}
+
+uintptr_t ProsynarArgumentParser::getReferenceLength(uintptr_t refID){
+	if(refSeqs[refID]){ return refSeqs[refID]->size(); }
+	if(refPackInds[refID] >= 0){ return refPack->getLength(refPackInds[refID]); }
+	return refGailLens[refGailInds[refID]];
+}
+
+void ProsynarArgumentParser::getReferenceWindow(uintptr_t refID, uintptr_t fromI, uintptr_t toI, std::string* toFill, ProsynarGailReferenceCache** useCache){
+	std::string* curRef = refSeqs[refID];
+	if(curRef){
+		toFill->clear();
+		toFill->insert(toFill->end(), curRef->begin() + fromI, curRef->begin() + toI);
+		return;
+	}
+	if(refPackInds[refID] >= 0){
+		refPack->getWindow(refPackInds[refID], fromI, toI, toFill);
+		return;
+	}
+	if(*useCache == 0){
+		*useCache = openGailReference();
+	}
+	uintptr_t entI = refGailInds[refID];
+	(*useCache)->getWindow(entI, refGailLens[entI], fromI, toI, toFill);
+}
+
+bool ProsynarArgumentParser::referenceIsGail(){
+	return refFile && strendswith(refFile, ".gail");
+}
+
+ProsynarGailReferenceCache* ProsynarArgumentParser::openGailReference(){
+	return new ProsynarGailReferenceCache(refFile, refGailAnnot.c_str(), refGailIndex.c_str());
+}
+
+void ProsynarArgumentParser::makeGailReference(){
+	std::string gailAnnot(makeGailFile); gailAnnot.append(".blk");
+	std::string gailIndex(makeGailFile); gailIndex.append(".ind");
+	GZipCompressionMethod baseComp;
+	InStream* redFile = 0;
+	SequenceReader* refRead = 0;
+	ThreadPool* usePool = 0;
+	MultithreadBlockCompOutStream* blockOut = 0;
+	GailAQSequenceWriter* gailOut = 0;
+	try{
+		openSequenceFileRead(refFile, &redFile, &refRead);
+		usePool = new ThreadPool(numThread);
+		blockOut = new MultithreadBlockCompOutStream(0, PROSYNAR_GAIL_COMP_BLOCK, makeGailFile, gailAnnot.c_str(), &baseComp, numThread, usePool);
+		gailOut = new GailAQSequenceWriter(blockOut, gailIndex.c_str());
+		while(refRead->readNextEntry()){
+			gailOut->nextNameLen = refRead->lastReadNameLen;
+			gailOut->nextShortNameLen = refRead->lastReadShortNameLen;
+			gailOut->nextName = refRead->lastReadName;
+			gailOut->nextSeqLen = refRead->lastReadSeqLen;
+			gailOut->nextSeq = refRead->lastReadSeq;
+			gailOut->nextHaveQual = refRead->lastReadHaveQual;
+			gailOut->nextQual = refRead->lastReadQual;
+			gailOut->nextQualPhred = 0;
+			gailOut->writeNextEntry();
+		}
+		delete(gailOut); gailOut = 0;
+		delete(blockOut); blockOut = 0;
+		delete(usePool); usePool = 0;
+		delete(refRead); refRead = 0;
+		delete(redFile); redFile = 0;
+	}catch(...){
+		if(gailOut){ delete(gailOut); }
+		if(blockOut){ delete(blockOut); }
+		if(usePool){ delete(usePool); }
+		if(refRead){ delete(refRead); }
+		if(redFile){ delete(redFile); }
+		throw;
+	}
+}
+
+intptr_t ProsynarArgumentParser::findReferenceID(const std::string& refName){
+	std::map<std::string,uintptr_t>::iterator idIt = refIDs.find(refName);
+	if(idIt == refIDs.end()){ return -1; }
+	return idIt->second;
+}
+
 void ProsynarArgumentParser::performSetup(){
+	loadShared();
+	prepareRun();
+}
+
+void ProsynarArgumentParser::loadShared(){
 	std::string fileConts;
 	//load the reference
-	if(refFile){
+	if(refPackFile){
+		if(!fileExists(refPackFile)){
+			if(!refFile){
+				throw std::runtime_error("Packed reference " + std::string(refPackFile) + " does not exist, and no reference given to build it from.");
+			}
+			if(referenceIsGail()){
+				refGailAnnot = refFile; refGailAnnot.append(".blk");
+				refGailIndex = refFile; refGailIndex.append(".ind");
+				ProsynarGailReferenceCache* packFrom = openGailReference();
+				FileOutStream* packOut = 0;
+				try{
+					packOut = new FileOutStream(0, refPackFile);
+					packSequenceFile(packFrom->gailRead, packOut);
+					delete(packOut); packOut = 0;
+				}catch(...){
+					if(packOut){ delete(packOut); killFile(refPackFile); }
+					delete(packFrom);
+					throw;
+				}
+				delete(packFrom);
+			}
+			else{
+				packSequenceFile(refFile, refPackFile);
+			}
+		}
+		refPack = new PackedSequenceStore(refPackFile);
+		for(uintptr_t i = 0; i<refPack->allSeqs.size(); i++){
+			internReference(refPack->allSeqs[i].seqName);
+		}
+	}
+	else if(referenceIsGail()){
+		//only the names and lengths are loaded: the threads pull in sequence as needed
+		refGailAnnot = refFile; refGailAnnot.append(".blk");
+		refGailIndex = refFile; refGailIndex.append(".ind");
+		ProsynarGailReferenceCache* indFrom = openGailReference();
+		try{
+			GailAQSequenceReader* gailRead = indFrom->gailRead;
+			uintptr_t numEnt = gailRead->getNumEntries();
+			for(uintptr_t i = 0; i<numEnt; i++){
+				uintptr_t curLen = gailRead->getEntryLength(i);
+				gailRead->getEntrySubsequence(i, 0, std::min(curLen, (uintptr_t)1));
+				std::string crefNam(gailRead->lastReadName, gailRead->lastReadName + gailRead->lastReadShortNameLen);
+				refGailEntries[crefNam] = i;
+				refGailLens.push_back(curLen);
+			}
+		}catch(...){
+			delete(indFrom);
+			throw;
+		}
+		delete(indFrom);
+		for(std::map<std::string,uintptr_t>::iterator refIt = refGailEntries.begin(); refIt != refGailEntries.end(); refIt++){
+			internReference(refIt->first);
+		}
+	}
+	else if(refFile){
 		InStream* redFile = 0;
 		SequenceReader* refRead = 0;
 		try{
@@ -231,6 +623,9 @@ void ProsynarArgumentParser::performSetup(){
 			if(redFile){ delete(redFile); }
 			throw;
 		}
+		for(std::map< std::string, std::string >::iterator refIt = allRefs.begin(); refIt != allRefs.end(); refIt++){
+			internReference(refIt->first);
+		}
 	}
 	//load in the costs
 	if(costFile){
@@ -277,6 +672,33 @@ void ProsynarArgumentParser::performSetup(){
 		}
 		defProbRegMap = &probRegMap;
 	}
+}
+
+void ProsynarArgumentParser::adoptShared(ProsynarArgumentParser* loadedArgs){
+	sharedFrom = loadedArgs;
+	//the reference (the sequences stay with the loaded parser)
+	refFile = loadedArgs->refFile;
+	refPackFile = loadedArgs->refPackFile;
+	refNames = loadedArgs->refNames;
+	refIDs = loadedArgs->refIDs;
+	refSeqs = loadedArgs->refSeqs;
+	refPack = loadedArgs->refPack;
+	refPackInds = loadedArgs->refPackInds;
+	refGailAnnot = loadedArgs->refGailAnnot;
+	refGailIndex = loadedArgs->refGailIndex;
+	refGailEntries = loadedArgs->refGailEntries;
+	refGailLens = loadedArgs->refGailLens;
+	refGailInds = loadedArgs->refGailInds;
+	//the defaults
+	probFile = loadedArgs->probFile;
+	costFile = loadedArgs->costFile;
+	qualmFile = loadedArgs->qualmFile;
+	defProbRegMap = loadedArgs->defProbRegMap;
+	defAllRegCosts = loadedArgs->defAllRegCosts;
+	defAllQualMangs = loadedArgs->defAllQualMangs;
+}
+
+void ProsynarArgumentParser::prepareRun(){
 	//let the filters and merger prepare
 	for(uintptr_t i = 0; i<useFilters.size(); i++){
 		useFilters[i]->initialize(this);
@@ -293,6 +715,7 @@ void ProsynarArgumentParser::performSetup(){
 
 #include "prosynar_task_pear.h"
 #include "prosynar_task_flash.h"
+#include "prosynar_task_kmer.h"
 #include "prosynar_task_naimerge.h"
 #include "prosynar_task_refover.h"
 #include "prosynar_task_refprob.h"
@@ -307,4 +730,5 @@ void getAllProsynarMergers(std::map<std::string,ProsynarMerger*(*)()>* toFill){
 	(*toFill)["Mpear"] = factoryPearMerger;
 	(*toFill)["Mflash"] = factoryFlashMerger;
 	(*toFill)["Malign"] = factorySimpleAlignMerger;
+	(*toFill)["Mkmer"] = factoryKmerSeedMerger;
 }
@@ -5,7 +5,7 @@
 #include <algorithm>
 
 #include "whodun_parse_seq.h"
-#include "prosynar_task_naimerge.h"
+#include "whodun_stringext_seq.h"
 
 FLASHMerger::FLASHMerger(){
 	softReclaim = false;
@@ -66,54 +66,77 @@ int FLASHMerger::posteriorCheck(){
 
 void FLASHMerger::initialize(ProsynarArgumentParser* baseArgs){
 	saveArgs = baseArgs;
-	cigLocSet.resize(baseArgs->numThread);
 	seqASet.resize(baseArgs->numThread);
 	seqqASet.resize(baseArgs->numThread);
-	seqqdASet.resize(baseArgs->numThread);
 	seqBSet.resize(baseArgs->numThread);
 	seqqBSet.resize(baseArgs->numThread);
-	seqqdBSet.resize(baseArgs->numThread);
 	seqBRSet.resize(baseArgs->numThread);
 	seqqBRSet.resize(baseArgs->numThread);
-	seqqdBRSet.resize(baseArgs->numThread);
-	seqILSet.resize(baseArgs->numThread);
-	seqdILSet.resize(baseArgs->numThread);
-	seqIRSet.resize(baseArgs->numThread);
-	seqdIRSet.resize(baseArgs->numThread);
+	mergeSet.resize(baseArgs->numThread);
+	misPruneSet.resize(baseArgs->numThread);
+	for(uintptr_t i = 0; i<mergeSet.size(); i++){
+		mergeSet[i].changeMethod(origRecipe ? ALIGNMERGE_METHOD_FLASH : ALIGNMERGE_METHOD_POSTERIOR);
+	}
 }
 
 /**
- * Find the best overlap using the flash method.
+ * Score a single overlap using the flash method.
  * @param seqL The left sequence.
  * @param qualL The left quality;
  * @param seqR The right sequence.
  * @param qualR The right quality.
- * @param minOver The minimum possible overlap.
+ * @param col The amount of overlap.
  * @param maxExp THe maximum expected overlap.
+ * @param worstRat The worst mismatch ratio of interest: quit early (returning infinity) once this is passed.
+ * @param avgQ The place to put the average quality of the mismatches.
+ * @return The mismatch ratio.
  */
-std::pair<uintptr_t,double> flashFindBestOverlap(std::vector<char>* seqL, std::vector<char>* qualL, std::vector<char>* seqR, std::vector<char>* qualR, uintptr_t minOver, uintptr_t maxExp){
+double flashScoreOverlap(std::vector<char>* seqL, std::vector<char>* qualL, std::vector<char>* seqR, std::vector<char>* qualR, uintptr_t col, uintptr_t maxExp, double worstRat, double* avgQ){
+	uintptr_t sli0 = seqL->size() - col;
+	uintptr_t numMiss = 0;
+	double curAvgQ = 0.0;
+	double ratDiv = (col > maxExp) ? maxExp : col;
+	for(uintptr_t i = 0; i<col; i++){
+		if((*seqL)[sli0 + i] != (*seqR)[i]){
+			curAvgQ += (*qualL)[sli0+i] + (*qualR)[i];
+			numMiss++;
+			//mismatches only go up: if over budget, it will not get better
+			if((numMiss / ratDiv) > worstRat){
+				*avgQ = 0.0;
+				return 1.0/0.0;
+			}
+		}
+	}
+	double curRat = numMiss / ratDiv;
+	*avgQ = curAvgQ / (2*numMiss);
+	return curRat;
+}
+
+std::pair<uintptr_t,double> flashFindBestOverlap(std::vector<char>* seqL, std::vector<char>* qualL, std::vector<char>* seqR, std::vector<char>* qualR, uintptr_t minOver, uintptr_t maxExp, double worstRat){
 	double winRat = 1.0/0.0;
 	uintptr_t winOver = 0;
 	double winAvgQ = 0.0;
 	uintptr_t maxPos = std::min(seqL->size(), seqR->size());
 	for(uintptr_t col = minOver; col <= maxPos; col++){
-		uintptr_t sli0 = seqL->size() - col;
-		uintptr_t numMiss = 0;
-		double curAvgQ = 0.0;
-		for(uintptr_t i = 0; i<col; i++){
-			if((*seqL)[sli0 + i] != (*seqR)[i]){
-				curAvgQ += (*qualL)[sli0+i] + (*qualR)[i];
-				numMiss++;
-			}
-		}
-		double curRat = numMiss;
-		if(col > maxExp){
-			curRat = curRat / maxExp;
-		}
-		else{
-			curRat = curRat / col;
+		double curAvgQ;
+		double curRat = flashScoreOverlap(seqL, qualL, seqR, qualR, col, maxExp, worstRat, &curAvgQ);
+		if((curRat < winRat) || ((curRat == winRat) && (curAvgQ < winAvgQ))){
+			winRat = curRat;
+			winAvgQ = curAvgQ;
+			winOver = col;
 		}
-		curAvgQ = curAvgQ / (2*numMiss);
+	}
+	return std::pair<uintptr_t,double>(winOver,winRat);
+}
+
+std::pair<uintptr_t,double> flashFindBestCandidateOverlap(std::vector<char>* seqL, std::vector<char>* qualL, std::vector<char>* seqR, std::vector<char>* qualR, uintptr_t numCand, uintptr_t* candOver, uintptr_t maxExp, double worstRat){
+	double winRat = 1.0/0.0;
+	uintptr_t winOver = 0;
+	double winAvgQ = 0.0;
+	for(uintptr_t ci = 0; ci < numCand; ci++){
+		uintptr_t col = candOver[ci];
+		double curAvgQ;
+		double curRat = flashScoreOverlap(seqL, qualL, seqR, qualR, col, maxExp, worstRat, &curAvgQ);
 		if((curRat < winRat) || ((curRat == winRat) && (curAvgQ < winAvgQ))){
 			winRat = curRat;
 			winAvgQ = curAvgQ;
@@ -123,7 +146,13 @@ std::pair<uintptr_t,double> flashFindBestOverlap(std::vector<char>* seqL, std::v
 	return std::pair<uintptr_t,double>(winOver,winRat);
 }
 
-int FLASHMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep){
+std::pair<uintptr_t,double> FLASHMerger::findBestOverlap(int threadInd, std::vector<char>* seqL, std::vector<char>* qualL, std::vector<char>* seqR, std::vector<char>* qualR){
+	return flashFindBestOverlap(seqL, qualL, seqR, qualR, reqOverlap, maxExpOverlap, worstMR);
+}
+
+int FLASHMerger::buildMerge(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep){
+	CRBSAMFileContents* read1 = pairCtx->reads[0];
+	CRBSAMFileContents* read2 = pairCtx->reads[1];
 	const char* read1SStart = &(read1->entrySeq[0]);
 	const char* read1QStart = &(read1->entryQual[0]);
 	uintptr_t read1SLen = read1->entrySeq.size();
@@ -131,30 +160,11 @@ int FLASHMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileC
 	const char* read2QStart = &(read2->entryQual[0]);
 	uintptr_t read2SLen = read2->entrySeq.size();
 	if(!softReclaim){
-		std::vector<intptr_t>* cigVec = &(cigLocSet[threadInd]);
 		//expand the cigars (really want the soft clips)
-		std::pair<uintptr_t,uintptr_t> read1SClip;
-		try{
-			cigVec->clear();
-			read1SClip = cigarStringToReferencePositions(read1->entryPos, &(read1->entryCigar), cigVec);
-		}catch(std::exception& err){
-			errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
-			errRep->push_back(':');
-			errRep->push_back(' ');
-			errRep->append(err.what());
-			return -1;
-		}
-		std::pair<uintptr_t,uintptr_t> read2SClip;
-		try{
-			cigVec->clear();
-			read2SClip = cigarStringToReferencePositions(read2->entryPos, &(read2->entryCigar), cigVec);
-		}catch(std::exception& err){
-			errRep->insert(errRep->end(),read2->entryName.begin(), read2->entryName.end());
-			errRep->push_back(':');
-			errRep->push_back(' ');
-			errRep->append(err.what());
-			return -1;
-		}
+		if(pairCtx->expandCigar(0, errRep)){ return -1; }
+		if(pairCtx->expandCigar(1, errRep)){ return -1; }
+		std::pair<uintptr_t,uintptr_t> read1SClip = pairCtx->softClips[0];
+		std::pair<uintptr_t,uintptr_t> read2SClip = pairCtx->softClips[1];
 		//do the clipping
 		read1SStart += read1SClip.first;
 		read1QStart += read1SClip.first;
@@ -170,101 +180,95 @@ int FLASHMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileC
 	//get the stuff
 		std::vector<char>* seqA = &(seqASet[threadInd]);
 		std::vector<char>* seqAQ = &(seqqASet[threadInd]);
-		std::vector<double>* seqAQD = &(seqqdASet[threadInd]);
 			seqA->clear(); seqA->insert(seqA->end(), read1SStart, read1SStart + read1SLen);
 			seqAQ->clear(); seqAQ->insert(seqAQ->end(), read1QStart, read1QStart + read1SLen);
-			seqAQD->resize(read1SLen); fastaPhredsToLog10Prob(read1SLen, (const unsigned char*)read1QStart, &((*seqAQD)[0]));
 		std::vector<char>* seqB = &(seqBSet[threadInd]);
 		std::vector<char>* seqBQ = &(seqqBSet[threadInd]);
-		std::vector<double>* seqBQD = &(seqqdBSet[threadInd]);
 			seqB->clear(); seqB->insert(seqB->end(), read2SStart, read2SStart + read2SLen);
 			seqBQ->clear(); seqBQ->insert(seqBQ->end(), read2QStart, read2QStart + read2SLen);
-			seqBQD->resize(read2SLen); fastaPhredsToLog10Prob(read2SLen, (const unsigned char*)read2QStart, &((*seqBQD)[0]));
 		std::vector<char>* seqBR = &(seqBRSet[threadInd]);
 		std::vector<char>* seqBRQ = &(seqqBRSet[threadInd]);
-		std::vector<double>* seqBRQD = &(seqqdBRSet[threadInd]);
 			seqBR->clear(); seqBR->insert(seqBR->end(), read2SStart, read2SStart + read2SLen);
 			seqBRQ->clear(); seqBRQ->insert(seqBRQ->end(), read2QStart, read2QStart + read2SLen);
-			seqBRQD->clear(); seqBRQD->insert(seqBRQD->end(), seqBQD->begin(), seqBQD->end());
-			sequenceReverseCompliment(read2SLen, &((*seqBR)[0]), &((*seqBRQD)[0]));
-			std::reverse(seqBRQ->begin(), seqBRQ->end());
+			sequenceReverseCompliment(read2SLen, &((*seqBR)[0]), 0);
+			memreverse(&((*seqBRQ)[0]), seqBRQ->size());
 	//start walking
-		std::pair<uintptr_t,double> resAB = flashFindBestOverlap(seqA, seqAQ, seqB, seqBQ, reqOverlap, maxExpOverlap);
-		std::pair<uintptr_t,double> resBA = flashFindBestOverlap(seqB, seqBQ, seqA, seqAQ, reqOverlap, maxExpOverlap);
-		std::pair<uintptr_t,double> resAR = flashFindBestOverlap(seqA, seqAQ, seqBR, seqBRQ, reqOverlap, maxExpOverlap);
-		std::pair<uintptr_t,double> resRA = flashFindBestOverlap(seqBR, seqBRQ, seqA, seqAQ, reqOverlap, maxExpOverlap);
+		std::pair<uintptr_t,double> resAB = findBestOverlap(threadInd, seqA, seqAQ, seqB, seqBQ);
+		std::pair<uintptr_t,double> resBA = findBestOverlap(threadInd, seqB, seqBQ, seqA, seqAQ);
+		std::pair<uintptr_t,double> resAR = findBestOverlap(threadInd, seqA, seqAQ, seqBR, seqBRQ);
+		std::pair<uintptr_t,double> resRA = findBestOverlap(threadInd, seqBR, seqBRQ, seqA, seqAQ);
 	//winner winner
-		std::vector<char>* winL = seqA; /*std::vector<char>* winLQ = seqAQ;*/ std::vector<double>* winLQD = seqAQD;
-		std::vector<char>* winR = seqB; /*std::vector<char>* winRQ = seqBQ;*/ std::vector<double>* winRQD = seqBQD;
+		std::vector<char>* winL = seqA; std::vector<char>* winLQ = seqAQ;
+		std::vector<char>* winR = seqB; std::vector<char>* winRQ = seqBQ;
 		std::pair<uintptr_t,double> winRes = resAB;
 		if(resBA.second < winRes.second){
-			winL = seqB; /*winLQ = seqBQ;*/ winLQD = seqBQD;
-			winR = seqA; /*winRQ = seqAQ;*/ winRQD = seqAQD;
+			winL = seqB; winLQ = seqBQ;
+			winR = seqA; winRQ = seqAQ;
 			winRes = resBA;
 		}
 		if(resAR.second < winRes.second){
-			winL = seqA; /*winLQ = seqAQ;*/ winLQD = seqAQD;
-			winR = seqBR; /*winRQ = seqBRQ;*/ winRQD = seqBRQD;
+			winL = seqA; winLQ = seqAQ;
+			winR = seqBR; winRQ = seqBRQ;
 			winRes = resAR;
 		}
 		if(resRA.second < winRes.second){
-			winL = seqBR; /*winLQ = seqBRQ;*/ winLQD = seqBRQD;
-			winR = seqA; /*winRQ = seqAQ;*/ winRQD = seqAQD;
+			winL = seqBR; winLQ = seqBRQ;
+			winR = seqA; winRQ = seqAQ;
 			winRes = resRA;
 		}
 		if(winRes.second > worstMR){
+			//every overlap went over the mismatch budget
+			misPruneSet[threadInd]++;
 			return 1;
 		}
 	//chicken dinner
-		mergeSeq->clear(); mergeQual->clear();
-		if(origRecipe){
-			uintptr_t sli0 = winL->size() - winRes.first;
-			for(uintptr_t i = 0; i<sli0; i++){
-				mergeSeq->push_back((*winL)[i]);
-				mergeQual->push_back((*winLQD)[i]);
-			}
-			for(uintptr_t i = 0; i<winRes.first; i++){
-				char optL = (*winL)[sli0+i];
-				double optLQ = (*winLQD)[sli0+i];
-				char optR = (*winR)[i];
-				double optRQ = (*winRQD)[i];
-				if(optLQ < optRQ){
-					mergeSeq->push_back(optL);
-					mergeQual->push_back( (optL == optR) ? optLQ : -0.2);
-				}
-				else{
-					mergeSeq->push_back(optR);
-					mergeQual->push_back( (optL == optR) ? optRQ : -0.2);
-				}
-			}
-			for(uintptr_t i = winRes.first; i<winR->size(); i++){
-				mergeSeq->push_back((*winR)[i]);
-				mergeQual->push_back((*winRQD)[i]);
-			}
-		}
-		else{
-			uintptr_t sli0 = winL->size() - winRes.first;
-			mergeSeq->insert(mergeSeq->end(), winL->begin(), winL->begin() + sli0);
-			mergeQual->insert(mergeQual->end(), winLQD->begin(), winLQD->begin() + sli0);
-			std::vector<int>* seqIL = &(seqILSet[threadInd]);
-			std::vector<double>* seqdIL = &(seqdILSet[threadInd]);
-			seqIL->clear(); seqdIL->clear();
-			std::vector<int>* seqIR = &(seqIRSet[threadInd]);
-			std::vector<double>* seqdIR = &(seqdIRSet[threadInd]);
-			seqIR->clear(); seqdIR->clear();
-			for(uintptr_t i = 0; i<winRes.first; i++){
-				seqIL->push_back(0x00FF & (*winL)[sli0+i]);
-				seqdIL->push_back((*winLQD)[sli0+i]);
-				seqIR->push_back(0x00FF & (*winR)[i]);
-				seqdIR->push_back((*winRQD)[i]);
-			}
-			mergeIndelExpandedSequences(seqIL, seqdIL, seqIR, seqdIR, mergeSeq, mergeQual);
-			mergeSeq->insert(mergeSeq->end(), winR->begin() + winRes.first, winR->begin() + winR->size());
-			mergeQual->insert(mergeQual->end(), winRQD->begin() + winRes.first, winRQD->begin() + winRQD->size());
-		}
+		AlignedSequenceMerger* curMerge = &(mergeSet[threadInd]);
+		curMerge->changeFocus(winL->size(), &((*winL)[0]), &((*winLQ)[0]), winR->size(), &((*winR)[0]), &((*winRQ)[0]), winRes.first);
+		curMerge->expandIndels();
+		curMerge->addInPrefix();
+		curMerge->mergeOverlap();
+		curMerge->addInSuffix();
 	return 0;
 }
 
+int FLASHMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep){
+	ProsynarPairContext pairCtx;
+	pairCtx.changePair(saveArgs, read1, read2);
+	return mergePair(threadInd, &pairCtx, mergeSeq, mergeQual, errRep);
+}
+
+int FLASHMerger::mergePair(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep){
+	int buildR = buildMerge(threadInd, pairCtx, errRep);
+	if(buildR){ return buildR; }
+	mergeSet[threadInd].getMerged(mergeSeq, mergeQual);
+	return 0;
+}
+
+bool FLASHMerger::havePhredMerge(){
+	return true;
+}
+
+int FLASHMerger::mergePairPhred(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::string* mergePhred, std::string* errRep){
+	ProsynarPairContext pairCtx;
+	pairCtx.changePair(saveArgs, read1, read2);
+	return mergePairPhred(threadInd, &pairCtx, mergeSeq, mergePhred, errRep);
+}
+
+int FLASHMerger::mergePairPhred(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::string* mergePhred, std::string* errRep){
+	int buildR = buildMerge(threadInd, pairCtx, errRep);
+	if(buildR){ return buildR; }
+	mergeSet[threadInd].getMergedPhred(mergeSeq, mergePhred);
+	return 0;
+}
+
+void FLASHMerger::getPruneCounts(std::map<std::string,uintptr_t>* toFill){
+	uintptr_t totPrune = 0;
+	for(uintptr_t i = 0; i<misPruneSet.size(); i++){
+		totPrune += misPruneSet[i];
+	}
+	(*toFill)["mismatch budget"] += totPrune;
+}
+
 ProsynarMerger* factoryFlashMerger(){
 	return new FLASHMerger();
 }
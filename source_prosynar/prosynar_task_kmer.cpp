@@ -0,0 +1,146 @@
+#include "prosynar_task_kmer.h"
+
+#include <string.h>
+#include <algorithm>
+
+KmerSeedMerger::KmerSeedMerger(){
+	kmerSize = 10;
+	minSeedHits = 1;
+	myMainDoc = "prosynar -- Mkmer [OPTION]\nMerge by sliding the sequences past each other, only at offsets that share a kmer.\nThe OPTIONS are:\n";
+	myVersionDoc = "ProSynAr Mkmer 1.0";
+	ArgumentParserIntMeta kmerMeta("Seed Size");
+		addIntegerOption("--kmer", &kmerSize, 0, "    Specify the size of the seeding kmers (at most 16).\n    --kmer 10\n", &kmerMeta);
+	ArgumentParserIntMeta hitMeta("Seed Hit Threshold");
+		addIntegerOption("--minhit", &minSeedHits, 0, "    Specify the number of shared kmers an overlap needs before it is scored.\n    --minhit 1\n", &hitMeta);
+}
+
+KmerSeedMerger::~KmerSeedMerger(){
+}
+
+int KmerSeedMerger::posteriorCheck(){
+	if(FLASHMerger::posteriorCheck()){
+		return 1;
+	}
+	if((kmerSize <= 0) || (kmerSize > 16)){
+		argumentError = "Kmer size must be between 1 and 16.";
+		return 1;
+	}
+	if(kmerSize > reqOverlap){
+		argumentError = "Kmer size cannot be larger than the overlap threshold.";
+		return 1;
+	}
+	if(minSeedHits <= 0){
+		argumentError = "Seed hit threshold must be positive.";
+		return 1;
+	}
+	return 0;
+}
+
+void KmerSeedMerger::initialize(ProsynarArgumentParser* baseArgs){
+	FLASHMerger::initialize(baseArgs);
+	hashHeadSet.resize(baseArgs->numThread);
+	hashNextSet.resize(baseArgs->numThread);
+	kmerValSet.resize(baseArgs->numThread);
+	overHitSet.resize(baseArgs->numThread);
+	candOverSet.resize(baseArgs->numThread);
+}
+
+/**The two bit code for each base, or 4 if not a base.*/
+static const unsigned char kmerSeedBaseCodes[256] = {
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4, 4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4, 4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,0,4,1,4,4,4,2,4,4,4,4,4,4,4,4, 4,4,4,4,3,4,4,4,4,4,4,4,4,4,4,4,
+	4,0,4,1,4,4,4,2,4,4,4,4,4,4,4,4, 4,4,4,4,3,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4, 4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4, 4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4, 4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
+	4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4, 4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4
+};
+
+/**
+ * Get the hash bucket for a packed kmer.
+ * @param kmerVal The packed kmer.
+ * @param hashBits The number of bits in the hash.
+ * @return The bucket.
+ */
+static inline uintptr_t kmerSeedHash(uint32_t kmerVal, int hashBits){
+	return ((uint32_t)(kmerVal * 2654435761UL)) >> (32 - hashBits);
+}
+
+std::pair<uintptr_t,double> KmerSeedMerger::findBestOverlap(int threadInd, std::vector<char>* seqL, std::vector<char>* qualL, std::vector<char>* seqR, std::vector<char>* qualR){
+	uintptr_t kmerS = kmerSize;
+	uintptr_t seqLS = seqL->size();
+	uintptr_t maxPos = std::min(seqLS, seqR->size());
+	std::vector<uintptr_t>* candOver = &(candOverSet[threadInd]);
+	candOver->clear();
+	if(maxPos < (uintptr_t)reqOverlap){
+		return std::pair<uintptr_t,double>(0, 1.0/0.0);
+	}
+	//only the last maxPos bases of the left and the first maxPos of the right can overlap
+		uintptr_t leftS0 = seqLS - maxPos;
+		uintptr_t numKmer = maxPos - kmerS + 1;
+		const char* leftSeq = &((*seqL)[leftS0]);
+		const char* rightSeq = &((*seqR)[0]);
+	//hash the left suffix
+		int hashBits = 4;
+		while(((uintptr_t)1 << hashBits) < 2*numKmer){ hashBits++; }
+		std::vector<intptr_t>* hashHead = &(hashHeadSet[threadInd]);
+		std::vector<intptr_t>* hashNext = &(hashNextSet[threadInd]);
+		std::vector<uint32_t>* kmerVal = &(kmerValSet[threadInd]);
+		hashHead->clear(); hashHead->resize((uintptr_t)1 << hashBits, -1);
+		hashNext->resize(numKmer);
+		kmerVal->resize(numKmer);
+		intptr_t* hashHeadA = &((*hashHead)[0]);
+		intptr_t* hashNextA = &((*hashNext)[0]);
+		uint32_t* kmerValA = &((*kmerVal)[0]);
+		uint32_t kmerMask = (kmerS == 16) ? 0xFFFFFFFFUL : ((((uint32_t)1) << (2*kmerS)) - 1);
+		uint32_t curPack = 0;
+		uintptr_t curValid = 0;
+		for(uintptr_t i = 0; i<maxPos; i++){
+			unsigned char curCode = kmerSeedBaseCodes[0x00FF & leftSeq[i]];
+			if(curCode > 3){ curValid = 0; curPack = 0; }
+			else{ curValid++; curPack = ((curPack << 2) | curCode) & kmerMask; }
+			if(i + 1 < kmerS){ continue; }
+			uintptr_t kmerI = (i + 1) - kmerS;
+			if(curValid < kmerS){ hashNextA[kmerI] = -2; continue; }
+			uintptr_t curBuck = kmerSeedHash(curPack, hashBits);
+			kmerValA[kmerI] = curPack;
+			hashNextA[kmerI] = hashHeadA[curBuck];
+			hashHeadA[curBuck] = kmerI;
+		}
+	//look up the right prefix, count the hits for each overlap
+		std::vector<uintptr_t>* overHit = &(overHitSet[threadInd]);
+		overHit->clear(); overHit->resize(maxPos+1, 0);
+		uintptr_t* overHitA = &((*overHit)[0]);
+		curPack = 0;
+		curValid = 0;
+		for(uintptr_t j = 0; j<maxPos; j++){
+			unsigned char curCode = kmerSeedBaseCodes[0x00FF & rightSeq[j]];
+			if(curCode > 3){ curValid = 0; curPack = 0; }
+			else{ curValid++; curPack = ((curPack << 2) | curCode) & kmerMask; }
+			if(curValid < kmerS){ continue; }
+			uintptr_t kmerJ = (j + 1) - kmerS;
+			intptr_t curLook = hashHeadA[kmerSeedHash(curPack, hashBits)];
+			while(curLook >= 0){
+				uintptr_t kmerI = curLook;
+				curLook = hashNextA[kmerI];
+				if(kmerValA[kmerI] != curPack){ continue; }
+				if(kmerI < kmerJ){ continue; }
+				overHitA[maxPos - (kmerI - kmerJ)]++;
+			}
+		}
+	//pull out the candidates (in order, so ties break the way flash does)
+		for(uintptr_t col = reqOverlap; col <= maxPos; col++){
+			if(overHitA[col] >= (uintptr_t)minSeedHits){
+				candOver->push_back(col);
+			}
+		}
+		if(candOver->size() == 0){
+			return std::pair<uintptr_t,double>(0, 1.0/0.0);
+		}
+	return flashFindBestCandidateOverlap(seqL, qualL, seqR, qualR, candOver->size(), &((*candOver)[0]), maxExpOverlap, worstMR);
+}
+
+ProsynarMerger* factoryKmerSeedMerger(){
+	return new KmerSeedMerger();
+}
\ No newline at end of file
@@ -1,57 +1,17 @@
 #include "prosynar_task_naimerge.h"
 
-#include <math.h>
 #include <string.h>
 #include <algorithm>
 
 #include "whodun_parse_seq.h"
 
-void mergeIndelExpandedSequences(std::vector<int>* seqA, std::vector<double>* qualA, std::vector<int>* seqB, std::vector<double>* qualB, std::string* mergeSeq, std::vector<double>* mergeQual){
-	for(uintptr_t i = 0; i<seqA->size(); i++){
-		int sac = (*seqA)[i];
-		double lqac = (*qualA)[i];
-		int sbc = (*seqB)[i];
-		double lqbc = (*qualB)[i];
-		double errA = pow(10.0, lqac);
-		double errB = pow(10.0, lqbc);
-		if(lqac < lqbc){
-			if(sac >= 0){
-				mergeSeq->push_back(sac);
-				if(sac != sbc){
-					double numVal = errA * (1.0 - errB/3.0);
-					double denVal = errA + errB - 4*errA*errB/3.0;
-					mergeQual->push_back(log10(numVal/denVal));
-				}
-				else{
-					double numVal = errA*errB / 3;
-					double denVal = 1 - errA - errB + 4*errA*errB/3.0;
-					mergeQual->push_back(log10(numVal/denVal));
-				}
-			}
-		}
-		else{
-			if(sbc >= 0){
-				mergeSeq->push_back(sbc);
-				if(sac != sbc){
-					double numVal = errB * (1.0 - errA/3.0);
-					double denVal = errA + errB - 4*errA*errB/3.0;
-					mergeQual->push_back(log10(numVal/denVal));
-				}
-				else{
-					double numVal = errA*errB / 3;
-					double denVal = 1 - errA - errB + 4*errA*errB/3.0;
-					mergeQual->push_back(log10(numVal/denVal));
-				}
-			}
-		}
-	}
-}
-
 SimpleAlignMerger::SimpleAlignMerger(){
 	softReclaim = false;
 	reqOverlap = 1;
 	qualmFile = 0;
 	costReadFile = 0;
+	seedSize = 8;
+	minSeedHits = 0;
 	myMainDoc = "prosynar -- Malign [OPTION]\nMerge by aligning the sequences.\nThe OPTIONS are:\n";
 	myVersionDoc = "ProSynAr Malign 1.0";
 	myCopyrightDoc = "Copyright (C) 2019 UNT HSC Center for Human Identification";
@@ -67,6 +27,10 @@ SimpleAlignMerger::SimpleAlignMerger(){
 		qualmMeta.isFile = true;
 		qualmMeta.fileExts.insert(".bqualm");
 		addStringOption("--bqualm", &qualmFile, 0, "    Specify how to modify alignment parameters using quality.\n    --bqualm File.bqualm\n", &qualmMeta);
+	ArgumentParserIntMeta seedMeta("Seed Size");
+		addIntegerOption("--seedk", &seedSize, 0, "    Specify the size of the kmers to check for before aligning (at most 16).\n    --seedk 8\n", &seedMeta);
+	ArgumentParserIntMeta hitMeta("Seed Hit Threshold");
+		addIntegerOption("--seedhit", &minSeedHits, 0, "    Specify the number of kmers a pair must share to be aligned.\n    Zero aligns everything.\n    --seedhit 0\n", &hitMeta);
 }
 
 SimpleAlignMerger::~SimpleAlignMerger(){
@@ -98,6 +62,14 @@ int SimpleAlignMerger::posteriorCheck(){
 		argumentError = "Alignment parameter file required.";
 		return 1;
 	}
+	if((seedSize <= 0) || (seedSize > 16)){
+		argumentError = "Seed size must be between 1 and 16.";
+		return 1;
+	}
+	if(minSeedHits < 0){
+		argumentError = "Seed hit threshold must be non-negative.";
+		return 1;
+	}
 	return 0;
 }
 
@@ -115,24 +87,23 @@ void SimpleAlignMerger::initialize(ProsynarArgumentParser* baseArgs){
 		readStream(&redQFile, &qfileConts);
 		bigMang.parseQualityMangleSet(qfileConts.c_str(), qfileConts.c_str() + qfileConts.size());
 	}
-	cigLocSet.resize(baseArgs->numThread);
 	costSet.resize(baseArgs->numThread);
 	seqASet.resize(baseArgs->numThread);
 	seqqASet.resize(baseArgs->numThread);
-	seqqdASet.resize(baseArgs->numThread);
 	seqBSet.resize(baseArgs->numThread);
 	seqqBSet.resize(baseArgs->numThread);
-	seqqdBSet.resize(baseArgs->numThread);
-	seqILSet.resize(baseArgs->numThread);
-	seqdILSet.resize(baseArgs->numThread);
-	seqIRSet.resize(baseArgs->numThread);
-	seqdIRSet.resize(baseArgs->numThread);
+	mergeSet.resize(baseArgs->numThread);
 	saveAlns.resize(baseArgs->numThread);
+	kmerASet.resize(baseArgs->numThread);
+	kmerBSet.resize(baseArgs->numThread);
+	seedPruneSet.resize(baseArgs->numThread);
 	LinearPairwiseAlignmentIteration* nullIt = 0;
 	runIters.insert(runIters.end(), baseArgs->numThread, nullIt);
 }
 
-int SimpleAlignMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep){
+int SimpleAlignMerger::buildMerge(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep){
+	CRBSAMFileContents* read1 = pairCtx->reads[0];
+	CRBSAMFileContents* read2 = pairCtx->reads[1];
 	const char* read1SStart = &(read1->entrySeq[0]);
 	const char* read1QStart = &(read1->entryQual[0]);
 	uintptr_t read1SLen = read1->entrySeq.size();
@@ -140,30 +111,11 @@ int SimpleAlignMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSA
 	const char* read2QStart = &(read2->entryQual[0]);
 	uintptr_t read2SLen = read2->entrySeq.size();
 	if(!softReclaim){
-		std::vector<intptr_t>* cigVec = &(cigLocSet[threadInd]);
 		//expand the cigars (really want the soft clips)
-		std::pair<uintptr_t,uintptr_t> read1SClip;
-		try{
-			cigVec->clear();
-			read1SClip = cigarStringToReferencePositions(read1->entryPos, &(read1->entryCigar), cigVec);
-		}catch(std::exception& err){
-			errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
-			errRep->push_back(':');
-			errRep->push_back(' ');
-			errRep->append(err.what());
-			return -1;
-		}
-		std::pair<uintptr_t,uintptr_t> read2SClip;
-		try{
-			cigVec->clear();
-			read2SClip = cigarStringToReferencePositions(read2->entryPos, &(read2->entryCigar), cigVec);
-		}catch(std::exception& err){
-			errRep->insert(errRep->end(),read2->entryName.begin(), read2->entryName.end());
-			errRep->push_back(':');
-			errRep->push_back(' ');
-			errRep->append(err.what());
-			return -1;
-		}
+		if(pairCtx->expandCigar(0, errRep)){ return -1; }
+		if(pairCtx->expandCigar(1, errRep)){ return -1; }
+		std::pair<uintptr_t,uintptr_t> read1SClip = pairCtx->softClips[0];
+		std::pair<uintptr_t,uintptr_t> read2SClip = pairCtx->softClips[1];
 		//do the clipping
 		read1SStart += read1SClip.first;
 		read1QStart += read1SClip.first;
@@ -179,16 +131,20 @@ int SimpleAlignMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSA
 	//get the stuff
 		std::string* seqA = &(seqASet[threadInd]);
 		std::vector<char>* seqAQ = &(seqqASet[threadInd]);
-		std::vector<double>* seqAQD = &(seqqdASet[threadInd]);
 			seqA->clear(); seqA->insert(seqA->end(), read1SStart, read1SStart + read1SLen);
 			seqAQ->clear(); seqAQ->insert(seqAQ->end(), read1QStart, read1QStart + read1SLen);
-			seqAQD->resize(read1SLen); fastaPhredsToLog10Prob(read1SLen, (const unsigned char*)read1QStart, &((*seqAQD)[0]));
 		std::string* seqB = &(seqBSet[threadInd]);
 		std::vector<char>* seqBQ = &(seqqBSet[threadInd]);
-		std::vector<double>* seqBQD = &(seqqdBSet[threadInd]);
 			seqB->clear(); seqB->insert(seqB->end(), read2SStart, read2SStart + read2SLen);
 			seqBQ->clear(); seqBQ->insert(seqBQ->end(), read2QStart, read2QStart + read2SLen);
-			seqBQD->resize(read2SLen); fastaPhredsToLog10Prob(read2SLen, (const unsigned char*)read2QStart, &((*seqBQD)[0]));
+	//cheap check for any shared sequence
+		if(minSeedHits){
+			uintptr_t numShare = alignMergeCountSharedKmers(seqA, seqB, seedSize, &(kmerASet[threadInd]), &(kmerBSet[threadInd]));
+			if(numShare < (uintptr_t)minSeedHits){
+				seedPruneSet[threadInd]++;
+				return 1;
+			}
+		}
 	//mangle the alignment parameters
 		PositionDependentCostKDTree* useCost = &bigCost;
 		if(qualmFile){
@@ -216,109 +172,108 @@ int SimpleAlignMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSA
 		if(!wasAln){
 			return 1;
 		}
-		uintptr_t alnLen = curIter->aInds.size();
-	//expand out indels
-		std::vector<int>* seqIL = &(seqILSet[threadInd]);
-		std::vector<double>* seqdIL = &(seqdILSet[threadInd]);
-		seqIL->clear(); seqdIL->clear();
-		std::vector<int>* seqIR = &(seqIRSet[threadInd]);
-		std::vector<double>* seqdIR = &(seqdIRSet[threadInd]);
-		seqIR->clear(); seqdIR->clear();
-		for(uintptr_t i = 1; i<alnLen; i++){
-			if(curIter->aInds[i] != curIter->aInds[i-1]){
-				if(curIter->bInds[i] != curIter->bInds[i-1]){
-					//consume both
-					seqIL->push_back((*seqA)[curIter->aInds[i-1]]);
-					seqdIL->push_back((*seqAQD)[curIter->aInds[i-1]]);
-					seqIR->push_back((*seqB)[curIter->bInds[i-1]]);
-					seqdIR->push_back((*seqBQD)[curIter->bInds[i-1]]);
-				}
-				else{
-					//insert a, skip b
-					seqIL->push_back((*seqA)[curIter->aInds[i-1]]);
-					seqdIL->push_back((*seqAQD)[curIter->aInds[i-1]]);
-					seqIR->push_back(-1);
-					seqdIR->push_back(0.0);
-				}
-			}
-			else{
-				//insert b, skip a
-				seqIL->push_back(-1);
-				seqdIL->push_back(0.0);
-				seqIR->push_back((*seqB)[curIter->bInds[i-1]]);
-				seqdIR->push_back((*seqBQD)[curIter->bInds[i-1]]);
-			}
-		}
-	//fill in any indel qualities
-		uintptr_t ai = 0;
-		while(ai < seqIL->size()){
-			if((*seqIL)[ai] >= 0){
-				ai++; continue;
-			}
-			uintptr_t nai = ai + 1;
-			while((nai < seqIL->size()) && ((*seqIL)[nai] < 0)){
-				nai++;
-			}
-			double winQual;
-			if(ai && (nai < seqIL->size())){
-				double leftQ = (*seqdIL)[ai-1];
-				double rightQ = (*seqdIL)[nai];
-				winQual = log10((pow(10.0, leftQ) + pow(10.0, rightQ))/2.0);
-			}
-			else if(ai){ winQual = (*seqdIL)[ai-1]; }
-			else if(nai < seqIL->size()){ winQual = (*seqdIL)[nai]; }
-			else{ winQual = -1.0 / 0.0; }
-			for(uintptr_t ci = ai; ci < nai; ci++){
-				(*seqdIL)[ci] = winQual;
-			}
-			ai = nai;
-		}
-		uintptr_t bi = 0;
-		while(bi < seqIL->size()){
-			if((*seqIL)[bi] >= 0){
-				bi++; continue;
-			}
-			uintptr_t nbi = bi + 1;
-			while((nbi < seqIL->size()) && ((*seqIL)[nbi] < 0)){
-				nbi++;
-			}
-			double winQual;
-			if(bi && (nbi < seqIL->size())){
-				double leftQ = (*seqdIL)[bi-1];
-				double rightQ = (*seqdIL)[nbi];
-				winQual = log10((pow(10.0, leftQ) + pow(10.0, rightQ))/2.0);
-			}
-			else if(bi){ winQual = (*seqdIL)[bi-1]; }
-			else if(nbi < seqIL->size()){ winQual = (*seqdIL)[nbi]; }
-			else{ winQual = -1.0 / 0.0; }
-			for(uintptr_t ci = bi; ci < nbi; ci++){
-				(*seqdIL)[ci] = winQual;
-			}
-			bi = nbi;
-		}
 	//do the merge
-		mergeSeq->clear(); mergeQual->clear();
-		//prefix
-		if(curIter->aInds[0] != 0){
-			mergeSeq->insert(mergeSeq->end(), seqA->begin(), seqA->begin() + curIter->aInds[0]);
-			mergeQual->insert(mergeQual->end(), seqAQD->begin(), seqAQD->begin() + curIter->aInds[0]);
-		}
-		else{
-			mergeSeq->insert(mergeSeq->end(), seqB->begin(), seqB->begin() + curIter->bInds[0]);
-			mergeQual->insert(mergeQual->end(), seqBQD->begin(), seqBQD->begin() + curIter->bInds[0]);
+		AlignedSequenceMerger* curMerge = &(mergeSet[threadInd]);
+		try{
+			curMerge->changeFocus(read1SLen, read1SStart, read1QStart, read2SLen, read2SStart, read2QStart, curIter);
+			curMerge->expandIndels();
+			curMerge->addInPrefix();
+			curMerge->mergeOverlap();
+			curMerge->addInSuffix();
+		}catch(std::exception& err){
+			errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
+			errRep->push_back(':');
+			errRep->push_back(' ');
+			errRep->append(err.what());
+			return -1;
 		}
-		//overlap
-		mergeIndelExpandedSequences(seqIL, seqdIL, seqIR, seqdIR, mergeSeq, mergeQual);
-		//suffix
-		if((uintptr_t)(curIter->aInds[alnLen-1]) < seqA->size()){
-			mergeSeq->insert(mergeSeq->end(), seqA->begin() + curIter->aInds[alnLen-1], seqA->end());
-			mergeQual->insert(mergeQual->end(), seqAQD->begin() + curIter->aInds[alnLen-1], seqAQD->end());
+	return 0;
+}
+
+int SimpleAlignMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep){
+	ProsynarPairContext pairCtx;
+	pairCtx.changePair(saveArgs, read1, read2);
+	return mergePair(threadInd, &pairCtx, mergeSeq, mergeQual, errRep);
+}
+
+int SimpleAlignMerger::mergePair(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep){
+	int buildR = buildMerge(threadInd, pairCtx, errRep);
+	if(buildR){ return buildR; }
+	mergeSet[threadInd].getMerged(mergeSeq, mergeQual);
+	return 0;
+}
+
+bool SimpleAlignMerger::havePhredMerge(){
+	return true;
+}
+
+int SimpleAlignMerger::mergePairPhred(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::string* mergePhred, std::string* errRep){
+	ProsynarPairContext pairCtx;
+	pairCtx.changePair(saveArgs, read1, read2);
+	return mergePairPhred(threadInd, &pairCtx, mergeSeq, mergePhred, errRep);
+}
+
+int SimpleAlignMerger::mergePairPhred(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::string* mergePhred, std::string* errRep){
+	int buildR = buildMerge(threadInd, pairCtx, errRep);
+	if(buildR){ return buildR; }
+	mergeSet[threadInd].getMergedPhred(mergeSeq, mergePhred);
+	return 0;
+}
+
+void SimpleAlignMerger::getPruneCounts(std::map<std::string,uintptr_t>* toFill){
+	uintptr_t totPrune = 0;
+	for(uintptr_t i = 0; i<seedPruneSet.size(); i++){
+		totPrune += seedPruneSet[i];
+	}
+	(*toFill)["kmer seed"] += totPrune;
+}
+
+/**
+ * Get the (two bit packed) kmers in a sequence, sorted and without duplicates.
+ * @param seq The sequence.
+ * @param kmerSize The size of the kmers.
+ * @param toFill The place to put the kmers.
+ */
+void alignMergeGetKmers(std::string* seq, uintptr_t kmerSize, std::vector<uint32_t>* toFill){
+	toFill->clear();
+	uint32_t kmerMask = (kmerSize >= 16) ? 0xFFFFFFFF : ((((uint32_t)1) << (2*kmerSize)) - 1);
+	uint32_t curKmer = 0;
+	uintptr_t curRun = 0;
+	for(uintptr_t i = 0; i<seq->size(); i++){
+		uint32_t curCode;
+		switch((*seq)[i]){
+			case 'A': case 'a': curCode = 0; break;
+			case 'C': case 'c': curCode = 1; break;
+			case 'G': case 'g': curCode = 2; break;
+			case 'T': case 't': curCode = 3; break;
+			default:
+				curRun = 0;
+				continue;
 		}
-		else{
-			mergeSeq->insert(mergeSeq->end(), seqB->begin() + curIter->bInds[alnLen-1], seqB->end());
-			mergeQual->insert(mergeQual->end(), seqBQD->begin() + curIter->bInds[alnLen-1], seqBQD->end());
+		curKmer = ((curKmer << 2) | curCode) & kmerMask;
+		curRun++;
+		if(curRun >= kmerSize){
+			toFill->push_back(curKmer);
 		}
-	return 0;
+	}
+	std::sort(toFill->begin(), toFill->end());
+	toFill->erase(std::unique(toFill->begin(), toFill->end()), toFill->end());
+}
+
+uintptr_t alignMergeCountSharedKmers(std::string* seqA, std::string* seqB, uintptr_t kmerSize, std::vector<uint32_t>* kmerA, std::vector<uint32_t>* kmerB){
+	alignMergeGetKmers(seqA, kmerSize, kmerA);
+	alignMergeGetKmers(seqB, kmerSize, kmerB);
+	uintptr_t numShare = 0;
+	uintptr_t ia = 0;
+	uintptr_t ib = 0;
+	while((ia < kmerA->size()) && (ib < kmerB->size())){
+		uint32_t curA = (*kmerA)[ia];
+		uint32_t curB = (*kmerB)[ib];
+		if(curA < curB){ ia++; }
+		else if(curB < curA){ ib++; }
+		else{ numShare++; ia++; ib++; }
+	}
+	return numShare;
 }
 
 ProsynarMerger* factorySimpleAlignMerger(){
@@ -8,7 +8,10 @@
 
 #include "whodun_probutil.h"
 #include "whodun_parse_seq.h"
-#include "prosynar_task_naimerge.h"
+#include "whodun_stringext_seq.h"
+
+/**Room for rounding error when comparing against a bound.*/
+#define PEAR_CEIL_SLOP 1e-9
 
 PEARMerger::PEARMerger(){
 	softReclaim = false;
@@ -71,7 +74,6 @@ int PEARMerger::posteriorCheck(){
 
 void PEARMerger::initialize(ProsynarArgumentParser* baseArgs){
 	saveArgs = baseArgs;
-	cigLocSet.resize(baseArgs->numThread);
 	seqASet.resize(baseArgs->numThread);
 	seqqASet.resize(baseArgs->numThread);
 	seqqdASet.resize(baseArgs->numThread);
@@ -81,44 +83,40 @@ void PEARMerger::initialize(ProsynarArgumentParser* baseArgs){
 	seqBRSet.resize(baseArgs->numThread);
 	seqqBRSet.resize(baseArgs->numThread);
 	seqqdBRSet.resize(baseArgs->numThread);
-	seqILSet.resize(baseArgs->numThread);
-	seqdILSet.resize(baseArgs->numThread);
-	seqIRSet.resize(baseArgs->numThread);
-	seqdIRSet.resize(baseArgs->numThread);
+	mergeSet.resize(baseArgs->numThread);
+	pvalPruneSet.resize(baseArgs->numThread);
+	for(uintptr_t i = 0; i<mergeSet.size(); i++){
+		mergeSet[i].changeMethod(origRecipe ? ALIGNMERGE_METHOD_PEAR : ALIGNMERGE_METHOD_POSTERIOR);
+	}
 }
 
-/**
- * Find the best overlap using the flash method.
- * @param seqL The left sequence.
- * @param qualL The left quality;
- * @param seqR The right sequence.
- * @param qualR The right quality.
- * @param matPts The points for a match.
- * @param mmatPts The points for a mismatch.
- * @return The number of bases of overlap, and the score.
- */
-std::pair<uintptr_t,double> pearFindBestOverlap(std::vector<char>* seqL, std::vector<double>* qualL, std::vector<char>* seqR, std::vector<double>* qualR, double matPts, double mmatPts){
+std::pair<uintptr_t,double> pearFindBestOverlap(std::vector<char>* seqL, std::vector<double>* qualL, std::vector<char>* seqR, std::vector<double>* qualR, double matPts, double mmatPts, double beatScore){
 	double winScore = -1.0/0.0;
 	uintptr_t winOver = 0;
 	uintptr_t maxPos = std::min(seqL->size(), seqR->size());
+	//the most a single base can add (both terms are a fraction of the points)
+	double baseCeil = std::max(0.0, std::max(matPts, mmatPts));
 	//count the base frequencies
+	uintptr_t allCounts[256];
+	memset(allCounts, 0, 256*sizeof(uintptr_t));
+	membytecount(&((*seqL)[0]), seqL->size(), allCounts);
+	membytecount(&((*seqR)[0]), seqR->size(), allCounts);
 	double allFreqs[256];
-	memset(allFreqs, 0, 256*sizeof(double));
-	for(uintptr_t i = 0; i<seqL->size(); i++){
-		allFreqs[(*seqL)[i] & 0x00FF] += 1.0;
-	}
-	for(uintptr_t i = 0; i<seqR->size(); i++){
-		allFreqs[(*seqR)[i] & 0x00FF] += 1.0;
-	}
 	uintptr_t totNBase = seqL->size() + seqR->size();
 	for(uintptr_t i = 0; i<256; i++){
-		allFreqs[i] = allFreqs[i] / totNBase;
+		allFreqs[i] = ((double)allCounts[i]) / totNBase;
 	}
 	//get the best score
 	for(uintptr_t col = 1; col <= maxPos; col++){
 		uintptr_t sli0 = seqL->size() - col;
 		double curScore = 0.0;
+		double needScore = std::max(winScore, beatScore) - PEAR_CEIL_SLOP;
+		bool curAbandon = false;
 		for(uintptr_t i = 0; i<col; i++){
+			if((curScore + baseCeil*(col - i)) < needScore){
+				curAbandon = true;
+				break;
+			}
 			unsigned char baseL = 0x00FF & ((*seqL)[sli0 + i]);
 			unsigned char baseR = 0x00FF & ((*seqR)[i]);
 			double errL = pow(10.0, (*qualL)[sli0 + i]);
@@ -154,6 +152,9 @@ std::pair<uintptr_t,double> pearFindBestOverlap(std::vector<char>* seqL, std::ve
 				curScore += mmatPts*(1.0-curPro);
 			}
 		}
+		if(curAbandon){
+			continue;
+		}
 		if(curScore > winScore){
 			winScore = curScore;
 			winOver = col;
@@ -162,7 +163,9 @@ std::pair<uintptr_t,double> pearFindBestOverlap(std::vector<char>* seqL, std::ve
 	return std::pair<uintptr_t,double>(winOver,winScore);
 }
 
-int PEARMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep){
+int PEARMerger::buildMerge(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep){
+	CRBSAMFileContents* read1 = pairCtx->reads[0];
+	CRBSAMFileContents* read2 = pairCtx->reads[1];
 	const char* read1SStart = &(read1->entrySeq[0]);
 	const char* read1QStart = &(read1->entryQual[0]);
 	uintptr_t read1SLen = read1->entrySeq.size();
@@ -170,30 +173,11 @@ int PEARMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileCo
 	const char* read2QStart = &(read2->entryQual[0]);
 	uintptr_t read2SLen = read2->entrySeq.size();
 	if(!softReclaim){
-		std::vector<intptr_t>* cigVec = &(cigLocSet[threadInd]);
 		//expand the cigars (really want the soft clips)
-		std::pair<uintptr_t,uintptr_t> read1SClip;
-		try{
-			cigVec->clear();
-			read1SClip = cigarStringToReferencePositions(read1->entryPos, &(read1->entryCigar), cigVec);
-		}catch(std::exception& err){
-			errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
-			errRep->push_back(':');
-			errRep->push_back(' ');
-			errRep->append(err.what());
-			return -1;
-		}
-		std::pair<uintptr_t,uintptr_t> read2SClip;
-		try{
-			cigVec->clear();
-			read2SClip = cigarStringToReferencePositions(read2->entryPos, &(read2->entryCigar), cigVec);
-		}catch(std::exception& err){
-			errRep->insert(errRep->end(),read2->entryName.begin(), read2->entryName.end());
-			errRep->push_back(':');
-			errRep->push_back(' ');
-			errRep->append(err.what());
-			return -1;
-		}
+		if(pairCtx->expandCigar(0, errRep)){ return -1; }
+		if(pairCtx->expandCigar(1, errRep)){ return -1; }
+		std::pair<uintptr_t,uintptr_t> read1SClip = pairCtx->softClips[0];
+		std::pair<uintptr_t,uintptr_t> read2SClip = pairCtx->softClips[1];
 		//do the clipping
 		read1SStart += read1SClip.first;
 		read1QStart += read1SClip.first;
@@ -212,13 +196,15 @@ int PEARMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileCo
 		std::vector<double>* seqAQD = &(seqqdASet[threadInd]);
 			seqA->clear(); seqA->insert(seqA->end(), read1SStart, read1SStart + read1SLen);
 			seqAQ->clear(); seqAQ->insert(seqAQ->end(), read1QStart, read1QStart + read1SLen);
-			seqAQD->resize(read1SLen); fastaPhredsToLog10Prob(read1SLen, (const unsigned char*)read1QStart, &((*seqAQD)[0]));
+			double* read1QDStart = pairCtx->getQualLog10(0) + (read1QStart - &(read1->entryQual[0]));
+			seqAQD->clear(); seqAQD->insert(seqAQD->end(), read1QDStart, read1QDStart + read1SLen);
 		std::vector<char>* seqB = &(seqBSet[threadInd]);
 		std::vector<char>* seqBQ = &(seqqBSet[threadInd]);
 		std::vector<double>* seqBQD = &(seqqdBSet[threadInd]);
 			seqB->clear(); seqB->insert(seqB->end(), read2SStart, read2SStart + read2SLen);
 			seqBQ->clear(); seqBQ->insert(seqBQ->end(), read2QStart, read2QStart + read2SLen);
-			seqBQD->resize(read2SLen); fastaPhredsToLog10Prob(read2SLen, (const unsigned char*)read2QStart, &((*seqBQD)[0]));
+			double* read2QDStart = pairCtx->getQualLog10(1) + (read2QStart - &(read2->entryQual[0]));
+			seqBQD->clear(); seqBQD->insert(seqBQD->end(), read2QDStart, read2QDStart + read2SLen);
 		std::vector<char>* seqBR = &(seqBRSet[threadInd]);
 		std::vector<char>* seqBRQ = &(seqqBRSet[threadInd]);
 		std::vector<double>* seqBRQD = &(seqqdBRSet[threadInd]);
@@ -226,29 +212,27 @@ int PEARMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileCo
 			seqBRQ->clear(); seqBRQ->insert(seqBRQ->end(), read2QStart, read2QStart + read2SLen);
 			seqBRQD->clear(); seqBRQD->insert(seqBRQD->end(), seqBQD->begin(), seqBQD->end());
 			sequenceReverseCompliment(read2SLen, &((*seqBR)[0]), &((*seqBRQD)[0]));
-			std::reverse(seqBRQ->begin(), seqBRQ->end());
-	//start walking
-		std::pair<uintptr_t,double> resAB = pearFindBestOverlap(seqA, seqAQD, seqB, seqBQD, matchPoints, mismatchPoints);
-		std::pair<uintptr_t,double> resBA = pearFindBestOverlap(seqB, seqBQD, seqA, seqAQD, matchPoints, mismatchPoints);
-		std::pair<uintptr_t,double> resAR = pearFindBestOverlap(seqA, seqAQD, seqBR, seqBRQD, matchPoints, mismatchPoints);
-		std::pair<uintptr_t,double> resRA = pearFindBestOverlap(seqBR, seqBRQD, seqA, seqAQD, matchPoints, mismatchPoints);
-	//winner winner
-		std::vector<char>* winL = seqA; /*std::vector<char>* winLQ = seqAQ;*/ std::vector<double>* winLQD = seqAQD;
-		std::vector<char>* winR = seqB; /*std::vector<char>* winRQ = seqBQ;*/ std::vector<double>* winRQD = seqBQD;
-		std::pair<uintptr_t,double> winRes = resAB;
+			memreverse(&((*seqBRQ)[0]), seqBRQ->size());
+	//start walking (later orientations only need to beat what was already found)
+		std::vector<char>* winL = seqA; std::vector<char>* winLQ = seqAQ;
+		std::vector<char>* winR = seqB; std::vector<char>* winRQ = seqBQ;
+		std::pair<uintptr_t,double> winRes = pearFindBestOverlap(seqA, seqAQD, seqB, seqBQD, matchPoints, mismatchPoints, -1.0/0.0);
+		std::pair<uintptr_t,double> resBA = pearFindBestOverlap(seqB, seqBQD, seqA, seqAQD, matchPoints, mismatchPoints, winRes.second);
 		if(resBA.second > winRes.second){
-			winL = seqB; /*winLQ = seqBQ;*/ winLQD = seqBQD;
-			winR = seqA; /*winRQ = seqAQ;*/ winRQD = seqAQD;
+			winL = seqB; winLQ = seqBQ;
+			winR = seqA; winRQ = seqAQ;
 			winRes = resBA;
 		}
+		std::pair<uintptr_t,double> resAR = pearFindBestOverlap(seqA, seqAQD, seqBR, seqBRQD, matchPoints, mismatchPoints, winRes.second);
 		if(resAR.second > winRes.second){
-			winL = seqA; /*winLQ = seqAQ;*/ winLQD = seqAQD;
-			winR = seqBR; /*winRQ = seqBRQ;*/ winRQD = seqBRQD;
+			winL = seqA; winLQ = seqAQ;
+			winR = seqBR; winRQ = seqBRQ;
 			winRes = resAR;
 		}
+		std::pair<uintptr_t,double> resRA = pearFindBestOverlap(seqBR, seqBRQD, seqA, seqAQD, matchPoints, mismatchPoints, winRes.second);
 		if(resRA.second > winRes.second){
-			winL = seqBR; /*winLQ = seqBRQ;*/ winLQD = seqBRQD;
-			winR = seqA; /*winRQ = seqAQ;*/ winRQD = seqAQD;
+			winL = seqBR; winLQ = seqBRQ;
+			winR = seqA; winRQ = seqAQ;
 			winRes = resRA;
 		}
 	//if too short, stop
@@ -256,17 +240,14 @@ int PEARMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileCo
 			return 1;
 		}
 	//count the base frequencies
+		uintptr_t allCounts[256];
+		memset(allCounts, 0, 256*sizeof(uintptr_t));
+		membytecount(&((*winL)[0]), winL->size(), allCounts);
+		membytecount(&((*winR)[0]), winR->size(), allCounts);
 		double allFreqs[256];
-		memset(allFreqs, 0, 256*sizeof(double));
-		for(uintptr_t i = 0; i<winL->size(); i++){
-			allFreqs[(*winL)[i] & 0x00FF] += 1.0;
-		}
-		for(uintptr_t i = 0; i<winR->size(); i++){
-			allFreqs[(*winR)[i] & 0x00FF] += 1.0;
-		}
 		uintptr_t totNBase = winL->size() + winR->size();
 		for(uintptr_t i = 0; i<256; i++){
-			allFreqs[i] = allFreqs[i] / totNBase;
+			allFreqs[i] = ((double)allCounts[i]) / totNBase;
 		}
 	//score p-test
 		double ranMatP = 0.0;
@@ -280,6 +261,7 @@ int PEARMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileCo
 		uintptr_t curOver = testObsOver ? winRes.first : reqOverlap;
 		uintptr_t maxOver = 2 * std::max(winL->size(), winR->size());
 		double totL10Pro = 0.0;
+		double failL10Pro = log10(1.0 - sigLevel) - PEAR_CEIL_SLOP;
 		while(curOver < maxOver){
 			double addToD = ceil((winRes.second - mismatchPoints*curOver) / (matchPoints - mismatchPoints)) - 1;
 			if(addToD < 0){ curOver++; continue; }
@@ -301,6 +283,11 @@ int PEARMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileCo
 			*/
 			totL10Pro += curL10Mul;
 			curOver++;
+			//every term is a log probability: once failed, will stay failed
+			if(totL10Pro < failL10Pro){
+				pvalPruneSet[threadInd]++;
+				return 1;
+			}
 		}
 		double pvalue = 1.0 - pow(10.0, totL10Pro);
 	//decide
@@ -308,55 +295,53 @@ int PEARMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileCo
 			return 1;
 		}
 	//chicken dinner
-		mergeSeq->clear(); mergeQual->clear();
-		if(origRecipe){
-			uintptr_t sli0 = winL->size() - winRes.first;
-			for(uintptr_t i = 0; i<sli0; i++){
-				mergeSeq->push_back((*winL)[i]);
-				mergeQual->push_back((*winLQD)[i]);
-			}
-			for(uintptr_t i = 0; i<winRes.first; i++){
-				char optL = (*winL)[sli0+i];
-				double optLQ = (*winLQD)[sli0+i];
-				char optR = (*winR)[i];
-				double optRQ = (*winRQD)[i];
-				if(optLQ < optRQ){
-					mergeSeq->push_back(optL);
-					mergeQual->push_back( (optL == optR) ? (optLQ + optRQ) : optLQ);
-				}
-				else{
-					mergeSeq->push_back(optR);
-					mergeQual->push_back( (optL == optR) ? (optLQ + optRQ) : optRQ);
-				}
-			}
-			for(uintptr_t i = winRes.first; i<winR->size(); i++){
-				mergeSeq->push_back((*winR)[i]);
-				mergeQual->push_back((*winRQD)[i]);
-			}
-		}
-		else{
-			uintptr_t sli0 = winL->size() - winRes.first;
-			mergeSeq->insert(mergeSeq->end(), winL->begin(), winL->begin() + sli0);
-			mergeQual->insert(mergeQual->end(), winLQD->begin(), winLQD->begin() + sli0);
-			std::vector<int>* seqIL = &(seqILSet[threadInd]);
-			std::vector<double>* seqdIL = &(seqdILSet[threadInd]);
-			seqIL->clear(); seqdIL->clear();
-			std::vector<int>* seqIR = &(seqIRSet[threadInd]);
-			std::vector<double>* seqdIR = &(seqdIRSet[threadInd]);
-			seqIR->clear(); seqdIR->clear();
-			for(uintptr_t i = 0; i<winRes.first; i++){
-				seqIL->push_back(0x00FF & (*winL)[sli0+i]);
-				seqdIL->push_back((*winLQD)[sli0+i]);
-				seqIR->push_back(0x00FF & (*winR)[i]);
-				seqdIR->push_back((*winRQD)[i]);
-			}
-			mergeIndelExpandedSequences(seqIL, seqdIL, seqIR, seqdIR, mergeSeq, mergeQual);
-			mergeSeq->insert(mergeSeq->end(), winR->begin() + winRes.first, winR->begin() + winR->size());
-			mergeQual->insert(mergeQual->end(), winRQD->begin() + winRes.first, winRQD->begin() + winRQD->size());
-		}
+		AlignedSequenceMerger* curMerge = &(mergeSet[threadInd]);
+		curMerge->changeFocus(winL->size(), &((*winL)[0]), &((*winLQ)[0]), winR->size(), &((*winR)[0]), &((*winRQ)[0]), winRes.first);
+		curMerge->expandIndels();
+		curMerge->addInPrefix();
+		curMerge->mergeOverlap();
+		curMerge->addInSuffix();
+	return 0;
+}
+
+int PEARMerger::mergePair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep){
+	ProsynarPairContext pairCtx;
+	pairCtx.changePair(saveArgs, read1, read2);
+	return mergePair(threadInd, &pairCtx, mergeSeq, mergeQual, errRep);
+}
+
+int PEARMerger::mergePair(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::vector<double>* mergeQual, std::string* errRep){
+	int buildR = buildMerge(threadInd, pairCtx, errRep);
+	if(buildR){ return buildR; }
+	mergeSet[threadInd].getMerged(mergeSeq, mergeQual);
+	return 0;
+}
+
+bool PEARMerger::havePhredMerge(){
+	return true;
+}
+
+int PEARMerger::mergePairPhred(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* mergeSeq, std::string* mergePhred, std::string* errRep){
+	ProsynarPairContext pairCtx;
+	pairCtx.changePair(saveArgs, read1, read2);
+	return mergePairPhred(threadInd, &pairCtx, mergeSeq, mergePhred, errRep);
+}
+
+int PEARMerger::mergePairPhred(int threadInd, ProsynarPairContext* pairCtx, std::string* mergeSeq, std::string* mergePhred, std::string* errRep){
+	int buildR = buildMerge(threadInd, pairCtx, errRep);
+	if(buildR){ return buildR; }
+	mergeSet[threadInd].getMergedPhred(mergeSeq, mergePhred);
 	return 0;
 }
 
+void PEARMerger::getPruneCounts(std::map<std::string,uintptr_t>* toFill){
+	uintptr_t totPrune = 0;
+	for(uintptr_t i = 0; i<pvalPruneSet.size(); i++){
+		totPrune += pvalPruneSet[i];
+	}
+	(*toFill)["p-value bound"] += totPrune;
+}
+
 ProsynarMerger* factoryPearMerger(){
 	return new PEARMerger();
 }
@@ -41,42 +41,22 @@ int ReferenceOverlapFilter::posteriorCheck(){
 
 void ReferenceOverlapFilter::initialize(ProsynarArgumentParser* baseArgs){
 	saveArgs = baseArgs;
-	cigLocSet.resize(baseArgs->numThread);
-	nameTmpSet.resize(baseArgs->numThread);
 }
 
 int ReferenceOverlapFilter::filterPair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* errRep){
-	std::vector<intptr_t>* cigVec = &(cigLocSet[threadInd]);
-	//should both be mapped
-	if((read1->entryPos < 0) || (read2->entryPos < 0)){ return 0; }
-	if((read1->entryReference.size() == 0) || (read2->entryReference.size() == 0)){ return 0; }
-	//should both be on the same reference
-	if((read1->entryReference.size() != read2->entryReference.size()) || (memcmp(&(read1->entryReference[0]), &(read2->entryReference[0]), read1->entryReference.size())!=0)){ return 0; }
+	ProsynarPairContext pairCtx;
+	pairCtx.changePair(saveArgs, read1, read2);
+	return filterPair(threadInd, &pairCtx, errRep);
+}
+
+int ReferenceOverlapFilter::filterPair(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep){
+	//should both be mapped, on the same reference
+	if(!(pairCtx->sameReference())){ return 0; }
 	//expand the cigars, figure the bounds
-	std::pair<intptr_t,intptr_t> read1B;
-	try{
-		cigVec->clear();
-		/*std::pair<uintptr_t,uintptr_t> mainSClip = */cigarStringToReferencePositions(read1->entryPos, &(read1->entryCigar), cigVec);;
-		read1B = getCigarReferenceBounds(cigVec);
-	}catch(std::exception& err){
-		errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
-		errRep->push_back(':');
-		errRep->push_back(' ');
-		errRep->append(err.what());
-		return 0;
-	}
-	std::pair<intptr_t,intptr_t> read2B;
-	try{
-		cigVec->clear();
-		/*std::pair<uintptr_t,uintptr_t> mainSClip = */cigarStringToReferencePositions(read2->entryPos, &(read2->entryCigar), cigVec);;
-		read2B = getCigarReferenceBounds(cigVec);
-	}catch(std::exception& err){
-		errRep->insert(errRep->end(),read2->entryName.begin(), read2->entryName.end());
-		errRep->push_back(':');
-		errRep->push_back(' ');
-		errRep->append(err.what());
-		return 0;
-	}
+	if(pairCtx->expandCigar(0, errRep)){ return 0; }
+	if(pairCtx->expandCigar(1, errRep)){ return 0; }
+	std::pair<intptr_t,intptr_t> read1B = pairCtx->refBounds[0];
+	std::pair<intptr_t,intptr_t> read2B = pairCtx->refBounds[1];
 	//make sure they are mapped
 	if(read1B.first < 0){ return 0; }
 	if(read2B.first < 0){ return 0; }
@@ -91,6 +71,18 @@ int ReferenceOverlapFilter::filterPair(int threadInd, CRBSAMFileContents* read1,
 	return 1;
 }
 
+bool ReferenceOverlapFilter::quickReject(ProsynarPairContext* pairCtx){
+	if(!(pairCtx->sameReference())){ return true; }
+	//the aligned bases are somewhere in the stretch the cigar covers
+	CRBSAMFileContents* read1 = pairCtx->reads[0];
+	CRBSAMFileContents* read2 = pairCtx->reads[1];
+	intptr_t read1S = cigarStringReferenceSpan(&(read1->entryCigar));
+	intptr_t read2S = cigarStringReferenceSpan(&(read2->entryCigar));
+	if((read1S <= 0) || (read2S <= 0)){ return false; }
+	intptr_t maxOver = std::min(read1->entryPos + read1S, read2->entryPos + read2S) - 1 - std::max(read1->entryPos, read2->entryPos);
+	return maxOver < reqOverlap;
+}
+
 ProsynarFilter* factoryReferenceOverlapFilter(){
 	return new ReferenceOverlapFilter();
 }
@@ -223,19 +215,19 @@ void ProbabilisticReferenceOverlapFilter::initialize(ProsynarArgumentParser* bas
 	else{
 		useQualMangs = &allQualMangs;
 	}
+	//lay them out by reference id
+	prosynarTableByReferenceID(saveArgs, useRegCosts, &idRegCosts);
+	prosynarTableByReferenceID(saveArgs, useQualMangs, &idQualMangs);
 	//prepare thread local storage
-	nameTmpSet.resize(baseArgs->numThread);
 	alnBndsSet1.resize(baseArgs->numThread);
 	alnProsSet1.resize(baseArgs->numThread);
 	alnBndsSet2.resize(baseArgs->numThread);
 	alnProsSet2.resize(baseArgs->numThread);
-	cigLocSet.resize(baseArgs->numThread);
 	refTmpSet.resize(baseArgs->numThread);
 	readTmpSet.resize(baseArgs->numThread);
 	readQTmpSet.resize(baseArgs->numThread);
 	scoreSet.resize(baseArgs->numThread);
 	scoreSeenSet.resize(baseArgs->numThread);
-	readQPTmpSet.resize(baseArgs->numThread);
 	for(uintptr_t i = 0; i<(uintptr_t)(baseArgs->numThread); i++){
 		scoreSet[i].resize(uptoRank+1);
 	}
@@ -251,13 +243,15 @@ void ProbabilisticReferenceOverlapFilter::initialize(ProsynarArgumentParser* bas
  * Get the alignments for an entry.
  * @param threadInd The thread index.
  * @param baseFil The base filter: get options.
- * @param read1 The read in question.
+ * @param pairCtx The pair in question.
+ * @param readI The read of the pair to get alignments for.
  * @param fillBnd The place to put the bounds of the alignments.
  * @param fillPro The place to put the probabilities of the alignments.
  * @param errRep The place to note error messages.
  * @return Whether there was a problem.
  */
-int probabilisticROFGetAlignments(int threadInd, ProbabilisticReferenceOverlapFilter* baseFil, CRBSAMFileContents* read1, std::vector< std::pair<intptr_t,intptr_t> >* fillBnd, std::vector<double>* fillPro, std::string* errRep){
+int probabilisticROFGetAlignments(int threadInd, ProbabilisticReferenceOverlapFilter* baseFil, ProsynarPairContext* pairCtx, int readI, std::vector< std::pair<intptr_t,intptr_t> >* fillBnd, std::vector<double>* fillPro, std::string* errRep){
+	CRBSAMFileContents* read1 = pairCtx->reads[readI];
 	fillBnd->clear();
 	fillPro->clear();
 	//common values
@@ -266,14 +260,11 @@ int probabilisticROFGetAlignments(int threadInd, ProbabilisticReferenceOverlapFi
 		intptr_t worstScore = -1; worstScore = worstScore << (8*sizeof(intptr_t)-1);
 		std::greater<intptr_t> compMeth;
 	//thread local storage
-		std::string* nameTmp = &(baseFil->nameTmpSet[threadInd]);
-		std::vector<intptr_t>* cigVec = &(baseFil->cigLocSet[threadInd]);
 		std::string* mainRefSeq = &(baseFil->refTmpSet[threadInd]);
 		std::string* mainReadSeq = &(baseFil->readTmpSet[threadInd]);
 		std::vector<char>* mainQualStore = &(baseFil->readQTmpSet[threadInd]);
 		std::vector<intptr_t>* mainScores = &(baseFil->scoreSet[threadInd]);
 		std::vector<uintptr_t>* packScoreSeen = &(baseFil->scoreSeenSet[threadInd]);
-		std::vector<double>* mainQualPStore = &(baseFil->readQPTmpSet[threadInd]);
 	//idiot check
 		if(read1->entrySeq.size() == 0){
 			errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
@@ -291,58 +282,40 @@ int probabilisticROFGetAlignments(int threadInd, ProbabilisticReferenceOverlapFi
 			return 1;
 		}
 	//get the relevant reference
-		nameTmp->clear(); nameTmp->insert(nameTmp->end(), read1->entryReference.begin(), read1->entryReference.end());
-		std::map<std::string,std::string>::iterator refIt = baseFil->saveArgs->allRefs.find(*nameTmp);
-		if(refIt == baseFil->saveArgs->allRefs.end()){
+		intptr_t refID = pairCtx->getReferenceID();
+		if(!(pairCtx->haveReference())){
 			errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
 			errRep->append(" sequence for reference ");
 			errRep->insert(errRep->end(),read1->entryReference.begin(), read1->entryReference.end());
 			errRep->append("not found.");
 			return 1;
 		}
-		std::string* selRef = &(refIt->second);
 	//get the cost info
-		std::map<std::string,PositionDependentCostKDTree>::iterator costIt = baseFil->useRegCosts->find(*nameTmp);
-		if(costIt == baseFil->useRegCosts->end()){
+		PositionDependentCostKDTree* selCost = prosynarGetByReferenceID(&(baseFil->idRegCosts), refID);
+		if(selCost == 0){
 			errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
 			errRep->append(" alignment parameters for reference ");
 			errRep->insert(errRep->end(),read1->entryReference.begin(), read1->entryReference.end());
 			errRep->append("not found.");
 			return 1;
 		}
-		PositionDependentCostKDTree* selCost = &(costIt->second);
 	//get the quality mangle
-		std::map<std::string,PositionDependentQualityMangleSet>::iterator qualmIt = baseFil->useQualMangs->find(*nameTmp);
-		PositionDependentQualityMangleSet* selMang = 0;
-		if(qualmIt != baseFil->useQualMangs->end()){
-			selMang = &(qualmIt->second);
-		}
+		PositionDependentQualityMangleSet* selMang = prosynarGetByReferenceID(&(baseFil->idQualMangs), refID);
 	//get the bounds of the thing
-		std::pair<intptr_t,intptr_t> read1B;
-		std::pair<uintptr_t,uintptr_t> mainSClip;
-		try{
-			cigVec->clear();
-			mainSClip = cigarStringToReferencePositions(read1->entryPos, &(read1->entryCigar), cigVec);
-			read1B = getCigarReferenceBounds(cigVec);
-		}catch(std::exception& err){
-			errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
-			errRep->push_back(':');
-			errRep->push_back(' ');
-			errRep->append(err.what());
-			return 0;
-		}
+		if(pairCtx->expandCigar(readI, errRep)){ return 0; }
+		std::pair<intptr_t,intptr_t> read1B = pairCtx->refBounds[readI];
+		std::pair<uintptr_t,uintptr_t> mainSClip = pairCtx->softClips[readI];
 	//require a map
 		if(read1B.first < 0){ return 0; }
 	//expand
 		read1B.first = std::max((intptr_t)0, read1B.first - (intptr_t)(baseFil->overRun + baseFil->softReclaim*mainSClip.first));
-		read1B.second = std::min(selRef->size()-1, read1B.second + (baseFil->overRun + baseFil->softReclaim*mainSClip.second));
+		read1B.second = std::min(pairCtx->getReferenceLength()-1, read1B.second + (baseFil->overRun + baseFil->softReclaim*mainSClip.second));
 		read1B.second++;
 	//get the quality
 		mainQualStore->clear(); mainQualStore->insert(mainQualStore->end(), read1->entryQual.begin() + (baseFil->softReclaim ? 0 : mainSClip.first), read1->entryQual.end() - (baseFil->softReclaim ? 0 : mainSClip.second));
-		mainQualPStore->resize(mainQualStore->size());
-		fastaPhredsToLog10Prob(mainQualStore->size(), (unsigned char*)(&((*mainQualStore)[0])), &((*mainQualPStore)[0]));
+		double* mainQualP = pairCtx->getQualLog10(readI) + (baseFil->softReclaim ? 0 : mainSClip.first);
 	//prepare an alignment
-		mainRefSeq->clear(); mainRefSeq->insert(mainRefSeq->end(), selRef->begin() + read1B.first, selRef->begin() + read1B.second);
+		pairCtx->getReferenceWindow(read1B.first, read1B.second, mainRefSeq);
 		mainReadSeq->clear(); mainReadSeq->insert(mainReadSeq->end(), read1->entrySeq.begin() + (baseFil->softReclaim ? 0 : mainSClip.first), read1->entrySeq.end() - (baseFil->softReclaim ? 0 : mainSClip.second));
 		PositionDependentCostKDTree* mainUseCost = &(baseFil->rebaseCosts[threadInd]);
 			mainUseCost->regionsRebased(selCost, read1B.first, read1B.second, -1, -1);
@@ -372,7 +345,7 @@ int probabilisticROFGetAlignments(int threadInd, ProbabilisticReferenceOverlapFi
 			if(!(mainIter->getNextAlignment())){ break; }
 			uintptr_t scoreInd = std::lower_bound(mainScores->begin(), mainScores->begin() + mainNumScore, mainIter->alnScore, compMeth) - mainScores->begin();
 			if(maxCount && ((*packScoreSeen)[scoreInd] >= maxCount)){ continue; }
-			double curLPro = linearReferenceAlignProbabilityAffine(mainAln, &((*mainQualPStore)[0]), mainIter, baseFil->lproGapOpen, baseFil->lproGapExtend);
+			double curLPro = linearReferenceAlignProbabilityAffine(mainAln, mainQualP, mainIter, baseFil->lproGapOpen, baseFil->lproGapExtend);
 			intptr_t lowInd = mainIter->aInds[0] + read1B.first;
 			intptr_t higInd = mainIter->aInds[mainIter->aInds.size()-1] + read1B.first;
 			fillBnd->push_back(std::pair<intptr_t,intptr_t>(lowInd,higInd));
@@ -384,11 +357,14 @@ int probabilisticROFGetAlignments(int threadInd, ProbabilisticReferenceOverlapFi
 }
 
 int ProbabilisticReferenceOverlapFilter::filterPair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* errRep){
-	//should both be mapped
-	if((read1->entryPos < 0) || (read2->entryPos < 0)){ return 0; }
-	if((read1->entryReference.size() == 0) || (read2->entryReference.size() == 0)){ return 0; }
-	//should both be on the same reference
-	if((read1->entryReference.size() != read2->entryReference.size()) || (memcmp(&(read1->entryReference[0]), &(read2->entryReference[0]), read1->entryReference.size())!=0)){ return 0; }
+	ProsynarPairContext pairCtx;
+	pairCtx.changePair(saveArgs, read1, read2);
+	return filterPair(threadInd, &pairCtx, errRep);
+}
+
+int ProbabilisticReferenceOverlapFilter::filterPair(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep){
+	//should both be mapped, on the same reference
+	if(!(pairCtx->sameReference())){ return 0; }
 	//get the alignments for both
 	std::vector< std::pair<intptr_t,intptr_t> >* alnBnd1 = &(alnBndsSet1[threadInd]);
 	std::vector< std::pair<intptr_t,intptr_t> >* alnBnd2 = &(alnBndsSet2[threadInd]);
@@ -396,8 +372,8 @@ int ProbabilisticReferenceOverlapFilter::filterPair(int threadInd, CRBSAMFileCon
 	std::vector<double>* alnPro2 = &(alnProsSet2[threadInd]);
 	alnBnd1->clear(); alnPro1->clear();
 	alnBnd2->clear(); alnPro2->clear();
-	if(probabilisticROFGetAlignments(threadInd, this, read1, alnBnd1, alnPro1, errRep)){ return -1; }
-	if(probabilisticROFGetAlignments(threadInd, this, read2, alnBnd2, alnPro2, errRep)){ return -1; }
+	if(probabilisticROFGetAlignments(threadInd, this, pairCtx, 0, alnBnd1, alnPro1, errRep)){ return -1; }
+	if(probabilisticROFGetAlignments(threadInd, this, pairCtx, 1, alnBnd2, alnPro2, errRep)){ return -1; }
 	//calculate the probabilities of the two possibilities
 	intptr_t numOver = 0;
 	ProbabilitySummation overLike;
@@ -428,6 +404,10 @@ int ProbabilisticReferenceOverlapFilter::filterPair(int threadInd, CRBSAMFileCon
 	return 0;
 }
 
+bool ProbabilisticReferenceOverlapFilter::quickReject(ProsynarPairContext* pairCtx){
+	return !(pairCtx->sameReference());
+}
+
 ProsynarFilter* factoryProbabilisticReferenceOverlapFilter(){
 	return new ProbabilisticReferenceOverlapFilter();
 }
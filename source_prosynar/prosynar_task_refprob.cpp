@@ -6,6 +6,48 @@
 #include "whodun_probutil.h"
 #include "whodun_parse_seq.h"
 
+void ProblematicRegionIndex::build(std::vector< std::pair<intptr_t,intptr_t> >* probRegs, uintptr_t refLen, const std::string& refName){
+	intptr_t prevEnd = 0;
+	for(uintptr_t i = 0; i<probRegs->size(); i++){
+		if(prevEnd != (*probRegs)[i].first){
+			regionProb.push_back(false);
+			regions.push_back( std::pair<intptr_t,intptr_t>(prevEnd, (*probRegs)[i].first) );
+		}
+		regionProb.push_back(true);
+		regions.push_back( (*probRegs)[i] );
+		prevEnd = (*probRegs)[i].second;
+	}
+	if((uintptr_t)prevEnd > refLen){
+		throw new std::runtime_error("Problem region beyond the end of the reference sequence " + refName);
+	}
+	if((uintptr_t)prevEnd != refLen){
+		regionProb.push_back(false);
+		regions.push_back( std::pair<intptr_t,intptr_t>(prevEnd, refLen) );
+	}
+	//note where each bucket starts
+	uintptr_t curRegion = 0;
+	uintptr_t numBucket = (refLen >> PROBREG_BUCKET_SHIFT) + 1;
+	bucketRegion.resize(numBucket);
+	for(uintptr_t i = 0; i<numBucket; i++){
+		intptr_t bucketStart = i << PROBREG_BUCKET_SHIFT;
+		while(((curRegion+1) < regions.size()) && (regions[curRegion+1].first <= bucketStart)){ curRegion++; }
+		bucketRegion[i] = curRegion;
+	}
+}
+
+uintptr_t ProblematicRegionIndex::findRegion(intptr_t baseI){
+	uintptr_t bucketI = std::min((uintptr_t)baseI >> PROBREG_BUCKET_SHIFT, (uintptr_t)(bucketRegion.size() - 1));
+	uintptr_t curRegion = bucketRegion[bucketI];
+	while(((curRegion+1) < regions.size()) && (regions[curRegion+1].first <= baseI)){ curRegion++; }
+	return curRegion;
+}
+
+uintptr_t ProblematicRegionIndex::findRegionEnd(intptr_t endI){
+	uintptr_t curRegion = findRegion(endI - 1);
+	while((curRegion < regions.size()) && (regions[curRegion].second < endI)){ curRegion++; }
+	return curRegion;
+}
+
 ProblematicRegionFilter::ProblematicRegionFilter(){
 	probFile = 0;
 	costRefFile = 0;
@@ -18,6 +60,7 @@ ProblematicRegionFilter::ProblematicRegionFilter(){
 	overRun = 20;
 	softReclaim = 1;
 	hotfuzz = 1000;
+	subPool = 0;
 	myMainDoc = "prosynar -- Fpprobreg [OPTION]\nFilter by the amount of overlap of alignments, weighted by probability.\nThe OPTIONS are:\n";
 	myVersionDoc = "ProSynAr Fpprobreg 1.0";
 	myCopyrightDoc = "Copyright (C) 2019 UNT HSC Center for Human Identification";
@@ -51,12 +94,7 @@ ProblematicRegionFilter::ProblematicRegionFilter(){
 		addFloatOption("--gext", &lproGapExtend, 0, "    The (log10) probability of extending a gap.\n    --gext -1.0\n", &gapEMeta);
 }
 
-ProblematicRegionFilter::~ProblematicRegionFilter(){
-	for(uintptr_t i = 0; i<workIters.size(); i++){
-		if(workIters[i]){ delete(workIters[i]); }
-	}
-	workIters.clear();
-}
+ProblematicRegionFilter::~ProblematicRegionFilter(){}
 
 int ProblematicRegionFilter::handleUnknownArgument(int argc, char** argv, std::ostream* helpOut){
 	if(strcmp(argv[0],"--")==0){
@@ -160,74 +198,32 @@ void ProblematicRegionFilter::initialize(ProsynarArgumentParser* baseArgs){
 	else{
 		throw std::runtime_error("No problem regions specified.");
 	}
+	//lay the costs out by reference id
+	prosynarTableByReferenceID(saveArgs, useRegCosts, &idRegCosts);
+	prosynarTableByReferenceID(saveArgs, useQualMangs, &idQualMangs);
 	//expand the problem region info
 	for(std::map< std::string , std::vector< std::pair<intptr_t,intptr_t> > >::iterator probIt = useProbReg->begin(); probIt != useProbReg->end(); probIt++){
-		std::vector< std::pair<intptr_t,intptr_t> >* curReg = &(probIt->second);
-		std::vector<bool>* curExpRegP = &(expandProbRegP[probIt->first]);
-		std::vector< std::pair<intptr_t,intptr_t> >* curExpReg = &(expandProbReg[probIt->first]);
-		intptr_t prevEnd = 0;
-		for(uintptr_t i = 0; i<curReg->size(); i++){
-			if(prevEnd != (*curReg)[i].first){
-				curExpRegP->push_back(false);
-				curExpReg->push_back( std::pair<intptr_t,intptr_t>(prevEnd, (*curReg)[i].first) );
-			}
-			curExpRegP->push_back(true);
-			curExpReg->push_back( (*curReg)[i] );
-			prevEnd = (*curReg)[i].second;
+		uintptr_t curID = saveArgs->internReference(probIt->first);
+		if(curID >= expandProbIndex.size()){
+			expandProbIndex.resize(curID+1);
 		}
 		//had better have the reference
-		std::map<std::string,std::string>::iterator refIt = saveArgs->allRefs.find(probIt->first);
-		if(refIt == saveArgs->allRefs.end()){
+		if(!(saveArgs->haveReferenceSequence(curID))){
 			throw new std::runtime_error("Reference sequence " + probIt->first + " no found");
 		}
-		if((uintptr_t)prevEnd > refIt->second.size()){
-			throw new std::runtime_error("Problem region beyond the end of the reference sequence " + probIt->first);
-		}
-		if((uintptr_t)prevEnd != refIt->second.size()){
-			curExpRegP->push_back(false);
-			curExpReg->push_back( std::pair<intptr_t,intptr_t>(prevEnd, refIt->second.size()) );
-		}
+		expandProbIndex[curID].build(&(probIt->second), saveArgs->getReferenceLength(curID), probIt->first);
 	}
 	//prepare thread local storage
-	cigLocSet1.resize(baseArgs->numThread);
-	cigLocSet2.resize(baseArgs->numThread);
-	nameTmpSet.resize(baseArgs->numThread);
-	seqTmpSet.resize(baseArgs->numThread);
-	qualTmpSet.resize(baseArgs->numThread);
-	refATmpSet.resize(baseArgs->numThread);
-	refBTmpSet.resize(baseArgs->numThread);
-	scoreSet.resize(baseArgs->numThread);
-	scoreSeenSet.resize(baseArgs->numThread);
-	readQPTmpSet.resize(baseArgs->numThread);
-	for(uintptr_t i = 0; i<(uintptr_t)(baseArgs->numThread); i++){
-		scoreSet[i].resize(uptoRank+1);
+	seqTmpSet.resize(2*baseArgs->numThread);
+	qualTmpSet.resize(2*baseArgs->numThread);
+	likeJobs.resize(4*baseArgs->numThread);
+	for(uintptr_t i = 0; i<likeJobs.size(); i++){
+		likeJobs[i].forFilter = this;
+		likeJobs[i].mainScores.resize(uptoRank+1);
+	}
+	if(baseArgs->numThread > 1){
+		subPool = baseArgs->usePool;
 	}
-	rebaseCosts.resize(baseArgs->numThread);
-	mangleCosts.resize(baseArgs->numThread);
-	rebaseMangs.resize(baseArgs->numThread);
-	workAlns.resize(baseArgs->numThread);
-	LinearPairwiseAlignmentIteration* nullIt = 0;
-	workIters.insert(workIters.end(), baseArgs->numThread, nullIt);
-}
-
-/**
- * Compare two pairs by the first element only.
- * @param itemA A pair to compare.
- * @param itemB A pair to compare.
- * @param Whether itemA is less than itemB.
- */
-bool pairCompOnlyFirst(const std::pair<intptr_t,intptr_t>& itemA, const std::pair<intptr_t,intptr_t>& itemB){
-	return itemA.first < itemB.first;
-}
-
-/**
- * Compare two pairs by the second element only.
- * @param itemA A pair to compare.
- * @param itemB A pair to compare.
- * @param Whether itemA is less than itemB.
- */
-bool pairCompOnlySecond(const std::pair<intptr_t,intptr_t>& itemA, const std::pair<intptr_t,intptr_t>& itemB){
-	return itemA.second < itemB.second;
 }
 
 /**
@@ -261,24 +257,106 @@ double linearReferenceSourceProbabilityAffine(LinearPairwiseSequenceAlignment* a
 	return endLike.getFinalLogSum();
 }
 
-int ProblematicRegionFilter::filterPair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* errRep){
+ProblematicRegionLikelihoodJob::ProblematicRegionLikelihoodJob(){
+	forFilter = 0;
+	readSeq = 0;
+	readQual = 0;
+	readQualP = 0;
+	refFrom = 0;
+	refTo = 0;
+	selCost = 0;
+	selMang = 0;
+	result = 0.0;
+	workIter = 0;
+}
+
+ProblematicRegionLikelihoodJob::~ProblematicRegionLikelihoodJob(){
+	if(workIter){ delete(workIter); }
+}
+
+void problematicRegionLikelihood(void* theJob){
+	ProblematicRegionLikelihoodJob* myJob = (ProblematicRegionLikelihoodJob*)theJob;
+	ProblematicRegionFilter* forFil = myJob->forFilter;
 	//NOTE: requires two's complement
 	intptr_t worstScore = -1; worstScore = worstScore << (8*sizeof(intptr_t)-1);
-	std::string* nameTmp = &(nameTmpSet[threadInd]);
-	std::vector<intptr_t>* cigVec1 = &(cigLocSet1[threadInd]);
-	std::vector<intptr_t>* cigVec2 = &(cigLocSet2[threadInd]);
-	std::string* seqTmp = &(seqTmpSet[threadInd]);
-	std::vector<char>* qualTmp = &(qualTmpSet[threadInd]);
-	std::string* refATmp = &(refATmpSet[threadInd]);
-	std::string* refBTmp = &(refBTmpSet[threadInd]);
-	std::vector<intptr_t>* mainScores = &(scoreSet[threadInd]);
-	std::vector<uintptr_t>* packScoreSeen = &(scoreSeenSet[threadInd]);
-	std::vector<double>* mainQualPStore = &(readQPTmpSet[threadInd]);
-	//should both be mapped
-		if((read1->entryPos < 0) || (read2->entryPos < 0)){ return 0; }
-		if((read1->entryReference.size() == 0) || (read2->entryReference.size() == 0)){ return 0; }
-	//should both be on the same reference
-		if((read1->entryReference.size() != read2->entryReference.size()) || (memcmp(&(read1->entryReference[0]), &(read2->entryReference[0]), read1->entryReference.size())!=0)){ return 0; }
+	try{
+		//costs for the stretch
+			PositionDependentCostKDTree* refCosts = &(myJob->rebaseCost);
+				refCosts->regionsRebased(myJob->selCost, myJob->refFrom, myJob->refTo, -1, -1);
+			if(myJob->selMang){
+				PositionDependentQualityMangleSet* subMang = &(myJob->rebaseMang);
+					subMang->rebase(myJob->selMang, myJob->refFrom, myJob->refTo);
+				PositionDependentCostKDTree* tmpUse = &(myJob->mangleCost);
+					tmpUse->regionsQualityMangled(refCosts, subMang, myJob->readQual);
+				refCosts = tmpUse;
+			}
+			refCosts->produceFromRegions();
+		//align and add up
+			PositionDependentAffineGapLinearPairwiseAlignment* refAln = &(myJob->workAln);
+			refAln->changeProblem(2, &(myJob->refSeq), myJob->readSeq, refCosts);
+			refAln->prepareAlignmentStructure();
+			if(!(myJob->workIter)){
+				myJob->workIter = refAln->getIteratorToken();
+			}
+			LinearPairwiseAlignmentIteration* refIter = myJob->workIter;
+			std::vector<intptr_t>* mainScores = &(myJob->mainScores);
+			std::vector<uintptr_t>* packScoreSeen = &(myJob->scoreSeen);
+			int numScore = refAln->findAlignmentScores(refIter, mainScores->size(), &((*mainScores)[0]), worstScore, forFil->hotfuzz);
+			packScoreSeen->resize(numScore);
+			for(int i = 0; i<numScore; i++){ (*packScoreSeen)[i] = forFil->uptoCount; }
+			refAln->startFuzzyIteration(refIter, (*mainScores)[numScore-1], forFil->hotfuzz, numScore);
+			myJob->result = linearReferenceSourceProbabilityAffine(refAln, myJob->readQualP, refIter, forFil->lproGapOpen, forFil->lproGapExtend, numScore, &((*mainScores)[0]), forFil->uptoCount ? &((*packScoreSeen)[0]) : 0);
+	}catch(std::exception& err){
+		myJob->errMess = err.what();
+	}
+}
+
+void ProblematicRegionFilter::prepareLikelihood(ProblematicRegionLikelihoodJob* toFill, ProsynarPairContext* pairCtx, std::string* readSeq, std::vector<char>* readQual, double* readQualP, std::pair<uintptr_t,uintptr_t> refGot, ProblematicRegionPairLocus* pairLoc){
+	toFill->readSeq = readSeq;
+	toFill->readQual = readQual;
+	toFill->readQualP = readQualP;
+	toFill->refFrom = refGot.first;
+	toFill->refTo = refGot.second;
+	toFill->selCost = pairLoc->selCost;
+	toFill->selMang = pairLoc->selMang;
+	toFill->errMess.clear();
+	pairCtx->getReferenceWindow(refGot.first, refGot.second, &(toFill->refSeq));
+}
+
+void ProblematicRegionFilter::runLikelihoods(ProblematicRegionLikelihoodJob* allJobs, uintptr_t numJob){
+	//small stuff is not worth the trouble
+	uintptr_t totCells = 0;
+	for(uintptr_t i = 0; i<numJob; i++){
+		totCells += (allJobs[i].refSeq.size() + 1) * (allJobs[i].readSeq->size() + 1);
+	}
+	bool doSplit = subPool && (numJob > 1) && (totCells >= PROBREG_SPLIT_CELLS);
+	//hand off all but the first, and do the first here
+	if(doSplit){
+		subPool->forkJoin(problematicRegionLikelihood, numJob, allJobs, sizeof(ProblematicRegionLikelihoodJob));
+	}
+	else{
+		for(uintptr_t i = 0; i<numJob; i++){
+			problematicRegionLikelihood(allJobs + i);
+		}
+	}
+	for(uintptr_t i = 0; i<numJob; i++){
+		if(allJobs[i].errMess.size()){ throw std::runtime_error(allJobs[i].errMess); }
+	}
+}
+
+int ProblematicRegionFilter::filterPair(int threadInd, CRBSAMFileContents* read1, CRBSAMFileContents* read2, std::string* errRep){
+	ProsynarPairContext pairCtx;
+	pairCtx.changePair(saveArgs, read1, read2);
+	return filterPair(threadInd, &pairCtx, errRep);
+}
+
+int ProblematicRegionFilter::classifyPair(ProsynarPairContext* pairCtx, std::string* errRep, ProblematicRegionPairLocus* toFill){
+	int read1I = 0;
+	int read2I = 1;
+	CRBSAMFileContents* read1 = pairCtx->reads[read1I];
+	CRBSAMFileContents* read2 = pairCtx->reads[read2I];
+	//should both be mapped, on the same reference
+		if(!(pairCtx->sameReference())){ return 0; }
 	//idiot check
 		if(read1->entrySeq.size() == 0){
 			errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
@@ -311,32 +389,10 @@ int ProblematicRegionFilter::filterPair(int threadInd, CRBSAMFileContents* read1
 			return -1;
 		}
 	//expand the cigars, figure the bounds
-		std::pair<intptr_t,intptr_t> read1B;
-		std::pair<uintptr_t,uintptr_t> read1SClip;
-		try{
-			cigVec1->clear();
-			read1SClip = cigarStringToReferencePositions(read1->entryPos, &(read1->entryCigar), cigVec1);;
-			read1B = getCigarReferenceBounds(cigVec1);
-		}catch(std::exception& err){
-			errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
-			errRep->push_back(':');
-			errRep->push_back(' ');
-			errRep->append(err.what());
-			return -1;
-		}
-		std::pair<intptr_t,intptr_t> read2B;
-		std::pair<uintptr_t,uintptr_t> read2SClip;
-		try{
-			cigVec2->clear();
-			read2SClip = cigarStringToReferencePositions(read2->entryPos, &(read2->entryCigar), cigVec2);;
-			read2B = getCigarReferenceBounds(cigVec2);
-		}catch(std::exception& err){
-			errRep->insert(errRep->end(),read2->entryName.begin(), read2->entryName.end());
-			errRep->push_back(':');
-			errRep->push_back(' ');
-			errRep->append(err.what());
-			return -1;
-		}
+		if(pairCtx->expandCigar(read1I, errRep)){ return -1; }
+		if(pairCtx->expandCigar(read2I, errRep)){ return -1; }
+		std::pair<intptr_t,intptr_t> read1B = pairCtx->refBounds[read1I];
+		std::pair<intptr_t,intptr_t> read2B = pairCtx->refBounds[read2I];
 		read1B.second++;
 		read2B.second++;
 	//make sure they actually are mapped
@@ -344,58 +400,54 @@ int ProblematicRegionFilter::filterPair(int threadInd, CRBSAMFileContents* read1
 		if(read2B.first < 0){ return 0; }
 	//swap if out of order
 		if((read1B.first > read2B.first) || ((read1B.first == read2B.first) && (read1B.second > read2B.second))){
-			return filterPair(threadInd, read2, read1, errRep);
+			std::swap(read1I, read2I);
+			std::swap(read1, read2);
+			std::swap(read1B, read2B);
 		}
 	//get the reference, costs, mangles, and region set
-		nameTmp->clear(); nameTmp->insert(nameTmp->end(), read1->entryReference.begin(), read1->entryReference.end());
-		std::map<std::string,std::string>::iterator refIt = saveArgs->allRefs.find(*nameTmp);
-			if(refIt == saveArgs->allRefs.end()){
+		intptr_t refID = pairCtx->getReferenceID();
+			if(!(pairCtx->haveReference())){
 				errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
 				errRep->append(" sequence for reference ");
 				errRep->insert(errRep->end(),read1->entryReference.begin(), read1->entryReference.end());
 				errRep->append(" not found.");
 				return -1;
 			}
-			std::string* selRef = &(refIt->second);
-		std::map< std::string, std::vector<bool> >::iterator probIt = expandProbRegP.find(*nameTmp);
-			if(probIt == expandProbRegP.end()){
+			uintptr_t selRefLen = pairCtx->getReferenceLength();
+		bool haveProb = ((uintptr_t)refID < expandProbIndex.size()) && (expandProbIndex[refID].regions.size() != 0);
+			if(!haveProb){
 				//no problem = no problem
 				return 1;
 			}
-			std::vector<bool>* selProbP = &(probIt->second);
-			std::vector< std::pair<intptr_t,intptr_t> >* selProbR = &(expandProbReg[*nameTmp]);
-		std::map<std::string,PositionDependentCostKDTree>::iterator costIt = useRegCosts->find(*nameTmp);
-			if(costIt == useRegCosts->end()){
+			ProblematicRegionIndex* selIndex = &(expandProbIndex[refID]);
+			std::vector<bool>* selProbP = &(selIndex->regionProb);
+		PositionDependentCostKDTree* selCost = prosynarGetByReferenceID(&idRegCosts, refID);
+			if(selCost == 0){
 				errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
 				errRep->append(" alignment parameters for reference ");
 				errRep->insert(errRep->end(),read1->entryReference.begin(), read1->entryReference.end());
 				errRep->append(" not found.");
 				return -1;
 			}
-			PositionDependentCostKDTree* selCost = &(costIt->second);
-		std::map<std::string,PositionDependentQualityMangleSet>::iterator qualmIt = useQualMangs->find(*nameTmp);
-			PositionDependentQualityMangleSet* selMang = 0;
-			if(qualmIt != useQualMangs->end()){
-				selMang = &(qualmIt->second);
-			}
+		PositionDependentQualityMangleSet* selMang = prosynarGetByReferenceID(&idQualMangs, refID);
 	//idiot check the maps to the reference
-		if((uintptr_t)(read1B.second) > selRef->size()){
+		if((uintptr_t)(read1B.second) > selRefLen){
 			errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
 			errRep->append(" alignment extends beyond reference ");
 			errRep->insert(errRep->end(),read1->entryReference.begin(), read1->entryReference.end());
 			return -1;
 		}
-		if((uintptr_t)(read2B.second) > selRef->size()){
+		if((uintptr_t)(read2B.second) > selRefLen){
 			errRep->insert(errRep->end(),read1->entryName.begin(), read1->entryName.end());
 			errRep->append(" alignment extends beyond reference ");
 			errRep->insert(errRep->end(),read1->entryReference.begin(), read1->entryReference.end());
 			return -1;
 		}
 	//note which problem regions they are in
-		uintptr_t read1LPI = std::upper_bound(selProbR->begin(), selProbR->end(), read1B, pairCompOnlyFirst) - selProbR->begin(); read1LPI--;
-		uintptr_t read1HPI = std::lower_bound(selProbR->begin(), selProbR->end(), read1B, pairCompOnlySecond) - selProbR->begin();
-		uintptr_t read2LPI = std::upper_bound(selProbR->begin(), selProbR->end(), read2B, pairCompOnlyFirst) - selProbR->begin(); read2LPI--;
-		uintptr_t read2HPI = std::lower_bound(selProbR->begin(), selProbR->end(), read2B, pairCompOnlySecond) - selProbR->begin();
+		uintptr_t read1LPI = selIndex->findRegion(read1B.first);
+		uintptr_t read1HPI = selIndex->findRegionEnd(read1B.second);
+		uintptr_t read2LPI = selIndex->findRegion(read2B.first);
+		uintptr_t read2HPI = selIndex->findRegionEnd(read2B.second);
 	//simple checks first
 		switch(read1HPI - read2LPI){
 			case 0:
@@ -419,10 +471,56 @@ int ProblematicRegionFilter::filterPair(int threadInd, CRBSAMFileContents* read1
 				//big separation, known good
 				return 1;
 		}
-	//check moving the left edge of the right read
+	//save where it is for a closer look
+		toFill->read1I = read1I;
+		toFill->read2I = read2I;
+		toFill->read1B = read1B;
+		toFill->read2B = read2B;
+		toFill->selRefLen = selRefLen;
+		toFill->selIndex = selIndex;
+		toFill->selCost = selCost;
+		toFill->selMang = selMang;
+		toFill->read1LPI = read1LPI;
+		toFill->read1HPI = read1HPI;
+		toFill->read2LPI = read2LPI;
+		toFill->read2HPI = read2HPI;
+		return PROBREG_CLASS_CHECK;
+}
+
+bool ProblematicRegionFilter::quickReject(ProsynarPairContext* pairCtx){
+	std::string tmpErr;
+	ProblematicRegionPairLocus pairLoc;
+	return classifyPair(pairCtx, &tmpErr, &pairLoc) == PROBREG_CLASS_BAD;
+}
+
+int ProblematicRegionFilter::filterPair(int threadInd, ProsynarPairContext* pairCtx, std::string* errRep){
+	//sort out the easy cases
+		ProblematicRegionPairLocus pairLoc;
+		int quickRes = classifyPair(pairCtx, errRep, &pairLoc);
+		if(quickRes != PROBREG_CLASS_CHECK){ return quickRes; }
+	int read1I = pairLoc.read1I;
+	int read2I = pairLoc.read2I;
+	CRBSAMFileContents* read1 = pairCtx->reads[read1I];
+	CRBSAMFileContents* read2 = pairCtx->reads[read2I];
+	ProblematicRegionLikelihoodJob* pairJobs = &(likeJobs[4*threadInd]);
+	uintptr_t numJob = 0;
+	std::pair<uintptr_t,uintptr_t> read1SClip = pairCtx->softClips[read1I];
+	std::pair<uintptr_t,uintptr_t> read2SClip = pairCtx->softClips[read2I];
+	std::vector<intptr_t>* cigVec1 = &(pairCtx->cigLocs[read1I]);
+	std::vector<intptr_t>* cigVec2 = &(pairCtx->cigLocs[read2I]);
+	uintptr_t selRefLen = pairLoc.selRefLen;
+	std::vector< std::pair<intptr_t,intptr_t> >* selProbR = &(pairLoc.selIndex->regions);
+	std::vector<bool>* selProbP = &(pairLoc.selIndex->regionProb);
+	uintptr_t read1LPI = pairLoc.read1LPI;
+	uintptr_t read1HPI = pairLoc.read1HPI;
+	uintptr_t read2LPI = pairLoc.read2LPI;
+	uintptr_t read2HPI = pairLoc.read2HPI;
+	//set up moving the left edge of the right read
 		bool canMoveLeftOfRight = (read2LPI != read2HPI);
 		if(canMoveLeftOfRight){
 			//get the read sequence
+				std::string* seqTmp = &(seqTmpSet[2*threadInd]);
+				std::vector<char>* qualTmp = &(qualTmpSet[2*threadInd]);
 				intptr_t breakInd = (*selProbR)[read2LPI].second;
 				seqTmp->clear(); qualTmp->clear();
 				if(softReclaim){
@@ -436,68 +534,19 @@ int ProblematicRegionFilter::filterPair(int threadInd, CRBSAMFileContents* read1
 					qualTmp->push_back(read2->entryQual[i + read2SClip.first]);
 					readAlnSize++;
 				}
-				mainQualPStore->resize(qualTmp->size());
-				fastaPhredsToLog10Prob(qualTmp->size(), (unsigned char*)(&((*qualTmp)[0])), &((*mainQualPStore)[0]));
+				double* mainQualP = pairCtx->getQualLog10(read2I) + (softReclaim ? 0 : read2SClip.first);
 			//get the competing references
 				std::pair<uintptr_t,uintptr_t> refAGot(std::max((intptr_t)0, breakInd-(intptr_t)readAlnSize), breakInd);
-				std::pair<uintptr_t,uintptr_t> refBGot(breakInd, std::min(selRef->size(), breakInd+readAlnSize));
-				refATmp->clear(); refATmp->insert(refATmp->end(), selRef->begin() + refAGot.first, selRef->begin() + refAGot.second);
-				refBTmp->clear(); refBTmp->insert(refBTmp->end(), selRef->begin() + refBGot.first, selRef->begin() + refBGot.second);
-			//likelihood of A
-				PositionDependentCostKDTree* refACosts = &(rebaseCosts[threadInd]);
-					refACosts->regionsRebased(selCost, refAGot.first, refAGot.second, -1, -1);
-				if(selMang){
-					PositionDependentQualityMangleSet* subMang = &(rebaseMangs[threadInd]);
-						subMang->rebase(selMang, refAGot.first, refAGot.second);
-					PositionDependentCostKDTree* tmpUse = &(mangleCosts[threadInd]);
-						tmpUse->regionsQualityMangled(refACosts, subMang, qualTmp);
-					refACosts = tmpUse;
-				}
-				refACosts->produceFromRegions();
-				PositionDependentAffineGapLinearPairwiseAlignment* refAAln = &(workAlns[threadInd]);
-				refAAln->changeProblem(2, refATmp, seqTmp, refACosts);
-				refAAln->prepareAlignmentStructure();
-				LinearPairwiseAlignmentIteration* refAIter = workIters[threadInd];
-				if(!refAIter){
-					workIters[threadInd] = refAAln->getIteratorToken();
-					refAIter = workIters[threadInd];
-				}
-				int numScoreA = refAAln->findAlignmentScores(refAIter, mainScores->size(), &((*mainScores)[0]), worstScore, hotfuzz);
-				packScoreSeen->resize(numScoreA);
-				for(int i = 0; i<numScoreA; i++){ (*packScoreSeen)[i] = uptoCount; }
-				refAAln->startFuzzyIteration(refAIter, (*mainScores)[numScoreA-1], hotfuzz, numScoreA);
-				double refALPro = linearReferenceSourceProbabilityAffine(refAAln, &((*mainQualPStore)[0]), refAIter, lproGapOpen, lproGapExtend, numScoreA, &((*mainScores)[0]), uptoCount ? &((*packScoreSeen)[0]) : 0);
-			//likelihood of B
-				PositionDependentCostKDTree* refBCosts = &(rebaseCosts[threadInd]);
-					refBCosts->regionsRebased(selCost, refBGot.first, refBGot.second, -1, -1);
-				if(selMang){
-					PositionDependentQualityMangleSet* subMang = &(rebaseMangs[threadInd]);
-						subMang->rebase(selMang, refBGot.first, refBGot.second);
-					PositionDependentCostKDTree* tmpUse = &(mangleCosts[threadInd]);
-						tmpUse->regionsQualityMangled(refBCosts, subMang, qualTmp);
-					refBCosts = tmpUse;
-				}
-				refBCosts->produceFromRegions();
-				PositionDependentAffineGapLinearPairwiseAlignment* refBAln = &(workAlns[threadInd]);
-				refBAln->changeProblem(2, refBTmp, seqTmp, refBCosts);
-				refBAln->prepareAlignmentStructure();
-				LinearPairwiseAlignmentIteration* refBIter = workIters[threadInd];
-				if(!refBIter){
-					workIters[threadInd] = refBAln->getIteratorToken();
-					refBIter = workIters[threadInd];
-				}
-				int numScoreB = refBAln->findAlignmentScores(refBIter, mainScores->size(), &((*mainScores)[0]), worstScore, hotfuzz);
-				packScoreSeen->resize(numScoreB);
-				for(int i = 0; i<numScoreB; i++){ (*packScoreSeen)[i] = uptoCount; }
-				refBAln->startFuzzyIteration(refBIter, (*mainScores)[numScoreB-1], hotfuzz, numScoreB);
-				double refBLPro = linearReferenceSourceProbabilityAffine(refBAln, &((*mainQualPStore)[0]), refBIter, lproGapOpen, lproGapExtend, numScoreB, &((*mainScores)[0]), uptoCount ? &((*packScoreSeen)[0]) : 0);
-			//make the decision
-				canMoveLeftOfRight = (refALPro - refBLPro) < threshLR;
+				std::pair<uintptr_t,uintptr_t> refBGot(breakInd, std::min(selRefLen, breakInd+readAlnSize));
+				prepareLikelihood(pairJobs + numJob, pairCtx, seqTmp, qualTmp, mainQualP, refAGot, &pairLoc); numJob++;
+				prepareLikelihood(pairJobs + numJob, pairCtx, seqTmp, qualTmp, mainQualP, refBGot, &pairLoc); numJob++;
 		}
-	//check moving the right edge of the left read
+	//set up moving the right edge of the left read
 		bool canMoveRightOfLeft = (read1LPI != read1HPI);
 		if(canMoveRightOfLeft){
 			//get the read sequence
+				std::string* seqTmp = &(seqTmpSet[2*threadInd+1]);
+				std::vector<char>* qualTmp = &(qualTmpSet[2*threadInd+1]);
 				intptr_t breakInd = (*selProbR)[read1HPI].first;
 				seqTmp->clear(); qualTmp->clear();
 				uintptr_t readAlnSize = overRun + softReclaim * read1SClip.second;
@@ -516,63 +565,22 @@ int ProblematicRegionFilter::filterPair(int threadInd, CRBSAMFileContents* read1
 					seqTmp->insert(seqTmp->end(), read1->entrySeq.end()-read1SClip.second, read1->entrySeq.end());
 					qualTmp->insert(qualTmp->end(), read1->entryQual.end()-read1SClip.second, read1->entryQual.end());
 				}
-				mainQualPStore->resize(qualTmp->size());
-				fastaPhredsToLog10Prob(qualTmp->size(), (unsigned char*)(&((*qualTmp)[0])), &((*mainQualPStore)[0]));
+				double* mainQualP = pairCtx->getQualLog10(read1I) + (read1->entryQual.size() - (softReclaim ? 0 : read1SClip.second) - qualTmp->size());
 			//get the competing references
 				std::pair<uintptr_t,uintptr_t> refAGot(std::max((intptr_t)0, breakInd-(intptr_t)readAlnSize), breakInd);
-				std::pair<uintptr_t,uintptr_t> refBGot(breakInd, std::min(selRef->size(), breakInd+readAlnSize));
-				refATmp->clear(); refATmp->insert(refATmp->end(), selRef->begin() + refAGot.first, selRef->begin() + refAGot.second);
-				refBTmp->clear(); refBTmp->insert(refBTmp->end(), selRef->begin() + refBGot.first, selRef->begin() + refBGot.second);
-			//likelihood of A
-				PositionDependentCostKDTree* refACosts = &(rebaseCosts[threadInd]);
-					refACosts->regionsRebased(selCost, refAGot.first, refAGot.second, -1, -1);
-				if(selMang){
-					PositionDependentQualityMangleSet* subMang = &(rebaseMangs[threadInd]);
-						subMang->rebase(selMang, refAGot.first, refAGot.second);
-					PositionDependentCostKDTree* tmpUse = &(mangleCosts[threadInd]);
-						tmpUse->regionsQualityMangled(refACosts, subMang, qualTmp);
-					refACosts = tmpUse;
-				}
-				refACosts->produceFromRegions();
-				PositionDependentAffineGapLinearPairwiseAlignment* refAAln = &(workAlns[threadInd]);
-				refAAln->changeProblem(2, refATmp, seqTmp, refACosts);
-				refAAln->prepareAlignmentStructure();
-				LinearPairwiseAlignmentIteration* refAIter = workIters[threadInd];
-				if(!refAIter){
-					workIters[threadInd] = refAAln->getIteratorToken();
-					refAIter = workIters[threadInd];
-				}
-				int numScoreA = refAAln->findAlignmentScores(refAIter, mainScores->size(), &((*mainScores)[0]), worstScore, hotfuzz);
-				packScoreSeen->resize(numScoreA);
-				for(int i = 0; i<numScoreA; i++){ (*packScoreSeen)[i] = uptoCount; }
-				refAAln->startFuzzyIteration(refAIter, (*mainScores)[numScoreA-1], hotfuzz, numScoreA);
-				double refALPro = linearReferenceSourceProbabilityAffine(refAAln, &((*mainQualPStore)[0]), refAIter, lproGapOpen, lproGapExtend, numScoreA, &((*mainScores)[0]), uptoCount ? &((*packScoreSeen)[0]) : 0);
-			//likelihood of B
-				PositionDependentCostKDTree* refBCosts = &(rebaseCosts[threadInd]);
-					refBCosts->regionsRebased(selCost, refBGot.first, refBGot.second, -1, -1);
-				if(selMang){
-					PositionDependentQualityMangleSet* subMang = &(rebaseMangs[threadInd]);
-						subMang->rebase(selMang, refBGot.first, refBGot.second);
-					PositionDependentCostKDTree* tmpUse = &(mangleCosts[threadInd]);
-						tmpUse->regionsQualityMangled(refBCosts, subMang, qualTmp);
-					refBCosts = tmpUse;
-				}
-				refBCosts->produceFromRegions();
-				PositionDependentAffineGapLinearPairwiseAlignment* refBAln = &(workAlns[threadInd]);
-				refBAln->changeProblem(2, refBTmp, seqTmp, refBCosts);
-				refBAln->prepareAlignmentStructure();
-				LinearPairwiseAlignmentIteration* refBIter = workIters[threadInd];
-				if(!refBIter){
-					workIters[threadInd] = refBAln->getIteratorToken();
-					refBIter = workIters[threadInd];
-				}
-				int numScoreB = refBAln->findAlignmentScores(refBIter, mainScores->size(), &((*mainScores)[0]), worstScore, hotfuzz);
-				packScoreSeen->resize(numScoreB);
-				for(int i = 0; i<numScoreB; i++){ (*packScoreSeen)[i] = uptoCount; }
-				refBAln->startFuzzyIteration(refBIter, (*mainScores)[numScoreB-1], hotfuzz, numScoreB);
-				double refBLPro = linearReferenceSourceProbabilityAffine(refBAln, &((*mainQualPStore)[0]), refBIter, lproGapOpen, lproGapExtend, numScoreB, &((*mainScores)[0]), uptoCount ? &((*packScoreSeen)[0]) : 0);
-			//make the decision
-				canMoveRightOfLeft = (refALPro - refBLPro) > threshLR;
+				std::pair<uintptr_t,uintptr_t> refBGot(breakInd, std::min(selRefLen, breakInd+readAlnSize));
+				prepareLikelihood(pairJobs + numJob, pairCtx, seqTmp, qualTmp, mainQualP, refAGot, &pairLoc); numJob++;
+				prepareLikelihood(pairJobs + numJob, pairCtx, seqTmp, qualTmp, mainQualP, refBGot, &pairLoc); numJob++;
+		}
+	//work out the likelihoods and make the decisions
+		runLikelihoods(pairJobs, numJob);
+		uintptr_t jobI = 0;
+		if(canMoveLeftOfRight){
+			canMoveLeftOfRight = (pairJobs[jobI].result - pairJobs[jobI+1].result) < threshLR;
+			jobI += 2;
+		}
+		if(canMoveRightOfLeft){
+			canMoveRightOfLeft = (pairJobs[jobI].result - pairJobs[jobI+1].result) > threshLR;
 		}
 	//final check
 		switch(read1HPI - read2LPI){